@@ -0,0 +1,119 @@
+/*
+ *admission.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "admission.h"
+#include "protocol.h"
+
+int admission_env_limit(const char* name, int fallback) {
+    const char* value = getenv(name);
+    char* end = NULL;
+    long limit = 0;
+
+    if (!value || '\0' == value[0]) {
+        return fallback;
+    }
+
+    limit = strtol(value, &end, 10);
+    return ('\0' == *end && 0 <= limit && limit <= 1000000) ? (int)limit
+            : fallback;
+}
+
+int admission_init(struct Admission* admission, int limit, int queueDepth) {
+    memset(admission, 0, sizeof(struct Admission));
+    pthread_mutex_init(&admission->guard, NULL);
+
+    admission->limit = MAX(1, limit);
+    admission->queueDepth = MAX(0, queueDepth);
+    admission->bulkLimit = MAX(1, admission->limit / ADMISSION_BULK_SHARE);
+    admission->idleMs = ADMISSION_DEFAULT_IDLE_MS;
+
+    admission->queue = (int*)malloc((size_t)MAX(1, admission->queueDepth)
+            * sizeof(int));
+    return admission->queue ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int admission_limit_idle(const struct Admission* admission, int socket) {
+    struct timeval timeout;
+
+    timeout.tv_sec = admission->idleMs / 1000;
+    timeout.tv_usec = (admission->idleMs % 1000) * 1000L;
+    return 0 == setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+            sizeof(timeout)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+enum AdmissionDecision admission_offer(struct Admission* admission,
+        int socket) {
+    enum AdmissionDecision decision = ADMISSION_REJECTED;
+
+    pthread_mutex_lock(&admission->guard);
+
+    if (admission->active < admission->limit) {
+        admission->active += 1;
+        decision = ADMISSION_SERVE;
+    } else if (admission->queued < admission->queueDepth) {
+        admission->queue[(admission->queueHead + admission->queued)
+                % admission->queueDepth] = socket;
+        admission->queued += 1;
+        decision = ADMISSION_QUEUED;
+    }
+
+    pthread_mutex_unlock(&admission->guard);
+    return decision;
+}
+
+int admission_next(struct Admission* admission) {
+    int socket = -1;
+
+    pthread_mutex_lock(&admission->guard);
+
+    /*The finishing thread takes over the longest waiting connection*/
+    if (0 < admission->queued) {
+        socket = admission->queue[admission->queueHead];
+        admission->queueHead = (admission->queueHead + 1)
+                % admission->queueDepth;
+        admission->queued -= 1;
+    } else {
+        admission->active -= 1;
+    }
+
+    pthread_mutex_unlock(&admission->guard);
+    return socket;
+}
+
+void admission_reject(struct Admission* admission, int socket) {
+    send(socket, SERVER_BUSY_REPLY, strlen(SERVER_BUSY_REPLY),
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+    shutdown(socket, SHUT_WR);
+    close(socket);
+
+    __atomic_add_fetch(&admission->rejected, 1, __ATOMIC_RELAXED);
+}
+
+int admission_begin_bulk(struct Admission* admission) {
+    int taken = 0;
+
+    pthread_mutex_lock(&admission->guard);
+
+    if (admission->bulkActive < admission->bulkLimit) {
+        admission->bulkActive += 1;
+        taken = 1;
+    }
+
+    pthread_mutex_unlock(&admission->guard);
+    return taken;
+}
+
+void admission_end_bulk(struct Admission* admission) {
+    pthread_mutex_lock(&admission->guard);
+    admission->bulkActive -= 1;
+    pthread_mutex_unlock(&admission->guard);
+}
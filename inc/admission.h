@@ -0,0 +1,208 @@
+/*
+ *admission.h
+ */
+
+#pragma once
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * The number of connections served at once by default.
+ */
+#define ADMISSION_DEFAULT_CLIENTS 512
+
+/**
+ * The number of connections waiting for service by default.
+ */
+#define ADMISSION_DEFAULT_QUEUE 256
+
+/**
+ * The time in milliseconds an admitted connection may wait for its next
+ * request by default. It exceeds the interval controls renew their
+ * registrations in, so those connections are kept.
+ */
+#define ADMISSION_DEFAULT_IDLE_MS 15000
+
+/**
+ * The divisor of the connection limit giving the number of bulk requests
+ * served at once.
+ */
+#define ADMISSION_BULK_SHARE 8
+
+/**
+ * The outcomes of offering a new connection.
+ */
+enum AdmissionDecision {
+    ADMISSION_SERVE = 0,
+    ADMISSION_QUEUED = 1,
+    ADMISSION_REJECTED = 2
+};
+
+/**
+ * Bounds the connections a thread-per-connection server serves at once.
+ *
+ * Up to limit connections are served by their own threads. Further ones wait
+ * in a FIFO queue of queueDepth sockets and are taken over by the next
+ * thread finishing its connection. Beyond that, connections are rejected
+ * right away. Bulk requests, whose replies grow with the server's state, are
+ * served by at most bulkLimit threads at once and rejected beyond, so they
+ * cannot starve the short requests.
+ */
+struct Admission {
+    /**
+     * Mutex protecting all of the following.
+     */
+    pthread_mutex_t guard;
+
+    /**
+     * The maximum number of connections served at once.
+     */
+    int limit;
+
+    /**
+     * The maximum number of connections waiting.
+     */
+    int queueDepth;
+
+    /**
+     * The maximum number of bulk requests served at once.
+     */
+    int bulkLimit;
+
+    /**
+     * The number of connections being served.
+     */
+    int active;
+
+    /**
+     * The number of bulk requests being served.
+     */
+    int bulkActive;
+
+    /**
+     * The waiting sockets, a ring buffer of queueDepth entries.
+     */
+    int* queue;
+
+    /**
+     * The position of the longest waiting socket in queue.
+     */
+    int queueHead;
+
+    /**
+     * The number of waiting sockets.
+     */
+    int queued;
+
+    /**
+     * The number of rejected connections.
+     */
+    uint64_t rejected;
+
+    /**
+     * The time in milliseconds a connection may wait for a request, 0 for no
+     * limit. Only set before the first connection is offered.
+     */
+    int idleMs;
+};
+
+/**
+ * Get a limit from the environment.
+ *
+ * Returns the variable's value if it is a number in 0..1000000, the given
+ * fallback else.
+ *
+ * @param name  The environment variable's name.
+ *
+ * @param fallback  The default limit.
+ */
+int admission_env_limit(const char* name, int fallback);
+
+/**
+ * Prepare the admission control.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE if no memory is left.
+ *
+ * @param admission The admission control to be initialized.
+ *
+ * @param limit The maximum number of connections served at once, at least 1.
+ *
+ * @param queueDepth  The maximum number of connections waiting.
+ */
+int admission_init(struct Admission* admission, int limit, int queueDepth);
+
+/**
+ * Bound the time an accepted connection may stay idle.
+ *
+ * Once a wait for the next request exceeds the admission control's idleMs,
+ * reading from the socket fails, so its server closes the connection and
+ * gives its slot back. Idle persistent connections cannot hold all slots.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE if the socket cannot be
+ * configured.
+ *
+ * @param admission The server's admission control.
+ *
+ * @param socket  The accepted socket.
+ */
+int admission_limit_idle(const struct Admission* admission, int socket);
+
+/**
+ * Offer a newly accepted connection.
+ *
+ * Returns ADMISSION_SERVE if the caller has to start a thread serving the
+ * socket, ADMISSION_QUEUED if the socket waits for a thread and
+ * ADMISSION_REJECTED if the caller has to reject it.
+ *
+ * @param admission The server's admission control.
+ *
+ * @param socket  The accepted socket.
+ */
+enum AdmissionDecision admission_offer(struct Admission* admission,
+        int socket);
+
+/**
+ * Finish serving a connection.
+ *
+ * Returns the next waiting socket, which the calling thread has to serve
+ * now, or -1 if none is waiting and the thread has to end.
+ *
+ * @param admission The server's admission control.
+ */
+int admission_next(struct Admission* admission);
+
+/**
+ * Reject a connection, which could not be served.
+ *
+ * Sends SERVER_BUSY_REPLY without blocking and closes the socket.
+ *
+ * @param admission The server's admission control.
+ *
+ * @param socket  The socket to be rejected.
+ */
+void admission_reject(struct Admission* admission, int socket);
+
+/**
+ * Take a slot in the bulk lane.
+ *
+ * Returns 1 if a slot was taken, 0 if the lane is full and the request has
+ * to be replied SERVER_BUSY_REPLY instead. Bulk requests never wait, so they
+ * cannot tie up the threads needed by short requests.
+ *
+ * @param admission The server's admission control.
+ */
+int admission_begin_bulk(struct Admission* admission);
+
+/**
+ * Release the slot in the bulk lane.
+ *
+ * @param admission The server's admission control.
+ */
+void admission_end_bulk(struct Admission* admission);
+
+#endif
@@ -0,0 +1,500 @@
+/*
+ *airportHost.c
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "errorReturn.h"
+#include "protocol.h"
+#include "airportHost.h"
+#include "checkinDatagram.h"
+
+/**
+ * A plane's connection to a hosted airport.
+ */
+struct HostConnection {
+    /**
+     * Always HOST_CONNECTION, the event loop tells endpoints apart by it.
+     */
+    enum HostEndpoint endpoint;
+
+    /**
+     * The airport, which the plane is connected to.
+     */
+    struct Airport* airport;
+
+    /**
+     * The replies, which are not sent yet, NULL if there are none.
+     */
+    char* output;
+
+    /**
+     * The length of output.
+     */
+    size_t outputSize;
+
+    /**
+     * The number of bytes of output, which are sent already.
+     */
+    size_t outputSent;
+
+    /**
+     * Set once the plane has hung up, the connection is closed as soon as
+     * all its requests are served.
+     */
+    int closing;
+
+    /**
+     * The requests received from the plane.
+     */
+    struct LineReader reader;
+};
+
+void control_host_init(struct AirportHost* host, struct ControlStats* stats,
+        HostRequestHandler handler) {
+    memset(host, 0, sizeof(struct AirportHost));
+    host->stats = stats;
+    host->handler = handler;
+    host->eventLoop = -1;
+}
+
+int control_host_add(struct AirportHost* host, const char* id,
+        const char* info) {
+    struct Airport* airports = NULL;
+    struct Airport* airport = NULL;
+    int capacity = 0;
+
+    if (E_CONTROL_OK != control_check_chars(id)
+            || E_CONTROL_OK != control_check_chars(info)) {
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    if (host->count == host->capacity) {
+        capacity = MAX(2 * host->capacity, HOST_MAX_EVENTS);
+        airports = (struct Airport*)realloc(host->airports,
+                (size_t)capacity * sizeof(struct Airport));
+        if (!airports) {
+            return E_CONTROL_INVALID_INFO;
+        }
+        host->airports = airports;
+        host->capacity = capacity;
+    }
+
+    airport = host->airports + host->count;
+    memset(airport, 0, sizeof(struct Airport));
+    airport->endpoint = HOST_LISTENER;
+    airport->stats = host->stats;
+    airport->acceptSocket = -1;
+    airport->datagrams.endpoint = HOST_DATAGRAM;
+    airport->datagrams.socket = -1;
+    airport->id = strdup(id);
+    airport->info = strdup(info);
+    if (!airport->id || !airport->info) {
+        free(airport->id);
+        free(airport->info);
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    host->count += 1;
+    return E_CONTROL_OK;
+}
+
+int control_host_load(struct AirportHost* host, const char* path) {
+    FILE* airportsFile = NULL;
+    char* line = NULL;
+    char* separator = NULL;
+    size_t lineSize = 0;
+    int success = E_CONTROL_OK;
+
+    airportsFile = fopen(path, "r");
+    if (!airportsFile) {
+        return E_CONTROL_INVALID_AIRPORTS;
+    }
+
+    while (E_CONTROL_OK == success
+            && 0 <= getline(&line, &lineSize, airportsFile)) {
+        control_trim_string_end(line);
+        if ('\0' == line[0]) {
+            continue;
+        }
+
+        separator = strchr(line, ':');
+        if (!separator) {
+            success = E_CONTROL_INVALID_AIRPORTS;
+            break;
+        }
+        *separator = '\0';
+
+        if (E_CONTROL_OK != control_host_add(host, line, separator + 1)) {
+            success = E_CONTROL_INVALID_AIRPORTS;
+        }
+    }
+
+    free(line);
+    fclose(airportsFile);
+    return success;
+}
+
+/**
+ * Raise the soft limit of open file descriptors to the hard limit.
+ *
+ * Every hosted airport needs a listening socket, so thousands of airports
+ * exceed the usual default limit.
+ */
+static void raise_file_limit(void) {
+    struct rlimit limit;
+
+    if (0 == getrlimit(RLIMIT_NOFILE, &limit)
+            && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/**
+ * Register an endpoint with the event loop, or re-arm it.
+ *
+ * Endpoints are one-shot, so only one worker at a time handles each of them.
+ * Returns 0 on success, -1 on error.
+ *
+ * @param host  The host owning the event loop.
+ *
+ * @param socketNumber  The endpoint's socket.
+ *
+ * @param endpoint  The struct Airport or struct HostConnection of the socket.
+ *
+ * @param events  The events to wait for, EPOLLIN or EPOLLOUT.
+ *
+ * @param operation EPOLL_CTL_ADD for new endpoints, EPOLL_CTL_MOD else.
+ */
+static int arm_endpoint(struct AirportHost* host, int socketNumber,
+        void* endpoint, uint32_t events, int operation) {
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events | EPOLLONESHOT;
+    event.data.ptr = endpoint;
+
+    return epoll_ctl(host->eventLoop, operation, socketNumber, &event);
+}
+
+int control_host_open(struct AirportHost* host) {
+    struct Airport* airport = NULL;
+    int i = 0;
+
+    raise_file_limit();
+
+    host->eventLoop = epoll_create1(EPOLL_CLOEXEC);
+    if (0 > host->eventLoop) {
+        return E_CONTROL_FAILED_TO_CONNECT;
+    }
+
+    for (i = 0; i < host->count; i++) {
+        airport = host->airports + i;
+        control_visit_log_init(&airport->visitLog, HOST_VISIT_CAPACITY);
+
+        airport->acceptSocket = control_open_incoming_conn(&airport->port);
+        fcntl(airport->acceptSocket, F_SETFL, O_NONBLOCK);
+        if (0 != listen(airport->acceptSocket, CONTROL_MAX_CONNECTIONS)
+                || 0 != arm_endpoint(host, airport->acceptSocket, airport,
+                        EPOLLIN, EPOLL_CTL_ADD)) {
+            return E_CONTROL_FAILED_TO_CONNECT;
+        }
+
+        airport->datagrams.airport = airport;
+        if (host->useDatagrams) {
+            airport->datagrams.socket = control_open_datagram_conn(
+                    airport->port);
+        }
+        if (0 <= airport->datagrams.socket
+                && 0 != arm_endpoint(host, airport->datagrams.socket,
+                        &airport->datagrams, EPOLLIN, EPOLL_CTL_ADD)) {
+            return E_CONTROL_FAILED_TO_CONNECT;
+        }
+    }
+
+    return E_CONTROL_OK;
+}
+
+/**
+ * Close a plane's connection and release it.
+ *
+ * @param connection  The connection to be closed.
+ */
+static void close_connection(struct HostConnection* connection) {
+    control_close_conn(connection->reader.socketNumber);
+    free(connection->output);
+    free(connection);
+}
+
+/**
+ * Accept the planes waiting at an airport.
+ *
+ * Accept failures are counted as errors, the airport keeps listening.
+ *
+ * @param host  The host serving the airport.
+ *
+ * @param airport The airport, whose listener is ready.
+ */
+static void accept_planes(struct AirportHost* host, struct Airport* airport) {
+    struct HostConnection* connection = NULL;
+    int planeSocket = 0;
+    int i = 0;
+
+    for (i = 0; i < HOST_ACCEPT_BATCH; i++) {
+        planeSocket = accept4(airport->acceptSocket, NULL, NULL,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (0 > planeSocket) {
+            if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+                control_stats_add(airport->stats, STATS_ERRORS, 1);
+            }
+            break;
+        }
+
+        connection = (struct HostConnection*)calloc(1,
+                sizeof(struct HostConnection));
+        if (!connection) {
+            control_stats_add(airport->stats, STATS_ERRORS, 1);
+            control_close_conn(planeSocket);
+            continue;
+        }
+        connection->endpoint = HOST_CONNECTION;
+        connection->airport = airport;
+        init_line_reader(&connection->reader, planeSocket);
+
+        if (0 != arm_endpoint(host, planeSocket, connection, EPOLLIN,
+                EPOLL_CTL_ADD)) {
+            control_stats_add(airport->stats, STATS_ERRORS, 1);
+            close_connection(connection);
+        }
+    }
+
+    arm_endpoint(host, airport->acceptSocket, airport, EPOLLIN,
+            EPOLL_CTL_MOD);
+}
+
+/**
+ * Process the requests buffered on a connection.
+ *
+ * Reading stops once the socket has no more data or HOST_OUTPUT_HIGH_WATER
+ * bytes of replies are buffered. The replies are collected in the
+ * connection's output.
+ *
+ * Returns 0 on success, -1 if no memory is left.
+ *
+ * @param host  The host serving the connection.
+ *
+ * @param connection  The connection, whose requests are to be processed.
+ */
+static int process_requests(struct AirportHost* host,
+        struct HostConnection* connection) {
+    char buffer[CONTROL_MAX_ID_SIZE];
+    struct Airport* airport = connection->airport;
+    struct timespec start;
+    enum StatsCounter kind = STATS_CHECK_INS;
+    FILE* streamToPlane = NULL;
+    size_t bytes = 0;
+    int received = 0;
+    int length = 0;
+
+    streamToPlane = open_memstream(&connection->output,
+            &connection->outputSize);
+    if (!streamToPlane) {
+        return -1;
+    }
+
+    while (HOST_OUTPUT_HIGH_WATER > ftell(streamToPlane)) {
+        if (!has_buffered_line(&connection->reader)) {
+            received = fill_line_reader(&connection->reader);
+            if (0 < received) {
+                continue;
+            }
+            if (0 == received) {
+                connection->closing = 1;
+            } else if (EAGAIN != errno && EWOULDBLOCK != errno) {
+                /*Overlong lines and broken connections are dropped*/
+                control_stats_add(airport->stats, STATS_ERRORS, 1);
+                connection->closing = 1;
+                connection->reader.start = connection->reader.end;
+                break;
+            }
+            if (!connection->closing || connection->reader.start
+                    == connection->reader.end) {
+                break;
+            }
+            /*The final line lacking its LF is served before hanging up*/
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        length = read_line(&connection->reader, buffer, sizeof(buffer));
+        if (0 > length) {
+            break;
+        }
+        bytes = host->handler(airport, buffer, streamToPlane, &kind);
+
+        control_stats_request(airport->stats, kind,
+                (uint64_t)(length + 1 + bytes),
+                control_stats_micros_since(&start));
+    }
+
+    fclose(streamToPlane);
+    connection->outputSent = 0;
+    return 0;
+}
+
+/**
+ * Send the connection's buffered replies without blocking.
+ *
+ * Returns 1 if all replies are sent, 0 if the socket is full, -1 on error.
+ *
+ * @param connection  The connection, whose replies are to be sent.
+ */
+static int send_output(struct HostConnection* connection) {
+    ssize_t sent = 0;
+
+    while (connection->outputSent < connection->outputSize) {
+        sent = send(connection->reader.socketNumber,
+                connection->output + connection->outputSent,
+                connection->outputSize - connection->outputSent,
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (0 > sent) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return (EAGAIN == errno || EWOULDBLOCK == errno) ? 0 : -1;
+        }
+        connection->outputSent += (size_t)sent;
+    }
+
+    free(connection->output);
+    connection->output = NULL;
+    connection->outputSize = 0;
+    connection->outputSent = 0;
+    return 1;
+}
+
+/**
+ * Serve a plane's connection, which became readable or writable.
+ *
+ * Pending replies are sent first, requests are only read while the plane
+ * keeps up with the replies. Requests left buffered at the high water mark
+ * have already left the socket, so no EPOLLIN reports them; the connection
+ * waits for EPOLLOUT instead, which fires once it can take more replies.
+ *
+ * @param host  The host serving the connection.
+ *
+ * @param connection  The ready connection.
+ */
+static void serve_connection(struct AirportHost* host,
+        struct HostConnection* connection) {
+    int socketNumber = connection->reader.socketNumber;
+    int flushed = send_output(connection);
+
+    if (1 == flushed) {
+        if (0 != process_requests(host, connection)) {
+            control_stats_add(connection->airport->stats, STATS_ERRORS, 1);
+            close_connection(connection);
+            return;
+        }
+        flushed = send_output(connection);
+    }
+
+    if (0 > flushed) {
+        control_stats_add(connection->airport->stats, STATS_ERRORS, 1);
+        close_connection(connection);
+    } else if (0 == flushed) {
+        arm_endpoint(host, socketNumber, connection, EPOLLOUT,
+                EPOLL_CTL_MOD);
+    } else if (connection->closing
+            && connection->reader.start == connection->reader.end) {
+        close_connection(connection);
+    } else if (has_buffered_line(&connection->reader)) {
+        arm_endpoint(host, socketNumber, connection, EPOLLOUT,
+                EPOLL_CTL_MOD);
+    } else {
+        arm_endpoint(host, socketNumber, connection, EPOLLIN,
+                EPOLL_CTL_MOD);
+    }
+}
+
+/**
+ * Serve a batch of an airport's check-in datagrams.
+ *
+ * @param host  The host serving the airport.
+ *
+ * @param datagrams The airport's ready UDP endpoint.
+ */
+static void serve_datagrams(struct AirportHost* host,
+        struct AirportDatagrams* datagrams) {
+    control_serve_datagrams(datagrams);
+
+    arm_endpoint(host, datagrams->socket, datagrams, EPOLLIN,
+            EPOLL_CTL_MOD);
+}
+
+/**
+ * A worker's starting point.
+ *
+ * Waits on the shared event loop and serves whichever endpoint is ready.
+ *
+ * @param parameter The host to be served.
+ */
+static void* worker_main(void* parameter) {
+    struct AirportHost* host = (struct AirportHost*)parameter;
+    struct epoll_event events[HOST_MAX_EVENTS];
+    enum HostEndpoint* endpoint = NULL;
+    int ready = 0;
+    int i = 0;
+
+    while (1) {
+        ready = epoll_wait(host->eventLoop, events, HOST_MAX_EVENTS, -1);
+
+        for (i = 0; i < ready; i++) {
+            endpoint = (enum HostEndpoint*)events[i].data.ptr;
+            if (HOST_LISTENER == *endpoint) {
+                accept_planes(host, (struct Airport*)endpoint);
+            } else if (HOST_DATAGRAM == *endpoint) {
+                serve_datagrams(host, (struct AirportDatagrams*)endpoint);
+            } else {
+                serve_connection(host, (struct HostConnection*)endpoint);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void control_host_run(struct AirportHost* host, int workers) {
+    pthread_t worker;
+    pthread_attr_t workerOptions;
+    int i = 0;
+
+    pthread_attr_init(&workerOptions);
+    pthread_attr_setdetachstate(&workerOptions, PTHREAD_CREATE_DETACHED);
+
+    for (i = 1; i < workers; i++) {
+        if (0 != pthread_create(&worker, &workerOptions, worker_main, host)) {
+            control_stats_add(host->stats, STATS_ERRORS, 1);
+            break;
+        }
+    }
+
+    pthread_attr_destroy(&workerOptions);
+
+    worker_main(host);
+}
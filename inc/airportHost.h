@@ -0,0 +1,247 @@
+/*
+ *airportHost.h
+ */
+
+#pragma once
+
+#ifndef AIRPORT_HOST_H
+#define AIRPORT_HOST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "controlStats.h"
+#include "visitLog.h"
+
+/**
+ * The number of worker threads serving the hosted airports by default.
+ */
+#define HOST_DEFAULT_WORKERS 4
+
+/**
+ * The maximum number of events a worker takes from the event loop at once.
+ */
+#define HOST_MAX_EVENTS 64
+
+/**
+ * The maximum number of planes accepted per listener wake-up, so a busy
+ * airport cannot starve the others.
+ */
+#define HOST_ACCEPT_BATCH 64
+
+/**
+ * The amount of buffered replies, at which a connection stops reading
+ * requests until they are sent.
+ */
+#define HOST_OUTPUT_HIGH_WATER (64 * 1024)
+
+/**
+ * The initial capacity of a hosted airport's visit log.
+ */
+#define HOST_VISIT_CAPACITY 16
+
+/**
+ * The kinds of endpoints registered with the event loop.
+ */
+enum HostEndpoint {
+    HOST_LISTENER = 0,
+    HOST_CONNECTION = 1,
+    HOST_DATAGRAM = 2
+};
+
+struct Airport;
+
+/**
+ * An airport's optional UDP check-in endpoint.
+ */
+struct AirportDatagrams {
+    /**
+     * Always HOST_DATAGRAM, the event loop tells endpoints apart by it.
+     */
+    enum HostEndpoint endpoint;
+
+    /**
+     * The airport owning the endpoint.
+     */
+    struct Airport* airport;
+
+    /**
+     * The UDP socket bound to the airport's port, -1 if it is not open.
+     */
+    int socket;
+
+    /**
+     * The idempotency keys of recent check-ins, allocated on first use.
+     */
+    uint64_t* keys;
+};
+
+/**
+ * An airport served by a control process.
+ */
+struct Airport {
+    /**
+     * Always HOST_LISTENER, the event loop tells endpoints apart by it.
+     */
+    enum HostEndpoint endpoint;
+
+    /**
+     * The airport ID.
+     */
+    char* id;
+
+    /**
+     * The airport info text.
+     */
+    char* info;
+
+    /**
+     * The log holding all the visiting planes.
+     */
+    struct VisitLog visitLog;
+
+    /**
+     * The recent throughput and latency, which may be shared by airports.
+     */
+    struct ControlStats* stats;
+
+    /**
+     * The socket accepting planes, -1 if it is not open.
+     */
+    int acceptSocket;
+
+    /**
+     * The port number the airport is listening on.
+     */
+    int port;
+
+    /**
+     * The UDP check-ins received on the same port number.
+     */
+    struct AirportDatagrams datagrams;
+};
+
+/**
+ * Process a single request of a connected plane.
+ *
+ * Returns the number of bytes sent.
+ *
+ * @param airport The airport, which the plane is connected to.
+ *
+ * @param request The received line without trailing LF.
+ *
+ * @param streamToPlane The file stream receiving the reply.
+ *
+ * @param kind  Output parameter, set to STATS_CHECK_INS or STATS_QUERIES.
+ */
+typedef size_t (*HostRequestHandler)(struct Airport* airport,
+        const char* request, FILE* streamToPlane, enum StatsCounter* kind);
+
+/**
+ * Many airports served by one shared event loop and a pool of workers.
+ */
+struct AirportHost {
+    /**
+     * The hosted airports.
+     */
+    struct Airport* airports;
+
+    /**
+     * The number of hosted airports.
+     */
+    int count;
+
+    /**
+     * The number of allocated entries in airports.
+     */
+    int capacity;
+
+    /**
+     * The statistics shared by all hosted airports.
+     */
+    struct ControlStats* stats;
+
+    /**
+     * The function processing the planes' requests.
+     */
+    HostRequestHandler handler;
+
+    /**
+     * The epoll instance, which all workers wait on.
+     */
+    int eventLoop;
+
+    /**
+     * Set if the airports also accept check-ins over UDP.
+     */
+    int useDatagrams;
+};
+
+/**
+ * Prepare an empty airport host.
+ *
+ * @param host  The host to be initialized.
+ *
+ * @param stats The statistics shared by all hosted airports.
+ *
+ * @param handler The function processing the planes' requests.
+ */
+void control_host_init(struct AirportHost* host, struct ControlStats* stats,
+        HostRequestHandler handler);
+
+/**
+ * Add an airport to the host.
+ *
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_INFO if the ID or info
+ * text is invalid or no memory is left. Airports must be added before the
+ * host is opened.
+ *
+ * @param host  The host, which shall serve the airport.
+ *
+ * @param id  The airport ID.
+ *
+ * @param info  The airport info text.
+ */
+int control_host_add(struct AirportHost* host, const char* id,
+        const char* info);
+
+/**
+ * Add the airports listed in a file to the host.
+ *
+ * Every non-empty line holds an airport as "<id>:<info>".
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_AIRPORTS if the file
+ * cannot be read or holds an invalid line.
+ *
+ * @param host  The host, which shall serve the airports.
+ *
+ * @param path  The path of the airports file.
+ */
+int control_host_load(struct AirportHost* host, const char* path);
+
+/**
+ * Open a listening socket on an ephemeral port for every hosted airport.
+ *
+ * The process' file descriptor limit is raised as far as allowed first. If
+ * useDatagrams is set, a UDP check-in socket is bound to the same port
+ * number where possible. Returns E_CONTROL_OK on success,
+ * E_CONTROL_FAILED_TO_CONNECT if a socket or the event loop cannot be set up.
+ *
+ * @param host  The host, whose airports shall listen for planes.
+ */
+int control_host_open(struct AirportHost* host);
+
+/**
+ * Serve the planes of all hosted airports.
+ *
+ * The calling thread and workers - 1 additional threads wait on the shared
+ * event loop. If threads cannot be started, the host keeps running with the
+ * ones it has. This function does not return.
+ *
+ * @param host  The opened host.
+ *
+ * @param workers The number of worker threads.
+ */
+void control_host_run(struct AirportHost* host, int workers);
+
+#endif
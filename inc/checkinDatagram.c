@@ -0,0 +1,536 @@
+/*
+ *checkinDatagram.c
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+#include "errorReturn.h"
+#include "protocol.h"
+#include "checkinDatagram.h"
+
+/**
+ * Marks a destination in roc_checkin_datagrams(), which refused UDP.
+ */
+#define DATAGRAM_REFUSED -1
+
+int control_open_datagram_conn(int port) {
+    int datagramSocket = 0;
+    int enable = 1;
+    struct sockaddr_in address;
+
+    datagramSocket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK
+            | SOCK_CLOEXEC, 0);
+    if (0 > datagramSocket) {
+        return -1;
+    }
+
+    /*Controls sharing an airport's TCP port share its UDP port as well*/
+    setsockopt(datagramSocket, SOL_SOCKET, SO_REUSEPORT, (void*)&enable,
+            sizeof(enable));
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons((uint16_t)port);
+    if (0 != bind(datagramSocket, (struct sockaddr*)&address,
+            sizeof(address))) {
+        close(datagramSocket);
+        return -1;
+    }
+
+    return datagramSocket;
+}
+
+/**
+ * Remember the idempotency key of a check-in.
+ *
+ * Returns 1 if the check-in is new, 0 if it was seen recently.
+ *
+ * @param keys  The airport's DATAGRAM_KEY_SLOTS recent keys.
+ *
+ * @param key The check-in's key.
+ *
+ * @param planeId The checking in plane's ID.
+ */
+static int remember_key(uint64_t* keys, uint64_t key, const char* planeId) {
+    uint64_t stamp = key;
+    uint64_t* bucket = NULL;
+    int i = 0;
+
+    /*A key reused by another plane is a different check-in*/
+    while (*planeId) {
+        stamp = (stamp ^ (unsigned char)*planeId++) * 1099511628211ULL;
+    }
+    stamp |= 1;
+
+    bucket = keys + ((stamp * 0x9E3779B97F4A7C15ULL) >> 32)
+            % (DATAGRAM_KEY_SLOTS / DATAGRAM_KEY_WAYS) * DATAGRAM_KEY_WAYS;
+    for (i = 0; i < DATAGRAM_KEY_WAYS; i++) {
+        if (stamp == bucket[i]) {
+            return 0;
+        }
+    }
+
+    /*The bucket's oldest key is dropped*/
+    memmove(bucket + 1, bucket, (DATAGRAM_KEY_WAYS - 1) * sizeof(uint64_t));
+    bucket[0] = stamp;
+    return 1;
+}
+
+/**
+ * Split a datagram into its idempotency key and its text.
+ *
+ * Returns the text following "<key>:", NULL if the datagram is malformed.
+ *
+ * @param datagram  The NUL-terminated datagram.
+ *
+ * @param key Output parameter, the datagram's key.
+ */
+static char* parse_datagram(char* datagram, uint64_t* key) {
+    char* end = NULL;
+
+    errno = 0;
+    *key = strtoull(datagram, &end, 16);
+    if (end == datagram || ':' != *end || 0 != errno) {
+        return NULL;
+    }
+
+    return end + 1;
+}
+
+/**
+ * Send a batch of prepared datagrams.
+ *
+ * Datagrams, which cannot be sent right away, are dropped like on the
+ * network.
+ *
+ * @param datagramSocket  The UDP socket to send from.
+ *
+ * @param messages  The datagrams to be sent.
+ *
+ * @param count The number of datagrams.
+ */
+static void send_batch(int datagramSocket, struct mmsghdr* messages,
+        int count) {
+    int sent = 0;
+    int done = 0;
+
+    while (done < count) {
+        sent = sendmmsg(datagramSocket, messages + done, count - done,
+                MSG_DONTWAIT);
+        if (0 > sent) {
+            /*A reported ICMP error is consumed by the failed call*/
+            if (EINTR == errno || ECONNREFUSED == errno) {
+                continue;
+            }
+            break;
+        }
+        done += sent;
+    }
+}
+
+int control_serve_datagrams(struct AirportDatagrams* datagrams) {
+    char requestData[DATAGRAM_BATCH][DATAGRAM_MAX_SIZE + 1];
+    char replyData[DATAGRAM_BATCH][DATAGRAM_MAX_SIZE];
+    struct Airport* airport = datagrams->airport;
+    struct mmsghdr requests[DATAGRAM_BATCH];
+    struct mmsghdr replies[DATAGRAM_BATCH];
+    struct iovec requestParts[DATAGRAM_BATCH];
+    struct iovec replyParts[DATAGRAM_BATCH];
+    struct sockaddr_in senders[DATAGRAM_BATCH];
+    struct timespec start;
+    const char* planeId = NULL;
+    uint64_t key = 0;
+    int replyCount = 0;
+    int received = 0;
+    int length = 0;
+    int i = 0;
+
+    if (!datagrams->keys) {
+        datagrams->keys = (uint64_t*)calloc(DATAGRAM_KEY_SLOTS,
+                sizeof(uint64_t));
+        if (!datagrams->keys) {
+            return 0;
+        }
+    }
+
+    memset(requests, 0, sizeof(requests));
+    for (i = 0; i < DATAGRAM_BATCH; i++) {
+        requestParts[i].iov_base = requestData[i];
+        requestParts[i].iov_len = DATAGRAM_MAX_SIZE;
+        requests[i].msg_hdr.msg_name = senders + i;
+        requests[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        requests[i].msg_hdr.msg_iov = requestParts + i;
+        requests[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    do {
+        received = recvmmsg(datagrams->socket, requests, DATAGRAM_BATCH,
+                MSG_DONTWAIT, NULL);
+    } while (0 > received && EINTR == errno);
+    if (0 >= received) {
+        return 0;
+    }
+
+    memset(replies, 0, sizeof(replies));
+    for (i = 0; i < received; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        requestData[i][requests[i].msg_len] = '\0';
+        planeId = parse_datagram(requestData[i], &key);
+        if (!planeId || (MSG_TRUNC & requests[i].msg_hdr.msg_flags)
+                || '\0' == planeId[0]
+                || E_CONTROL_OK != control_check_chars(planeId)) {
+            control_stats_add(airport->stats, STATS_ERRORS, 1);
+            continue;
+        }
+
+        if (remember_key(datagrams->keys, key, planeId)) {
+            control_visit_log_append(&airport->visitLog, planeId);
+        }
+
+        length = snprintf(replyData[replyCount], DATAGRAM_MAX_SIZE,
+                "%llx:%s", (unsigned long long)key, airport->info);
+        replyParts[replyCount].iov_base = replyData[replyCount];
+        replyParts[replyCount].iov_len = (size_t)length;
+        replies[replyCount].msg_hdr.msg_name = senders + i;
+        replies[replyCount].msg_hdr.msg_namelen =
+                requests[i].msg_hdr.msg_namelen;
+        replies[replyCount].msg_hdr.msg_iov = replyParts + replyCount;
+        replies[replyCount].msg_hdr.msg_iovlen = 1;
+        replyCount += 1;
+
+        control_stats_request(airport->stats, STATS_CHECK_INS,
+                (uint64_t)(requests[i].msg_len + length),
+                control_stats_micros_since(&start));
+    }
+
+    send_batch(datagrams->socket, replies, replyCount);
+    return replyCount;
+}
+
+/**
+ * Choose the first of a route's idempotency keys.
+ *
+ * The keys of a route are consecutive, so replies map back to the
+ * destination by subtraction. Returns a random non-zero key leaving room for
+ * DATAGRAM_ROUTE_SEGMENT successors.
+ */
+static uint64_t choose_key_base(void) {
+    struct timespec now;
+    uint64_t mixed = 0;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    mixed = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec
+            ^ ((uint64_t)getpid() << 16);
+
+    /*splitmix64 finalizer*/
+    mixed += 0x9E3779B97F4A7C15ULL;
+    mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+    mixed ^= mixed >> 31;
+
+    return (mixed >> 2) + 1;
+}
+
+/**
+ * Send the check-ins of all destinations, which did not reply yet.
+ *
+ * @param datagramSocket  The UDP socket to send from.
+ *
+ * @param planeId The plane's ID.
+ *
+ * @param ports The destinations' port numbers.
+ *
+ * @param count The number of destinations.
+ *
+ * @param answered  The destinations' states, only the ones set to 0 are sent.
+ *
+ * @param keyBase The idempotency key of the first destination.
+ */
+static void send_checkins(int datagramSocket, const char* planeId,
+        const int* ports, int count, const int* answered, uint64_t keyBase) {
+    char data[DATAGRAM_BATCH][DATAGRAM_MAX_SIZE];
+    struct mmsghdr messages[DATAGRAM_BATCH];
+    struct iovec parts[DATAGRAM_BATCH];
+    struct sockaddr_in targets[DATAGRAM_BATCH];
+    int batched = 0;
+    int i = 0;
+
+    memset(messages, 0, sizeof(messages));
+    memset(targets, 0, sizeof(targets));
+
+    for (i = 0; i < count; i++) {
+        if (0 != answered[i]) {
+            continue;
+        }
+
+        targets[batched].sin_family = AF_INET;
+        targets[batched].sin_addr.s_addr = INADDR_ANY;
+        targets[batched].sin_port = htons((uint16_t)ports[i]);
+        parts[batched].iov_base = data[batched];
+        parts[batched].iov_len = (size_t)snprintf(data[batched],
+                DATAGRAM_MAX_SIZE, "%llx:%s",
+                (unsigned long long)(keyBase + (uint64_t)i), planeId);
+        messages[batched].msg_hdr.msg_name = targets + batched;
+        messages[batched].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        messages[batched].msg_hdr.msg_iov = parts + batched;
+        messages[batched].msg_hdr.msg_iovlen = 1;
+        batched += 1;
+
+        if (DATAGRAM_BATCH == batched) {
+            send_batch(datagramSocket, messages, batched);
+            batched = 0;
+        }
+    }
+
+    send_batch(datagramSocket, messages, batched);
+}
+
+/**
+ * Give up on the destinations, whose ports refused a check-in.
+ *
+ * Drains the socket's error queue. Returns the number of destinations given
+ * up.
+ *
+ * @param datagramSocket  The UDP socket, which reported errors.
+ *
+ * @param ports The destinations' port numbers.
+ *
+ * @param count The number of destinations.
+ *
+ * @param answered  The destinations' states, refused ones are set to
+ *                  DATAGRAM_REFUSED.
+ */
+static int collect_refusals(int datagramSocket, const int* ports, int count,
+        int* answered) {
+    char data[DATAGRAM_MAX_SIZE];
+    char control[256];
+    struct sockaddr_in target;
+    struct iovec part;
+    struct msghdr message;
+    struct cmsghdr* header = NULL;
+    struct sock_extended_err* error = NULL;
+    int refused = 0;
+    int i = 0;
+
+    while (1) {
+        memset(&message, 0, sizeof(message));
+        part.iov_base = data;
+        part.iov_len = sizeof(data);
+        message.msg_name = &target;
+        message.msg_namelen = sizeof(target);
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        if (0 > recvmsg(datagramSocket, &message, MSG_ERRQUEUE
+                | MSG_DONTWAIT)) {
+            return refused;
+        }
+
+        for (header = CMSG_FIRSTHDR(&message); header;
+                header = CMSG_NXTHDR(&message, header)) {
+            error = (struct sock_extended_err*)CMSG_DATA(header);
+            if (SOL_IP != header->cmsg_level || IP_RECVERR != header->cmsg_type
+                    || ECONNREFUSED != error->ee_errno) {
+                continue;
+            }
+
+            for (i = 0; i < count; i++) {
+                if (0 == answered[i] && ports[i] == ntohs(target.sin_port)) {
+                    answered[i] = DATAGRAM_REFUSED;
+                    refused += 1;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Take the replies received on the socket.
+ *
+ * Returns the number of destinations, which replied.
+ *
+ * @param datagramSocket  The UDP socket to receive from.
+ *
+ * @param count The number of destinations.
+ *
+ * @param infos Output parameter, receives the destinations' info texts.
+ *
+ * @param answered  The destinations' states, replying ones are set to 1.
+ *
+ * @param keyBase The idempotency key of the first destination.
+ */
+static int collect_replies(int datagramSocket, int count, char** infos,
+        int* answered, uint64_t keyBase) {
+    char data[DATAGRAM_BATCH][DATAGRAM_MAX_SIZE + 1];
+    struct mmsghdr messages[DATAGRAM_BATCH];
+    struct iovec parts[DATAGRAM_BATCH];
+    const char* info = NULL;
+    uint64_t key = 0;
+    uint64_t destination = 0;
+    int replied = 0;
+    int received = 0;
+    int i = 0;
+
+    do {
+        memset(messages, 0, sizeof(messages));
+        for (i = 0; i < DATAGRAM_BATCH; i++) {
+            parts[i].iov_base = data[i];
+            parts[i].iov_len = DATAGRAM_MAX_SIZE;
+            messages[i].msg_hdr.msg_iov = parts + i;
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        received = recvmmsg(datagramSocket, messages, DATAGRAM_BATCH,
+                MSG_DONTWAIT, NULL);
+
+        for (i = 0; i < received; i++) {
+            data[i][messages[i].msg_len] = '\0';
+            info = parse_datagram(data[i], &key);
+            destination = key - keyBase;
+            if (!info || (uint64_t)count <= destination
+                    || 0 != answered[destination]
+                    || E_ROC_OK != roc_check_chars(info)) {
+                continue;
+            }
+
+            strcpy(infos[destination], info);
+            answered[destination] = 1;
+            replied += 1;
+        }
+    } while (DATAGRAM_BATCH == received);
+
+    return replied;
+}
+
+/**
+ * Get the milliseconds left until the given instant.
+ *
+ * @param deadline  The instant, read from the monotonic clock.
+ */
+static int millis_until(const struct timespec* deadline) {
+    struct timespec now;
+    long left = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    left = (deadline->tv_sec - now.tv_sec) * 1000
+            + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+    return (int)MAX(0, left);
+}
+
+/**
+ * Check in at a window of destinations.
+ *
+ * The window is kept small enough, so the replies fit into the socket's
+ * receive buffer. Returns the number of destinations, which replied.
+ *
+ * @param datagramSocket  The UDP socket to use.
+ *
+ * @param planeId The plane's ID.
+ *
+ * @param ports The destinations' port numbers.
+ *
+ * @param count The number of destinations, at most DATAGRAM_WINDOW.
+ *
+ * @param infos Output parameter, receives the destinations' info texts.
+ *
+ * @param answered  The destinations' states, all 0 initially.
+ *
+ * @param keyBase The idempotency key of the first destination.
+ */
+static int exchange_window(int datagramSocket, const char* planeId,
+        const int* ports, int count, char** infos, int* answered,
+        uint64_t keyBase) {
+    struct pollfd waiting;
+    struct timespec deadline;
+    int timeout = DATAGRAM_TIMEOUT_MS;
+    int pending = count;
+    int replied = 0;
+    int collected = 0;
+    int attempt = 0;
+
+    waiting.fd = datagramSocket;
+    waiting.events = POLLIN;
+
+    for (attempt = 0; 0 < pending && attempt < DATAGRAM_ATTEMPTS; attempt++) {
+        send_checkins(datagramSocket, planeId, ports, count, answered,
+                keyBase);
+
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (timeout % 1000) * 1000000L;
+        if (1000000000L <= deadline.tv_nsec) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        while (0 < pending) {
+            waiting.revents = 0;
+            if (0 >= poll(&waiting, 1, millis_until(&deadline))) {
+                break;
+            }
+            if (POLLERR & waiting.revents) {
+                pending -= collect_refusals(datagramSocket, ports, count,
+                        answered);
+            }
+            if (POLLIN & waiting.revents) {
+                collected = collect_replies(datagramSocket, count, infos,
+                        answered, keyBase);
+                replied += collected;
+                pending -= collected;
+            }
+        }
+
+        timeout *= 2;
+    }
+
+    return replied;
+}
+
+int roc_checkin_datagrams(const char* planeId, const int* ports, int count,
+        char** infos, int* answered) {
+    uint64_t keyBase = choose_key_base();
+    int datagramSocket = 0;
+    int enable = 1;
+    int replied = 0;
+    int first = 0;
+    int i = 0;
+
+    memset(answered, 0, count * sizeof(int));
+
+    datagramSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (0 > datagramSocket) {
+        return 0;
+    }
+    setsockopt(datagramSocket, SOL_IP, IP_RECVERR, &enable, sizeof(enable));
+
+    for (first = 0; first < count; first += DATAGRAM_WINDOW) {
+        replied += exchange_window(datagramSocket, planeId, ports + first,
+                MIN(DATAGRAM_WINDOW, count - first), infos + first,
+                answered + first, keyBase + (uint64_t)first);
+    }
+
+    close(datagramSocket);
+
+    for (i = 0; i < count; i++) {
+        answered[i] = (1 == answered[i]);
+    }
+    return replied;
+}
@@ -0,0 +1,106 @@
+/*
+ *checkinDatagram.h
+ */
+
+#pragma once
+
+#ifndef CHECKIN_DATAGRAM_H
+#define CHECKIN_DATAGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "airportHost.h"
+
+/**
+ * The maximum number of datagrams received or sent by a single system call.
+ */
+#define DATAGRAM_BATCH 64
+
+/**
+ * The maximum length of a check-in datagram or its reply.
+ */
+#define DATAGRAM_MAX_SIZE 192
+
+/**
+ * The number of recent idempotency keys an airport remembers.
+ */
+#define DATAGRAM_KEY_SLOTS 1024
+
+/**
+ * The number of keys sharing a bucket of the idempotency key cache.
+ */
+#define DATAGRAM_KEY_WAYS 4
+
+/**
+ * The maximum number of check-ins roc2310 has in flight, so their replies
+ * fit into the socket's default receive buffer.
+ */
+#define DATAGRAM_WINDOW 128
+
+/**
+ * The time roc2310 waits for the first replies in milliseconds. It doubles
+ * with every retransmission.
+ */
+#define DATAGRAM_TIMEOUT_MS 20
+
+/**
+ * The number of times a check-in datagram is sent before falling back to TCP.
+ */
+#define DATAGRAM_ATTEMPTS 3
+
+/**
+ * The maximum number of destinations roc2310 checks in at over UDP at once.
+ */
+#define DATAGRAM_ROUTE_SEGMENT 1024
+
+/**
+ * Open a UDP socket for check-ins on the given port number.
+ *
+ * Returns the non-blocking socket or -1 if the port number is taken.
+ *
+ * @param port  The port number, which the airport's TCP listener is bound to.
+ */
+int control_open_datagram_conn(int port);
+
+/**
+ * Serve a batch of the check-in datagrams waiting at an airport.
+ *
+ * A datagram "<key>:<plane id>" logs the plane's visit and is replied
+ * "<key>:<info>". The key is a hexadecimal number chosen by the plane, which
+ * is reused for retransmissions. A check-in with a recently seen key is only
+ * replied, but not logged again. Up to DATAGRAM_BATCH datagrams are received
+ * and replied with one system call each. Malformed datagrams are counted as
+ * errors and dropped.
+ *
+ * Returns the number of check-ins served, 0 if none were waiting.
+ *
+ * @param datagrams The airport's UDP endpoint.
+ */
+int control_serve_datagrams(struct AirportDatagrams* datagrams);
+
+/**
+ * Check in at many airports at once over UDP.
+ *
+ * All check-ins are sent in batches from one socket, at most DATAGRAM_WINDOW
+ * at a time, and retransmitted up to DATAGRAM_ATTEMPTS times. Airports
+ * refusing UDP are given up right away.
+ *
+ * Returns the number of airports, which replied.
+ *
+ * @param planeId The plane's ID.
+ *
+ * @param ports The airports' port numbers.
+ *
+ * @param count The number of airports.
+ *
+ * @param infos Output parameter, infos[i] receives the info text of the
+ *              airport at ports[i], at most ROC_MAX_INFO_SIZE bytes.
+ *
+ * @param answered  Output parameter, answered[i] is set to 1 if the airport at
+ *                  ports[i] replied, to 0 else.
+ */
+int roc_checkin_datagrams(const char* planeId, const int* ports, int count,
+        char** infos, int* answered);
+
+#endif
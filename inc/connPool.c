@@ -0,0 +1,100 @@
+/*
+ *connPool.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "connPool.h"
+
+int roc_pool_init(struct ConnPool* pool, int capacity) {
+    pool->idle = (struct PooledConn*)malloc(capacity
+            * sizeof(struct PooledConn));
+    if (!pool->idle) {
+        return EXIT_FAILURE;
+    }
+    pool->count = 0;
+    pool->capacity = capacity;
+    pthread_mutex_init(&pool->lock, NULL);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Check if an idle connection is still open.
+ *
+ * Returns 1 if the peer neither closed it nor sent unexpected data, 0 else.
+ *
+ * @param socket  The idle connection.
+ */
+static int is_alive(int socket) {
+    char probe = 0;
+    ssize_t peeked = recv(socket, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    return 0 > peeked && (EAGAIN == errno || EWOULDBLOCK == errno);
+}
+
+int roc_pool_take(struct ConnPool* pool, int port) {
+    int socket = -1;
+    int i = 0;
+
+    if (!pool) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = pool->count - 1; 0 <= i && 0 > socket; i--) {
+        if (port != pool->idle[i].port) {
+            continue;
+        }
+        socket = pool->idle[i].socket;
+        pool->idle[i] = pool->idle[--pool->count];
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    /*A control or mapper, which restarted, closed its end meanwhile*/
+    if (0 <= socket && !is_alive(socket)) {
+        close(socket);
+        return roc_pool_take(pool, port);
+    }
+    return socket;
+}
+
+void roc_pool_give(struct ConnPool* pool, int port, int socket) {
+    int samePort = 0;
+    int i = 0;
+
+    if (!pool) {
+        close(socket);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < pool->count; i++) {
+        samePort += port == pool->idle[i].port;
+    }
+    if (pool->count < pool->capacity && samePort < POOL_MAX_PER_PORT) {
+        pool->idle[pool->count].port = port;
+        pool->idle[pool->count].socket = socket;
+        pool->count += 1;
+        socket = -1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (0 <= socket) {
+        close(socket);
+    }
+}
+
+void roc_pool_close(struct ConnPool* pool) {
+    int i = 0;
+
+    for (i = 0; i < pool->count; i++) {
+        close(pool->idle[i].socket);
+    }
+    free(pool->idle);
+    pool->count = 0;
+    pthread_mutex_destroy(&pool->lock);
+}
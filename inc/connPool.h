@@ -0,0 +1,107 @@
+/*
+ *connPool.h
+ */
+
+#pragma once
+
+#ifndef CONN_POOL_H
+#define CONN_POOL_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+/**
+ * The maximum number of idle connections kept per port, so a pool does not
+ * tie up too many of a control's connection slots.
+ */
+#define POOL_MAX_PER_PORT 8
+
+/**
+ * An idle connection kept for reuse.
+ */
+struct PooledConn {
+    /**
+     * The port number the connection leads to.
+     */
+    int port;
+
+    /**
+     * The connected socket.
+     */
+    int socket;
+};
+
+/**
+ * Idle TCP connections to mappers and controls, shared by threads.
+ *
+ * Both keep a connection open until the client closes it, so a connection,
+ * whose last request was answered completely, can serve the next one.
+ */
+struct ConnPool {
+    /**
+     * Guards the idle connections.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The idle connections.
+     */
+    struct PooledConn* idle;
+
+    /**
+     * The number of idle connections.
+     */
+    int count;
+
+    /**
+     * The maximum number of idle connections.
+     */
+    int capacity;
+};
+
+/**
+ * Set up an empty pool.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE if no memory is left.
+ *
+ * @param pool  The pool to be initialized.
+ *
+ * @param capacity  The maximum number of idle connections kept.
+ */
+int roc_pool_init(struct ConnPool* pool, int capacity);
+
+/**
+ * Take an idle connection to the given port.
+ *
+ * Connections, which the peer closed meanwhile, are dropped. Returns the
+ * connected socket, -1 if there is no idle one, so the caller has to
+ * connect itself.
+ *
+ * @param pool  The pool, NULL if there is none.
+ *
+ * @param port  The port number the connection has to lead to.
+ */
+int roc_pool_take(struct ConnPool* pool, int port);
+
+/**
+ * Hand a connection back for reuse.
+ *
+ * The connection must not have any unread or unanswered data. It is closed
+ * if the pool is full or holds POOL_MAX_PER_PORT connections to the port.
+ *
+ * @param pool  The pool, NULL if there is none.
+ *
+ * @param port  The port number the connection leads to.
+ *
+ * @param socket  The connected socket.
+ */
+void roc_pool_give(struct ConnPool* pool, int port, int socket);
+
+/**
+ * Close all idle connections and free the pool.
+ *
+ * @param pool  The pool to be closed.
+ */
+void roc_pool_close(struct ConnPool* pool);
+
+#endif
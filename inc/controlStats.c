@@ -0,0 +1,144 @@
+/*
+ *controlStats.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "controlStats.h"
+
+/**
+ * The percentiles replied in tenths of a percent.
+ */
+static const int replyPermilles[] = {500, 900, 990, 999};
+
+/**
+ * The names of the replied percentiles.
+ */
+static const char* replyPercentiles[] = {"p50", "p90", "p99", "p999"};
+
+/**
+ * Get the slot of the current second, recycling it if it is outdated.
+ *
+ * @param stats The statistics to be updated.
+ */
+static struct StatsSecond* current_second(struct ControlStats* stats) {
+    uint64_t now = (uint64_t)time(NULL);
+    struct StatsSecond* slot = stats->seconds + now % STATS_SECONDS;
+    uint64_t seen = __atomic_load_n(&slot->second, __ATOMIC_RELAXED);
+    int i = 0;
+
+    if (seen < now
+            && __atomic_compare_exchange_n(&slot->second, &seen, now, 0,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        for (i = 0; i < STATS_COUNTER_COUNT; i++) {
+            __atomic_store_n(slot->counters + i, 0, __ATOMIC_RELAXED);
+        }
+        for (i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+            __atomic_store_n(slot->latencies + i, 0, __ATOMIC_RELAXED);
+        }
+    }
+
+    return slot;
+}
+
+void control_stats_add(struct ControlStats* stats, enum StatsCounter counter,
+        uint64_t amount) {
+    struct StatsSecond* slot = current_second(stats);
+
+    __atomic_fetch_add(slot->counters + counter, amount, __ATOMIC_RELAXED);
+}
+
+void control_stats_request(struct ControlStats* stats, enum StatsCounter kind,
+        uint64_t bytes, uint64_t micros) {
+    struct StatsSecond* slot = current_second(stats);
+    int bucket = 0;
+
+    while (1 < micros && bucket < STATS_LATENCY_BUCKETS - 1) {
+        micros >>= 1;
+        bucket += 1;
+    }
+
+    __atomic_fetch_add(slot->counters + kind, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(slot->counters + STATS_BYTES, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(slot->latencies + bucket, 1, __ATOMIC_RELAXED);
+}
+
+uint64_t control_stats_micros_since(const struct timespec* start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)((int64_t)(now.tv_sec - start->tv_sec) * 1000000
+            + (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+char* control_stats_reply(struct ControlStats* stats, size_t* size) {
+    uint64_t latencies[STATS_LATENCY_BUCKETS];
+    uint64_t counters[STATS_COUNTER_COUNT];
+    uint64_t now = (uint64_t)time(NULL);
+    uint64_t second = 0;
+    uint64_t total = 0;
+    uint64_t seen = 0;
+    struct StatsSecond* slot = NULL;
+    char* reply = NULL;
+    size_t used = 0;
+    int active = 0;
+    int bucket = 0;
+    int i = 0;
+    int j = 0;
+
+    reply = (char*)malloc(STATS_SECONDS * 112 + 128);
+    if (!reply) {
+        return NULL;
+    }
+    memset(latencies, 0, sizeof(latencies));
+
+    for (second = now - STATS_SECONDS + 1; second <= now; second++) {
+        slot = stats->seconds + second % STATS_SECONDS;
+        if (second != __atomic_load_n(&slot->second, __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        active = 0;
+        for (i = 0; i < STATS_COUNTER_COUNT; i++) {
+            counters[i] = __atomic_load_n(slot->counters + i,
+                    __ATOMIC_RELAXED);
+            active |= (0 != counters[i]);
+        }
+        for (i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+            latencies[i] += __atomic_load_n(slot->latencies + i,
+                    __ATOMIC_RELAXED);
+        }
+
+        if (active) {
+            used += sprintf(reply + used, "%llu:%llu:%llu:%llu:%llu\n",
+                    (unsigned long long)second,
+                    (unsigned long long)counters[STATS_CHECK_INS],
+                    (unsigned long long)counters[STATS_QUERIES],
+                    (unsigned long long)counters[STATS_BYTES],
+                    (unsigned long long)counters[STATS_ERRORS]);
+        }
+    }
+
+    for (i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+        total += latencies[i];
+    }
+
+    for (j = 0; j < 4; j++) {
+        seen = 0;
+        for (bucket = 0; bucket < STATS_LATENCY_BUCKETS - 1; bucket++) {
+            seen += latencies[bucket];
+            if (total && seen * 1000 >= total * replyPermilles[j]) {
+                break;
+            }
+        }
+        used += sprintf(reply + used, "%s:%llu\n", replyPercentiles[j],
+                total ? (unsigned long long)1 << (bucket + 1) : 0ULL);
+    }
+
+    memcpy(reply + used, ".\n", 3);
+    *size = used + 2;
+    return reply;
+}
@@ -0,0 +1,119 @@
+/*
+ *controlStats.h
+ */
+
+#pragma once
+
+#ifndef CONTROL_STATS_H
+#define CONTROL_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * The number of seconds kept in the throughput time series.
+ */
+#define STATS_SECONDS 300
+
+/**
+ * The number of latency histogram buckets, bucket i counts requests taking
+ * less than 2^(i + 1) microseconds.
+ */
+#define STATS_LATENCY_BUCKETS 24
+
+/**
+ * The counters kept for every second.
+ */
+enum StatsCounter {
+    STATS_CHECK_INS = 0,
+    STATS_QUERIES = 1,
+    STATS_BYTES = 2,
+    STATS_ERRORS = 3,
+    STATS_COUNTER_COUNT = 4
+};
+
+/**
+ * The activity of a single second.
+ */
+struct StatsSecond {
+    /**
+     * The second since the epoch, which this slot currently counts.
+     */
+    uint64_t second;
+
+    /**
+     * The counters indexed by enum StatsCounter.
+     */
+    uint64_t counters[STATS_COUNTER_COUNT];
+
+    /**
+     * The latency histogram of this second's requests.
+     */
+    uint64_t latencies[STATS_LATENCY_BUCKETS];
+};
+
+/**
+ * Lock-free ring buffer of per-second activity.
+ *
+ * Writers only issue relaxed atomic increments. A slot is recycled by the
+ * first writer of a new second, so a concurrent increment may rarely be lost
+ * while the slot is being reset.
+ */
+struct ControlStats {
+    /**
+     * The slots, indexed by second modulo STATS_SECONDS.
+     */
+    struct StatsSecond seconds[STATS_SECONDS];
+};
+
+/**
+ * Add to one of the current second's counters.
+ *
+ * @param stats The statistics to be updated.
+ *
+ * @param counter The counter to be incremented.
+ *
+ * @param amount  The amount to add.
+ */
+void control_stats_add(struct ControlStats* stats, enum StatsCounter counter,
+        uint64_t amount);
+
+/**
+ * Record a processed request in the current second.
+ *
+ * @param stats The statistics to be updated.
+ *
+ * @param kind  Either STATS_CHECK_INS or STATS_QUERIES.
+ *
+ * @param bytes The number of bytes received and sent for the request.
+ *
+ * @param micros  The request's processing time in microseconds.
+ */
+void control_stats_request(struct ControlStats* stats, enum StatsCounter kind,
+        uint64_t bytes, uint64_t micros);
+
+/**
+ * Get the time elapsed since the given instant in microseconds.
+ *
+ * @param start The instant, read from the monotonic clock.
+ */
+uint64_t control_stats_micros_since(const struct timespec* start);
+
+/**
+ * Get the reply to a "stats" request.
+ *
+ * Returns a text holding a "second:check-ins:queries:bytes:errors" line for
+ * every active second within the last STATS_SECONDS seconds, oldest first,
+ * then the lines "p50:", "p90:", "p99:" and "p999:" followed by the
+ * respective latency percentile's upper bound in microseconds over the same
+ * period and the closing ".\n". The caller has to free() the returned buffer.
+ * NULL is returned if no memory is left.
+ *
+ * @param stats The statistics to be replied.
+ *
+ * @param size  Output parameter, the length of the returned text.
+ */
+char* control_stats_reply(struct ControlStats* stats, size_t* size);
+
+#endif
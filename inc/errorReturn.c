@@ -14,7 +14,10 @@ const char* controlErrorTexts[] = {
         "Usage: control2310 id info [mapper]",
         "Invalid char in parameter",
         "Invalid port",
-        "Can not connect to map"
+        "Can not connect to map",
+        "Can not open journal",
+        "Can not load airports",
+        "Can not open shared log"
         };
 
 /**
@@ -27,7 +30,8 @@ const char* rocErrorTexts[] = {
         "Mapper required",
         "Failed to connect to mapper",
         "No map entry for destination",
-        "Failed to connect to at least one destination"
+        "Failed to connect to at least one destination",
+        "Can not load fleet"
         };
 
 void error_return_control(enum ControlErrorCodes code) {
@@ -19,7 +19,10 @@ enum ControlErrorCodes {
     E_CONTROL_INVALID_ARGS_COUNT = 1,
     E_CONTROL_INVALID_INFO = 2,
     E_CONTROL_INVALID_PORT = 3,
-    E_CONTROL_FAILED_TO_CONNECT = 4
+    E_CONTROL_FAILED_TO_CONNECT = 4,
+    E_CONTROL_INVALID_JOURNAL = 5,
+    E_CONTROL_INVALID_AIRPORTS = 6,
+    E_CONTROL_INVALID_SHARED_LOG = 7
 };
 
 /**
@@ -32,7 +35,8 @@ enum RocErrorCodes {
     E_ROC_MAPPER_REQUIRED = 3,
     E_ROC_FAILED_TO_CONNECT_MAPPER = 4,
     E_ROC_FAILED_TO_FIND_ENTRY = 5,
-    E_ROC_FAILED_TO_CONNECT_CONTROL = 6
+    E_ROC_FAILED_TO_CONNECT_CONTROL = 6,
+    E_ROC_INVALID_FLEET = 7
 };
 
 /**
@@ -11,6 +11,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "errorReturn.h"
 #include "protocol.h"
@@ -39,6 +40,9 @@ char** alloc_log(int rows, int columns) {
     bodySize = rows * columns * sizeof(char);
 
     row = (char**)malloc(headerSize + bodySize);
+    if (!row) {
+        return NULL;
+    }
     memset(row, 0, headerSize + bodySize);
 
     buf = (char*)(row + rows);
@@ -62,6 +66,26 @@ char** control_alloc_log(int rows, int columns) {
     return alloc_log(rows, columns);
 }
 
+/**
+ * Set if client connections are opened with TCP Fast Open.
+ */
+static int clientFastOpen = 0;
+
+/**
+ * Let a listening socket accept requests carried in the SYN.
+ *
+ * Clients only use TCP Fast Open if they opted in, otherwise this has no
+ * effect. Failure is ignored, as older kernels still accept the usual way.
+ *
+ * @param acceptSocket  The socket to be listened on.
+ */
+static void enable_fast_open_listener(int acceptSocket) {
+    int queue = TCP_FASTOPEN_QUEUE;
+
+    setsockopt(acceptSocket, IPPROTO_TCP, TCP_FASTOPEN, (void*)&queue,
+            sizeof(queue));
+}
+
 /**
  * Create a server-like socket and wait for incoming connections.
  *
@@ -86,6 +110,7 @@ int open_incoming_conn(int* port) {
     }
     setsockopt(acceptSocket, SOL_SOCKET, SO_REUSEADDR, (void*)&enable,
             sizeof(enable));
+    enable_fast_open_listener(acceptSocket);
 
     acceptAddress.sin_family = AF_INET;
     acceptAddress.sin_addr.s_addr = INADDR_ANY;
@@ -110,6 +135,56 @@ int mapper_open_incoming_conn(int* port) {
     return open_incoming_conn(port);
 }
 
+int control_open_shared_conn(int* port) {
+    int acceptSocket = 0;
+    int enable = 1;
+    struct sockaddr_in acceptAddress;
+    socklen_t addressSize = sizeof(struct sockaddr_in);
+
+    memset(&acceptAddress, 0, addressSize);
+
+    acceptSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (0 > acceptSocket) {
+        return -1;
+    }
+    setsockopt(acceptSocket, SOL_SOCKET, SO_REUSEADDR, (void*)&enable,
+            sizeof(enable));
+    setsockopt(acceptSocket, SOL_SOCKET, SO_REUSEPORT, (void*)&enable,
+            sizeof(enable));
+    enable_fast_open_listener(acceptSocket);
+
+    acceptAddress.sin_family = AF_INET;
+    acceptAddress.sin_addr.s_addr = INADDR_ANY;
+    acceptAddress.sin_port = htons((uint16_t)*port);
+    if (0 != bind(acceptSocket, (struct sockaddr*)(&acceptAddress),
+            addressSize)
+            || 0 != getsockname(acceptSocket,
+                    (struct sockaddr*)(&acceptAddress), &addressSize)) {
+        close(acceptSocket);
+        return -1;
+    }
+    *port = ntohs(acceptAddress.sin_port);
+
+    return acceptSocket;
+}
+
+void set_client_fast_open(int enabled) {
+    clientFastOpen = enabled;
+}
+
+void tune_client_conn(int clientSocket) {
+    int enable = 1;
+
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (void*)&enable,
+            sizeof(enable));
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_QUICKACK, (void*)&enable,
+            sizeof(enable));
+    if (clientFastOpen) {
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+                (void*)&enable, sizeof(enable));
+    }
+}
+
 /**
  * Open a connection to the given server.
  *
@@ -129,6 +204,7 @@ int open_client_conn(int port) {
     if (0 > clientSocket) {
         return -1;
     }
+    tune_client_conn(clientSocket);
 
     clientAddress.sin_family = AF_INET;
     clientAddress.sin_addr.s_addr = INADDR_ANY;
@@ -136,6 +212,7 @@ int open_client_conn(int port) {
 
     if (0 > connect(clientSocket, (struct sockaddr*)&clientAddress,
             addressSize)) {
+        close(clientSocket);
         return -1;
     }
 
@@ -372,6 +449,13 @@ int roc_find_destination_port(int mapperPort, const char* destination, long
         return E_ROC_FAILED_TO_CONNECT_MAPPER;
     }
 
+    /*An overloaded mapper is as good as an unreachable one*/
+    if (0 == strcmp(SERVER_BUSY_REPLY, buffer)) {
+        fclose(streamToMapper);
+        control_close_conn(mapperSocket);
+        return E_ROC_FAILED_TO_CONNECT_MAPPER;
+    }
+
     *controlPort = (int)strtol(buffer, &end, 10);
 
     if ('\n' != *end || *controlPort <= 0 || 65535 < *controlPort) {
@@ -433,6 +517,10 @@ void mapper_trim_string_end(char* text) {
     trim_string_end(text);
 }
 
+void control_trim_string_end(char* text) {
+    trim_string_end(text);
+}
+
 int open_socket_stream(int socketNumber, FILE** stream) {
     *stream = fdopen(socketNumber, "r+");
 
@@ -443,6 +531,98 @@ int open_socket_stream(int socketNumber, FILE** stream) {
     return EXIT_SUCCESS;
 }
 
+void init_line_reader(struct LineReader* reader, int socketNumber) {
+    reader->socketNumber = socketNumber;
+    reader->start = 0;
+    reader->end = 0;
+}
+
+int has_buffered_line(const struct LineReader* reader) {
+    return NULL != memchr(reader->buffer + reader->start, '\n',
+            reader->end - reader->start);
+}
+
+int read_line(struct LineReader* reader, char* line, size_t size) {
+    char* found = NULL;
+    ssize_t received = 0;
+    size_t length = 0;
+    size_t copied = 0;
+    int discarding = 0;
+
+    while (1) {
+        found = (char*)memchr(reader->buffer + reader->start, '\n',
+                reader->end - reader->start);
+        length = (found ? (size_t)(found - reader->buffer) : reader->end)
+                - reader->start;
+
+        if (!discarding) {
+            copied = MIN(length, size - 1);
+            memcpy(line, reader->buffer + reader->start, copied);
+            line[copied] = '\0';
+        }
+
+        if (found) {
+            reader->start += length + 1;
+            return (int)copied;
+        }
+
+        if (length >= size - 1 || LINE_READER_SIZE == length) {
+            /*Drop the overlong line's remainder*/
+            discarding = 1;
+            reader->start = 0;
+            reader->end = 0;
+        } else if (0 < reader->start) {
+            memmove(reader->buffer, reader->buffer + reader->start, length);
+            reader->start = 0;
+            reader->end = length;
+        }
+
+        received = recv(reader->socketNumber, reader->buffer + reader->end,
+                LINE_READER_SIZE - reader->end, 0);
+        if (0 > received && EINTR == errno) {
+            continue;
+        }
+        if (0 == received && !discarding && 0 < length) {
+            /*Hand out the final line lacking its LF*/
+            reader->start = reader->end;
+            return (int)copied;
+        }
+        if (0 >= received) {
+            /*A timeout or error drops the partial line, it may be cut off*/
+            reader->start = 0;
+            reader->end = 0;
+            return -1;
+        }
+        reader->end += (size_t)received;
+    }
+}
+
+int fill_line_reader(struct LineReader* reader) {
+    ssize_t received = 0;
+
+    if (0 < reader->start) {
+        memmove(reader->buffer, reader->buffer + reader->start,
+                reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    if (LINE_READER_SIZE == reader->end) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    do {
+        received = recv(reader->socketNumber, reader->buffer + reader->end,
+                LINE_READER_SIZE - reader->end, MSG_DONTWAIT);
+    } while (0 > received && EINTR == errno);
+
+    if (0 < received) {
+        reader->end += (size_t)received;
+    }
+    return (int)received;
+}
+
 int control_register_id(int mapperPort, int acceptPort, const char* id) {
     int success = E_CONTROL_OK;
     int mapperSocket = 0;
@@ -26,9 +26,10 @@
 #endif
 
 /**
- * The maximum amount of concurrently connected planes.
+ * The listen() backlog. The number of connections served at once is bounded
+ * by the admission control instead, which rejects the excess explicitly.
  */
-#define CONTROL_MAX_CONNECTIONS 16
+#define CONTROL_MAX_CONNECTIONS 4096
 
 /**
  * The maximum length of a plane's ID.
@@ -40,6 +41,193 @@
  */
 #define CONTROL_MAX_PLANE_COUNT 1024
 
+/**
+ * The environment variable naming the control's optional visit journal.
+ */
+#define CONTROL_JOURNAL_ENV "CONTROL2310_JOURNAL"
+
+/**
+ * The environment variable naming the file of further airports, which are
+ * hosted by the same control process.
+ */
+#define CONTROL_AIRPORTS_ENV "CONTROL2310_AIRPORTS"
+
+/**
+ * The environment variable holding the number of worker threads serving the
+ * hosted airports.
+ */
+#define CONTROL_WORKERS_ENV "CONTROL2310_WORKERS"
+
+/**
+ * The environment variable enabling UDP check-ins at the control.
+ */
+#define CONTROL_UDP_ENV "CONTROL2310_UDP"
+
+/**
+ * The environment variable letting all controls of an airport share its
+ * visit log and port.
+ */
+#define CONTROL_SHARED_ENV "CONTROL2310_SHARED"
+
+/**
+ * The reply of a control or mapper, which is too busy to serve a connection.
+ * The connection is closed afterwards.
+ */
+#define SERVER_BUSY_REPLY "busy\n"
+
+/**
+ * The environment variable holding the number of connections the control
+ * serves at once.
+ */
+#define CONTROL_MAX_CLIENTS_ENV "CONTROL2310_MAX_CLIENTS"
+
+/**
+ * The environment variable holding the number of connections waiting for
+ * the control, before further ones are rejected as busy.
+ */
+#define CONTROL_QUEUE_ENV "CONTROL2310_QUEUE"
+
+/**
+ * The environment variable holding the number of threads serving the
+ * control's planes.
+ */
+#define CONTROL_POOL_ENV "CONTROL2310_POOL"
+
+/**
+ * The environment variable holding the time in milliseconds a control's
+ * plane may stay idle, before its connection is closed.
+ */
+#define CONTROL_IDLE_ENV "CONTROL2310_IDLE"
+
+/**
+ * The environment variable selecting the control's I/O backend.
+ */
+#define CONTROL_IO_ENV "CONTROL2310_IO"
+
+/**
+ * The value of CONTROL_IO_ENV selecting the io_uring backend, planes are
+ * served by threads else.
+ */
+#define CONTROL_IO_URING "uring"
+
+/**
+ * The environment variable holding the number of connections the mapper
+ * serves at once.
+ */
+#define MAPPER_MAX_CLIENTS_ENV "MAPPER2310_MAX_CLIENTS"
+
+/**
+ * The environment variable holding the number of connections waiting for
+ * the mapper, before further ones are rejected as busy.
+ */
+#define MAPPER_QUEUE_ENV "MAPPER2310_QUEUE"
+
+/**
+ * The environment variable holding the number of threads serving the
+ * mapper's clients.
+ */
+#define MAPPER_POOL_ENV "MAPPER2310_POOL"
+
+/**
+ * The environment variable holding the time in milliseconds a mapper's
+ * client may stay idle, before its connection is closed.
+ */
+#define MAPPER_IDLE_ENV "MAPPER2310_IDLE"
+
+/**
+ * The environment variable enabling UDP check-ins at the roc.
+ */
+#define ROC_UDP_ENV "ROC2310_UDP"
+
+/**
+ * The environment variable holding the number of destinations the roc visits
+ * at once.
+ */
+#define ROC_PARALLEL_ENV "ROC2310_PARALLEL"
+
+/**
+ * The environment variable holding the time in milliseconds a single visit
+ * of the roc may take.
+ */
+#define ROC_HOP_TIMEOUT_ENV "ROC2310_HOP_TIMEOUT"
+
+/**
+ * The environment variable holding the time in milliseconds all visits of
+ * the roc's route may take.
+ */
+#define ROC_ROUTE_TIMEOUT_ENV "ROC2310_ROUTE_TIMEOUT"
+
+/**
+ * The environment variable holding the path of the roc's resolution cache
+ * file, which is shared by all rocs using the same path.
+ */
+#define ROC_CACHE_ENV "ROC2310_CACHE"
+
+/**
+ * The environment variable holding the time in seconds a cached resolution
+ * stays valid.
+ */
+#define ROC_CACHE_TTL_ENV "ROC2310_CACHE_TTL"
+
+/**
+ * The environment variable holding the path of a file of further planes the
+ * roc flies along with the command line's one.
+ */
+#define ROC_FLEET_ENV "ROC2310_FLEET"
+
+/**
+ * The environment variable asking the roc to report the combined visitors
+ * of the controls its fleet visited.
+ */
+#define ROC_VISITORS_ENV "ROC2310_VISITORS"
+
+/**
+ * The environment variable holding the path of the Unix socket, at which
+ * the roc's agent listens.
+ */
+#define ROC_AGENT_ENV "ROC2310_AGENT"
+
+/**
+ * The environment variable holding the number of routes the roc's agent
+ * flies at once.
+ */
+#define ROC_AGENT_THREADS_ENV "ROC2310_AGENT_THREADS"
+
+/**
+ * The environment variable naming the file, which the roc appends its
+ * per-hop timings to, "-" for stderr.
+ */
+#define ROC_TIMINGS_ENV "ROC2310_TIMINGS"
+
+/**
+ * The environment variable enabling TCP Fast Open on the roc's connections.
+ */
+#define ROC_FASTOPEN_ENV "ROC2310_FASTOPEN"
+
+/**
+ * The environment variable holding the comma separated port numbers of
+ * further mappers, which the roc's lookups are hedged to.
+ */
+#define ROC_MAPPERS_ENV "ROC2310_MAPPERS"
+
+/**
+ * The environment variable holding the time in milliseconds the roc waits
+ * for a mapper, before the next one is asked too.
+ */
+#define ROC_HEDGE_ENV "ROC2310_HEDGE"
+
+/**
+ * The environment variable enabling TCP Fast Open on the control's
+ * connections to the mapper.
+ */
+#define CONTROL_FASTOPEN_ENV "CONTROL2310_FASTOPEN"
+
+/**
+ * The number of connections, whose SYN carried a request, a listener queues
+ * before the handshake completes.
+ */
+#define TCP_FASTOPEN_QUEUE 256
+
 /**
  * The maximum number of destinations that can be logged.
  */
@@ -51,7 +239,7 @@
 #define ROC_MAX_INFO_SIZE 80
 
 /**
- * The maximum number of controls, that the map can hold.
+ * The initial number of controls, that the map can hold. It grows on demand.
  */
 #define MAPPER_MAX_CONTROL_COUNT 1024
 
@@ -60,6 +248,39 @@
  */
 #define MAPPER_MAX_ID_SIZE 80
 
+/**
+ * The size of a socket line reader's receive buffer.
+ */
+#define LINE_READER_SIZE 4096
+
+/**
+ * Buffered reader splitting the data received on a socket into lines.
+ *
+ * Unlike a file stream, it tells whether another complete line is already
+ * buffered, so replies to pipelined requests can be flushed in batches.
+ */
+struct LineReader {
+    /**
+     * The socket to read from.
+     */
+    int socketNumber;
+
+    /**
+     * The received, not yet consumed data is buffer[start] to buffer[end].
+     */
+    size_t start;
+
+    /**
+     * The end of the received data.
+     */
+    size_t end;
+
+    /**
+     * The receive buffer.
+     */
+    char buffer[LINE_READER_SIZE];
+};
+
 /**
  * Allocate a map of airports and port numbers.
  *
@@ -132,6 +353,43 @@ int control_open_incoming_conn(int* port);
  */
 int mapper_open_incoming_conn(int* port);
 
+/**
+ * Create a server-like socket, whose port can be shared by other processes.
+ *
+ * Returns the socket's file descriptor, which is bound with SO_REUSEPORT, so
+ * the kernel spreads incoming connections across all processes listening on
+ * the port. In case of an error, -1 is returned.
+ *
+ * @param port  Input and output parameter, the port number to be bound or 0
+ *              for an ephemeral port. It is set to the bound port number.
+ */
+int control_open_shared_conn(int* port);
+
+/**
+ * Enable or disable TCP Fast Open for client connections opened afterwards.
+ *
+ * Once a server's cookie is known, the first request travels in the SYN,
+ * saving a round trip per connection. The kernel has to allow it, i.e.
+ * net.ipv4.tcp_fastopen has to include 1 for clients and 2 for servers,
+ * else the usual handshake is used.
+ *
+ * @param enabled 1 to use TCP Fast Open, 0 else.
+ */
+void set_client_fast_open(int enabled);
+
+/**
+ * Tune a client socket before it is connected.
+ *
+ * TCP_NODELAY and TCP_QUICKACK are set, as requests and replies are single
+ * small lines, which must neither wait for Nagle's algorithm nor for a
+ * delayed ACK. TCP_FASTOPEN_CONNECT is set if set_client_fast_open() enabled
+ * it, so connect() returns right away and the first send() opens the
+ * connection.
+ *
+ * @param clientSocket  The socket to be tuned.
+ */
+void tune_client_conn(int clientSocket);
+
 /**
  * Open connection to the given destination airport.
  *
@@ -287,6 +545,13 @@ void roc_trim_string_end(char* text);
  */
 void mapper_trim_string_end(char* text);
 
+/**
+ * Remove the trailing LF from the given string if present.
+ *
+ * @param text  The string to be trimmed.
+ */
+void control_trim_string_end(char* text);
+
 /**
  * Open a stream object from the given client socket.
  *
@@ -300,6 +565,52 @@ void mapper_trim_string_end(char* text);
  */
 int open_socket_stream(int socketNumber, FILE** stream);
 
+/**
+ * Prepare a line reader for the given socket.
+ *
+ * @param reader  The line reader to be initialized.
+ *
+ * @param socketNumber  The socket to read from.
+ */
+void init_line_reader(struct LineReader* reader, int socketNumber);
+
+/**
+ * Check if a complete line has been received, but not yet read.
+ *
+ * Returns 1 if read_line() will not block, 0 else.
+ *
+ * @param reader  The line reader to be checked.
+ */
+int has_buffered_line(const struct LineReader* reader);
+
+/**
+ * Read the next line from the socket.
+ *
+ * Returns the length of the line without trailing LF, which is stripped, or
+ * -1 on EOF or error. A line longer than size - 1 characters is truncated and
+ * the rest of it is discarded. A final line lacking its LF is only handed out
+ * on EOF; if receiving fails, e.g. on a receive timeout, it is discarded.
+ *
+ * @param reader  The line reader to read from.
+ *
+ * @param line  Output parameter, the buffer receiving the NUL-terminated
+ *              line.
+ *
+ * @param size  The size of line in bytes.
+ */
+int read_line(struct LineReader* reader, char* line, size_t size);
+
+/**
+ * Receive the data already available on the socket without blocking.
+ *
+ * Returns the number of bytes received, 0 on EOF or -1 if nothing is
+ * available or on error, errno tells which. If the buffer is filled by an
+ * incomplete line, -1 is returned and errno is set to ENOBUFS.
+ *
+ * @param reader  The line reader to fill.
+ */
+int fill_line_reader(struct LineReader* reader);
+
 /**
  * Register the airport's port number with the mapper.
  *
@@ -0,0 +1,156 @@
+/*
+ *registration.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "errorReturn.h"
+#include "protocol.h"
+#include "registration.h"
+
+int control_register_batch(FILE* streamToMapper,
+        const struct Registration* registration) {
+    char buffer[ROC_MAX_INFO_SIZE + 1];
+    char* end = NULL;
+    long port = 0;
+    int first = 0;
+    int last = 0;
+    int i = 0;
+
+    for (first = 0; first < registration->count; first = last) {
+        last = MIN(first + REGISTRATION_BATCH_SIZE, registration->count);
+
+        for (i = first; i < last; i++) {
+            fprintf(streamToMapper, "!%s:%d\n", registration->ids[i],
+                    registration->ports[i]);
+        }
+        for (i = first; i < last; i++) {
+            fprintf(streamToMapper, "?%s\n", registration->ids[i]);
+        }
+        if (0 != fflush(streamToMapper)) {
+            return E_CONTROL_FAILED_TO_CONNECT;
+        }
+
+        for (i = first; i < last; i++) {
+            if (!fgets(buffer, sizeof(buffer), streamToMapper)) {
+                return E_CONTROL_FAILED_TO_CONNECT;
+            }
+
+            /*Another control may own the ID, only a missing one is fatal*/
+            port = strtol(buffer, &end, 10);
+            if ('\n' != *end || port <= 0 || 65535 < port) {
+                return E_CONTROL_FAILED_TO_CONNECT;
+            }
+        }
+    }
+
+    return E_CONTROL_OK;
+}
+
+/**
+ * Sleep for a random time up to the given delay (full jitter).
+ *
+ * @param delay The maximum delay in milliseconds.
+ *
+ * @param seed  The state of the random number generator.
+ */
+static void sleep_jittered(int delay, unsigned int* seed) {
+    struct timespec duration;
+    long sleepMs = (long)(rand_r(seed) % (delay + 1));
+
+    duration.tv_sec = sleepMs / 1000;
+    duration.tv_nsec = (sleepMs % 1000) * 1000000L;
+    nanosleep(&duration, NULL);
+}
+
+/**
+ * Wait until the registrations are due for renewal.
+ *
+ * Returns 1 if the registrations need to be renewed over the same connection,
+ * 0 if the mapper closed the connection, e.g. because it restarted.
+ *
+ * @param mapperSocket  The socket connected to the mapper.
+ */
+static int wait_for_renewal(int mapperSocket) {
+    struct pollfd waiting;
+    char buffer[64];
+
+    waiting.fd = mapperSocket;
+    waiting.events = POLLIN;
+    waiting.revents = 0;
+
+    if (0 == poll(&waiting, 1, REGISTRATION_RENEW_MS)) {
+        return 1;
+    }
+
+    /*The mapper never talks unasked, so this is EOF or an error*/
+    return 0 < recv(mapperSocket, buffer, sizeof(buffer), MSG_DONTWAIT);
+}
+
+/**
+ * The registration thread's starting point.
+ *
+ * Keeps the airports registered for the lifetime of the program.
+ *
+ * @param parameter The airports to be registered.
+ */
+static void* registration_main(void* parameter) {
+    struct Registration* registration = (struct Registration*)parameter;
+    unsigned int seed = (unsigned int)(time(NULL) ^ getpid()
+            ^ (unsigned long)registration);
+    int delay = REGISTRATION_BACKOFF_MIN_MS;
+    int mapperSocket = 0;
+    FILE* streamToMapper = NULL;
+
+    while (1) {
+        mapperSocket = control_open_mapper_conn(registration->mapperPort);
+        if (0 > mapperSocket) {
+            sleep_jittered(delay, &seed);
+            delay = MIN(2 * delay, REGISTRATION_BACKOFF_MAX_MS);
+            continue;
+        }
+
+        if (EXIT_SUCCESS != open_socket_stream(mapperSocket,
+                &streamToMapper)) {
+            control_close_conn(mapperSocket);
+            sleep_jittered(delay, &seed);
+            delay = MIN(2 * delay, REGISTRATION_BACKOFF_MAX_MS);
+            continue;
+        }
+
+        while (E_CONTROL_OK == control_register_batch(streamToMapper,
+                registration)) {
+            delay = REGISTRATION_BACKOFF_MIN_MS;
+            if (!wait_for_renewal(mapperSocket)) {
+                break;
+            }
+        }
+
+        fclose(streamToMapper);
+        sleep_jittered(delay, &seed);
+        delay = MIN(2 * delay, REGISTRATION_BACKOFF_MAX_MS);
+    }
+
+    return NULL;
+}
+
+int control_start_registration(struct Registration* registration) {
+    pthread_attr_t options;
+    int success = 0;
+
+    pthread_attr_init(&options);
+    pthread_attr_setdetachstate(&options, PTHREAD_CREATE_DETACHED);
+
+    success = pthread_create(&registration->thread, &options,
+            registration_main, registration);
+
+    pthread_attr_destroy(&options);
+    return (0 == success) ? E_CONTROL_OK : E_CONTROL_FAILED_TO_CONNECT;
+}
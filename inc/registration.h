@@ -0,0 +1,94 @@
+/*
+ *registration.h
+ */
+
+#pragma once
+
+#ifndef REGISTRATION_H
+#define REGISTRATION_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+/**
+ * The initial delay before retrying a failed registration in milliseconds.
+ */
+#define REGISTRATION_BACKOFF_MIN_MS 50
+
+/**
+ * The maximum delay before retrying a failed registration in milliseconds.
+ */
+#define REGISTRATION_BACKOFF_MAX_MS 5000
+
+/**
+ * The interval, in which registrations are renewed in milliseconds.
+ */
+#define REGISTRATION_RENEW_MS 10000
+
+/**
+ * The maximum number of registrations sent before their replies are read.
+ */
+#define REGISTRATION_BATCH_SIZE 256
+
+/**
+ * The airports, which are kept registered with a mapper in the background.
+ */
+struct Registration {
+    /**
+     * The port number at which the mapper is listening.
+     */
+    int mapperPort;
+
+    /**
+     * The number of airports to be registered.
+     */
+    int count;
+
+    /**
+     * The airport IDs to be registered.
+     */
+    const char** ids;
+
+    /**
+     * The airports' port numbers, ports[i] belongs to ids[i].
+     */
+    const int* ports;
+
+    /**
+     * The background thread.
+     */
+    pthread_t thread;
+};
+
+/**
+ * Register airports with the mapper in the background.
+ *
+ * A background thread registers all airports over one persistent mapper
+ * connection. Failed attempts are retried with jittered exponential backoff.
+ * The registrations are verified and renewed periodically, so they are
+ * restored automatically if the mapper restarts. The given registration and
+ * the arrays it points to must stay valid while the program runs.
+ *
+ * Returns E_CONTROL_OK on success, E_CONTROL_FAILED_TO_CONNECT if the thread
+ * cannot be started.
+ *
+ * @param registration  The airports to be registered.
+ */
+int control_start_registration(struct Registration* registration);
+
+/**
+ * Register airports over an established mapper connection.
+ *
+ * Registrations and look-ups are pipelined in chunks of
+ * REGISTRATION_BATCH_SIZE airports, so a chunk costs a single round trip.
+ * Returns E_CONTROL_OK if the mapper replies a port number for
+ * each airport afterwards, E_CONTROL_FAILED_TO_CONNECT else.
+ *
+ * @param streamToMapper  The file stream connected to the mapper.
+ *
+ * @param registration  The airports to be registered.
+ */
+int control_register_batch(FILE* streamToMapper,
+        const struct Registration* registration);
+
+#endif
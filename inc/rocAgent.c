@@ -0,0 +1,604 @@
+/*
+ *rocAgent.c
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "errorReturn.h"
+#include "protocol.h"
+#include "rocAgent.h"
+
+/**
+ * The maximum number of destinations accepted in a single route.
+ */
+#define AGENT_MAX_DESTINATIONS (1 << 24)
+
+/**
+ * The prefixes of the agent's reply lines by enum FlightStream.
+ */
+#define AGENT_PREFIXES "iet"
+
+/**
+ * Fill in the address of the agent's Unix socket.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE if path is too long.
+ *
+ * @param address Output parameter, receives the address.
+ *
+ * @param path  The path of the agent's Unix socket.
+ */
+static int agent_address(struct sockaddr_un* address, const char* path) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (sizeof(address->sun_path) <= strlen(path)) {
+        return EXIT_FAILURE;
+    }
+    strcpy(address->sun_path, path);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Connect to the agent's Unix socket.
+ *
+ * Returns the connected socket, -1 if no agent listens at path.
+ *
+ * @param path  The path of the agent's Unix socket.
+ */
+static int connect_agent(const char* path) {
+    struct sockaddr_un address;
+    int agentSocket = -1;
+
+    if (EXIT_SUCCESS != agent_address(&address, path)) {
+        return -1;
+    }
+    agentSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (0 > agentSocket) {
+        return -1;
+    }
+    if (0 != connect(agentSocket, (struct sockaddr*)&address,
+            sizeof(address))) {
+        close(agentSocket);
+        return -1;
+    }
+    return agentSocket;
+}
+
+/**
+ * Open a write stream on a copy of a socket, which stays open on fclose().
+ *
+ * Returns the stream, NULL on error.
+ *
+ * @param agentSocket The connected socket.
+ */
+static FILE* open_write_stream(int agentSocket) {
+    FILE* stream = NULL;
+    int copy = dup(agentSocket);
+
+    if (0 > copy) {
+        return NULL;
+    }
+    if (EXIT_SUCCESS != open_socket_stream(copy, &stream)) {
+        close(copy);
+        return NULL;
+    }
+    return stream;
+}
+
+/**
+ * Send a route to the agent.
+ *
+ * The request is the plane's ID, a line of the hedge delay, the number of
+ * mappers and their port numbers, a line of the flight's settings and the
+ * number of destinations, followed by a line per destination. Returns
+ * EXIT_SUCCESS on success, EXIT_FAILURE else.
+ *
+ * @param agentSocket The connection to the agent.
+ *
+ * @param flight  The flight, whose settings are sent.
+ *
+ * @param destinations  The route's destinations.
+ *
+ * @param count The number of destinations.
+ */
+static int send_route(int agentSocket, const struct RouteFlight* flight,
+        char** destinations, int count) {
+    FILE* request = NULL;
+    int failed = 0;
+    int i = 0;
+
+    request = open_write_stream(agentSocket);
+    if (!request) {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(request, "%s\n%d %d", flight->planeId,
+            flight->mappers.hedgeMillis, flight->mappers.count);
+    for (i = 0; i < flight->mappers.count; i++) {
+        fprintf(request, " %d", flight->mappers.ports[i]);
+    }
+    fprintf(request, "\n%d %d %d %d %d %d\n", flight->parallel,
+            flight->useDatagrams, flight->deadlines.hopMillis,
+            flight->deadlines.routeMillis, flight->timed, count);
+    for (i = 0; i < count; i++) {
+        fprintf(request, "%s\n", destinations[i]);
+    }
+    failed = 0 != fflush(request) || ferror(request);
+    fclose(request);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int roc_agent_fly(const char* path, const struct RouteFlight* flight,
+        char** destinations, int count) {
+    char line[LINE_READER_SIZE];
+    struct LineReader reader;
+    const char* kind = NULL;
+    int agentSocket = -1;
+    int result = -1;
+    int replies = 0;
+    int i = 0;
+
+    /*Arguments, which do not fit a line of the agent, are flown locally*/
+    if (LINE_READER_SIZE <= strlen(flight->planeId)) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (LINE_READER_SIZE <= strlen(destinations[i])) {
+            return -1;
+        }
+    }
+
+    agentSocket = connect_agent(path);
+    if (0 > agentSocket) {
+        return -1;
+    }
+    if (EXIT_SUCCESS != send_route(agentSocket, flight, destinations,
+            count)) {
+        close(agentSocket);
+        return -1;
+    }
+
+    /*Replies are output lines prefixed by their kind, then "x:<result>"*/
+    init_line_reader(&reader, agentSocket);
+    while (0 > result && 0 <= read_line(&reader, line, sizeof(line))) {
+        replies += 1;
+        kind = strchr(AGENT_PREFIXES, line[0]);
+        if ('x' == line[0]) {
+            result = (int)strtol(line + 2, NULL, 10);
+        } else if (kind && '\0' != line[0] && ':' == line[1]) {
+            flight->output(flight->context,
+                    (enum FlightStream)(kind - AGENT_PREFIXES), line + 2);
+        }
+    }
+    close(agentSocket);
+
+    /*An agent, which died midway, cannot be retried without repeating infos*/
+    if (0 > result && 0 < replies) {
+        result = E_ROC_FAILED_TO_CONNECT_CONTROL;
+    }
+    return result;
+}
+
+void roc_agent_spawn(const char* path) {
+    pid_t child = fork();
+    int devNull = -1;
+    int fd = 0;
+
+    if (0 > child) {
+        return;
+    }
+    if (0 < child) {
+        waitpid(child, NULL, 0);
+        return;
+    }
+
+    /*The grandchild is adopted by init and leaves the terminal's session*/
+    if (0 != fork()) {
+        _exit(EXIT_SUCCESS);
+    }
+    setsid();
+
+    devNull = open("/dev/null", O_RDWR);
+    if (0 <= devNull) {
+        dup2(devNull, STDIN_FILENO);
+        dup2(devNull, STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+    }
+    /*Pipes inherited from the caller's caller must not be kept open*/
+    for (fd = STDERR_FILENO + 1; fd < 1024; fd++) {
+        close(fd);
+    }
+    _exit(roc_agent_serve(path, AGENT_IDLE_SECONDS));
+}
+
+/**
+ * Relay a line of a flight's output to the roc.
+ *
+ * @param context The stream to the roc.
+ *
+ * @param stream  The kind of the line, its reply's prefix.
+ *
+ * @param text  The line without trailing LF.
+ */
+static void relay_output(void* context, enum FlightStream stream,
+        const char* text) {
+    FILE* reply = (FILE*)context;
+
+    fprintf(reply, "%c:%s\n", AGENT_PREFIXES[stream], text);
+    fflush(reply);
+}
+
+/**
+ * Read a route's mappers from a roc into the flight.
+ *
+ * Returns 0 on success, -1 if the request is invalid.
+ *
+ * @param reader  The connection to the roc.
+ *
+ * @param flight  The flight to be set up.
+ */
+static int read_mappers(struct LineReader* reader,
+        struct RouteFlight* flight) {
+    struct MapperList* mappers = &flight->mappers;
+    char line[LINE_READER_SIZE];
+    int offset = 0;
+    int length = 0;
+    int i = 0;
+
+    if (0 > read_line(reader, line, sizeof(line))
+            || 2 != sscanf(line, "%d %d%n", &mappers->hedgeMillis,
+            &mappers->count, &offset)
+            || mappers->hedgeMillis < 0 || mappers->count < 0
+            || ROUTE_MAX_MAPPERS < mappers->count) {
+        return -1;
+    }
+    for (i = 0; i < mappers->count; i++) {
+        if (1 != sscanf(line + offset, " %d%n", &mappers->ports[i], &length)
+                || mappers->ports[i] <= 0 || 65535 < mappers->ports[i]) {
+            return -1;
+        }
+        offset += length;
+    }
+    return 0;
+}
+
+/**
+ * Read a route's settings from a roc into the flight.
+ *
+ * Returns the number of destinations, -1 if the request is invalid.
+ *
+ * @param reader  The connection to the roc.
+ *
+ * @param flight  The flight to be set up.
+ */
+static int read_settings(struct LineReader* reader,
+        struct RouteFlight* flight) {
+    char line[LINE_READER_SIZE];
+    int count = 0;
+
+    if (0 > read_line(reader, line, sizeof(line))
+            || 6 != sscanf(line, "%d %d %d %d %d %d", &flight->parallel,
+            &flight->useDatagrams, &flight->deadlines.hopMillis,
+            &flight->deadlines.routeMillis, &flight->timed, &count)
+            || flight->deadlines.hopMillis < 0
+            || flight->deadlines.routeMillis < 0
+            || count < 0 || AGENT_MAX_DESTINATIONS < count) {
+        return -1;
+    }
+    flight->parallel = MIN(MAX(1, flight->parallel), ROUTE_MAX_PARALLEL);
+    return count;
+}
+
+/**
+ * Read a route's destinations from a roc.
+ *
+ * Returns the destinations, NULL if the request is invalid. The caller has
+ * to free them with free_destinations().
+ *
+ * @param reader  The connection to the roc.
+ *
+ * @param count The number of destinations.
+ */
+static char** read_destinations(struct LineReader* reader, int count) {
+    char line[LINE_READER_SIZE];
+    char** destinations = (char**)calloc(MAX(1, count), sizeof(char*));
+    int i = 0;
+
+    for (i = 0; destinations && i < count; i++) {
+        if (0 > read_line(reader, line, sizeof(line))) {
+            break;
+        }
+        destinations[i] = strdup(line);
+        if (!destinations[i]) {
+            break;
+        }
+    }
+    if (destinations && i < count) {
+        while (0 < i) {
+            free(destinations[--i]);
+        }
+        free(destinations);
+        return NULL;
+    }
+    return destinations;
+}
+
+/**
+ * Free the destinations returned by read_destinations().
+ *
+ * @param destinations  The destinations.
+ *
+ * @param count The number of destinations.
+ */
+static void free_destinations(char** destinations, int count) {
+    int i = 0;
+
+    for (i = 0; destinations && i < count; i++) {
+        free(destinations[i]);
+    }
+    free(destinations);
+}
+
+/**
+ * Fly the route a roc handed over and relay the output.
+ *
+ * @param agent The agent flying the route.
+ *
+ * @param client  The connection to the roc.
+ */
+static void serve_client(struct RocAgent* agent, int client) {
+    char planeId[LINE_READER_SIZE];
+    struct LineReader reader;
+    struct RouteFlight flight;
+    char** destinations = NULL;
+    FILE* reply = NULL;
+    int success = E_ROC_OK;
+    int count = -1;
+
+    reply = open_write_stream(client);
+    if (!reply) {
+        return;
+    }
+    init_line_reader(&reader, client);
+
+    if (0 <= read_line(&reader, planeId, sizeof(planeId))) {
+        roc_flight_init(&flight, planeId, 0, relay_output, reply);
+        count = 0 == read_mappers(&reader, &flight)
+                ? read_settings(&reader, &flight) : -1;
+    }
+    if (0 <= count) {
+        destinations = read_destinations(&reader, count);
+    }
+    if (!destinations) {
+        fclose(reply);
+        return;
+    }
+
+    flight.cache = agent->cache;
+    flight.pool = &agent->pool;
+    success = roc_flight_resolve(&flight, destinations, count);
+    if (E_ROC_OK == success) {
+        success = roc_flight_visit(&flight);
+    }
+    fprintf(reply, "x:%d\n", success);
+
+    roc_flight_free(&flight);
+    free_destinations(destinations, count);
+    fclose(reply);
+}
+
+/**
+ * Get the monotonic clock's time in seconds.
+ */
+static int64_t now_seconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec;
+}
+
+/**
+ * Check if the agent has waited for a route long enough.
+ *
+ * @param agent The agent to be checked.
+ */
+static int is_idle(struct RocAgent* agent) {
+    return 0 == __atomic_load_n(&agent->busy, __ATOMIC_ACQUIRE)
+            && agent->idleSeconds <= now_seconds()
+            - __atomic_load_n(&agent->lastActive, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Accept rocs and fly their routes until the agent is idle.
+ *
+ * Once a thread finds the agent idle, the listener is shut down, so the
+ * other threads return too.
+ *
+ * @param arg The agent.
+ */
+static void* serve_clients(void* arg) {
+    struct RocAgent* agent = (struct RocAgent*)arg;
+    int client = -1;
+
+    while (1) {
+        client = accept4(agent->listener, NULL, NULL, SOCK_CLOEXEC);
+        if (0 > client) {
+            if (EINTR == errno || ((EAGAIN == errno || EWOULDBLOCK == errno)
+                    && !is_idle(agent))) {
+                continue;
+            }
+            break;
+        }
+
+        __atomic_add_fetch(&agent->busy, 1, __ATOMIC_ACQ_REL);
+        serve_client(agent, client);
+        close(client);
+        __atomic_store_n(&agent->lastActive, now_seconds(),
+                __ATOMIC_RELEASE);
+        __atomic_sub_fetch(&agent->busy, 1, __ATOMIC_ACQ_REL);
+    }
+
+    shutdown(agent->listener, SHUT_RDWR);
+    return NULL;
+}
+
+/**
+ * Get the number of threads flying routes from ROC_AGENT_THREADS_ENV.
+ */
+static int agent_threads() {
+    const char* value = getenv(ROC_AGENT_THREADS_ENV);
+    long threads = value ? strtol(value, NULL, 10) : AGENT_DEFAULT_THREADS;
+
+    return (int)MIN(MAX(1, threads), AGENT_MAX_THREADS);
+}
+
+/**
+ * Open the agent's resolution cache.
+ *
+ * Returns the cache, NULL if it cannot be opened.
+ *
+ * @param path  The path of the agent's Unix socket.
+ */
+static struct RouteCache* open_agent_cache(const char* path) {
+    struct RouteCache* cache = roc_cache_open_env();
+    char* cachePath = NULL;
+
+    if (cache) {
+        return cache;
+    }
+    cachePath = (char*)malloc(strlen(path) + sizeof(".cache"));
+    if (!cachePath) {
+        return NULL;
+    }
+    sprintf(cachePath, "%s.cache", path);
+    cache = roc_cache_open(cachePath, ROUTE_CACHE_DEFAULT_TTL);
+    free(cachePath);
+    return cache;
+}
+
+/**
+ * Take the lock, which makes an agent the only one serving at path.
+ *
+ * Returns the locked file, -1 if another agent holds the lock.
+ *
+ * @param path  The path of the agent's Unix socket.
+ */
+static int lock_agent(const char* path) {
+    char* lockPath = (char*)malloc(strlen(path) + sizeof(".lock"));
+    int lock = -1;
+
+    if (!lockPath) {
+        return -1;
+    }
+    sprintf(lockPath, "%s.lock", path);
+    lock = open(lockPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    free(lockPath);
+
+    if (0 <= lock && 0 != flock(lock, LOCK_EX | LOCK_NB)) {
+        close(lock);
+        return -1;
+    }
+    return lock;
+}
+
+/**
+ * Listen at the agent's Unix socket.
+ *
+ * A socket file left behind by an agent, which died, is replaced. Returns
+ * the listening socket, -1 on error.
+ *
+ * @param path  The path of the agent's Unix socket.
+ *
+ * @param idleSeconds The time in seconds a wait for a roc may take.
+ */
+static int listen_agent(const char* path, int idleSeconds) {
+    struct sockaddr_un address;
+    struct timeval timeout;
+    int listener = -1;
+
+    if (EXIT_SUCCESS != agent_address(&address, path)) {
+        return -1;
+    }
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (0 > listener) {
+        return -1;
+    }
+
+    timeout.tv_sec = idleSeconds;
+    timeout.tv_usec = 0;
+    unlink(path);
+    if (0 != bind(listener, (struct sockaddr*)&address, sizeof(address))
+            || 0 != listen(listener, SOMAXCONN)
+            || 0 != setsockopt(listener, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+            sizeof(timeout))) {
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+int roc_agent_serve(const char* path, int idleSeconds) {
+    pthread_t workers[AGENT_MAX_THREADS];
+    struct RocAgent agent;
+    int threads = agent_threads();
+    int started = 0;
+    int lock = lock_agent(path);
+
+    if (0 > lock) {
+        return EXIT_FAILURE;
+    }
+
+    /*A roc, which went away, must not take the agent down*/
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&agent, 0, sizeof(agent));
+    agent.idleSeconds = idleSeconds;
+    agent.lastActive = now_seconds();
+    agent.cache = open_agent_cache(path);
+    agent.listener = listen_agent(path, idleSeconds);
+    if (0 > agent.listener
+            || EXIT_SUCCESS != roc_pool_init(&agent.pool, AGENT_POOL_SIZE)) {
+        if (0 <= agent.listener) {
+            close(agent.listener);
+        }
+        if (agent.cache) {
+            roc_cache_close(agent.cache);
+        }
+        close(lock);
+        return EXIT_FAILURE;
+    }
+
+    for (started = 0; started < threads - 1; started++) {
+        if (0 != pthread_create(&workers[started], NULL, serve_clients,
+                &agent)) {
+            break;
+        }
+    }
+    serve_clients(&agent);
+    while (0 < started) {
+        pthread_join(workers[--started], NULL);
+    }
+
+    unlink(path);
+    close(agent.listener);
+    roc_pool_close(&agent.pool);
+    if (agent.cache) {
+        roc_cache_close(agent.cache);
+    }
+    close(lock);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+ *rocAgent.h
+ */
+
+#pragma once
+
+#ifndef ROC_AGENT_H
+#define ROC_AGENT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "connPool.h"
+#include "routeCache.h"
+#include "routeFlight.h"
+
+/**
+ * The number of routes flown at once if ROC_AGENT_THREADS_ENV is not set.
+ */
+#define AGENT_DEFAULT_THREADS 8
+
+/**
+ * The maximum number of routes flown at once.
+ */
+#define AGENT_MAX_THREADS 64
+
+/**
+ * The time in seconds a spawned agent waits for a route before it exits.
+ */
+#define AGENT_IDLE_SECONDS 600
+
+/**
+ * The maximum number of idle connections the agent keeps.
+ */
+#define AGENT_POOL_SIZE 1024
+
+/**
+ * A long-running roc flying the routes handed to it over a Unix socket.
+ *
+ * Its resolution cache and its connections to the mapper and to controls
+ * outlive the single route, so a roc2310 invocation neither connects to the
+ * mapper nor to a control, which a previous one has already visited.
+ */
+struct RocAgent {
+    /**
+     * The socket listening for rocs.
+     */
+    int listener;
+
+    /**
+     * The resolution cache.
+     */
+    struct RouteCache* cache;
+
+    /**
+     * The idle connections to the mapper and to controls.
+     */
+    struct ConnPool pool;
+
+    /**
+     * The time in seconds the agent waits for a route before it exits.
+     */
+    int idleSeconds;
+
+    /**
+     * The number of routes being flown.
+     */
+    int busy;
+
+    /**
+     * The monotonic clock's time in seconds, at which the last route was
+     * flown.
+     */
+    int64_t lastActive;
+};
+
+/**
+ * Hand a route to the agent listening at path and relay its output.
+ *
+ * The flight's settings are sent along, so the route is flown as if by this
+ * process. Its output lines are passed to the flight's output. Returns
+ * the flight's result, E_ROC_OK or the error to exit with, or -1 if the
+ * agent cannot be reached or did not take the route, so the caller has to
+ * fly it itself.
+ *
+ * @param path  The path of the agent's Unix socket.
+ *
+ * @param flight  The flight, whose settings and output are used.
+ *
+ * @param destinations  The destinations as given on the command line.
+ *
+ * @param count The number of destinations.
+ */
+int roc_agent_fly(const char* path, const struct RouteFlight* flight,
+        char** destinations, int count);
+
+/**
+ * Start an agent listening at path in the background.
+ *
+ * The agent is detached from the calling process and its terminal and exits
+ * after AGENT_IDLE_SECONDS without a route. Returns right away; if another
+ * agent already listens at path, the new one exits.
+ *
+ * @param path  The path of the agent's Unix socket.
+ */
+void roc_agent_spawn(const char* path);
+
+/**
+ * Serve rocs at path until no route was handed over for idleSeconds.
+ *
+ * Routes are flown by ROC_AGENT_THREADS_ENV threads at once. The resolution
+ * cache is the one named by ROC_CACHE_ENV, else path followed by ".cache".
+ * Returns EXIT_SUCCESS once idle, EXIT_FAILURE if another agent serves at
+ * path or it cannot listen.
+ *
+ * @param path  The path of the agent's Unix socket.
+ *
+ * @param idleSeconds The time in seconds to wait for a route before
+ *                    returning.
+ */
+int roc_agent_serve(const char* path, int idleSeconds);
+
+#endif
@@ -0,0 +1,278 @@
+/*
+ *routeCache.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "protocol.h"
+#include "routeCache.h"
+
+/**
+ * Hash an airport ID and its mapper's port number.
+ *
+ * @param mapperPort  The port number of the mapper in charge.
+ *
+ * @param id  The airport ID.
+ */
+static uint32_t cache_hash(int mapperPort, const char* id) {
+    uint32_t hash = 2166136261u ^ (uint32_t)mapperPort;
+
+    while (*id) {
+        hash = (hash ^ (unsigned char)*id++) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Check the cache file's head and rebuild the file if it does not match.
+ *
+ * The caller holds the file's lock. Returns EXIT_SUCCESS on success,
+ * EXIT_FAILURE else.
+ *
+ * @param cache The cache, whose file is to be checked.
+ */
+static int prepare_file(struct RouteCache* cache) {
+    struct RouteCacheHeader header;
+    struct stat status;
+
+    if (0 != fstat(cache->fd, &status)) {
+        return EXIT_FAILURE;
+    }
+
+    if ((size_t)status.st_size == cache->mapSize
+            && sizeof(header) == pread(cache->fd, &header, sizeof(header), 0)
+            && 0 == memcmp(header.magic, ROUTE_CACHE_MAGIC, 8)
+            && ROUTE_CACHE_VERSION == header.version
+            && ROUTE_CACHE_SLOTS == header.slots) {
+        return EXIT_SUCCESS;
+    }
+
+    /*Stale layouts and broken files start over empty*/
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ROUTE_CACHE_MAGIC, 8);
+    header.version = ROUTE_CACHE_VERSION;
+    header.slots = ROUTE_CACHE_SLOTS;
+
+    if (0 != ftruncate(cache->fd, 0)
+            || 0 != ftruncate(cache->fd, (off_t)cache->mapSize)
+            || sizeof(header) != pwrite(cache->fd, &header, sizeof(header),
+            0)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+struct RouteCache* roc_cache_open(const char* path, int ttl) {
+    struct RouteCache* cache = NULL;
+    void* map = NULL;
+    int prepared = EXIT_FAILURE;
+
+    cache = (struct RouteCache*)calloc(1, sizeof(struct RouteCache));
+    if (!cache) {
+        return NULL;
+    }
+    cache->ttl = ttl;
+    cache->mapSize = sizeof(struct RouteCacheHeader)
+            + (size_t)ROUTE_CACHE_SLOTS * sizeof(struct RouteCacheEntry);
+
+    cache->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (0 > cache->fd) {
+        free(cache);
+        return NULL;
+    }
+
+    /*Concurrent rocs wait until the first one has set up the file*/
+    if (0 == flock(cache->fd, LOCK_EX)) {
+        prepared = prepare_file(cache);
+        flock(cache->fd, LOCK_UN);
+    }
+
+    if (EXIT_SUCCESS == prepared) {
+        map = mmap(NULL, cache->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                cache->fd, 0);
+    }
+    if (!map || MAP_FAILED == map) {
+        close(cache->fd);
+        free(cache);
+        return NULL;
+    }
+
+    cache->header = (struct RouteCacheHeader*)map;
+    cache->entries = (struct RouteCacheEntry*)(cache->header + 1);
+    return cache;
+}
+
+struct RouteCache* roc_cache_open_env() {
+    const char* path = getenv(ROC_CACHE_ENV);
+    const char* ttl = getenv(ROC_CACHE_TTL_ENV);
+    long seconds = ttl ? strtol(ttl, NULL, 10) : 0;
+
+    if (!path || '\0' == path[0]) {
+        return NULL;
+    }
+    return roc_cache_open(path, 0 < seconds && seconds <= 86400 * 365
+            ? (int)seconds : ROUTE_CACHE_DEFAULT_TTL);
+}
+
+void roc_cache_close(struct RouteCache* cache) {
+    munmap(cache->header, cache->mapSize);
+    close(cache->fd);
+    free(cache);
+}
+
+/**
+ * Get the entry probed in the given step for an airport ID.
+ *
+ * @param cache The cache to be searched.
+ *
+ * @param hash  The ID's hash.
+ *
+ * @param probe The probing step.
+ */
+static struct RouteCacheEntry* probe_entry(struct RouteCache* cache,
+        uint32_t hash, int probe) {
+    return &cache->entries[(hash + (uint32_t)probe)
+            & (ROUTE_CACHE_SLOTS - 1)];
+}
+
+/**
+ * Copy an entry, which may be written concurrently.
+ *
+ * Returns 1 if the copy is consistent, 0 if the entry was being written.
+ *
+ * @param entry The shared entry.
+ *
+ * @param copy  Output parameter, receives the entry.
+ */
+static int read_entry(const struct RouteCacheEntry* entry,
+        struct RouteCacheEntry* copy) {
+    uint32_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+
+    if (sequence & 1) {
+        return 0;
+    }
+    memcpy(copy, entry, sizeof(struct RouteCacheEntry));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    copy->id[MAPPER_MAX_ID_SIZE - 1] = '\0';
+    return sequence == __atomic_load_n(&entry->sequence, __ATOMIC_RELAXED);
+}
+
+/**
+ * Check if an entry holds the given airport ID.
+ *
+ * @param entry The consistent copy of an entry.
+ *
+ * @param mapperPort  The port number of the mapper in charge.
+ *
+ * @param id  The airport ID.
+ */
+static int holds_id(const struct RouteCacheEntry* entry, int mapperPort,
+        const char* id) {
+    return mapperPort == entry->mapperPort && 0 == strcmp(entry->id, id);
+}
+
+/**
+ * Start writing an entry.
+ *
+ * Returns 1 if the entry may be written, 0 if another process is writing it.
+ *
+ * @param entry The shared entry.
+ */
+static int begin_write(struct RouteCacheEntry* entry) {
+    uint32_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_RELAXED);
+
+    return !(sequence & 1) && __atomic_compare_exchange_n(&entry->sequence,
+            &sequence, sequence + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+/**
+ * Publish a written entry.
+ *
+ * @param entry The shared entry.
+ */
+static void end_write(struct RouteCacheEntry* entry) {
+    __atomic_add_fetch(&entry->sequence, 1, __ATOMIC_RELEASE);
+}
+
+int roc_cache_lookup(struct RouteCache* cache, int mapperPort,
+        const char* id) {
+    struct RouteCacheEntry copy;
+    uint32_t hash = cache_hash(mapperPort, id);
+    int64_t now = (int64_t)time(NULL);
+    int probe = 0;
+
+    for (probe = 0; probe < ROUTE_CACHE_PROBES; probe++) {
+        if (read_entry(probe_entry(cache, hash, probe), &copy)
+                && holds_id(&copy, mapperPort, id)) {
+            return now < copy.expires ? copy.port : 0;
+        }
+    }
+    return 0;
+}
+
+void roc_cache_store(struct RouteCache* cache, int mapperPort,
+        const char* id, int port) {
+    struct RouteCacheEntry copy;
+    struct RouteCacheEntry* entry = NULL;
+    struct RouteCacheEntry* chosen = NULL;
+    uint32_t hash = cache_hash(mapperPort, id);
+    int64_t now = (int64_t)time(NULL);
+    int probe = 0;
+
+    if (MAPPER_MAX_ID_SIZE <= strlen(id)) {
+        return;
+    }
+
+    /*Reuse the ID's own slot, else a free or expired one, else the first*/
+    for (probe = 0; probe < ROUTE_CACHE_PROBES; probe++) {
+        entry = probe_entry(cache, hash, probe);
+        if (!read_entry(entry, &copy)) {
+            continue;
+        }
+        if (holds_id(&copy, mapperPort, id)) {
+            chosen = entry;
+            break;
+        }
+        if (!chosen && copy.expires <= now) {
+            chosen = entry;
+        }
+    }
+    if (!chosen) {
+        chosen = probe_entry(cache, hash, 0);
+    }
+
+    if (!begin_write(chosen)) {
+        return;
+    }
+    chosen->mapperPort = (uint16_t)mapperPort;
+    chosen->port = (uint16_t)port;
+    chosen->expires = now + cache->ttl;
+    strcpy(chosen->id, id);
+    end_write(chosen);
+}
+
+void roc_cache_invalidate(struct RouteCache* cache, int mapperPort,
+        const char* id) {
+    struct RouteCacheEntry copy;
+    struct RouteCacheEntry* entry = NULL;
+    uint32_t hash = cache_hash(mapperPort, id);
+    int probe = 0;
+
+    for (probe = 0; probe < ROUTE_CACHE_PROBES; probe++) {
+        entry = probe_entry(cache, hash, probe);
+        if (read_entry(entry, &copy) && holds_id(&copy, mapperPort, id)
+                && begin_write(entry)) {
+            entry->expires = 0;
+            end_write(entry);
+        }
+    }
+}
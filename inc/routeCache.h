@@ -0,0 +1,195 @@
+/*
+ *routeCache.h
+ */
+
+#pragma once
+
+#ifndef ROUTE_CACHE_H
+#define ROUTE_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+/**
+ * Identifies a file as roc2310 resolution cache.
+ */
+#define ROUTE_CACHE_MAGIC "ROCCACHE"
+
+/**
+ * The cache file's layout version. Files of other versions are rebuilt.
+ */
+#define ROUTE_CACHE_VERSION 1
+
+/**
+ * The number of entries a cache file holds, a power of 2.
+ */
+#define ROUTE_CACHE_SLOTS 4096
+
+/**
+ * The number of slots probed for an airport ID.
+ */
+#define ROUTE_CACHE_PROBES 8
+
+/**
+ * The time in seconds an entry stays valid by default.
+ */
+#define ROUTE_CACHE_DEFAULT_TTL 300
+
+/**
+ * The head of a cache file, followed by ROUTE_CACHE_SLOTS entries.
+ */
+struct RouteCacheHeader {
+    /**
+     * Always ROUTE_CACHE_MAGIC without the terminating NUL.
+     */
+    char magic[8];
+
+    /**
+     * The version stamp, ROUTE_CACHE_VERSION.
+     */
+    uint32_t version;
+
+    /**
+     * The number of entries following the head.
+     */
+    uint32_t slots;
+};
+
+/**
+ * A cached airport ID to port number mapping.
+ */
+struct RouteCacheEntry {
+    /**
+     * Odd while the entry is written, incremented before and after.
+     */
+    uint32_t sequence;
+
+    /**
+     * The port number of the mapper, which resolved the ID.
+     */
+    uint16_t mapperPort;
+
+    /**
+     * The control's port number.
+     */
+    uint16_t port;
+
+    /**
+     * The wall clock time in seconds, at which the entry expires, 0 if the
+     * slot is free or the entry was invalidated.
+     */
+    int64_t expires;
+
+    /**
+     * The airport ID.
+     */
+    char id[MAPPER_MAX_ID_SIZE];
+};
+
+/**
+ * A process' view of a resolution cache file shared by all roc processes.
+ *
+ * Entries are written under a per-entry sequence number and read without
+ * locks: a reader discards an entry, whose sequence number is odd or changed
+ * while it was copied. A writer skips an entry another one is writing, as
+ * the cache is only a hint.
+ */
+struct RouteCache {
+    /**
+     * The cache file.
+     */
+    int fd;
+
+    /**
+     * The mapped cache file, starting with the head.
+     */
+    struct RouteCacheHeader* header;
+
+    /**
+     * The entries following the head.
+     */
+    struct RouteCacheEntry* entries;
+
+    /**
+     * The size of the mapping.
+     */
+    size_t mapSize;
+
+    /**
+     * The time in seconds new entries stay valid.
+     */
+    int ttl;
+};
+
+/**
+ * Open or create the cache file at the given path.
+ *
+ * A file of another layout version is rebuilt. Returns the opened cache,
+ * NULL if the file cannot be created or mapped.
+ *
+ * @param path  The cache file's path.
+ *
+ * @param ttl The time in seconds new entries stay valid.
+ */
+struct RouteCache* roc_cache_open(const char* path, int ttl);
+
+/**
+ * Open the cache file named in the environment, if any.
+ *
+ * Returns the cache, NULL if ROC_CACHE_ENV is not set or the file cannot be
+ * used, so destinations are resolved by the mapper as usual.
+ */
+struct RouteCache* roc_cache_open_env();
+
+/**
+ * Unmap and close the cache file.
+ *
+ * @param cache The cache to be closed.
+ */
+void roc_cache_close(struct RouteCache* cache);
+
+/**
+ * Look up an airport ID.
+ *
+ * Returns the cached port number, 0 if the ID is not cached or expired.
+ *
+ * @param cache The cache to be searched.
+ *
+ * @param mapperPort  The port number of the mapper in charge.
+ *
+ * @param id  The airport ID.
+ */
+int roc_cache_lookup(struct RouteCache* cache, int mapperPort,
+        const char* id);
+
+/**
+ * Store an airport ID's port number.
+ *
+ * The entry is not stored if all its slots are being written by others.
+ *
+ * @param cache The cache to be updated.
+ *
+ * @param mapperPort  The port number of the mapper, which resolved the ID.
+ *
+ * @param id  The airport ID.
+ *
+ * @param port  The control's port number.
+ */
+void roc_cache_store(struct RouteCache* cache, int mapperPort,
+        const char* id, int port);
+
+/**
+ * Drop an airport ID, e.g. because its control cannot be connected to.
+ *
+ * @param cache The cache to be updated.
+ *
+ * @param mapperPort  The port number of the mapper in charge.
+ *
+ * @param id  The airport ID.
+ */
+void roc_cache_invalidate(struct RouteCache* cache, int mapperPort,
+        const char* id);
+
+#endif
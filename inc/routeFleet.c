@@ -0,0 +1,644 @@
+/*
+ *routeFleet.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "controlStats.h"
+#include "errorReturn.h"
+#include "protocol.h"
+#include "routeFleet.h"
+#include "routeResolve.h"
+#include "routeVisit.h"
+#include "visitorSketch.h"
+
+/**
+ * The characters separating a fleet file's fields.
+ */
+#define FLEET_SEPARATORS " \t\r\n"
+
+/**
+ * The request asking a control for its visitor sketch.
+ */
+#define FLEET_SKETCH_REQUEST "sketch\n"
+
+/**
+ * The initial size of the buffer receiving a sketch, which is about 41 KB.
+ */
+#define FLEET_SKETCH_SIZE (64 * 1024)
+
+/**
+ * A plane in the air and its current visit.
+ */
+struct FleetSlot {
+    /**
+     * The plane's position in the fleet.
+     */
+    int plane;
+
+    /**
+     * The position of the destination visited in the plane's route.
+     */
+    int hop;
+
+    /**
+     * The visit in progress.
+     */
+    struct RouteVisit visit;
+
+    /**
+     * The instant the plane took off.
+     */
+    struct timespec takeOff;
+
+    /**
+     * The time limits of the plane's visits, its route deadline counting
+     * from take-off.
+     */
+    struct VisitDeadlines deadlines;
+
+    /**
+     * The instant the current visit started.
+     */
+    struct timespec started;
+
+    /**
+     * The length of request.
+     */
+    size_t length;
+
+    /**
+     * The plane's ID followed by LF.
+     */
+    char request[CONTROL_MAX_ID_SIZE + 2];
+
+    /**
+     * The current visit's info buffer.
+     */
+    char info[ROC_MAX_INFO_SIZE];
+};
+
+void roc_fleet_init(struct Fleet* fleet) {
+    memset(fleet, 0, sizeof(struct Fleet));
+}
+
+/**
+ * Make room for a further plane and its route.
+ *
+ * Returns E_ROC_OK on success, E_ROC_INVALID_FLEET if no memory is left.
+ *
+ * @param fleet The fleet to be extended.
+ *
+ * @param hops  The number of destinations to be added.
+ */
+static int reserve_plane(struct Fleet* fleet, int hops) {
+    struct FleetPlane* planes = NULL;
+    char** destinations = NULL;
+    int* ports = NULL;
+    int capacity = 0;
+
+    if (fleet->count == fleet->capacity) {
+        capacity = MAX(16, 2 * fleet->capacity);
+        planes = (struct FleetPlane*)realloc(fleet->planes,
+                capacity * sizeof(struct FleetPlane));
+        if (!planes) {
+            return E_ROC_INVALID_FLEET;
+        }
+        fleet->planes = planes;
+        fleet->capacity = capacity;
+    }
+
+    if (fleet->hops + hops > fleet->hopCapacity) {
+        capacity = MAX(MAX(64, 2 * fleet->hopCapacity), fleet->hops + hops);
+        destinations = (char**)realloc(fleet->destinations,
+                capacity * sizeof(char*));
+        if (!destinations) {
+            return E_ROC_INVALID_FLEET;
+        }
+        fleet->destinations = destinations;
+        ports = (int*)realloc(fleet->ports, capacity * sizeof(int));
+        if (!ports) {
+            return E_ROC_INVALID_FLEET;
+        }
+        fleet->ports = ports;
+        fleet->hopCapacity = capacity;
+    }
+    return E_ROC_OK;
+}
+
+int roc_fleet_add(struct Fleet* fleet, const char* planeId,
+        char** destinations, int count) {
+    struct FleetPlane* plane = NULL;
+    int needsMapper = 0;
+    int success = E_ROC_OK;
+    int i = 0;
+
+    if (E_ROC_OK != roc_check_chars(planeId)
+            || CONTROL_MAX_ID_SIZE <= strlen(planeId)) {
+        return E_ROC_INVALID_FLEET;
+    }
+    for (i = 0; i < count; i++) {
+        success = roc_check_destination_port(destinations[i]);
+        if (E_ROC_INVALID_MAPPER_PORT == success) {
+            needsMapper = 1;
+        } else if (E_ROC_OK != success) {
+            return E_ROC_INVALID_FLEET;
+        }
+    }
+
+    if (E_ROC_OK != reserve_plane(fleet, count)) {
+        return E_ROC_INVALID_FLEET;
+    }
+
+    plane = &fleet->planes[fleet->count];
+    memset(plane, 0, sizeof(struct FleetPlane));
+    plane->id = strdup(planeId);
+    plane->first = fleet->hops;
+    if (!plane->id) {
+        return E_ROC_INVALID_FLEET;
+    }
+    fleet->count += 1;
+
+    for (i = 0; i < count; i++) {
+        fleet->destinations[fleet->hops] = strdup(destinations[i]);
+        if (!fleet->destinations[fleet->hops]) {
+            return E_ROC_INVALID_FLEET;
+        }
+        fleet->ports[fleet->hops] = 0;
+        fleet->hops += 1;
+        plane->hops += 1;
+    }
+
+    fleet->needsMapper |= needsMapper;
+    return E_ROC_OK;
+}
+
+int roc_fleet_load(struct Fleet* fleet, const char* path) {
+    FILE* fleetFile = NULL;
+    char* line = NULL;
+    char* field = NULL;
+    char* position = NULL;
+    char** fields = NULL;
+    char** grown = NULL;
+    size_t lineSize = 0;
+    int capacity = 0;
+    int count = 0;
+    int success = E_ROC_OK;
+
+    fleetFile = fopen(path, "r");
+    if (!fleetFile) {
+        return E_ROC_INVALID_FLEET;
+    }
+
+    while (E_ROC_OK == success
+            && 0 <= getline(&line, &lineSize, fleetFile)) {
+        count = 0;
+        for (field = strtok_r(line, FLEET_SEPARATORS, &position); field;
+                field = strtok_r(NULL, FLEET_SEPARATORS, &position)) {
+            if (count == capacity) {
+                capacity = MAX(16, 2 * capacity);
+                grown = (char**)realloc(fields, capacity * sizeof(char*));
+                if (!grown) {
+                    success = E_ROC_INVALID_FLEET;
+                    break;
+                }
+                fields = grown;
+            }
+            fields[count++] = field;
+        }
+
+        if (E_ROC_OK == success && 0 < count) {
+            success = roc_fleet_add(fleet, fields[0], fields + 1, count - 1);
+        }
+    }
+
+    free(fields);
+    free(line);
+    fclose(fleetFile);
+    return success;
+}
+
+int roc_fleet_resolve(struct Fleet* fleet, const struct MapperList* mappers,
+        struct RouteCache* cache) {
+    struct FleetPlane* plane = NULL;
+    char* destination = NULL;
+    int success = E_ROC_OK;
+    int kept = 0;
+    int first = 0;
+    int i = 0;
+    int j = 0;
+
+    /*The whole fleet's airport IDs are looked up at once*/
+    success = roc_resolve_hedged(mappers, fleet->destinations, fleet->hops,
+            fleet->ports, cache, NULL, NULL);
+    if (E_ROC_OK != success) {
+        return success;
+    }
+
+    /*Skipped destinations are moved behind the kept ones to be freed*/
+    for (i = 0; i < fleet->count; i++) {
+        plane = &fleet->planes[i];
+        first = kept;
+        for (j = plane->first; j < plane->first + plane->hops; j++) {
+            if (!fleet->ports[j]) {
+                continue;
+            }
+            destination = fleet->destinations[kept];
+            fleet->destinations[kept] = fleet->destinations[j];
+            fleet->destinations[j] = destination;
+            fleet->ports[kept] = fleet->ports[j];
+            kept += 1;
+        }
+        plane->first = first;
+        plane->hops = kept - first;
+    }
+    return E_ROC_OK;
+}
+
+/**
+ * Start the plane's next visit, skipping destinations, which cannot be
+ * connected to. Past the plane's route deadline, the remaining destinations
+ * are given up as timed out.
+ *
+ * Returns 1 if a visit is in progress, 0 if the plane landed.
+ *
+ * @param fleet The fleet flown.
+ *
+ * @param slot  The plane in the air.
+ *
+ * @param waiting Output parameter, receives the visit's socket and the
+ *                events waited for.
+ *
+ * @param failed  The number of failed visits, incremented for every skipped
+ *                destination.
+ */
+static int start_next_visit(struct Fleet* fleet, struct FleetSlot* slot,
+        struct pollfd* waiting, int* failed) {
+    struct FleetPlane* plane = &fleet->planes[slot->plane];
+    int64_t now = 0;
+
+    for (; slot->hop < plane->hops; slot->hop++) {
+        now = roc_now_millis();
+        if (0 < slot->deadlines.routeEnd && slot->deadlines.routeEnd <= now) {
+            fleet->timedOut += 1;
+            *failed += 1;
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &slot->started);
+        waiting->fd = roc_start_visit(&slot->visit, slot->hop,
+                fleet->ports[plane->first + slot->hop]);
+        waiting->events = POLLOUT;
+        waiting->revents = 0;
+        if (0 <= waiting->fd) {
+            slot->visit.deadline = roc_visit_deadline(&slot->deadlines, now);
+            return 1;
+        }
+        *failed += 1;
+    }
+
+    plane->micros = control_stats_micros_since(&slot->takeOff);
+    return 0;
+}
+
+/**
+ * Record a finished visit.
+ *
+ * @param fleet The fleet flown.
+ *
+ * @param slot  The plane, whose visit finished.
+ *
+ * @param visited The visit's result, 1 if the destination replied.
+ *
+ * @param failed  The number of failed visits, incremented if it failed.
+ */
+static void finish_visit(struct Fleet* fleet, struct FleetSlot* slot,
+        int visited, int* failed) {
+    if (0 >= visited) {
+        *failed += 1;
+        return;
+    }
+
+    fleet->planes[slot->plane].replied += 1;
+    fleet->latencies[fleet->latencyCount++] =
+            control_stats_micros_since(&slot->started);
+    if (0 == slot->plane && fleet->output) {
+        fleet->output(fleet->outputContext, FLIGHT_INFO, slot->info);
+    }
+}
+
+/**
+ * Get the time poll() may wait for the planes' visits.
+ *
+ * Returns the time in milliseconds until the first visit times out, -1 if
+ * none of them has a deadline.
+ *
+ * @param slots The planes in the air.
+ *
+ * @param active  The number of planes.
+ *
+ * @param now The monotonic clock's current time in milliseconds.
+ */
+static int fleet_poll_timeout(const struct FleetSlot* slots, int active,
+        int64_t now) {
+    int64_t first = 0;
+    int i = 0;
+
+    for (i = 0; i < active; i++) {
+        if (slots[i].visit.deadline
+                && (0 == first || slots[i].visit.deadline < first)) {
+            first = slots[i].visit.deadline;
+        }
+    }
+    if (0 == first) {
+        return -1;
+    }
+    return (int)MIN(MAX(0, first - now), INT_MAX);
+}
+
+int roc_fleet_fly(struct Fleet* fleet, int parallel,
+        const struct VisitDeadlines* deadlines) {
+    struct timespec start;
+    struct pollfd* waiting = NULL;
+    struct FleetSlot* slots = NULL;
+    struct FleetSlot* slot = NULL;
+    int failed = 0;
+    int active = 0;
+    int next = 0;
+    int visited = 0;
+    int64_t now = 0;
+    int i = 0;
+
+    parallel = MAX(1, MIN(parallel, fleet->count));
+    waiting = (struct pollfd*)malloc(parallel * sizeof(struct pollfd));
+    slots = (struct FleetSlot*)malloc(parallel * sizeof(struct FleetSlot));
+    fleet->latencies = (uint64_t*)malloc(MAX(1, fleet->hops)
+            * sizeof(uint64_t));
+    if (!waiting || !slots || !fleet->latencies) {
+        free(waiting);
+        free(slots);
+        return fleet->hops;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (next < fleet->count || 0 < active) {
+        /*Another plane takes off as soon as one lands*/
+        while (active < parallel && next < fleet->count) {
+            slot = &slots[active];
+            slot->plane = next++;
+            slot->hop = 0;
+            slot->length = (size_t)snprintf(slot->request,
+                    sizeof(slot->request), "%s\n",
+                    fleet->planes[slot->plane].id);
+            clock_gettime(CLOCK_MONOTONIC, &slot->takeOff);
+            memset(&slot->deadlines, 0, sizeof(struct VisitDeadlines));
+            if (deadlines) {
+                slot->deadlines = *deadlines;
+                roc_start_deadlines(&slot->deadlines);
+            }
+            if (start_next_visit(fleet, slot, &waiting[active], &failed)) {
+                active += 1;
+            }
+        }
+
+        if (0 == active || 0 > poll(waiting, active, fleet_poll_timeout(
+                slots, active, roc_now_millis()))) {
+            continue;
+        }
+
+        now = roc_now_millis();
+        for (i = active - 1; 0 <= i; i--) {
+            visited = 0;
+            if (waiting[i].revents && roc_advance_visit(&slots[i].visit,
+                    &waiting[i], slots[i].request, slots[i].length,
+                    slots[i].info, &visited)) {
+                finish_visit(fleet, &slots[i], visited, &failed);
+            } else if (slots[i].visit.deadline
+                    && slots[i].visit.deadline <= now) {
+                fleet->timedOut += 1;
+                failed += 1;
+            } else {
+                continue;
+            }
+
+            close(waiting[i].fd);
+            slots[i].hop += 1;
+            if (start_next_visit(fleet, &slots[i], &waiting[i], &failed)) {
+                continue;
+            }
+
+            active -= 1;
+            waiting[i] = waiting[active];
+            slots[i] = slots[active];
+        }
+    }
+    fleet->micros = control_stats_micros_since(&start);
+
+    free(waiting);
+    free(slots);
+    return failed;
+}
+
+/**
+ * Order latencies ascending.
+ */
+static int compare_latencies(const void* first, const void* second) {
+    uint64_t one = *(const uint64_t*)first;
+    uint64_t other = *(const uint64_t*)second;
+
+    return (one > other) - (one < other);
+}
+
+/**
+ * Get a percentile of sorted latencies by the nearest rank.
+ *
+ * Returns the latency in microseconds, 0 if there are none.
+ *
+ * @param latencies The latencies in ascending order.
+ *
+ * @param count The number of latencies.
+ *
+ * @param permille  The percentile in thousandths.
+ */
+static uint64_t percentile(const uint64_t* latencies, int count,
+        int permille) {
+    if (0 == count) {
+        return 0;
+    }
+    return latencies[((int64_t)count * permille + 999) / 1000 - 1];
+}
+
+void roc_fleet_report(struct Fleet* fleet, FILE* output) {
+    struct FleetPlane* plane = NULL;
+    double seconds = (double)MAX(1, fleet->micros) / 1000000.0;
+    int replied = 0;
+    int hops = 0;
+    int i = 0;
+
+    for (i = 0; i < fleet->count; i++) {
+        plane = &fleet->planes[i];
+        fprintf(output, "plane:%s:%d/%d:%llu\n", plane->id, plane->replied,
+                plane->hops, (unsigned long long)plane->micros);
+        replied += plane->replied;
+        hops += plane->hops;
+    }
+
+    if (fleet->latencies) {
+        qsort(fleet->latencies, fleet->latencyCount, sizeof(uint64_t),
+                compare_latencies);
+    }
+
+    fprintf(output, "planes:%d\n", fleet->count);
+    fprintf(output, "hops:%d/%d\n", replied, hops);
+    fprintf(output, "timeouts:%d\n", fleet->timedOut);
+    fprintf(output, "micros:%llu\n", (unsigned long long)fleet->micros);
+    fprintf(output, "planes/s:%.1f\n", fleet->count / seconds);
+    fprintf(output, "hops/s:%.1f\n", replied / seconds);
+    fprintf(output, "p50:%llu\n", (unsigned long long)percentile(
+            fleet->latencies, fleet->latencyCount, 500));
+    fprintf(output, "p90:%llu\n", (unsigned long long)percentile(
+            fleet->latencies, fleet->latencyCount, 900));
+    fprintf(output, "p99:%llu\n", (unsigned long long)percentile(
+            fleet->latencies, fleet->latencyCount, 990));
+    fprintf(output, "p999:%llu\n", (unsigned long long)percentile(
+            fleet->latencies, fleet->latencyCount, 999));
+    fprintf(output, "max:%llu\n", (unsigned long long)percentile(
+            fleet->latencies, fleet->latencyCount, 1000));
+    fflush(output);
+}
+
+/**
+ * Order port numbers ascending.
+ */
+static int compare_ports(const void* first, const void* second) {
+    return *(const int*)first - *(const int*)second;
+}
+
+/**
+ * Receive a control's visitor sketch.
+ *
+ * The request is followed by closing the sending side, so the control hangs
+ * up once it replied. Returns E_ROC_OK if the sketch was received,
+ * E_ROC_FAILED_TO_CONNECT_CONTROL if the control is unreachable, busy or
+ * replied no sketch.
+ *
+ * @param port  The control's port number.
+ *
+ * @param sketch  Output parameter, the received sketch.
+ */
+static int fetch_sketch(int port, struct VisitorSketch* sketch) {
+    char* text = NULL;
+    char* grown = NULL;
+    size_t size = FLEET_SKETCH_SIZE;
+    size_t used = 0;
+    ssize_t received = 0;
+    int success = E_ROC_FAILED_TO_CONNECT_CONTROL;
+    int controlSocket = roc_open_destination_conn(port);
+
+    text = (char*)malloc(size);
+    if (0 > controlSocket || !text) {
+        free(text);
+        if (0 <= controlSocket) {
+            roc_close_conn(controlSocket);
+        }
+        return success;
+    }
+
+    if ((ssize_t)strlen(FLEET_SKETCH_REQUEST) == send(controlSocket,
+            FLEET_SKETCH_REQUEST, strlen(FLEET_SKETCH_REQUEST),
+            MSG_NOSIGNAL)) {
+        shutdown(controlSocket, SHUT_WR);
+        while (0 < (received = recv(controlSocket, text + used,
+                size - used - 1, 0))) {
+            used += (size_t)received;
+            if (used + 1 == size) {
+                grown = (char*)realloc(text, 2 * size);
+                if (!grown) {
+                    break;
+                }
+                text = grown;
+                size *= 2;
+            }
+        }
+        text[used] = '\0';
+        if (0 == received && E_CONTROL_OK
+                == control_sketch_decode(sketch, text)) {
+            success = E_ROC_OK;
+        }
+    }
+
+    roc_close_conn(controlSocket);
+    free(text);
+    return success;
+}
+
+void roc_fleet_visitors(struct Fleet* fleet, FILE* output) {
+    struct VisitorSketch* merged = control_sketch_create();
+    struct VisitorSketch* sketch = control_sketch_create();
+    int* ports = (int*)malloc(MAX(1, fleet->hops) * sizeof(int));
+    char* heavy = NULL;
+    char* line = NULL;
+    char* end = NULL;
+    size_t size = 0;
+    int controls = 0;
+    int fetched = 0;
+    int i = 0;
+
+    if (!merged || !sketch || !ports) {
+        free(merged);
+        free(sketch);
+        free(ports);
+        return;
+    }
+
+    /*Every control is asked once, however many planes visited it*/
+    memcpy(ports, fleet->ports, fleet->hops * sizeof(int));
+    qsort(ports, fleet->hops, sizeof(int), compare_ports);
+    for (i = 0; i < fleet->hops; i++) {
+        if (0 >= ports[i] || (0 < i && ports[i - 1] == ports[i])) {
+            continue;
+        }
+        controls += 1;
+        if (E_ROC_OK == fetch_sketch(ports[i], sketch)) {
+            control_sketch_merge(merged, sketch);
+            fetched += 1;
+        }
+    }
+
+    fprintf(output, "controls:%d/%d\n", fetched, controls);
+    fprintf(output, "visitors:%lu\n", control_sketch_distinct(merged));
+    heavy = control_sketch_heavy(merged, SKETCH_TOP, &size);
+    for (line = heavy; line && '.' != *line; line = end + 1) {
+        end = strchr(line, '\n');
+        fprintf(output, "heavy:%.*s\n", (int)(end - line), line);
+    }
+    fflush(output);
+
+    free(heavy);
+    free(merged);
+    free(sketch);
+    free(ports);
+}
+
+void roc_fleet_free(struct Fleet* fleet) {
+    int i = 0;
+
+    for (i = 0; i < fleet->count; i++) {
+        free(fleet->planes[i].id);
+    }
+    for (i = 0; i < fleet->hops; i++) {
+        free(fleet->destinations[i]);
+    }
+    free(fleet->planes);
+    free(fleet->destinations);
+    free(fleet->ports);
+    free(fleet->latencies);
+    roc_fleet_init(fleet);
+}
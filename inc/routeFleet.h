@@ -0,0 +1,241 @@
+/*
+ *routeFleet.h
+ */
+
+#pragma once
+
+#ifndef ROUTE_FLEET_H
+#define ROUTE_FLEET_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "routeCache.h"
+#include "routeFlight.h"
+#include "routeResolve.h"
+
+struct VisitDeadlines;
+
+/**
+ * A plane of the fleet and its flight.
+ */
+struct FleetPlane {
+    /**
+     * The plane's ID.
+     */
+    char* id;
+
+    /**
+     * The position of the plane's first destination in the fleet's route
+     * table.
+     */
+    int first;
+
+    /**
+     * The number of destinations the plane visits.
+     */
+    int hops;
+
+    /**
+     * The number of destinations, which replied a valid info.
+     */
+    int replied;
+
+    /**
+     * The time taken to fly the whole route in microseconds.
+     */
+    uint64_t micros;
+};
+
+/**
+ * Many planes flown concurrently by one roc.
+ *
+ * The planes' routes are kept in a single table, so all of them are resolved
+ * together and every airport ID is looked up once for the whole fleet.
+ */
+struct Fleet {
+    /**
+     * The planes, the command line's plane first.
+     */
+    struct FleetPlane* planes;
+
+    /**
+     * The number of planes.
+     */
+    int count;
+
+    /**
+     * The number of planes, which fit into planes.
+     */
+    int capacity;
+
+    /**
+     * All planes' destinations as given, one route after another.
+     */
+    char** destinations;
+
+    /**
+     * The destinations' port numbers, once resolved.
+     */
+    int* ports;
+
+    /**
+     * The number of destinations in the route table.
+     */
+    int hops;
+
+    /**
+     * The number of destinations, which fit into the route table.
+     */
+    int hopCapacity;
+
+    /**
+     * Set if a destination is an airport ID, which needs a mapper.
+     */
+    int needsMapper;
+
+    /**
+     * Receives the first plane's infos as FLIGHT_INFO lines as soon as its
+     * visits finish, like a single plane's, NULL if they are not printed.
+     */
+    FlightOutput output;
+
+    /**
+     * The context given to output.
+     */
+    void* outputContext;
+
+    /**
+     * The latencies of all replied visits in microseconds.
+     */
+    uint64_t* latencies;
+
+    /**
+     * The number of latencies recorded.
+     */
+    int latencyCount;
+
+    /**
+     * The number of visits given up at their deadline or not started by
+     * their plane's route deadline.
+     */
+    int timedOut;
+
+    /**
+     * The time taken to fly all planes in microseconds.
+     */
+    uint64_t micros;
+};
+
+/**
+ * Set up an empty fleet.
+ *
+ * @param fleet The fleet to be initialized.
+ */
+void roc_fleet_init(struct Fleet* fleet);
+
+/**
+ * Add a plane and its route to the fleet.
+ *
+ * The plane's ID and destinations are validated like roc2310's command line
+ * arguments and copied. Returns E_ROC_OK on success, E_ROC_INVALID_FLEET if
+ * they are invalid or no memory is left.
+ *
+ * @param fleet The fleet to be extended.
+ *
+ * @param planeId The plane's ID.
+ *
+ * @param destinations  The plane's destinations.
+ *
+ * @param count The number of destinations.
+ */
+int roc_fleet_add(struct Fleet* fleet, const char* planeId,
+        char** destinations, int count);
+
+/**
+ * Add all planes listed in a file to the fleet.
+ *
+ * Every line of the file holds a plane's ID followed by its destinations,
+ * separated by blanks. Empty lines are skipped. Returns E_ROC_OK on success,
+ * E_ROC_INVALID_FLEET if the file cannot be read or holds an invalid plane.
+ *
+ * @param fleet The fleet to be extended.
+ *
+ * @param path  The path of the fleet file.
+ */
+int roc_fleet_load(struct Fleet* fleet, const char* path);
+
+/**
+ * Resolve all planes' destinations over one connection per mapper.
+ *
+ * Invalid port numbers are dropped from the routes, like roc2310 skips
+ * them. Returns E_ROC_OK on success, else the error roc_resolve_hedged()
+ * reports.
+ *
+ * @param fleet The fleet to be resolved.
+ *
+ * @param mappers The mappers the airport IDs are looked up at.
+ *
+ * @param cache The resolution cache, NULL if there is none.
+ */
+int roc_fleet_resolve(struct Fleet* fleet, const struct MapperList* mappers,
+        struct RouteCache* cache);
+
+/**
+ * Fly all planes of the fleet from a single event loop.
+ *
+ * Up to parallel planes are in the air at once, each visiting its
+ * destinations one after another over non-blocking sockets. A further plane
+ * takes off as soon as one lands. A visit, which is not done by its
+ * deadline, is given up and the plane flies on to its next destination; the
+ * route deadline counts from each plane's take-off. The first plane's infos
+ * are handed to the fleet's output as its visits finish, in route order, as
+ * a plane visits one destination at a time. Returns the number of visits,
+ * which failed or timed out.
+ *
+ * @param fleet The resolved fleet.
+ *
+ * @param parallel  The maximum number of planes flying at once.
+ *
+ * @param deadlines The visits' time limits, NULL if there are none.
+ */
+int roc_fleet_fly(struct Fleet* fleet, int parallel,
+        const struct VisitDeadlines* deadlines);
+
+/**
+ * Report the flown fleet.
+ *
+ * A "plane:<id>:<replied>/<hops>:<micros>" line is written per plane,
+ * followed by the aggregate "planes:", "hops:", "micros:", "planes/s:" and
+ * "hops/s:" lines and the visit latency percentiles "p50:", "p90:", "p99:",
+ * "p999:" and "max:" in microseconds.
+ *
+ * @param fleet The flown fleet.
+ *
+ * @param output  The stream the report is written to.
+ */
+void roc_fleet_report(struct Fleet* fleet, FILE* output);
+
+/**
+ * Report the combined visitors of all controls the fleet visited.
+ *
+ * Every control is asked for its visitor sketch once and the sketches are
+ * merged, so planes visiting several of them are counted once. A
+ * "controls:<replied>/<asked>" line is written, followed by
+ * "visitors:<distinct planes>" and a "heavy:<id>:<visits>" line per
+ * estimated heavy hitter, the most frequent first.
+ *
+ * @param fleet The flown fleet.
+ *
+ * @param output  The stream the report is written to.
+ */
+void roc_fleet_visitors(struct Fleet* fleet, FILE* output);
+
+/**
+ * Release all memory held by the fleet.
+ *
+ * @param fleet The fleet to be freed.
+ */
+void roc_fleet_free(struct Fleet* fleet);
+
+#endif
@@ -0,0 +1,402 @@
+/*
+ *routeFlight.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkinDatagram.h"
+#include "errorReturn.h"
+#include "protocol.h"
+#include "routeFlight.h"
+#include "routeResolve.h"
+
+/**
+ * A segment of the route visited in parallel, see deliver_info().
+ */
+struct RouteSegment {
+    /**
+     * The flight the segment belongs to.
+     */
+    struct RouteFlight* flight;
+
+    /**
+     * The position of the segment's first destination in the route.
+     */
+    int first;
+
+    /**
+     * If not NULL, answered[i] is set if the segment's destination i replied
+     * over UDP.
+     */
+    const int* answered;
+
+    /**
+     * The info texts received over UDP.
+     */
+    char** datagramInfos;
+
+    /**
+     * Cleared once a destination could not be contacted.
+     */
+    int success;
+};
+
+/**
+ * Check if UDP check-ins are enabled.
+ *
+ * Returns 1 if ROC_UDP_ENV is set to anything but "0", 0 else.
+ */
+static int is_udp_enabled() {
+    const char* enabled = getenv(ROC_UDP_ENV);
+
+    return enabled && '\0' != enabled[0] && 0 != strcmp("0", enabled);
+}
+
+void roc_flight_init(struct RouteFlight* flight, const char* planeId,
+        int mapperPort, FlightOutput output, void* context) {
+    memset(flight, 0, sizeof(struct RouteFlight));
+    flight->planeId = planeId;
+    roc_mappers_init(&flight->mappers, mapperPort);
+    flight->parallel = roc_parallel_limit();
+    flight->useDatagrams = is_udp_enabled();
+    flight->output = output;
+    flight->context = context;
+    flight->startMicros = roc_now_micros();
+    roc_visit_deadlines(&flight->deadlines);
+}
+
+int roc_flight_resolve(struct RouteFlight* flight, char** destinations,
+        int count) {
+    int success = E_ROC_OK;
+    int i = 0;
+
+    flight->ports = (int*)malloc(MAX(1, count) * sizeof(int));
+    flight->cached = (int*)malloc(MAX(1, count) * sizeof(int));
+    flight->ids = (char**)malloc(MAX(1, count) * sizeof(char*));
+    if (!flight->ports || !flight->cached || !flight->ids) {
+        return E_ROC_FAILED_TO_CONNECT_MAPPER;
+    }
+
+    /*All destinations are resolved over one connection per mapper*/
+    success = roc_resolve_hedged(&flight->mappers, destinations, count,
+            flight->ports, flight->cache, flight->pool, flight->cached);
+    flight->resolvedMicros = roc_now_micros();
+    if (E_ROC_OK != success) {
+        return success;
+    }
+    for (i = 0; i < count; i++) {
+        if (flight->ports[i]) {
+            flight->ports[flight->count] = flight->ports[i];
+            flight->cached[flight->count] = flight->cached[i];
+            flight->ids[flight->count] = destinations[i];
+            flight->count += 1;
+        }
+    }
+    return E_ROC_OK;
+}
+
+/**
+ * Output a visited airport's info.
+ *
+ * @param flight  The flight visiting the airport.
+ *
+ * @param info  The airport's info text.
+ */
+static void output_info(struct RouteFlight* flight, const char* info) {
+    flight->output(flight->context, FLIGHT_INFO, info);
+}
+
+/**
+ * Get a time relative to the flight's start.
+ *
+ * Returns the time in microseconds since the flight was set up, -1 if the
+ * time is 0, i.e. was not reached.
+ *
+ * @param flight  The flight.
+ *
+ * @param micros  The monotonic clock's time in microseconds.
+ */
+static long long since_start(struct RouteFlight* flight, int64_t micros) {
+    return micros ? (long long)(micros - flight->startMicros) : -1;
+}
+
+/**
+ * Output the timing line of a visit, if timings are enabled.
+ *
+ * @param flight  The flight visiting the destination.
+ *
+ * @param i The destination's position in the route.
+ *
+ * @param result  The visit's result as named in the timing line.
+ *
+ * @param resolved  The monotonic clock's time in microseconds the
+ *                  destination's port number was known.
+ *
+ * @param timings The times the visit reached its steps, NULL if it was not
+ *                visited over TCP.
+ */
+static void report_hop(struct RouteFlight* flight, int i, const char* result,
+        int64_t resolved, const struct VisitTimings* timings) {
+    struct VisitTimings none;
+    char text[128 + LINE_READER_SIZE];
+
+    if (!flight->timed) {
+        return;
+    }
+    if (!timings) {
+        memset(&none, 0, sizeof(none));
+        timings = &none;
+    }
+    snprintf(text, sizeof(text),
+            "hop:%d:%s:%d:%s:%lld:%lld:%lld:%lld:%lld:%lld", i + 1,
+            flight->ids[i], flight->ports[i], result,
+            since_start(flight, resolved),
+            since_start(flight, timings->started),
+            since_start(flight, timings->connected),
+            since_start(flight, timings->sent),
+            since_start(flight, timings->firstByte),
+            since_start(flight, timings->closed));
+    flight->output(flight->context, FLIGHT_TIMING, text);
+}
+
+/**
+ * Report a destination, which did not reply in time.
+ *
+ * @param flight  The flight visiting the destination.
+ *
+ * @param i The destination's position in the route.
+ */
+static void report_timeout(struct RouteFlight* flight, int i) {
+    char text[64 + LINE_READER_SIZE];
+
+    snprintf(text, sizeof(text), "Timed out at destination %d (%s)", i + 1,
+            flight->ids[i]);
+    flight->output(flight->context, FLIGHT_ERROR, text);
+}
+
+/**
+ * Drop a destination, which could not be connected to, from the cache.
+ *
+ * A destination taken from the cache is looked up at the mapper again, as
+ * its control may have moved. Returns 1 if it got a new port number and is
+ * worth another try, 0 else.
+ *
+ * @param flight  The flight visiting the destination.
+ *
+ * @param i The destination's position in the route.
+ */
+static int refresh_destination(struct RouteFlight* flight, int i) {
+    int port = 0;
+
+    if (!flight->cache) {
+        return 0;
+    }
+    roc_cache_invalidate(flight->cache, flight->mappers.ports[0],
+            flight->ids[i]);
+    if (!flight->cached[i]) {
+        return 0;
+    }
+    flight->cached[i] = 0;
+
+    if (E_ROC_OK != roc_resolve_hedged(&flight->mappers, &flight->ids[i], 1,
+            &port, NULL, flight->pool, NULL) || port == flight->ports[i]) {
+        return 0;
+    }
+    roc_cache_store(flight->cache, flight->mappers.ports[0], flight->ids[i],
+            port);
+    flight->ports[i] = port;
+    return 1;
+}
+
+/**
+ * Check in at a segment of the route over UDP first, if enabled.
+ *
+ * Returns the destinations' states, 1 if the destination replied over UDP,
+ * 0 if it has to be visited over TCP. The caller has to free() the returned
+ * buffer, which is NULL if UDP is not enabled.
+ *
+ * @param flight  The flight visiting the segment.
+ *
+ * @param first The position of the segment's first destination.
+ *
+ * @param count The number of destinations in the segment.
+ *
+ * @param datagramInfos Output parameter, receives the destinations' info
+ *                      texts, which replied over UDP.
+ */
+static int* check_in_over_udp(struct RouteFlight* flight, int first,
+        int count, char*** datagramInfos) {
+    int* answered = NULL;
+
+    *datagramInfos = NULL;
+    if (!flight->useDatagrams || 0 == count) {
+        return NULL;
+    }
+
+    answered = (int*)malloc(count * sizeof(int));
+    *datagramInfos = roc_alloc_log(count, ROC_MAX_INFO_SIZE);
+    if (!answered || !*datagramInfos) {
+        free(answered);
+        free(*datagramInfos);
+        *datagramInfos = NULL;
+        return NULL;
+    }
+
+    roc_checkin_datagrams(flight->planeId, flight->ports + first, count,
+            *datagramInfos, answered);
+    return answered;
+}
+
+/**
+ * Visit a destination over TCP again and output its info.
+ *
+ * Returns 1 if the destination was visited, 0 if it could not be contacted
+ * or timed out.
+ *
+ * @param flight  The flight visiting the destination.
+ *
+ * @param i The destination's position in the route.
+ *
+ * @param resolved  The monotonic clock's time in microseconds the
+ *                  destination was looked up again.
+ */
+static int revisit_destination(struct RouteFlight* flight, int i,
+        int64_t resolved) {
+    char info[ROC_MAX_INFO_SIZE];
+    struct VisitTimings timings;
+    int visited = roc_visit_destination(flight->planeId, flight->ports[i],
+            &flight->deadlines, flight->pool, &timings, info);
+
+    if (VISIT_REPLIED == visited) {
+        output_info(flight, info);
+        report_hop(flight, i, "replied", resolved, &timings);
+    } else if (VISIT_TIMED_OUT == visited) {
+        report_timeout(flight, i);
+        report_hop(flight, i, "timed-out", resolved, &timings);
+    } else {
+        report_hop(flight, i, VISIT_REFUSED == visited ? "refused" : "failed",
+                resolved, &timings);
+    }
+    return VISIT_REPLIED == visited;
+}
+
+/**
+ * Output a destination's info, once all destinations before it are done.
+ *
+ * A destination, which could not be connected to, but got a new port number
+ * from the mapper, is visited again right away, so the output stays in route
+ * order.
+ *
+ * @param context The route segment visited.
+ *
+ * @param destination The destination's position in the segment.
+ *
+ * @param info  The destination's info text, NULL if it replied over UDP.
+ *
+ * @param visited One of enum VisitResult.
+ *
+ * @param timings The times the visit reached its steps, NULL if it replied
+ *                over UDP.
+ */
+static void deliver_info(void* context, int destination, const char* info,
+        int visited, const struct VisitTimings* timings) {
+    struct RouteSegment* segment = (struct RouteSegment*)context;
+    struct RouteFlight* flight = segment->flight;
+    int i = segment->first + destination;
+
+    if (segment->answered && segment->answered[destination]) {
+        output_info(flight, segment->datagramInfos[destination]);
+        report_hop(flight, i, "udp", flight->resolvedMicros, NULL);
+    } else if (VISIT_REPLIED == visited) {
+        output_info(flight, info);
+        report_hop(flight, i, "replied", flight->resolvedMicros, timings);
+    } else if (VISIT_TIMED_OUT == visited) {
+        report_timeout(flight, i);
+        report_hop(flight, i, "timed-out", flight->resolvedMicros, timings);
+        segment->success = 0;
+    } else {
+        report_hop(flight, i, VISIT_REFUSED == visited ? "refused" : "failed",
+                flight->resolvedMicros, timings);
+        if (!(VISIT_REFUSED == visited && refresh_destination(flight, i)
+                && revisit_destination(flight, i, roc_now_micros()))) {
+            segment->success = 0;
+        }
+    }
+}
+
+/**
+ * Visit up to parallel destinations of a segment of the route at once.
+ *
+ * Returns 1 if all destinations, which did not reply over UDP, were
+ * visited, 0 if one of them could not be contacted.
+ *
+ * @param flight  The flight visiting the segment.
+ *
+ * @param first The position of the segment's first destination.
+ *
+ * @param count The number of destinations in the segment.
+ *
+ * @param answered  If not NULL, answered[i] is set if the segment's
+ *                  destination i replied over UDP.
+ *
+ * @param datagramInfos The info texts received over UDP.
+ */
+static int visit_segment(struct RouteFlight* flight, int first, int count,
+        const int* answered, char** datagramInfos) {
+    struct RouteSegment segment;
+
+    segment.flight = flight;
+    segment.first = first;
+    segment.answered = answered;
+    segment.datagramInfos = datagramInfos;
+    segment.success = 1;
+
+    roc_visit_destinations(flight->planeId, flight->ports + first, count,
+            flight->parallel, answered, &flight->deadlines, flight->pool,
+            deliver_info, &segment);
+    return segment.success;
+}
+
+int roc_flight_visit(struct RouteFlight* flight) {
+    char text[64 + LINE_READER_SIZE];
+    int success = 1;
+    int segment = flight->useDatagrams ? DATAGRAM_ROUTE_SEGMENT
+            : MAX(1, flight->count);
+    char** datagramInfos = NULL;
+    int* answered = NULL;
+    int first = 0;
+    int count = 0;
+
+    roc_start_deadlines(&flight->deadlines);
+    for (first = 0; first < flight->count; first += segment) {
+        count = MIN(segment, flight->count - first);
+        answered = check_in_over_udp(flight, first, count, &datagramInfos);
+
+        success &= visit_segment(flight, first, count, answered,
+                datagramInfos);
+
+        free(answered);
+        free(datagramInfos);
+    }
+
+    if (flight->timed) {
+        snprintf(text, sizeof(text), "route:%s:%d:%lld:%lld",
+                flight->planeId, flight->count,
+                since_start(flight, flight->resolvedMicros),
+                since_start(flight, roc_now_micros()));
+        flight->output(flight->context, FLIGHT_TIMING, text);
+    }
+    return success ? E_ROC_OK : E_ROC_FAILED_TO_CONNECT_CONTROL;
+}
+
+void roc_flight_free(struct RouteFlight* flight) {
+    free(flight->ports);
+    free(flight->cached);
+    free(flight->ids);
+    flight->ports = NULL;
+    flight->cached = NULL;
+    flight->ids = NULL;
+    flight->count = 0;
+}
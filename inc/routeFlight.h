@@ -0,0 +1,195 @@
+/*
+ *routeFlight.h
+ */
+
+#pragma once
+
+#ifndef ROUTE_FLIGHT_H
+#define ROUTE_FLIGHT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "connPool.h"
+#include "routeCache.h"
+#include "routeResolve.h"
+#include "routeVisit.h"
+
+/**
+ * The kinds of a flight's output lines.
+ */
+enum FlightStream {
+    FLIGHT_INFO = 0,
+    FLIGHT_ERROR = 1,
+    FLIGHT_TIMING = 2
+};
+
+/**
+ * Callback receiving a flight's output line by line.
+ *
+ * @param context The context given to roc_flight_init().
+ *
+ * @param stream  FLIGHT_INFO for an info, which belongs on stdout,
+ *                FLIGHT_ERROR for stderr and FLIGHT_TIMING for the timing
+ *                report.
+ *
+ * @param text  The line without trailing LF.
+ */
+typedef void (*FlightOutput)(void* context, enum FlightStream stream,
+        const char* text);
+
+/**
+ * A single plane's flight along its route, as roc2310 flies it.
+ */
+struct RouteFlight {
+    /**
+     * The plane's ID.
+     */
+    const char* planeId;
+
+    /**
+     * The mappers the route is resolved at, none if the list is empty.
+     */
+    struct MapperList mappers;
+
+    /**
+     * The number of destinations to be visited.
+     */
+    int count;
+
+    /**
+     * The destinations' port numbers.
+     */
+    int* ports;
+
+    /**
+     * The destinations as given, aligned with ports.
+     */
+    char** ids;
+
+    /**
+     * Set for the destinations, whose port numbers were taken from the cache.
+     */
+    int* cached;
+
+    /**
+     * The resolution cache, NULL if there is none.
+     */
+    struct RouteCache* cache;
+
+    /**
+     * The idle connections to the mapper and controls, NULL if there are
+     * none.
+     */
+    struct ConnPool* pool;
+
+    /**
+     * The time limits of the route's visits.
+     */
+    struct VisitDeadlines deadlines;
+
+    /**
+     * The maximum number of destinations visited at once.
+     */
+    int parallel;
+
+    /**
+     * Set if the destinations are checked in at over UDP first.
+     */
+    int useDatagrams;
+
+    /**
+     * Set if a timing line is output per hop, see roc_flight_visit().
+     */
+    int timed;
+
+    /**
+     * The monotonic clock's time in microseconds the flight was set up, which
+     * the timings are relative to.
+     */
+    int64_t startMicros;
+
+    /**
+     * The monotonic clock's time in microseconds the route was resolved.
+     */
+    int64_t resolvedMicros;
+
+    /**
+     * Receives the infos, the timed out destinations and the timings.
+     */
+    FlightOutput output;
+
+    /**
+     * The context handed to output.
+     */
+    void* context;
+};
+
+/**
+ * Set up a flight with the settings from ROC_PARALLEL_ENV, ROC_UDP_ENV,
+ * ROC_HOP_TIMEOUT_ENV, ROC_ROUTE_TIMEOUT_ENV and the mappers from
+ * roc_mappers_init().
+ *
+ * No cache and no pool are used and no timings are output, until the caller
+ * sets them.
+ *
+ * @param flight  The flight to be initialized.
+ *
+ * @param planeId The plane's ID.
+ *
+ * @param mapperPort  The port number of the mapper, 0 if there is none.
+ *
+ * @param output  Receives the flight's output.
+ *
+ * @param context The context handed to output.
+ */
+void roc_flight_init(struct RouteFlight* flight, const char* planeId,
+        int mapperPort, FlightOutput output, void* context);
+
+/**
+ * Resolve the route, skipping invalid port numbers like roc2310 does.
+ *
+ * Returns E_ROC_OK on success, else the error roc_resolve_route() reports.
+ *
+ * @param flight  The flight, whose route is resolved.
+ *
+ * @param destinations  The destinations, which have to outlive the flight.
+ *
+ * @param count The number of destinations.
+ */
+int roc_flight_resolve(struct RouteFlight* flight, char** destinations,
+        int count);
+
+/**
+ * Visit all destinations of the resolved route.
+ *
+ * Up to parallel destinations are visited at once and each info is output
+ * as soon as it is in route order. The route's deadline starts now.
+ * Destinations, which replied over UDP, are not visited again; UDP
+ * check-ins are sent for DATAGRAM_ROUTE_SEGMENT destinations at a time,
+ * so the infos held stay bounded. A cached destination, which refuses the
+ * connection, is looked up again and revisited if its port number changed.
+ *
+ * If timed is set, a FLIGHT_TIMING line
+ * "hop:<n>:<destination>:<port>:<result>:<resolved>:<started>:<connected>:
+ * <sent>:<first byte>:<closed>" is output per visit in route order, where
+ * result is one of "replied", "refused", "failed", "timed-out" and "udp".
+ * The times are in microseconds since the flight was set up, -1 for the
+ * steps not reached. A destination revisited after a refresh gets a second
+ * line. A final "route:<plane id>:<hops>:<resolved>:<landed>" line follows.
+ *
+ * Returns E_ROC_OK if all destinations were visited, else
+ * E_ROC_FAILED_TO_CONNECT_CONTROL.
+ *
+ * @param flight  The resolved flight.
+ */
+int roc_flight_visit(struct RouteFlight* flight);
+
+/**
+ * Release the memory held by the flight, but neither its cache nor its pool.
+ *
+ * @param flight  The flight to be freed.
+ */
+void roc_flight_free(struct RouteFlight* flight);
+
+#endif
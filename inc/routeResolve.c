@@ -0,0 +1,801 @@
+/*
+ *routeResolve.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "errorReturn.h"
+#include "protocol.h"
+#include "routeCache.h"
+#include "routeResolve.h"
+
+/**
+ * A distinct airport ID of the route and its lookup result.
+ */
+struct RouteName {
+    /**
+     * The airport ID.
+     */
+    const char* id;
+
+    /**
+     * The control's port number, once resolved.
+     */
+    int port;
+
+    /**
+     * E_ROC_OK once resolved, the error to be reported else.
+     */
+    int error;
+
+    /**
+     * 1 if the port number was taken from the cache, 0 else.
+     */
+    int cached;
+};
+
+struct HedgedLookup;
+
+/**
+ * The lookup of a route's names at one of its mappers.
+ */
+struct MapperAttempt {
+    /**
+     * The lookups this one races against, NULL if it is the only one.
+     */
+    struct HedgedLookup* race;
+
+    /**
+     * The port number at which the mapper is listening.
+     */
+    int mapperPort;
+
+    /**
+     * The idle connections, NULL if there are none.
+     */
+    struct ConnPool* pool;
+
+    /**
+     * The names to be looked up, which receive the mapper's replies.
+     */
+    struct RouteName* names;
+
+    /**
+     * The number of names.
+     */
+    int count;
+
+    /**
+     * The connection to the mapper in use, -1 while there is none.
+     */
+    int socket;
+
+    /**
+     * The thread running the lookup.
+     */
+    pthread_t thread;
+};
+
+/**
+ * The lookups of a route's names at several mappers, of which the first
+ * complete one is taken.
+ */
+struct HedgedLookup {
+    /**
+     * Guards the fields below and the attempts' sockets.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Signaled when an attempt finished.
+     */
+    pthread_cond_t finished;
+
+    /**
+     * The attempt, whose reply is taken, -1 while there is none.
+     */
+    int winner;
+
+    /**
+     * The number of attempts, which finished.
+     */
+    int done;
+
+    /**
+     * One attempt per mapper.
+     */
+    struct MapperAttempt attempts[ROUTE_MAX_MAPPERS];
+};
+
+/**
+ * Order route names by their airport IDs.
+ */
+static int compare_names(const void* first, const void* second) {
+    return strcmp(((const struct RouteName*)first)->id,
+            ((const struct RouteName*)second)->id);
+}
+
+/**
+ * Take a destination as port number, if it is numeric.
+ *
+ * Returns 1 if the destination is an airport ID to be looked up, 0 if it is
+ * numeric.
+ *
+ * @param destination The destination given on the command line.
+ *
+ * @param port  Output parameter, receives the port number of a numeric
+ *              destination, 0 if it is invalid and to be skipped.
+ */
+static int needs_lookup(const char* destination, int* port) {
+    char* end = NULL;
+    long controlPort = strtol(destination, &end, 10);
+
+    *port = 0;
+    if (LONG_MIN == controlPort || LONG_MAX == controlPort) {
+        return 0;
+    }
+    if ('\0' != *end) {
+        return 1;
+    }
+    if (0 < controlPort && controlPort <= 65535) {
+        *port = (int)controlPort;
+    }
+    return 0;
+}
+
+/**
+ * Find a route name by its airport ID.
+ *
+ * Returns the name, NULL if the ID is not part of the route.
+ *
+ * @param names The route's distinct names in ID order.
+ *
+ * @param count The number of names.
+ *
+ * @param id  The airport ID to be found.
+ */
+static struct RouteName* find_name(struct RouteName* names, int count,
+        const char* id) {
+    struct RouteName key;
+
+    key.id = id;
+    return (struct RouteName*)bsearch(&key, names, count,
+            sizeof(struct RouteName), compare_names);
+}
+
+/**
+ * Store the mapper's reply for a route name.
+ *
+ * @param name  The looked up name.
+ *
+ * @param reply The port number replied, without trailing LF.
+ */
+static void take_port(struct RouteName* name, const char* reply) {
+    char* end = NULL;
+    long port = strtol(reply, &end, 10);
+
+    if ('\0' != *end || port <= 0 || 65535 < port) {
+        name->error = E_ROC_FAILED_TO_FIND_ENTRY;
+        return;
+    }
+    name->port = (int)port;
+    name->error = E_ROC_OK;
+}
+
+/**
+ * Check if the mapper replied SERVER_BUSY_REPLY.
+ *
+ * Returns 1 if it did, 0 else.
+ *
+ * @param reply The received line without trailing LF.
+ */
+static int is_busy(const char* reply) {
+    size_t length = strlen(SERVER_BUSY_REPLY) - 1;
+
+    return 0 == strncmp(SERVER_BUSY_REPLY, reply, length)
+            && '\0' == reply[length];
+}
+
+/**
+ * Send all of a buffer to the mapper.
+ *
+ * Returns 0 on success, -1 if the connection broke.
+ *
+ * @param mapperSocket  The connection to the mapper.
+ *
+ * @param data  The data to be sent.
+ *
+ * @param size  The length of data.
+ */
+static int send_all(int mapperSocket, const char* data, size_t size) {
+    ssize_t sent = 0;
+
+    while (0 < size) {
+        sent = send(mapperSocket, data, size, MSG_NOSIGNAL);
+        if (0 > sent && EINTR == errno) {
+            continue;
+        }
+        if (0 > sent) {
+            return -1;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * Look up a window of route names with pipelined "?" requests.
+ *
+ * Returns 0 on success, -1 if the connection broke or the mapper is busy.
+ *
+ * @param reader  The connection to the mapper.
+ *
+ * @param names The names to be looked up.
+ *
+ * @param count The number of names, at most ROUTE_RESOLVE_WINDOW.
+ */
+static int lookup_window(struct LineReader* reader, struct RouteName* names,
+        int count) {
+    char reply[ROC_MAX_INFO_SIZE + 1];
+    char* requests = NULL;
+    size_t size = 0;
+    int i = 0;
+
+    for (i = 0; i < count; i++) {
+        size += strlen(names[i].id) + 2;
+    }
+    requests = (char*)malloc(size + 1);
+    if (!requests) {
+        return -1;
+    }
+
+    size = 0;
+    for (i = 0; i < count; i++) {
+        size += (size_t)sprintf(requests + size, "?%s\n", names[i].id);
+    }
+    if (0 != send_all(reader->socketNumber, requests, size)) {
+        free(requests);
+        return -1;
+    }
+    free(requests);
+
+    for (i = 0; i < count; i++) {
+        /*An overloaded mapper is as good as an unreachable one*/
+        if (0 > read_line(reader, reply, sizeof(reply))
+                || is_busy(reply)) {
+            return -1;
+        }
+        take_port(&names[i], reply);
+    }
+    return 0;
+}
+
+/**
+ * Look up all route names over the given mapper connection.
+ *
+ * Returns 0 if all names were replied, -1 else.
+ *
+ * @param mapperSocket  The connection to the mapper.
+ *
+ * @param names The names to be looked up.
+ *
+ * @param count The number of names.
+ */
+static int lookup_over(int mapperSocket, struct RouteName* names, int count) {
+    struct LineReader reader;
+    int first = 0;
+
+    init_line_reader(&reader, mapperSocket);
+    for (first = 0; first < count; first += ROUTE_RESOLVE_WINDOW) {
+        if (0 != lookup_window(&reader, names + first,
+                MIN(ROUTE_RESOLVE_WINDOW, count - first))) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Register the connection an attempt uses, so it can be shut down once
+ * another attempt won.
+ *
+ * Returns 0 if the attempt goes on, -1 if another one already won.
+ *
+ * @param attempt The attempt using the connection.
+ *
+ * @param mapperSocket  The connection to the mapper.
+ */
+static int claim_socket(struct MapperAttempt* attempt, int mapperSocket) {
+    int success = 0;
+
+    if (!attempt->race) {
+        return 0;
+    }
+    pthread_mutex_lock(&attempt->race->lock);
+    if (-1 != attempt->race->winner) {
+        success = -1;
+    } else {
+        attempt->socket = mapperSocket;
+    }
+    pthread_mutex_unlock(&attempt->race->lock);
+    return success;
+}
+
+/**
+ * Unregister the connection an attempt used, before it is closed or pooled.
+ *
+ * @param attempt The attempt, which used the connection.
+ */
+static void release_socket(struct MapperAttempt* attempt) {
+    if (!attempt->race) {
+        return;
+    }
+    pthread_mutex_lock(&attempt->race->lock);
+    attempt->socket = -1;
+    pthread_mutex_unlock(&attempt->race->lock);
+}
+
+/**
+ * Look up the attempt's names over the given mapper connection.
+ *
+ * Returns 0 if all names were replied, -1 else.
+ *
+ * @param attempt The lookup.
+ *
+ * @param mapperSocket  The connection to the mapper.
+ */
+static int lookup_claimed(struct MapperAttempt* attempt, int mapperSocket) {
+    int success = 0;
+
+    if (0 != claim_socket(attempt, mapperSocket)) {
+        return -1;
+    }
+    success = lookup_over(mapperSocket, attempt->names, attempt->count);
+    release_socket(attempt);
+    return success;
+}
+
+/**
+ * Look up all of the attempt's names over one mapper connection.
+ *
+ * A pooled connection is tried first and a new one, if it went stale. Names,
+ * which are not replied, keep E_ROC_FAILED_TO_CONNECT_MAPPER.
+ *
+ * Returns 0 if all names were replied, -1 else.
+ *
+ * @param attempt The lookup.
+ */
+static int lookup_names(struct MapperAttempt* attempt) {
+    int mapperSocket = roc_pool_take(attempt->pool, attempt->mapperPort);
+
+    if (0 <= mapperSocket) {
+        if (0 == lookup_claimed(attempt, mapperSocket)) {
+            roc_pool_give(attempt->pool, attempt->mapperPort, mapperSocket);
+            return 0;
+        }
+        roc_close_conn(mapperSocket);
+    }
+
+    mapperSocket = control_open_mapper_conn(attempt->mapperPort);
+    if (0 > mapperSocket) {
+        return -1;
+    }
+    if (0 == lookup_claimed(attempt, mapperSocket)) {
+        roc_pool_give(attempt->pool, attempt->mapperPort, mapperSocket);
+        return 0;
+    }
+    roc_close_conn(mapperSocket);
+    return -1;
+}
+
+/**
+ * Resolve all of the attempt's names from a snapshot of the whole map.
+ *
+ * Returns 1 if the snapshot was received, so names not in it are unknown, 0
+ * if the mapper cannot be reached or is too busy to send it.
+ *
+ * @param attempt The lookup.
+ */
+static int fetch_snapshot(struct MapperAttempt* attempt) {
+    struct RouteName* names = attempt->names;
+    int count = attempt->count;
+    char entry[MAPPER_MAX_ID_SIZE + 16];
+    struct LineReader reader;
+    struct RouteName* name = NULL;
+    char* separator = NULL;
+    int mapperSocket = control_open_mapper_conn(attempt->mapperPort);
+    int entries = 0;
+    int i = 0;
+
+    if (0 > mapperSocket) {
+        return 0;
+    }
+    if (0 != claim_socket(attempt, mapperSocket)) {
+        roc_close_conn(mapperSocket);
+        return 0;
+    }
+    init_line_reader(&reader, mapperSocket);
+
+    /*The snapshot ends, when the mapper closes the connection*/
+    if (0 != send_all(mapperSocket, "@\n", 2)
+            || 0 != shutdown(mapperSocket, SHUT_WR)) {
+        release_socket(attempt);
+        roc_close_conn(mapperSocket);
+        return 0;
+    }
+
+    while (0 <= read_line(&reader, entry, sizeof(entry))) {
+        if (0 == entries++ && is_busy(entry)) {
+            release_socket(attempt);
+            roc_close_conn(mapperSocket);
+            return 0;
+        }
+
+        separator = strrchr(entry, ':');
+        if (!separator) {
+            continue;
+        }
+        *separator = '\0';
+        name = find_name(names, count, entry);
+        if (name) {
+            take_port(name, separator + 1);
+        }
+    }
+    release_socket(attempt);
+    roc_close_conn(mapperSocket);
+
+    for (i = 0; i < count; i++) {
+        if (E_ROC_OK != names[i].error) {
+            names[i].error = E_ROC_FAILED_TO_FIND_ENTRY;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Resolve all of the attempt's names at its mapper, from a snapshot if there
+ * are ROUTE_SNAPSHOT_MIN or more of them, else or if that fails with "?"
+ * lookups.
+ *
+ * Returns 1 if the mapper replied for all names, 0 else.
+ *
+ * @param attempt The lookup.
+ */
+static int resolve_at(struct MapperAttempt* attempt) {
+    if (ROUTE_SNAPSHOT_MIN <= attempt->count && fetch_snapshot(attempt)) {
+        return 1;
+    }
+    return 0 == lookup_names(attempt);
+}
+
+/**
+ * Thread running a hedged attempt.
+ *
+ * The first attempt resolving all names wins and shuts down the connections
+ * of the others, so they give up right away.
+ *
+ * @param parameter The attempt.
+ */
+static void* run_attempt(void* parameter) {
+    struct MapperAttempt* attempt = (struct MapperAttempt*)parameter;
+    struct HedgedLookup* race = attempt->race;
+    int resolved = resolve_at(attempt);
+    int i = 0;
+
+    pthread_mutex_lock(&race->lock);
+    race->done += 1;
+    if (resolved && -1 == race->winner) {
+        race->winner = (int)(attempt - race->attempts);
+        for (i = 0; i < ROUTE_MAX_MAPPERS; i++) {
+            if (0 <= race->attempts[i].socket) {
+                shutdown(race->attempts[i].socket, SHUT_RDWR);
+            }
+        }
+    }
+    pthread_cond_signal(&race->finished);
+    pthread_mutex_unlock(&race->lock);
+    return NULL;
+}
+
+/**
+ * Get the monotonic clock's time, by which the next mapper is asked.
+ *
+ * @param deadline  Output parameter, receives the time.
+ *
+ * @param millis  The time in milliseconds from now.
+ */
+static void hedge_deadline(struct timespec* deadline, int millis) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += millis / 1000;
+    deadline->tv_nsec += (long)(millis % 1000) * 1000000;
+    if (1000000000 <= deadline->tv_nsec) {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/**
+ * Look up the route names at several mappers, taking the first complete
+ * reply.
+ *
+ * Each mapper gets its own copy of the names. The next mapper is asked once
+ * the previous one took the hedge delay or all asked ones failed. If none
+ * replied, the first mapper's results are kept.
+ *
+ * @param mappers The mappers, at least two.
+ *
+ * @param pool  The idle connections, NULL if there are none.
+ *
+ * @param names The names to be looked up.
+ *
+ * @param count The number of names.
+ */
+static void hedge_names(const struct MapperList* mappers,
+        struct ConnPool* pool, struct RouteName* names, int count) {
+    struct HedgedLookup race;
+    struct MapperAttempt* attempt = NULL;
+    struct RouteName* copies = NULL;
+    pthread_condattr_t attributes;
+    struct timespec hedgeAt;
+    int created[ROUTE_MAX_MAPPERS];
+    int started = 0;
+    int due = 0;
+    int i = 0;
+
+    copies = (struct RouteName*)malloc((size_t)mappers->count * count
+            * sizeof(struct RouteName));
+    if (!copies) {
+        return;
+    }
+    memset(&race, 0, sizeof(race));
+    race.winner = -1;
+    for (i = 0; i < mappers->count; i++) {
+        attempt = &race.attempts[i];
+        attempt->race = &race;
+        attempt->mapperPort = mappers->ports[i];
+        attempt->pool = pool;
+        attempt->names = copies + (size_t)i * count;
+        attempt->count = count;
+        attempt->socket = -1;
+        memcpy(attempt->names, names, count * sizeof(struct RouteName));
+        created[i] = 0;
+    }
+    for (; i < ROUTE_MAX_MAPPERS; i++) {
+        race.attempts[i].socket = -1;
+    }
+
+    pthread_mutex_init(&race.lock, NULL);
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&race.finished, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    pthread_mutex_lock(&race.lock);
+    while (-1 == race.winner && race.done < mappers->count) {
+        if (started < mappers->count && (race.done == started || due)) {
+            attempt = &race.attempts[started];
+            created[started] = 0 == pthread_create(&attempt->thread, NULL,
+                    run_attempt, attempt);
+            race.done += !created[started];
+            started += 1;
+            due = 0;
+            hedge_deadline(&hedgeAt, mappers->hedgeMillis);
+        } else if (started < mappers->count) {
+            due = ETIMEDOUT == pthread_cond_timedwait(&race.finished,
+                    &race.lock, &hedgeAt);
+        } else {
+            pthread_cond_wait(&race.finished, &race.lock);
+        }
+    }
+    pthread_mutex_unlock(&race.lock);
+
+    /*The losers' connections are shut down, so they return quickly*/
+    for (i = 0; i < started; i++) {
+        if (created[i]) {
+            pthread_join(race.attempts[i].thread, NULL);
+        }
+    }
+    memcpy(names, race.attempts[MAX(0, race.winner)].names,
+            count * sizeof(struct RouteName));
+
+    pthread_cond_destroy(&race.finished);
+    pthread_mutex_destroy(&race.lock);
+    free(copies);
+}
+
+/**
+ * Look up the route names at the route's mappers.
+ *
+ * Names, which are not replied, keep E_ROC_FAILED_TO_CONNECT_MAPPER.
+ *
+ * @param mappers The mappers to be asked.
+ *
+ * @param pool  The idle connections, NULL if there are none.
+ *
+ * @param names The names to be looked up.
+ *
+ * @param count The number of names.
+ */
+static void lookup_at_mappers(const struct MapperList* mappers,
+        struct ConnPool* pool, struct RouteName* names, int count) {
+    struct MapperAttempt attempt;
+
+    if (1 < mappers->count) {
+        hedge_names(mappers, pool, names, count);
+        return;
+    }
+    if (1 == mappers->count) {
+        memset(&attempt, 0, sizeof(attempt));
+        attempt.mapperPort = mappers->ports[0];
+        attempt.pool = pool;
+        attempt.names = names;
+        attempt.count = count;
+        attempt.socket = -1;
+        resolve_at(&attempt);
+    }
+}
+
+/**
+ * Resolve the route names, which are not cached, from the mappers.
+ *
+ * Resolved names are stored in the cache, if any.
+ *
+ * @param mappers The mappers to be asked.
+ *
+ * @param cache The resolution cache, NULL if there is none.
+ *
+ * @param pool  The idle connections, NULL if there are none.
+ *
+ * @param names The route's distinct names in ID order.
+ *
+ * @param count The number of names.
+ */
+static void resolve_missing(const struct MapperList* mappers,
+        struct RouteCache* cache, struct ConnPool* pool,
+        struct RouteName* names, int count) {
+    struct RouteName* missing = NULL;
+    struct RouteName* name = NULL;
+    int misses = 0;
+    int i = 0;
+
+    missing = (struct RouteName*)malloc(MAX(1, count)
+            * sizeof(struct RouteName));
+    if (!missing) {
+        return;
+    }
+
+    /*The misses keep the names' ID order, so they can be searched too*/
+    for (i = 0; i < count; i++) {
+        if (!names[i].cached) {
+            missing[misses++] = names[i];
+        }
+    }
+
+    if (0 < misses) {
+        lookup_at_mappers(mappers, pool, missing, misses);
+    }
+
+    for (i = 0; i < misses; i++) {
+        name = find_name(names, count, missing[i].id);
+        *name = missing[i];
+        if (cache && E_ROC_OK == name->error) {
+            roc_cache_store(cache, mappers->ports[0], name->id,
+                    name->port);
+        }
+    }
+    free(missing);
+}
+
+void roc_mappers_init(struct MapperList* mappers, int mapperPort) {
+    const char* backups = getenv(ROC_MAPPERS_ENV);
+    const char* hedge = getenv(ROC_HEDGE_ENV);
+    long millis = hedge ? strtol(hedge, NULL, 10) : -1;
+    char* end = NULL;
+    long port = 0;
+
+    memset(mappers, 0, sizeof(struct MapperList));
+    mappers->hedgeMillis = 0 <= millis ? (int)MIN(millis, INT_MAX)
+            : ROUTE_DEFAULT_HEDGE_DELAY;
+    if (0 >= mapperPort) {
+        return;
+    }
+    mappers->ports[mappers->count++] = mapperPort;
+
+    while (backups && mappers->count < ROUTE_MAX_MAPPERS) {
+        port = strtol(backups, &end, 10);
+        if (end == backups) {
+            break;
+        }
+        if (0 < port && port <= 65535) {
+            mappers->ports[mappers->count++] = (int)port;
+        }
+        backups = ',' == *end ? end + 1 : NULL;
+    }
+}
+
+int roc_resolve_route(int mapperPort, char** destinations, int count,
+        int* ports, struct RouteCache* cache, struct ConnPool* pool,
+        int* cached) {
+    struct MapperList mappers;
+
+    memset(&mappers, 0, sizeof(mappers));
+    mappers.ports[0] = mapperPort;
+    mappers.count = 0 < mapperPort;
+    return roc_resolve_hedged(&mappers, destinations, count, ports, cache,
+            pool, cached);
+}
+
+int roc_resolve_hedged(const struct MapperList* mappers, char** destinations,
+        int count, int* ports, struct RouteCache* cache,
+        struct ConnPool* pool, int* cached) {
+    struct RouteName* names = NULL;
+    struct RouteName* name = NULL;
+    int success = E_ROC_OK;
+    int distinct = 0;
+    int unique = 0;
+    int port = 0;
+    int i = 0;
+
+    names = (struct RouteName*)malloc(MAX(1, count)
+            * sizeof(struct RouteName));
+    if (!names) {
+        return E_ROC_FAILED_TO_CONNECT_MAPPER;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (cached) {
+            cached[i] = 0;
+        }
+        if (needs_lookup(destinations[i], &ports[i])) {
+            names[distinct].id = destinations[i];
+            names[distinct].port = 0;
+            names[distinct].error = E_ROC_FAILED_TO_CONNECT_MAPPER;
+            names[distinct].cached = 0;
+            distinct += 1;
+        }
+    }
+
+    /*Every airport ID is looked up once*/
+    qsort(names, distinct, sizeof(struct RouteName), compare_names);
+    for (i = 0; i < distinct; i++) {
+        if (0 == unique || 0 != strcmp(names[unique - 1].id, names[i].id)) {
+            names[unique++] = names[i];
+        }
+    }
+    distinct = unique;
+
+    for (i = 0; cache && i < distinct; i++) {
+        names[i].port = roc_cache_lookup(cache, mappers->ports[0],
+                names[i].id);
+        if (0 < names[i].port) {
+            names[i].error = E_ROC_OK;
+            names[i].cached = 1;
+        }
+    }
+    resolve_missing(mappers, cache, pool, names, distinct);
+
+    /*Errors are reported for the first destination in route order*/
+    for (i = 0; i < count && E_ROC_OK == success; i++) {
+        if (!needs_lookup(destinations[i], &port)) {
+            continue;
+        }
+        name = find_name(names, distinct, destinations[i]);
+        success = name->error;
+        ports[i] = name->port;
+        if (cached) {
+            cached[i] = name->cached;
+        }
+    }
+
+    free(names);
+    return success;
+}
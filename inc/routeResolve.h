@@ -0,0 +1,148 @@
+/*
+ *routeResolve.h
+ */
+
+#pragma once
+
+#ifndef ROUTE_RESOLVE_H
+#define ROUTE_RESOLVE_H
+
+#include <stdio.h>
+
+#include "connPool.h"
+#include "routeCache.h"
+
+/**
+ * The maximum number of lookups sent to the mapper before their replies are
+ * read. Their replies are small enough to never fill the socket buffers, so
+ * neither side blocks the other.
+ */
+#define ROUTE_RESOLVE_WINDOW 1024
+
+/**
+ * The number of distinct airport IDs, from which on the whole map is fetched
+ * with a single "@" instead of one "?" lookup per ID.
+ */
+#define ROUTE_SNAPSHOT_MIN 256
+
+/**
+ * The maximum number of mappers a route's lookups are hedged to.
+ */
+#define ROUTE_MAX_MAPPERS 4
+
+/**
+ * The time in milliseconds a mapper may take by default, before the next one
+ * is asked too.
+ */
+#define ROUTE_DEFAULT_HEDGE_DELAY 10
+
+/**
+ * The mappers holding the same map, which a route's airport IDs are looked up
+ * at.
+ */
+struct MapperList {
+    /**
+     * The mappers' port numbers, the first one's is the command line's. It
+     * also keys the resolutions in the cache.
+     */
+    int ports[ROUTE_MAX_MAPPERS];
+
+    /**
+     * The number of mappers, 0 if there is none.
+     */
+    int count;
+
+    /**
+     * The time in milliseconds a mapper may take, before the next one is
+     * asked too.
+     */
+    int hedgeMillis;
+};
+
+/**
+ * Set up the mappers of a route from the command line's one and
+ * ROC_MAPPERS_ENV, skipping invalid port numbers and those beyond
+ * ROUTE_MAX_MAPPERS.
+ *
+ * The hedge delay is ROC_HEDGE_ENV milliseconds, ROUTE_DEFAULT_HEDGE_DELAY if
+ * it is not set.
+ *
+ * @param mappers Output parameter, receives the mappers.
+ *
+ * @param mapperPort  The command line's mapper's port number, 0 if there is
+ *                    none, which leaves the list empty.
+ */
+void roc_mappers_init(struct MapperList* mappers, int mapperPort);
+
+/**
+ * Resolve all destinations of a route over a single mapper connection.
+ *
+ * Numeric destinations are taken as port numbers, invalid ones are skipped
+ * like roc_resolve_control() does. The distinct airport IDs among the others
+ * are looked up with pipelined "?" requests, or all at once from a "@"
+ * snapshot of the map if there are ROUTE_SNAPSHOT_MIN or more of them.
+ * IDs found in the cache are not sent to the mapper at all, the others are
+ * cached once resolved. A pooled mapper connection is reused for the "?"
+ * requests.
+ *
+ * Returns E_ROC_OK if all destinations were resolved, else the error of the
+ * first destination in route order, which could not be resolved, i.e.
+ * E_ROC_FAILED_TO_CONNECT_MAPPER or E_ROC_FAILED_TO_FIND_ENTRY.
+ *
+ * @param mapperPort  The port number at which the mapper is listening.
+ *
+ * @param destinations  The route's destinations.
+ *
+ * @param count The number of destinations.
+ *
+ * @param ports Output parameter, receives destination i's port number in
+ *              ports[i], 0 if the destination is skipped.
+ *
+ * @param cache The resolution cache, NULL if there is none.
+ *
+ * @param pool  The idle connections to be reused and to receive the mapper
+ *              connection, NULL to connect anew and close it.
+ *
+ * @param cached  If not NULL, output parameter, cached[i] is set to 1 if
+ *                destination i's port number was taken from the cache, 0
+ *                else.
+ */
+int roc_resolve_route(int mapperPort, char** destinations, int count,
+        int* ports, struct RouteCache* cache, struct ConnPool* pool,
+        int* cached);
+
+/**
+ * Resolve all destinations of a route like roc_resolve_route(), but hedge the
+ * lookups across several mappers.
+ *
+ * The first mapper is asked first. If it did not reply within the list's
+ * hedge delay or failed, the next one is asked the same, and so on. The first
+ * complete reply is taken and the other mappers' connections are shut down.
+ * Resolutions are cached for the first mapper.
+ *
+ * Returns E_ROC_OK if all destinations were resolved, else the error of the
+ * first destination in route order, which could not be resolved.
+ *
+ * @param mappers The mappers to be asked.
+ *
+ * @param destinations  The route's destinations.
+ *
+ * @param count The number of destinations.
+ *
+ * @param ports Output parameter, receives destination i's port number in
+ *              ports[i], 0 if the destination is skipped.
+ *
+ * @param cache The resolution cache, NULL if there is none.
+ *
+ * @param pool  The idle connections to be reused and to receive the mapper
+ *              connections, NULL to connect anew and close them.
+ *
+ * @param cached  If not NULL, output parameter, cached[i] is set to 1 if
+ *                destination i's port number was taken from the cache, 0
+ *                else.
+ */
+int roc_resolve_hedged(const struct MapperList* mappers, char** destinations,
+        int count, int* ports, struct RouteCache* cache,
+        struct ConnPool* pool, int* cached);
+
+#endif
@@ -0,0 +1,526 @@
+/*
+ *routeVisit.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "errorReturn.h"
+#include "protocol.h"
+#include "routeVisit.h"
+
+/**
+ * The result of a visit in progress, besides enum VisitResult's.
+ */
+#define ROUTE_VISIT_PENDING 2
+
+int roc_parallel_limit() {
+    const char* value = getenv(ROC_PARALLEL_ENV);
+    long limit = value ? strtol(value, NULL, 10) : 0;
+
+    return (int)MIN(MAX(1, limit), ROUTE_MAX_PARALLEL);
+}
+
+int64_t roc_now_micros(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+int64_t roc_now_millis(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Get a time limit in milliseconds from the environment.
+ *
+ * Returns the variable's value, fallback if it is not set or negative.
+ *
+ * @param name  The environment variable's name.
+ *
+ * @param fallback  The limit used if the variable is not set.
+ */
+static int timeout_from_env(const char* name, int fallback) {
+    const char* value = getenv(name);
+    long millis = value ? strtol(value, NULL, 10) : -1;
+
+    return 0 <= millis ? (int)MIN(millis, INT_MAX) : fallback;
+}
+
+void roc_visit_deadlines(struct VisitDeadlines* deadlines) {
+    deadlines->hopMillis = timeout_from_env(ROC_HOP_TIMEOUT_ENV,
+            ROUTE_DEFAULT_HOP_TIMEOUT);
+    deadlines->routeMillis = timeout_from_env(ROC_ROUTE_TIMEOUT_ENV, 0);
+    roc_start_deadlines(deadlines);
+}
+
+void roc_start_deadlines(struct VisitDeadlines* deadlines) {
+    deadlines->routeEnd = 0 < deadlines->routeMillis
+            ? roc_now_millis() + deadlines->routeMillis : 0;
+}
+
+int64_t roc_visit_deadline(const struct VisitDeadlines* deadlines,
+        int64_t now) {
+    int64_t deadline = 0;
+
+    if (!deadlines) {
+        return 0;
+    }
+    if (0 < deadlines->hopMillis) {
+        deadline = now + deadlines->hopMillis;
+    }
+    if (0 < deadlines->routeEnd
+            && (0 == deadline || deadlines->routeEnd < deadline)) {
+        deadline = deadlines->routeEnd;
+    }
+    return deadline;
+}
+
+/**
+ * Get the time poll() may wait for the visits in progress.
+ *
+ * Returns the time in milliseconds until the first visit times out, -1 if
+ * none of them has a deadline.
+ *
+ * @param visits  The visits in progress.
+ *
+ * @param active  The number of visits.
+ *
+ * @param now The monotonic clock's current time in milliseconds.
+ */
+static int poll_timeout(const struct RouteVisit* visits, int active,
+        int64_t now) {
+    int64_t first = 0;
+    int i = 0;
+
+    for (i = 0; i < active; i++) {
+        if (visits[i].deadline
+                && (0 == first || visits[i].deadline < first)) {
+            first = visits[i].deadline;
+        }
+    }
+    if (0 == first) {
+        return -1;
+    }
+    return (int)MIN(MAX(0, first - now), INT_MAX);
+}
+
+int roc_start_visit(struct RouteVisit* visit, int destination, int port) {
+    struct sockaddr_in address;
+    int visitSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK
+            | SOCK_CLOEXEC, 0);
+
+    memset(visit, 0, sizeof(struct RouteVisit));
+    visit->destination = destination;
+    visit->timings.started = roc_now_micros();
+    if (0 > visitSocket) {
+        return -1;
+    }
+    tune_client_conn(visitSocket);
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons((uint16_t)port);
+
+    if (0 == connect(visitSocket, (struct sockaddr*)&address,
+            sizeof(address))) {
+        visit->step = VISIT_SENDING;
+        visit->timings.connected = roc_now_micros();
+    } else if (EINPROGRESS == errno) {
+        visit->step = VISIT_CONNECTING;
+    } else {
+        close(visitSocket);
+        return -1;
+    }
+    return visitSocket;
+}
+
+/**
+ * Start a visit on a pooled connection, else on a new one.
+ *
+ * Returns the visit's socket, -1 if the connection failed right away.
+ *
+ * @param visit Output parameter, receives the visit's initial state.
+ *
+ * @param destination The destination's position in the route.
+ *
+ * @param port  The destination's port number.
+ *
+ * @param pool  The idle connections, NULL if there are none.
+ */
+static int start_pooled_visit(struct RouteVisit* visit, int destination,
+        int port, struct ConnPool* pool) {
+    int visitSocket = roc_pool_take(pool, port);
+
+    if (0 > visitSocket) {
+        return roc_start_visit(visit, destination, port);
+    }
+    memset(visit, 0, sizeof(struct RouteVisit));
+    visit->destination = destination;
+    visit->step = VISIT_SENDING;
+    visit->pooled = 1;
+    visit->timings.started = roc_now_micros();
+    visit->timings.connected = visit->timings.started;
+    return visitSocket;
+}
+
+/**
+ * Check the info received from a destination.
+ *
+ * Returns 1 if the info is valid, 0 if the destination is busy or replied
+ * invalid characters.
+ *
+ * @param info  The received info, trimmed in place.
+ */
+static int accept_info(char* info) {
+    if (0 == strcmp(SERVER_BUSY_REPLY, info)) {
+        return 0;
+    }
+    roc_trim_string_end(info);
+    return E_ROC_OK == roc_check_chars(info);
+}
+
+/**
+ * Check the error of a send() or recv() on a visit's socket.
+ *
+ * Returns 0 if the visit has to wait, 1 if it failed. A TCP Fast Open
+ * connection reports a refused connect() here, as it is only opened by the
+ * first send(), which reports EINPROGRESS if the SYN could not carry the
+ * request.
+ *
+ * @param visited Output parameter, set to VISIT_REFUSED if the connection
+ *                was refused.
+ */
+static int visit_failed(int* visited) {
+    if (EAGAIN == errno || EWOULDBLOCK == errno || EINPROGRESS == errno) {
+        return 0;
+    }
+    if (ECONNREFUSED == errno) {
+        *visited = VISIT_REFUSED;
+    }
+    return 1;
+}
+
+int roc_advance_visit(struct RouteVisit* visit, struct pollfd* waiting,
+        const char* request, size_t length, char* info, int* visited) {
+    char* found = NULL;
+    ssize_t done = 0;
+    int error = 0;
+    socklen_t errorSize = sizeof(error);
+
+    if (VISIT_CONNECTING == visit->step) {
+        if (0 != getsockopt(waiting->fd, SOL_SOCKET, SO_ERROR, &error,
+                &errorSize) || 0 != error) {
+            *visited = VISIT_REFUSED;
+            return 1;
+        }
+        visit->step = VISIT_SENDING;
+        visit->timings.connected = roc_now_micros();
+    }
+
+    while (VISIT_SENDING == visit->step) {
+        done = send(waiting->fd, request + visit->sent, length - visit->sent,
+                MSG_NOSIGNAL);
+        if (0 > done) {
+            if (EINTR == errno) {
+                continue;
+            }
+            waiting->events = POLLOUT;
+            return visit_failed(visited);
+        }
+        visit->sent += (size_t)done;
+        if (length == visit->sent) {
+            visit->step = VISIT_RECEIVING;
+            visit->timings.sent = roc_now_micros();
+        }
+    }
+
+    /*Like fgets(), a line is cut short at the end of the buffer*/
+    while (1) {
+        done = recv(waiting->fd, info + visit->received,
+                ROC_MAX_INFO_SIZE - 1 - visit->received, 0);
+        if (0 > done) {
+            if (EINTR == errno) {
+                continue;
+            }
+            waiting->events = POLLIN;
+            return visit_failed(visited);
+        }
+
+        if (0 == visit->received && 0 < done) {
+            visit->timings.firstByte = roc_now_micros();
+        }
+        found = (char*)memchr(info + visit->received, '\n', (size_t)done);
+        visit->received += (size_t)done;
+        if (found) {
+            found[1] = '\0';
+            visit->lineEnded = 1;
+        } else {
+            info[visit->received] = '\0';
+        }
+
+        if (found || 0 == done
+                || ROC_MAX_INFO_SIZE - 1 == visit->received) {
+            *visited = 0 < visit->received && accept_info(info);
+            return 1;
+        }
+    }
+}
+
+/**
+ * Hand the finished visits at the front of the reorder window over in route
+ * order.
+ *
+ * Returns the route position of the first visit, which is not handed over.
+ *
+ * @param delivered The route position of the first visit not handed over
+ *                  yet.
+ *
+ * @param started The number of visits started so far.
+ *
+ * @param window  The size of the reorder window.
+ *
+ * @param skip  If not NULL, destinations i with skip[i] set were not visited.
+ *
+ * @param infos The reorder window's info buffers.
+ *
+ * @param results The reorder window's visit results.
+ *
+ * @param timings The reorder window's visit timings.
+ *
+ * @param deliver The function receiving the visits.
+ *
+ * @param context The context passed to deliver.
+ */
+static int deliver_in_order(int delivered, int started, int window,
+        const int* skip, char** infos, const int* results,
+        const struct VisitTimings* timings, VisitDelivery deliver,
+        void* context) {
+    int slot = 0;
+
+    while (delivered < started) {
+        slot = delivered % window;
+        if (ROUTE_VISIT_PENDING == results[slot]) {
+            break;
+        }
+        if (skip && skip[delivered]) {
+            deliver(context, delivered, NULL, 0, NULL);
+        } else {
+            deliver(context, delivered, infos[slot], results[slot],
+                    &timings[slot]);
+        }
+        delivered += 1;
+    }
+    return delivered;
+}
+
+int roc_visit_destinations(const char* planeId, const int* ports, int count,
+        int parallel, const int* skip, const struct VisitDeadlines* deadlines,
+        struct ConnPool* pool, VisitDelivery deliver, void* context) {
+    struct pollfd* waiting = NULL;
+    struct RouteVisit* visits = NULL;
+    char request[CONTROL_MAX_ID_SIZE + 2];
+    struct VisitTimings* timings = NULL;
+    char** infos = NULL;
+    int* results = NULL;
+    size_t length = 0;
+    int64_t now = 0;
+    int64_t deadline = 0;
+    int window = 0;
+    int active = 0;
+    int next = 0;
+    int delivered = 0;
+    int replied = 0;
+    int slot = 0;
+    int i = 0;
+
+    parallel = MAX(1, MIN(parallel, count));
+    window = MIN(count, ROUTE_REORDER_FACTOR * parallel);
+    length = (size_t)snprintf(request, sizeof(request), "%s\n", planeId);
+
+    waiting = (struct pollfd*)malloc(parallel * sizeof(struct pollfd));
+    visits = (struct RouteVisit*)malloc(parallel * sizeof(struct RouteVisit));
+    infos = roc_alloc_log(MAX(1, window), ROC_MAX_INFO_SIZE);
+    results = (int*)malloc(MAX(1, window) * sizeof(int));
+    timings = (struct VisitTimings*)malloc(MAX(1, window)
+            * sizeof(struct VisitTimings));
+    if (!waiting || !visits || !infos || !results || !timings) {
+        free(waiting);
+        free(visits);
+        free(infos);
+        free(results);
+        free(timings);
+        return 0;
+    }
+
+    while (delivered < count) {
+        /*Keep up to parallel visits in flight within the reorder window*/
+        now = roc_now_millis();
+        while (active < parallel && next < count
+                && next < delivered + window) {
+            slot = next % window;
+            results[slot] = VISIT_FAILED;
+            memset(&timings[slot], 0, sizeof(struct VisitTimings));
+            if (skip && skip[next]) {
+                next += 1;
+                continue;
+            }
+
+            /*Past the route's deadline, the remaining visits are given up*/
+            if (deadlines && 0 < deadlines->routeEnd
+                    && deadlines->routeEnd <= now) {
+                results[slot] = VISIT_TIMED_OUT;
+                next += 1;
+                continue;
+            }
+
+            waiting[active].fd = start_pooled_visit(&visits[active], next,
+                    ports[next], pool);
+            waiting[active].events = POLLOUT;
+            visits[active].deadline = roc_visit_deadline(deadlines, now);
+            if (0 <= waiting[active].fd) {
+                results[slot] = ROUTE_VISIT_PENDING;
+                active += 1;
+            } else {
+                results[slot] = VISIT_REFUSED;
+                timings[slot] = visits[active].timings;
+                timings[slot].closed = roc_now_micros();
+            }
+            next += 1;
+        }
+
+        delivered = deliver_in_order(delivered, next, window, skip, infos,
+                results, timings, deliver, context);
+        if (0 >= active || 0 > poll(waiting, (nfds_t)active,
+                poll_timeout(visits, active, now))) {
+            continue;
+        }
+
+        now = roc_now_millis();
+        for (i = active - 1; 0 <= i; i--) {
+            slot = visits[i].destination % window;
+            if (waiting[i].revents && roc_advance_visit(&visits[i],
+                    &waiting[i], request, length, infos[slot],
+                    &results[slot])) {
+                if (ROUTE_VISIT_PENDING == results[slot]) {
+                    results[slot] = VISIT_FAILED;
+                }
+                if (visits[i].pooled && VISIT_REPLIED != results[slot]
+                        && 0 == visits[i].received) {
+                    /*The pooled connection went stale, take a new one*/
+                    close(waiting[i].fd);
+                    deadline = visits[i].deadline;
+                    waiting[i].fd = roc_start_visit(&visits[i],
+                            visits[i].destination,
+                            ports[visits[i].destination]);
+                    waiting[i].events = POLLOUT;
+                    visits[i].deadline = deadline;
+                    results[slot] = 0 <= waiting[i].fd
+                            ? ROUTE_VISIT_PENDING : VISIT_REFUSED;
+                }
+                if (ROUTE_VISIT_PENDING == results[slot]) {
+                    continue;
+                }
+            } else if (visits[i].deadline && visits[i].deadline <= now) {
+                results[slot] = VISIT_TIMED_OUT;
+            } else {
+                continue;
+            }
+
+            replied += VISIT_REPLIED == results[slot];
+            if (VISIT_REPLIED == results[slot] && visits[i].lineEnded) {
+                roc_pool_give(pool, ports[visits[i].destination],
+                        waiting[i].fd);
+            } else if (0 <= waiting[i].fd) {
+                close(waiting[i].fd);
+            }
+            timings[slot] = visits[i].timings;
+            timings[slot].closed = roc_now_micros();
+            active -= 1;
+            waiting[i] = waiting[active];
+            visits[i] = visits[active];
+        }
+    }
+
+    free(waiting);
+    free(visits);
+    free(infos);
+    free(results);
+    free(timings);
+    return replied;
+}
+
+/**
+ * Keep the result of a single visit, see roc_visit_destination().
+ */
+struct SingleVisit {
+    /**
+     * The caller's info buffer.
+     */
+    char* info;
+
+    /**
+     * The visit's result.
+     */
+    int visited;
+
+    /**
+     * The caller's timings buffer, NULL if there is none.
+     */
+    struct VisitTimings* timings;
+};
+
+/**
+ * Receive the result of a single visit.
+ *
+ * @param context The visit's struct SingleVisit.
+ *
+ * @param destination Always 0.
+ *
+ * @param info  The destination's info text.
+ *
+ * @param visited The visit's result.
+ *
+ * @param timings The times the visit reached its steps.
+ */
+static void keep_visit(void* context, int destination, const char* info,
+        int visited, const struct VisitTimings* timings) {
+    struct SingleVisit* single = (struct SingleVisit*)context;
+
+    single->visited = visited;
+    if (single->timings) {
+        *single->timings = *timings;
+    }
+    if (VISIT_REPLIED == visited) {
+        strcpy(single->info, info);
+    }
+}
+
+int roc_visit_destination(const char* planeId, int port,
+        const struct VisitDeadlines* deadlines, struct ConnPool* pool,
+        struct VisitTimings* timings, char* info) {
+    struct SingleVisit single;
+
+    single.info = info;
+    single.visited = VISIT_FAILED;
+    single.timings = timings;
+    if (timings) {
+        memset(timings, 0, sizeof(struct VisitTimings));
+    }
+    roc_visit_destinations(planeId, &port, 1, 1, NULL, deadlines, pool,
+            keep_visit, &single);
+    return single.visited;
+}
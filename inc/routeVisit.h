@@ -0,0 +1,323 @@
+/*
+ *routeVisit.h
+ */
+
+#pragma once
+
+#ifndef ROUTE_VISIT_H
+#define ROUTE_VISIT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <poll.h>
+
+#include "connPool.h"
+
+/**
+ * The maximum number of destinations roc2310 visits at once, so its sockets
+ * stay well below the default file descriptor limit.
+ */
+#define ROUTE_MAX_PARALLEL 256
+
+/**
+ * The size of the reorder window as multiple of the visits at once. A visit
+ * is only started, while the route's first unfinished visit is less than the
+ * window ahead, so the infos held stay bounded however long the route is.
+ */
+#define ROUTE_REORDER_FACTOR 4
+
+/**
+ * The time in milliseconds a single visit may take by default, so a dead or
+ * hung control cannot stall the route.
+ */
+#define ROUTE_DEFAULT_HOP_TIMEOUT 10000
+
+/**
+ * The results of a visit.
+ */
+enum VisitResult {
+    VISIT_TIMED_OUT = -2,
+    VISIT_REFUSED = -1,
+    VISIT_FAILED = 0,
+    VISIT_REPLIED = 1
+};
+
+/**
+ * The time limits of a route's visits.
+ */
+struct VisitDeadlines {
+    /**
+     * The time in milliseconds a single visit may take, 0 if unlimited.
+     */
+    int hopMillis;
+
+    /**
+     * The time in milliseconds all visits may take, 0 if unlimited.
+     */
+    int routeMillis;
+
+    /**
+     * The monotonic clock's time in milliseconds, by which all visits have
+     * to be done, 0 if unlimited.
+     */
+    int64_t routeEnd;
+};
+
+/**
+ * The monotonic clock's times in microseconds a visit reached its steps, 0
+ * for the steps it did not reach.
+ */
+struct VisitTimings {
+    /**
+     * The visit was started, i.e. connect() was called or a pooled
+     * connection taken.
+     */
+    int64_t started;
+
+    /**
+     * The connection was established.
+     */
+    int64_t connected;
+
+    /**
+     * The whole request was sent.
+     */
+    int64_t sent;
+
+    /**
+     * The first byte of the info was received.
+     */
+    int64_t firstByte;
+
+    /**
+     * The connection was closed or handed back to the pool.
+     */
+    int64_t closed;
+};
+
+/**
+ * Receives the visits of roc_visit_destinations() in route order.
+ *
+ * @param context The caller's context.
+ *
+ * @param destination The destination's position in the route.
+ *
+ * @param info  The destination's info text, which is only valid during the
+ *              call, NULL if the destination was skipped.
+ *
+ * @param visited One of enum VisitResult, VISIT_FAILED if the destination
+ *                was skipped.
+ *
+ * @param timings The times the visit reached its steps, which are only
+ *                valid during the call, NULL if the destination was skipped.
+ */
+typedef void (*VisitDelivery)(void* context, int destination,
+        const char* info, int visited, const struct VisitTimings* timings);
+
+/**
+ * The steps of a single visit.
+ */
+enum VisitStep {
+    VISIT_CONNECTING = 0,
+    VISIT_SENDING = 1,
+    VISIT_RECEIVING = 2
+};
+
+/**
+ * A visit in progress.
+ */
+struct RouteVisit {
+    /**
+     * The destination's position in the route.
+     */
+    int destination;
+
+    /**
+     * The step the visit is at.
+     */
+    enum VisitStep step;
+
+    /**
+     * The number of bytes of the request sent.
+     */
+    size_t sent;
+
+    /**
+     * The number of bytes of the info received.
+     */
+    size_t received;
+
+    /**
+     * The monotonic clock's time in milliseconds, by which the visit times
+     * out, 0 if it may take forever.
+     */
+    int64_t deadline;
+
+    /**
+     * Set if the visit reuses a pooled connection.
+     */
+    int pooled;
+
+    /**
+     * The times the visit reached its steps.
+     */
+    struct VisitTimings timings;
+
+    /**
+     * Set once the info's LF was received, so nothing is left unread.
+     */
+    int lineEnded;
+};
+
+/**
+ * Get the number of destinations visited at once from the environment.
+ *
+ * Returns ROC_PARALLEL_ENV's value clamped to 1..ROUTE_MAX_PARALLEL, 1 if it
+ * is not set or not a number, i.e. the destinations are visited one after
+ * another.
+ */
+int roc_parallel_limit();
+
+/**
+ * Get the visits' time limits from the environment.
+ *
+ * A single visit may take ROC_HOP_TIMEOUT_ENV milliseconds,
+ * ROUTE_DEFAULT_HOP_TIMEOUT if it is not set. All visits have to be done
+ * within ROC_ROUTE_TIMEOUT_ENV milliseconds from now, if it is set. A value
+ * of 0 lifts the respective limit.
+ *
+ * @param deadlines Output parameter, receives the time limits.
+ */
+void roc_visit_deadlines(struct VisitDeadlines* deadlines);
+
+/**
+ * Start the route's time limit from now.
+ *
+ * @param deadlines The time limits, whose route deadline is set.
+ */
+void roc_start_deadlines(struct VisitDeadlines* deadlines);
+
+/**
+ * Get the deadline of a visit starting now.
+ *
+ * Returns the monotonic clock's time in milliseconds, by which the visit
+ * times out, 0 if it may take forever.
+ *
+ * @param deadlines The visits' time limits, NULL if there are none.
+ *
+ * @param now The monotonic clock's current time in milliseconds.
+ */
+int64_t roc_visit_deadline(const struct VisitDeadlines* deadlines,
+        int64_t now);
+
+/**
+ * Get the monotonic clock's time in microseconds, as used by struct
+ * VisitTimings.
+ */
+int64_t roc_now_micros(void);
+
+/**
+ * Get the monotonic clock's time in milliseconds, as used by the visits'
+ * deadlines.
+ */
+int64_t roc_now_millis(void);
+
+/**
+ * Start connecting to a destination without blocking.
+ *
+ * Returns the visit's socket, -1 if the connection failed right away. The
+ * socket is tuned by tune_client_conn() and is to be polled for POLLOUT
+ * before the visit is advanced.
+ *
+ * @param visit Output parameter, receives the visit's initial state.
+ *
+ * @param destination The destination's position in the route.
+ *
+ * @param port  The destination's port number.
+ */
+int roc_start_visit(struct RouteVisit* visit, int destination, int port);
+
+/**
+ * Advance a visit as far as possible without blocking.
+ *
+ * Returns 1 if the visit is finished, 0 if it has to wait for its socket.
+ *
+ * @param visit The visit to be advanced.
+ *
+ * @param waiting The visit's socket and the events waited for.
+ *
+ * @param request The plane's ID followed by LF.
+ *
+ * @param length  The length of request.
+ *
+ * @param info  The visit's info buffer of ROC_MAX_INFO_SIZE bytes.
+ *
+ * @param visited Output parameter, set to VISIT_REPLIED if the visit
+ *                succeeded, VISIT_REFUSED if the destination could not be
+ *                connected to.
+ */
+int roc_advance_visit(struct RouteVisit* visit, struct pollfd* waiting,
+        const char* request, size_t length, char* info, int* visited);
+
+/**
+ * Visit many destinations at once over TCP.
+ *
+ * Up to parallel destinations are connected to with non-blocking sockets,
+ * a further one is started as soon as one finishes. Each is sent the plane's
+ * ID and its info line is received, just like a visit one after another. The
+ * visits are handed to deliver in route order as soon as all visits before
+ * them finished, no matter which destination replied first, so the caller
+ * can stream them. A visit, which is not done by its deadline, is given up
+ * as VISIT_TIMED_OUT, just like the visits not started by the route's
+ * deadline. Returns the number of destinations, which replied.
+ *
+ * @param planeId The plane's ID.
+ *
+ * @param ports The destinations' port numbers in route order.
+ *
+ * @param count The number of destinations.
+ *
+ * @param parallel  The maximum number of destinations visited at once.
+ *
+ * @param skip  If not NULL, destinations i with skip[i] set are not visited,
+ *              e.g. because they replied over UDP already. They are still
+ *              handed to deliver in their turn.
+ *
+ * @param deadlines The visits' time limits, NULL if there are none.
+ *
+ * @param pool  The idle connections to be reused and to receive the
+ *              connections, whose visit succeeded, NULL to connect anew and
+ *              close them.
+ *
+ * @param deliver The function receiving every destination's visit.
+ *
+ * @param context The context passed to deliver.
+ */
+int roc_visit_destinations(const char* planeId, const int* ports, int count,
+        int parallel, const int* skip, const struct VisitDeadlines* deadlines,
+        struct ConnPool* pool, VisitDelivery deliver, void* context);
+
+/**
+ * Visit a single destination over TCP.
+ *
+ * Returns the visit's result, one of enum VisitResult.
+ *
+ * @param planeId The plane's ID.
+ *
+ * @param port  The destination's port number.
+ *
+ * @param deadlines The visit's time limits, NULL if there are none.
+ *
+ * @param pool  The idle connections, NULL if there are none.
+ *
+ * @param timings If not NULL, output parameter, receives the times the visit
+ *                reached its steps.
+ *
+ * @param info  Output parameter, receives the destination's info text, if
+ *              it replied. It must hold ROC_MAX_INFO_SIZE bytes.
+ */
+int roc_visit_destination(const char* planeId, int port,
+        const struct VisitDeadlines* deadlines, struct ConnPool* pool,
+        struct VisitTimings* timings, char* info);
+
+#endif
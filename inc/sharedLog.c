@@ -0,0 +1,395 @@
+/*
+ *sharedLog.c
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "controlStats.h"
+#include "errorReturn.h"
+#include "protocol.h"
+#include "sharedLog.h"
+
+/**
+ * Get the name of an airport's shared memory object.
+ *
+ * Slashes in the ID are replaced, as they are not allowed in the name.
+ *
+ * @param airportId The airport's ID.
+ *
+ * @param name  Output parameter, receives the name. It must hold
+ *              sizeof(SHARED_LOG_PREFIX) + CONTROL_MAX_ID_SIZE bytes.
+ */
+static void shared_log_name(const char* airportId, char* name) {
+    char* next = NULL;
+
+    snprintf(name, sizeof(SHARED_LOG_PREFIX) + CONTROL_MAX_ID_SIZE, "%s%s",
+            SHARED_LOG_PREFIX, airportId);
+    next = name + strlen(SHARED_LOG_PREFIX);
+    while ((next = strchr(next, '/'))) {
+        *next = '_';
+    }
+}
+
+/**
+ * Get the size of a shared memory object holding the given number of slots.
+ *
+ * @param slots The number of slots.
+ */
+static size_t shared_log_size(uint64_t slots) {
+    return sizeof(struct SharedLogHeader)
+            + (size_t)slots * sizeof(struct SharedVisit);
+}
+
+/**
+ * Lock the whole shared memory object for this process' view.
+ *
+ * The lock belongs to the open file description, so views opened by the same
+ * process exclude each other as well and an own lock is converted. Returns 0
+ * on success, -1 if it conflicts with another view's lock and wait is not
+ * set.
+ *
+ * @param fd  The shared memory object.
+ *
+ * @param type  F_RDLCK or F_WRLCK.
+ *
+ * @param wait  Set to wait until conflicting locks are released.
+ */
+static int lock_shared_log(int fd, short type, int wait) {
+    struct flock lock;
+
+    memset(&lock, 0, sizeof(struct flock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    return fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock);
+}
+
+/**
+ * Empty the shared memory object and set up a new shared log in it.
+ *
+ * The caller must hold the write lock. Returns EXIT_SUCCESS on success,
+ * EXIT_FAILURE else.
+ *
+ * @param log The shared log, whose object is to be reset.
+ */
+static int reset_shared_log(struct SharedLog* log) {
+    struct SharedLogHeader header;
+
+    memset(&header, 0, sizeof(struct SharedLogHeader));
+    memcpy(header.magic, SHARED_LOG_MAGIC, 8);
+    header.version = SHARED_LOG_VERSION;
+    header.slots = SHARED_LOG_SLOTS;
+    header.capacity = SHARED_LOG_INITIAL_SLOTS;
+
+    if (0 != ftruncate(log->fd, 0) || 0 != ftruncate(log->fd,
+            (off_t)shared_log_size(SHARED_LOG_INITIAL_SLOTS))
+            || (ssize_t)sizeof(struct SharedLogHeader) != pwrite(log->fd,
+                    &header, sizeof(struct SharedLogHeader), 0)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Map the shared memory object and verify it holds a shared log.
+ *
+ * The address space for SHARED_LOG_SLOTS slots is reserved at once, so the
+ * object can grow without remapping it. Returns EXIT_SUCCESS on success,
+ * EXIT_FAILURE else.
+ *
+ * @param log The shared log, whose object is to be mapped.
+ *
+ * @param size  The object's current size.
+ */
+static int map_shared_log(struct SharedLog* log, size_t size) {
+    void* map = NULL;
+
+    if (size < sizeof(struct SharedLogHeader)) {
+        return EXIT_FAILURE;
+    }
+
+    log->mapSize = shared_log_size(SHARED_LOG_SLOTS);
+    map = mmap(NULL, log->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+            log->fd, 0);
+    if (MAP_FAILED == map) {
+        return EXIT_FAILURE;
+    }
+    log->header = (struct SharedLogHeader*)map;
+    log->visits = (struct SharedVisit*)(log->header + 1);
+
+    if (0 != memcmp(log->header->magic, SHARED_LOG_MAGIC, 8)
+            || SHARED_LOG_VERSION != log->header->version
+            || SHARED_LOG_SLOTS != log->header->slots) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+struct SharedLog* control_shared_log_open(const char* airportId) {
+    struct SharedLog* log = NULL;
+    struct stat status;
+    int attempt = 0;
+
+    log = (struct SharedLog*)calloc(1, sizeof(struct SharedLog));
+    if (!log) {
+        return NULL;
+    }
+    log->fd = -1;
+    shared_log_name(airportId, log->name);
+
+    for (attempt = 0; attempt < SHARED_LOG_OPEN_ATTEMPTS; attempt++) {
+        log->fd = shm_open(log->name, O_RDWR | O_CREAT, 0600);
+        if (0 > log->fd) {
+            break;
+        }
+
+        /*Nobody else is attached, so any visits are left from gone controls*/
+        if (0 == lock_shared_log(log->fd, F_WRLCK, 0)
+                && EXIT_SUCCESS != reset_shared_log(log)) {
+            break;
+        }
+
+        /*Waits for a creator to finish, an own write lock is converted*/
+        if (0 != lock_shared_log(log->fd, F_RDLCK, 1)
+                || 0 != fstat(log->fd, &status)) {
+            break;
+        }
+        if (0 < status.st_nlink) {
+            if (EXIT_SUCCESS == map_shared_log(log,
+                    (size_t)status.st_size)) {
+                return log;
+            }
+            break;
+        }
+
+        /*The last process detached and unlinked the object meanwhile*/
+        close(log->fd);
+        log->fd = -1;
+    }
+
+    control_shared_log_close(log);
+    return NULL;
+}
+
+void control_shared_log_close(struct SharedLog* log) {
+    if (log->header) {
+        munmap(log->header, log->mapSize);
+    }
+    if (0 <= log->fd) {
+        /*Without other processes attached, the visits are not needed*/
+        if (0 == lock_shared_log(log->fd, F_WRLCK, 0)) {
+            shm_unlink(log->name);
+        }
+        close(log->fd);
+    }
+    free(log);
+}
+
+/**
+ * Grow the shared memory object, so it holds the given slot.
+ *
+ * The object doubles, at most up to SHARED_LOG_SLOTS slots. Returns
+ * EXIT_SUCCESS on success, EXIT_FAILURE if no memory is left for it.
+ *
+ * @param log The shared log to be grown.
+ *
+ * @param slot  The reserved slot, which is to be written.
+ */
+static int grow_shared_log(struct SharedLog* log, uint64_t slot) {
+    uint64_t capacity = __atomic_load_n(&log->header->capacity,
+            __ATOMIC_ACQUIRE);
+    uint64_t grown = MAX(capacity, 1);
+
+    while (grown <= slot) {
+        grown *= 2;
+    }
+    grown = MIN(grown, SHARED_LOG_SLOTS);
+
+    /*fallocate() never shrinks it, so writers may grow it concurrently*/
+    if (capacity < grown && 0 != fallocate(log->fd, 0,
+            (off_t)shared_log_size(capacity),
+            (off_t)(shared_log_size(grown) - shared_log_size(capacity)))) {
+        return EXIT_FAILURE;
+    }
+
+    while (capacity < grown && !__atomic_compare_exchange_n(
+            &log->header->capacity, &capacity, grown, 0, __ATOMIC_RELEASE,
+            __ATOMIC_ACQUIRE)) {
+    }
+    return EXIT_SUCCESS;
+}
+
+int control_shared_log_append(struct SharedLog* log, const char* planeId) {
+    struct SharedVisit* visit = NULL;
+    size_t length = strlen(planeId) + 1;
+    uint64_t slot = 0;
+
+    if (CONTROL_MAX_ID_SIZE < length) {
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    slot = __atomic_fetch_add(&log->header->reserved, 1, __ATOMIC_RELAXED);
+    if (SHARED_LOG_SLOTS <= slot) {
+        return E_CONTROL_INVALID_INFO;
+    }
+    if (__atomic_load_n(&log->header->capacity, __ATOMIC_ACQUIRE) <= slot
+            && EXIT_SUCCESS != grow_shared_log(log, slot)) {
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    visit = log->visits + slot;
+    memcpy(visit->id, planeId, length);
+    __atomic_store_n(&visit->length, (uint32_t)length, __ATOMIC_RELEASE);
+    return E_CONTROL_OK;
+}
+
+/**
+ * Read a slot, if its visit is committed.
+ *
+ * Returns 1 if a visit was read, 0 else.
+ *
+ * @param log The shared log to be read.
+ *
+ * @param slot  The slot's index.
+ *
+ * @param planeId Output parameter, receives the plane's ID. It must hold
+ *                CONTROL_MAX_ID_SIZE bytes.
+ */
+static int read_slot(struct SharedLog* log, uint64_t slot, char* planeId) {
+    struct SharedVisit* visit = NULL;
+    uint32_t length = 0;
+
+    /*The slot's writer may still be growing the object*/
+    if (__atomic_load_n(&log->header->capacity, __ATOMIC_ACQUIRE) <= slot) {
+        return 0;
+    }
+
+    visit = log->visits + slot;
+    length = __atomic_load_n(&visit->length, __ATOMIC_ACQUIRE);
+    if (0 == length || CONTROL_MAX_ID_SIZE < length) {
+        return 0;
+    }
+    memcpy(planeId, visit->id, length);
+    planeId[length - 1] = '\0';
+    return 1;
+}
+
+/**
+ * Forget a passed slot, keeping the others in order.
+ *
+ * @param log The shared log being read.
+ *
+ * @param index The slot's index into skipped.
+ */
+static void drop_skipped(struct SharedLog* log, int index) {
+    log->skippedCount -= 1;
+    memmove(log->skipped + index, log->skipped + index + 1,
+            (size_t)(log->skippedCount - index) * sizeof(struct SkippedSlot));
+}
+
+/**
+ * Remember a slot, which is passed while uncommitted.
+ *
+ * If SHARED_LOG_SKIPPED_MAX slots are remembered already, the oldest one is
+ * given up.
+ *
+ * @param log The shared log being read.
+ *
+ * @param slot  The slot's index.
+ */
+static void skip_slot(struct SharedLog* log, uint64_t slot) {
+    struct SkippedSlot* skipped = NULL;
+
+    if (SHARED_LOG_SKIPPED_MAX == log->skippedCount) {
+        drop_skipped(log, 0);
+    }
+    skipped = log->skipped + log->skippedCount;
+    skipped->slot = slot;
+    clock_gettime(CLOCK_MONOTONIC, &skipped->since);
+    log->skippedCount += 1;
+}
+
+/**
+ * Read the first of the passed slots, which is committed by now.
+ *
+ * Slots committed meanwhile leave the list once read, those passed for
+ * SHARED_LOG_ABANDON_MS are given up. Returns 1 if a visit was read, 0 if
+ * none is committed yet.
+ *
+ * @param log The shared log to be read.
+ *
+ * @param planeId Output parameter, receives the plane's ID. It must hold
+ *                CONTROL_MAX_ID_SIZE bytes.
+ */
+static int read_skipped(struct SharedLog* log, char* planeId) {
+    int i = 0;
+
+    while (i < log->skippedCount) {
+        if (read_slot(log, log->skipped[i].slot, planeId)) {
+            drop_skipped(log, i);
+            return 1;
+        }
+        if (control_stats_micros_since(&log->skipped[i].since)
+                >= (uint64_t)SHARED_LOG_ABANDON_MS * 1000) {
+            /*The slot's writer died before committing*/
+            drop_skipped(log, i);
+            continue;
+        }
+        i++;
+    }
+    return 0;
+}
+
+int control_shared_log_next(struct SharedLog* log, char* planeId) {
+    while (log->readCursor < SHARED_LOG_SLOTS
+            && log->readCursor < __atomic_load_n(&log->header->reserved,
+                    __ATOMIC_ACQUIRE)) {
+        if (read_slot(log, log->readCursor, planeId)) {
+            log->readCursor += 1;
+            log->stalled = 0;
+            return 1;
+        }
+
+        /*The slot's writer is still busy or died before committing*/
+        if (!log->stalled) {
+            log->stalled = 1;
+            clock_gettime(CLOCK_MONOTONIC, &log->stalledSince);
+            break;
+        }
+        if (control_stats_micros_since(&log->stalledSince)
+                < (uint64_t)SHARED_LOG_STALL_MS * 1000) {
+            break;
+        }
+        skip_slot(log, log->readCursor);
+        log->readCursor += 1;
+        log->stalled = 0;
+    }
+
+    return read_skipped(log, planeId);
+}
+
+int control_shared_log_port(struct SharedLog* log) {
+    return (int)__atomic_load_n(&log->header->port, __ATOMIC_ACQUIRE);
+}
+
+int control_shared_log_publish_port(struct SharedLog* log, int seen,
+        int port) {
+    uint32_t expected = (uint32_t)seen;
+
+    if (__atomic_compare_exchange_n(&log->header->port, &expected,
+            (uint32_t)port, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return port;
+    }
+    return (int)expected;
+}
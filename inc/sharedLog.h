@@ -0,0 +1,274 @@
+/*
+ *sharedLog.h
+ */
+
+#pragma once
+
+#ifndef SHARED_LOG_H
+#define SHARED_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "protocol.h"
+
+/**
+ * Identifies a shared memory object as shared visit log.
+ */
+#define SHARED_LOG_MAGIC "SHAREDLG"
+
+/**
+ * The shared log's layout version.
+ */
+#define SHARED_LOG_VERSION 2
+
+/**
+ * The prefix of the shared memory object's name, followed by the airport ID.
+ */
+#define SHARED_LOG_PREFIX "/control2310-"
+
+/**
+ * The maximum number of visits a shared log can hold. Only the address space
+ * is reserved for them, the object grows as slots are reserved.
+ */
+#define SHARED_LOG_SLOTS (1 << 23)
+
+/**
+ * The number of slots a new shared log holds. The object doubles whenever a
+ * writer reserves a slot beyond its end.
+ */
+#define SHARED_LOG_INITIAL_SLOTS (1 << 12)
+
+/**
+ * The number of attempts to open a shared log, which is unlinked by its last
+ * process meanwhile.
+ */
+#define SHARED_LOG_OPEN_ATTEMPTS 16
+
+/**
+ * The time in milliseconds a reader waits for a reserved slot to be
+ * committed, before it reads on and checks the slot again later.
+ */
+#define SHARED_LOG_STALL_MS 1000
+
+/**
+ * The maximum number of passed slots a reader checks again. Once more are
+ * passed, the oldest one is given up.
+ */
+#define SHARED_LOG_SKIPPED_MAX 64
+
+/**
+ * The time in milliseconds a passed slot is checked again, before its writer
+ * is taken to be dead and the slot is given up.
+ */
+#define SHARED_LOG_ABANDON_MS 60000
+
+/**
+ * A slot passed by a reader while uncommitted.
+ */
+struct SkippedSlot {
+    /**
+     * The slot's index.
+     */
+    uint64_t slot;
+
+    /**
+     * The time the slot was passed.
+     */
+    struct timespec since;
+};
+
+/**
+ * The head of a shared log.
+ *
+ * The head is followed by capacity slots of struct SharedVisit.
+ */
+struct SharedLogHeader {
+    /**
+     * Always SHARED_LOG_MAGIC without the terminating NUL.
+     */
+    char magic[8];
+
+    /**
+     * Always SHARED_LOG_VERSION.
+     */
+    uint32_t version;
+
+    /**
+     * The port number all processes listen on, 0 until one published it.
+     */
+    uint32_t port;
+
+    /**
+     * The maximum number of slots, always SHARED_LOG_SLOTS.
+     */
+    uint64_t slots;
+
+    /**
+     * The number of slots the object holds so far, which only grows.
+     */
+    uint64_t capacity;
+
+    /**
+     * The append cursor, i.e. the number of reserved slots. It may exceed
+     * slots once the log is full.
+     */
+    uint64_t reserved;
+};
+
+/**
+ * A single visit in the shared log.
+ */
+struct SharedVisit {
+    /**
+     * The length of the ID including its NUL, 0 until the visit is committed.
+     */
+    uint32_t length;
+
+    /**
+     * The visiting plane's ID.
+     */
+    char id[CONTROL_MAX_ID_SIZE];
+};
+
+/**
+ * A process' view of a visit log shared by all control processes serving
+ * the same airport.
+ *
+ * Writers reserve a slot by atomically incrementing the append cursor, fill
+ * it and commit it by setting its length last. Readers never lock, they
+ * follow the log up to the first uncommitted slot. A slot, which stays
+ * uncommitted for SHARED_LOG_STALL_MS, is passed and read once its writer
+ * commits it. Up to SHARED_LOG_SKIPPED_MAX passed slots are checked again,
+ * each for SHARED_LOG_ABANDON_MS at most.
+ *
+ * Every process holds a read lock on the object while it is attached. The
+ * first one to attach resets the object, so visits of controls, which are
+ * all gone, are not served again. The last one to detach unlinks it.
+ */
+struct SharedLog {
+    /**
+     * The shared memory object.
+     */
+    int fd;
+
+    /**
+     * The shared memory object's name.
+     */
+    char name[sizeof(SHARED_LOG_PREFIX) + CONTROL_MAX_ID_SIZE];
+
+    /**
+     * The mapped shared memory object, starting with the head.
+     */
+    struct SharedLogHeader* header;
+
+    /**
+     * The slots following the head.
+     */
+    struct SharedVisit* visits;
+
+    /**
+     * The size of the mapping.
+     */
+    size_t mapSize;
+
+    /**
+     * The number of slots this process has read.
+     */
+    uint64_t readCursor;
+
+    /**
+     * Set while the slot at readCursor is reserved, but not committed.
+     */
+    int stalled;
+
+    /**
+     * The time the slot at readCursor was first found uncommitted.
+     */
+    struct timespec stalledSince;
+
+    /**
+     * The slots passed while uncommitted, which are to be read later, the
+     * oldest first.
+     */
+    struct SkippedSlot skipped[SHARED_LOG_SKIPPED_MAX];
+
+    /**
+     * The number of entries in skipped.
+     */
+    int skippedCount;
+};
+
+/**
+ * Open or create the shared log of an airport.
+ *
+ * Returns the opened log, NULL if the shared memory object cannot be
+ * created, mapped or holds no shared log. If no other process has the log
+ * open, it is emptied first.
+ *
+ * @param airportId The airport's ID, which names the shared memory object.
+ */
+struct SharedLog* control_shared_log_open(const char* airportId);
+
+/**
+ * Unmap and close the shared log.
+ *
+ * The log stays in place for other processes, the last one unlinks it.
+ *
+ * @param log The shared log to be closed.
+ */
+void control_shared_log_close(struct SharedLog* log);
+
+/**
+ * Append a plane's visit to the shared log without blocking.
+ *
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_INFO if the ID is too
+ * long or the log is full.
+ *
+ * @param log The shared log to be appended to.
+ *
+ * @param planeId The visiting plane's ID without trailing LF.
+ */
+int control_shared_log_append(struct SharedLog* log, const char* planeId);
+
+/**
+ * Read the next visit of any process.
+ *
+ * Visits committed after their slot was passed are read once the log is
+ * caught up. Returns 1 if a visit was read, 0 if the next one is not
+ * committed yet.
+ *
+ * @param log The shared log to be read.
+ *
+ * @param planeId Output parameter, receives the plane's ID. It must hold
+ *                CONTROL_MAX_ID_SIZE bytes.
+ */
+int control_shared_log_next(struct SharedLog* log, char* planeId);
+
+/**
+ * Get the port number published for the airport.
+ *
+ * Returns the port, 0 if none has been published yet.
+ *
+ * @param log The shared log of the airport.
+ */
+int control_shared_log_port(struct SharedLog* log);
+
+/**
+ * Publish the port number the airport's processes listen on.
+ *
+ * The port is only replaced if the given one is still published, so
+ * concurrently starting processes agree on a single port. Returns the
+ * published port afterwards.
+ *
+ * @param log The shared log of the airport.
+ *
+ * @param seen  The port published before, 0 if there was none.
+ *
+ * @param port  The port to be published.
+ */
+int control_shared_log_publish_port(struct SharedLog* log, int seen,
+        int port);
+
+#endif
@@ -0,0 +1,975 @@
+/*
+ *uringBackend.c
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "protocol.h"
+#include "uringBackend.h"
+
+/**
+ * The operations in flight, kept in the low bits of their user data. The
+ * remaining bits hold the connection, if any.
+ */
+enum UringOperation {
+    URING_ACCEPT = 1,
+    URING_RECEIVE = 2,
+    URING_SEND = 3,
+    URING_CLOSE = 4,
+    URING_CANCEL = 5,
+    URING_SWEEP = 6
+};
+
+/**
+ * The bits of the user data holding the operation.
+ */
+#define URING_OPERATION_MASK 7
+
+/**
+ * A plane's connection served by the io_uring backend.
+ */
+struct UringConnection {
+    /**
+     * The connected socket.
+     */
+    int socket;
+
+    /**
+     * Set while the multishot receive is armed.
+     */
+    int receiving;
+
+    /**
+     * Set while the receive is cancelled, because the replies pile up.
+     */
+    int paused;
+
+    /**
+     * Set once the plane has hung up or the connection broke, it is closed
+     * as soon as all replies are sent.
+     */
+    int closing;
+
+    /**
+     * Set while the close is in flight.
+     */
+    int closed;
+
+    /**
+     * Set once the socket is closed, the connection is freed with the next
+     * flush.
+     */
+    int finished;
+
+    /**
+     * Set while the rest of an overlong request is dropped.
+     */
+    int discarding;
+
+    /**
+     * Set while the connection is on the backend's dirty list.
+     */
+    int isDirty;
+
+    /**
+     * The next connection on the dirty list.
+     */
+    struct UringConnection* next;
+
+    /**
+     * The neighbours on the backend's list of open connections.
+     */
+    struct UringConnection* previousOpen;
+    struct UringConnection* nextOpen;
+
+    /**
+     * The monotonic time in milliseconds, when the plane sent data last.
+     */
+    int64_t lastActive;
+
+    /**
+     * The replies being sent, NULL if no send is in flight.
+     */
+    char* sending;
+
+    /**
+     * The length of sending.
+     */
+    size_t sendingSize;
+
+    /**
+     * The number of bytes of sending, which are sent already.
+     */
+    size_t sendingSent;
+
+    /**
+     * Collects the replies while a send is in flight, NULL if there are
+     * none.
+     */
+    FILE* stream;
+
+    /**
+     * The buffer of stream.
+     */
+    char* output;
+
+    /**
+     * The length of output.
+     */
+    size_t outputSize;
+
+    /**
+     * The requests received from the plane, which are not served yet.
+     */
+    struct LineReader reader;
+};
+
+/**
+ * Create an io_uring instance.
+ *
+ * Returns the instance's file descriptor, -1 on error.
+ *
+ * @param entries The number of submission queue entries.
+ *
+ * @param params  In- and output parameter, the instance's setup.
+ */
+static int uring_setup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+/**
+ * Submit queued entries and wait for completions.
+ *
+ * Returns the number of entries submitted, -1 on error.
+ *
+ * @param ring  The io_uring instance.
+ *
+ * @param submit  The number of entries to be submitted.
+ *
+ * @param wait  The number of completions to wait for.
+ */
+static int uring_enter(int ring, unsigned submit, unsigned wait) {
+    return (int)syscall(__NR_io_uring_enter, ring, submit, wait,
+            wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/**
+ * Map the rings of a new io_uring instance.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE else.
+ *
+ * @param backend The backend, whose instance is to be mapped.
+ *
+ * @param params  The instance's setup.
+ */
+static int map_rings(struct UringBackend* backend,
+        const struct io_uring_params* params) {
+    size_t submitSize = params->sq_off.array
+            + params->sq_entries * sizeof(unsigned);
+    size_t completeSize = params->cq_off.cqes
+            + params->cq_entries * sizeof(struct io_uring_cqe);
+    char* rings = NULL;
+    void* entries = NULL;
+
+    /*Both rings share one mapping on all kernels providing buffer rings*/
+    if (!(params->features & IORING_FEAT_SINGLE_MMAP)) {
+        return EXIT_FAILURE;
+    }
+
+    backend->ringsSize = MAX(submitSize, completeSize);
+    rings = (char*)mmap(NULL, backend->ringsSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, backend->ring, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == rings) {
+        return EXIT_FAILURE;
+    }
+    backend->rings = rings;
+
+    entries = mmap(NULL, params->sq_entries * sizeof(struct io_uring_sqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            backend->ring, IORING_OFF_SQES);
+    if (MAP_FAILED == entries) {
+        return EXIT_FAILURE;
+    }
+    backend->entries = (struct io_uring_sqe*)entries;
+
+    backend->submitHead = (unsigned*)(rings + params->sq_off.head);
+    backend->submitTail = (unsigned*)(rings + params->sq_off.tail);
+    backend->submitMask = *(unsigned*)(rings + params->sq_off.ring_mask);
+    backend->submitArray = (unsigned*)(rings + params->sq_off.array);
+    backend->completeHead = (unsigned*)(rings + params->cq_off.head);
+    backend->completeTail = (unsigned*)(rings + params->cq_off.tail);
+    backend->completeMask = *(unsigned*)(rings + params->cq_off.ring_mask);
+    backend->completions = (struct io_uring_cqe*)(rings
+            + params->cq_off.cqes);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Hand a receive buffer back to the kernel.
+ *
+ * @param backend The backend owning the buffer.
+ *
+ * @param id  The buffer's ID.
+ */
+static void provide_buffer(struct UringBackend* backend, unsigned id) {
+    /*The ring's tail overlays the reserved field of its first entry*/
+    unsigned short tail = backend->bufferRing[0].resv;
+    struct io_uring_buf* buffer = &backend->bufferRing[tail
+            & (URING_BUFFER_COUNT - 1)];
+
+    buffer->addr = (uint64_t)(uintptr_t)(backend->buffers
+            + (size_t)id * URING_BUFFER_SIZE);
+    buffer->len = URING_BUFFER_SIZE;
+    buffer->bid = (unsigned short)id;
+    __atomic_store_n(&backend->bufferRing[0].resv,
+            (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * Register the receive buffers with the kernel.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE else.
+ *
+ * @param backend The backend, whose buffers are to be registered.
+ */
+static int provide_buffers(struct UringBackend* backend) {
+    struct io_uring_buf_reg registration;
+    size_t ringSize = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    void* ring = NULL;
+    unsigned id = 0;
+
+    ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == ring) {
+        return EXIT_FAILURE;
+    }
+    backend->bufferRing = (struct io_uring_buf*)ring;
+
+    backend->buffers = (char*)malloc((size_t)URING_BUFFER_COUNT
+            * URING_BUFFER_SIZE);
+    if (!backend->buffers) {
+        return EXIT_FAILURE;
+    }
+
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)ring;
+    registration.ring_entries = URING_BUFFER_COUNT;
+    registration.bgid = URING_BUFFER_GROUP;
+    if (0 != syscall(__NR_io_uring_register, backend->ring,
+            IORING_REGISTER_PBUF_RING, &registration, 1)) {
+        return EXIT_FAILURE;
+    }
+
+    for (id = 0; id < URING_BUFFER_COUNT; id++) {
+        provide_buffer(backend, id);
+    }
+    return EXIT_SUCCESS;
+}
+
+int control_uring_open(struct UringBackend* backend, struct Airport* airport,
+        HostRequestHandler handler, struct Admission* admission,
+        int acceptSocket) {
+    struct io_uring_params params;
+
+    memset(backend, 0, sizeof(struct UringBackend));
+    backend->airport = airport;
+    backend->handler = handler;
+    backend->admission = admission;
+    backend->acceptSocket = acceptSocket;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_COMPLETION_SIZE;
+
+    backend->ring = uring_setup(URING_QUEUE_SIZE, &params);
+    if (0 > backend->ring) {
+        return EXIT_FAILURE;
+    }
+
+    if (EXIT_SUCCESS != map_rings(backend, &params)
+            || EXIT_SUCCESS != provide_buffers(backend)) {
+        control_uring_close(backend);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void control_uring_close(struct UringBackend* backend) {
+    if (backend->bufferRing) {
+        munmap(backend->bufferRing,
+                URING_BUFFER_COUNT * sizeof(struct io_uring_buf));
+    }
+    if (backend->entries) {
+        munmap(backend->entries,
+                (backend->submitMask + 1) * sizeof(struct io_uring_sqe));
+    }
+    if (backend->rings) {
+        munmap(backend->rings, backend->ringsSize);
+    }
+    if (0 <= backend->ring) {
+        close(backend->ring);
+    }
+    free(backend->buffers);
+    memset(backend, 0, sizeof(struct UringBackend));
+    backend->ring = -1;
+}
+
+/**
+ * Submit the queued entries without waiting.
+ *
+ * @param backend The backend, whose entries are to be submitted.
+ */
+static void submit_entries(struct UringBackend* backend) {
+    int submitted = 0;
+
+    while (0 < backend->queued) {
+        submitted = uring_enter(backend->ring, backend->queued, 0);
+        if (0 > submitted && EINTR == errno) {
+            continue;
+        }
+        if (0 >= submitted) {
+            return;
+        }
+        backend->queued -= (unsigned)submitted;
+    }
+}
+
+/**
+ * Queue a new submission entry.
+ *
+ * Returns the cleared entry, which is submitted with the next
+ * io_uring_enter().
+ *
+ * @param backend The backend, whose submission ring is used.
+ *
+ * @param operation The operation to be performed.
+ *
+ * @param connection  The connection, which the operation is for, NULL for the
+ *                    listener.
+ */
+static struct io_uring_sqe* queue_entry(struct UringBackend* backend,
+        enum UringOperation operation, struct UringConnection* connection) {
+    struct io_uring_sqe* entry = NULL;
+    unsigned tail = *backend->submitTail;
+    unsigned index = 0;
+
+    if (backend->submitMask < tail - __atomic_load_n(backend->submitHead,
+            __ATOMIC_ACQUIRE)) {
+        submit_entries(backend);
+    }
+
+    index = tail & backend->submitMask;
+    entry = &backend->entries[index];
+    memset(entry, 0, sizeof(struct io_uring_sqe));
+    entry->user_data = (uint64_t)(uintptr_t)connection | operation;
+
+    backend->submitArray[index] = index;
+    __atomic_store_n(backend->submitTail, tail + 1, __ATOMIC_RELEASE);
+    backend->queued += 1;
+    return entry;
+}
+
+/**
+ * Returns the monotonic time in milliseconds.
+ */
+static int64_t now_millis(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Wake up after half the idle time to close the idle connections.
+ *
+ * @param backend The backend, whose connections are to be swept.
+ */
+static void arm_sweep(struct UringBackend* backend) {
+    struct io_uring_sqe* entry = queue_entry(backend, URING_SWEEP, NULL);
+
+    entry->opcode = IORING_OP_TIMEOUT;
+    entry->addr = (uint64_t)(uintptr_t)&backend->sweepInterval;
+    entry->len = 1;
+}
+
+/**
+ * Accept planes until the multishot accept ends.
+ *
+ * @param backend The backend, whose listener is to be served.
+ */
+static void arm_accept(struct UringBackend* backend) {
+    struct io_uring_sqe* entry = queue_entry(backend, URING_ACCEPT, NULL);
+
+    entry->opcode = IORING_OP_ACCEPT;
+    entry->fd = backend->acceptSocket;
+    entry->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+/**
+ * Receive a plane's requests into the provided buffers, until the multishot
+ * receive ends.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ */
+static void arm_receive(struct UringBackend* backend,
+        struct UringConnection* connection) {
+    struct io_uring_sqe* entry = queue_entry(backend, URING_RECEIVE,
+            connection);
+
+    entry->opcode = IORING_OP_RECV;
+    entry->fd = connection->socket;
+    entry->ioprio = IORING_RECV_MULTISHOT;
+    entry->flags = IOSQE_BUFFER_SELECT;
+    entry->buf_group = URING_BUFFER_GROUP;
+    connection->receiving = 1;
+}
+
+/**
+ * Send the rest of the connection's replies in flight.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ *
+ * @param flags IOSQE_IO_LINK if the socket is to be closed right after, 0
+ *              else.
+ */
+static void queue_send(struct UringBackend* backend,
+        struct UringConnection* connection, unsigned char flags) {
+    struct io_uring_sqe* entry = queue_entry(backend, URING_SEND,
+            connection);
+
+    entry->opcode = IORING_OP_SEND;
+    entry->fd = connection->socket;
+    entry->addr = (uint64_t)(uintptr_t)(connection->sending
+            + connection->sendingSent);
+    entry->len = (unsigned)(connection->sendingSize
+            - connection->sendingSent);
+    entry->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    entry->flags = flags;
+}
+
+/**
+ * Close the connection's socket.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ */
+static void queue_close(struct UringBackend* backend,
+        struct UringConnection* connection) {
+    struct io_uring_sqe* entry = queue_entry(backend, URING_CLOSE,
+            connection);
+
+    entry->opcode = IORING_OP_CLOSE;
+    entry->fd = connection->socket;
+    connection->closed = 1;
+}
+
+/**
+ * Cancel the connection's multishot receive.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ */
+static void queue_cancel(struct UringBackend* backend,
+        struct UringConnection* connection) {
+    struct io_uring_sqe* entry = queue_entry(backend, URING_CANCEL,
+            connection);
+
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->addr = (uint64_t)(uintptr_t)connection | URING_RECEIVE;
+    connection->paused = 1;
+}
+
+/**
+ * Put a connection on the dirty list, so it is flushed after the batch.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ */
+static void mark_dirty(struct UringBackend* backend,
+        struct UringConnection* connection) {
+    if (!connection->isDirty) {
+        connection->isDirty = 1;
+        connection->next = backend->dirty;
+        backend->dirty = connection;
+    }
+}
+
+/**
+ * Serve a single request of a connection.
+ *
+ * Returns 0 on success, -1 if the reply cannot be buffered.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ *
+ * @param request The request without trailing LF.
+ *
+ * @param length  The length of the received line.
+ */
+static int serve_request(struct UringBackend* backend,
+        struct UringConnection* connection, const char* request,
+        int length) {
+    struct Airport* airport = backend->airport;
+    struct timespec start;
+    enum StatsCounter kind = STATS_CHECK_INS;
+    size_t bytes = 0;
+
+    if (!connection->stream) {
+        connection->stream = open_memstream(&connection->output,
+                &connection->outputSize);
+        if (!connection->stream) {
+            return -1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    bytes = backend->handler(airport, request, connection->stream, &kind);
+
+    control_stats_request(airport->stats, kind,
+            (uint64_t)(length + 1 + bytes),
+            control_stats_micros_since(&start));
+    return 0;
+}
+
+/**
+ * Serve all complete requests buffered for a connection.
+ *
+ * Returns 0 on success, -1 if the replies cannot be buffered.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ */
+static int serve_lines(struct UringBackend* backend,
+        struct UringConnection* connection) {
+    char buffer[CONTROL_MAX_ID_SIZE];
+    int length = 0;
+
+    while (has_buffered_line(&connection->reader)) {
+        length = read_line(&connection->reader, buffer, sizeof(buffer));
+        if (0 != serve_request(backend, connection, buffer, length)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Take received data and serve the requests completed by it.
+ *
+ * Overlong requests are cut short like read_line() does, the rest of their
+ * line is dropped. Returns 0 on success, -1 if the replies cannot be
+ * buffered.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ *
+ * @param data  The received data.
+ *
+ * @param size  The length of data.
+ */
+static int take_data(struct UringBackend* backend,
+        struct UringConnection* connection, const char* data, size_t size) {
+    char buffer[CONTROL_MAX_ID_SIZE];
+    struct LineReader* reader = &connection->reader;
+    const char* found = NULL;
+    size_t copied = 0;
+
+    while (0 < size) {
+        if (connection->discarding) {
+            found = (const char*)memchr(data, '\n', size);
+            if (!found) {
+                return 0;
+            }
+            size -= (size_t)(found + 1 - data);
+            data = found + 1;
+            connection->discarding = 0;
+            continue;
+        }
+
+        if (0 < reader->start) {
+            memmove(reader->buffer, reader->buffer + reader->start,
+                    reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+        if (LINE_READER_SIZE == reader->end) {
+            memcpy(buffer, reader->buffer, sizeof(buffer) - 1);
+            buffer[sizeof(buffer) - 1] = '\0';
+            reader->end = 0;
+            connection->discarding = 1;
+            if (0 != serve_request(backend, connection, buffer,
+                    (int)sizeof(buffer) - 1)) {
+                return -1;
+            }
+            continue;
+        }
+
+        copied = MIN(size, LINE_READER_SIZE - reader->end);
+        memcpy(reader->buffer + reader->end, data, copied);
+        reader->end += copied;
+        data += copied;
+        size -= copied;
+
+        if (0 != serve_lines(backend, connection)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Drop a broken connection's pending requests, it is closed once the replies
+ * in flight are sent.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ */
+static void break_connection(struct UringBackend* backend,
+        struct UringConnection* connection) {
+    control_stats_add(backend->airport->stats, STATS_ERRORS, 1);
+    connection->closing = 1;
+    connection->reader.start = connection->reader.end;
+
+    if (connection->receiving && !connection->paused) {
+        queue_cancel(backend, connection);
+    }
+}
+
+/**
+ * Serve a newly accepted plane.
+ *
+ * @param backend The backend serving the airport.
+ *
+ * @param socket  The accepted socket.
+ */
+static void accept_plane(struct UringBackend* backend, int socket) {
+    struct UringConnection* connection = NULL;
+
+    if (backend->admission->limit <= backend->connections) {
+        control_stats_add(backend->airport->stats, STATS_ERRORS, 1);
+        admission_reject(backend->admission, socket);
+        return;
+    }
+
+    connection = (struct UringConnection*)calloc(1,
+            sizeof(struct UringConnection));
+    if (!connection) {
+        control_stats_add(backend->airport->stats, STATS_ERRORS, 1);
+        admission_reject(backend->admission, socket);
+        return;
+    }
+
+    connection->socket = socket;
+    connection->lastActive = now_millis();
+    init_line_reader(&connection->reader, socket);
+    connection->nextOpen = backend->open;
+    if (backend->open) {
+        backend->open->previousOpen = connection;
+    }
+    backend->open = connection;
+    backend->connections += 1;
+    arm_receive(backend, connection);
+}
+
+/**
+ * Handle the completion of a receive.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ *
+ * @param completion  The receive's completion.
+ */
+static void complete_receive(struct UringBackend* backend,
+        struct UringConnection* connection,
+        const struct io_uring_cqe* completion) {
+    unsigned id = completion->flags >> IORING_CQE_BUFFER_SHIFT;
+    struct LineReader* reader = &connection->reader;
+
+    if (0 < completion->res) {
+        connection->lastActive = now_millis();
+    }
+    if (0 < completion->res && !connection->closing
+            && 0 != take_data(backend, connection, backend->buffers
+            + (size_t)id * URING_BUFFER_SIZE, (size_t)completion->res)) {
+        /*Replies, which cannot be buffered, drop the connection*/
+        break_connection(backend, connection);
+    }
+    if (completion->flags & IORING_CQE_F_BUFFER) {
+        provide_buffer(backend, id);
+    }
+
+    if (0 == completion->res && !connection->closing) {
+        /*The final line lacking its LF is served before hanging up*/
+        connection->closing = 1;
+        if (reader->start < reader->end && reader->end < LINE_READER_SIZE) {
+            reader->buffer[reader->end++] = '\n';
+        }
+        if (0 != serve_lines(backend, connection)) {
+            control_stats_add(backend->airport->stats, STATS_ERRORS, 1);
+        }
+    } else if (0 > completion->res && -ENOBUFS != completion->res
+            && -ECANCELED != completion->res && !connection->closing) {
+        break_connection(backend, connection);
+    }
+
+    if (!(completion->flags & IORING_CQE_F_MORE)) {
+        connection->receiving = 0;
+        /*Running out of buffers only delays the requests*/
+        if (-ENOBUFS == completion->res && !connection->closing) {
+            arm_receive(backend, connection);
+        }
+    }
+    mark_dirty(backend, connection);
+}
+
+/**
+ * Handle the completion of a send.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ *
+ * @param result  The number of bytes sent or the negated error.
+ */
+static void complete_send(struct UringBackend* backend,
+        struct UringConnection* connection, int result) {
+    if (0 > result) {
+        break_connection(backend, connection);
+        connection->sendingSent = connection->sendingSize;
+    } else {
+        connection->sendingSent += (size_t)result;
+    }
+
+    if (connection->sendingSent < connection->sendingSize) {
+        queue_send(backend, connection, 0);
+        return;
+    }
+
+    free(connection->sending);
+    connection->sending = NULL;
+    mark_dirty(backend, connection);
+}
+
+/**
+ * Handle the completion of a close.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ *
+ * @param result  0 on success, the negated error else.
+ */
+static void complete_close(struct UringBackend* backend,
+        struct UringConnection* connection, int result) {
+    /*A close linked to a failed or short send is retried on its own*/
+    if (-ECANCELED == result) {
+        connection->closed = 0;
+    } else {
+        connection->finished = 1;
+    }
+    mark_dirty(backend, connection);
+}
+
+/**
+ * Send a connection's collected replies, close it once the plane has hung up
+ * and resume receiving once the replies are sent.
+ *
+ * @param backend The backend serving the plane.
+ *
+ * @param connection  The plane's connection.
+ */
+static void flush_connection(struct UringBackend* backend,
+        struct UringConnection* connection) {
+    int startSend = 0;
+    int hangUp = 0;
+
+    if (connection->finished) {
+        if (connection->stream) {
+            fclose(connection->stream);
+        }
+        free(connection->output);
+        free(connection->sending);
+        if (connection->previousOpen) {
+            connection->previousOpen->nextOpen = connection->nextOpen;
+        } else {
+            backend->open = connection->nextOpen;
+        }
+        if (connection->nextOpen) {
+            connection->nextOpen->previousOpen = connection->previousOpen;
+        }
+        free(connection);
+        backend->connections -= 1;
+        return;
+    }
+
+    if (!connection->sending && connection->stream) {
+        fclose(connection->stream);
+        connection->stream = NULL;
+        connection->sending = connection->output;
+        connection->sendingSize = connection->outputSize;
+        connection->sendingSent = 0;
+        connection->output = NULL;
+        startSend = 0 < connection->sendingSize;
+        if (!startSend) {
+            free(connection->sending);
+            connection->sending = NULL;
+        }
+    }
+
+    hangUp = connection->closing && !connection->receiving
+            && !connection->closed && (startSend || !connection->sending);
+    if (startSend) {
+        queue_send(backend, connection, hangUp ? IOSQE_IO_LINK : 0);
+    }
+    if (hangUp) {
+        queue_close(backend, connection);
+        return;
+    }
+
+    if (connection->stream && connection->receiving && !connection->paused
+            && HOST_OUTPUT_HIGH_WATER <= ftell(connection->stream)) {
+        /*Stop reading until the plane takes its replies*/
+        queue_cancel(backend, connection);
+    } else if (connection->paused && !connection->receiving
+            && !connection->closing && !connection->stream) {
+        connection->paused = 0;
+        arm_receive(backend, connection);
+    }
+}
+
+/**
+ * Close the connections, which wait longer than the admission control's
+ * idleMs for their next request, like admission_limit_idle() does for the
+ * threads. Connections with replies in flight or piled up are left alone,
+ * they wait for the plane to take its replies. A request cut off is
+ * dropped, not served.
+ *
+ * @param backend The backend, whose connections are to be swept.
+ */
+static void sweep_idle(struct UringBackend* backend) {
+    struct UringConnection* connection = backend->open;
+    int64_t idleSince = now_millis() - backend->admission->idleMs;
+
+    for (; connection; connection = connection->nextOpen) {
+        if (connection->closing || connection->paused || connection->sending
+                || connection->stream
+                || idleSince < connection->lastActive) {
+            continue;
+        }
+        connection->closing = 1;
+        connection->reader.start = connection->reader.end;
+        if (connection->receiving) {
+            queue_cancel(backend, connection);
+        }
+        mark_dirty(backend, connection);
+    }
+}
+
+/**
+ * Handle all available completions.
+ *
+ * @param backend The backend, whose completions are to be handled.
+ */
+static void complete_entries(struct UringBackend* backend) {
+    unsigned head = *backend->completeHead;
+    unsigned tail = __atomic_load_n(backend->completeTail, __ATOMIC_ACQUIRE);
+    struct io_uring_cqe* completion = NULL;
+    struct UringConnection* connection = NULL;
+
+    for (; head != tail; head++) {
+        completion = &backend->completions[head & backend->completeMask];
+        connection = (struct UringConnection*)(uintptr_t)
+                (completion->user_data & ~(uint64_t)URING_OPERATION_MASK);
+
+        switch (completion->user_data & URING_OPERATION_MASK) {
+            case URING_ACCEPT:
+                if (0 <= completion->res) {
+                    accept_plane(backend, completion->res);
+                } else {
+                    control_stats_add(backend->airport->stats,
+                            STATS_ERRORS, 1);
+                }
+                if (!(completion->flags & IORING_CQE_F_MORE)) {
+                    arm_accept(backend);
+                }
+                break;
+            case URING_RECEIVE:
+                complete_receive(backend, connection, completion);
+                break;
+            case URING_SEND:
+                complete_send(backend, connection, completion->res);
+                break;
+            case URING_CLOSE:
+                complete_close(backend, connection, completion->res);
+                break;
+            case URING_SWEEP:
+                sweep_idle(backend);
+                arm_sweep(backend);
+                break;
+            default:
+                break;
+        }
+    }
+
+    __atomic_store_n(backend->completeHead, head, __ATOMIC_RELEASE);
+}
+
+void control_uring_run(struct UringBackend* backend) {
+    struct UringConnection* connection = NULL;
+    int submitted = 0;
+    int sweepMs = 0;
+
+    arm_accept(backend);
+    if (0 < backend->admission->idleMs) {
+        sweepMs = (backend->admission->idleMs + 1) / 2;
+        backend->sweepInterval.tv_sec = sweepMs / 1000;
+        backend->sweepInterval.tv_nsec = (sweepMs % 1000) * 1000000LL;
+        arm_sweep(backend);
+    }
+
+    while (1) {
+        /*One system call submits the batch and waits for the next one*/
+        submitted = uring_enter(backend->ring, backend->queued, 1);
+        if (0 > submitted) {
+            if (EINTR != errno && EBUSY != errno) {
+                control_stats_add(backend->airport->stats, STATS_ERRORS, 1);
+            }
+        } else {
+            backend->queued -= (unsigned)submitted;
+        }
+
+        complete_entries(backend);
+
+        while (backend->dirty) {
+            connection = backend->dirty;
+            backend->dirty = connection->next;
+            connection->isDirty = 0;
+            flush_connection(backend, connection);
+        }
+    }
+}
@@ -0,0 +1,209 @@
+/*
+ *uringBackend.h
+ */
+
+#pragma once
+
+#ifndef URING_BACKEND_H
+#define URING_BACKEND_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#include "admission.h"
+#include "airportHost.h"
+
+/**
+ * The number of submission queue entries.
+ */
+#define URING_QUEUE_SIZE 1024
+
+/**
+ * The number of completion queue entries. Multishot receives complete many
+ * times per submission, so the completion queue is larger.
+ */
+#define URING_COMPLETION_SIZE 4096
+
+/**
+ * The number of receive buffers provided to the kernel, a power of 2.
+ */
+#define URING_BUFFER_COUNT 512
+
+/**
+ * The size of a single receive buffer.
+ */
+#define URING_BUFFER_SIZE 4096
+
+/**
+ * The ID of the provided buffer group.
+ */
+#define URING_BUFFER_GROUP 0
+
+/**
+ * Serves an airport's planes from a single thread on an io_uring instance.
+ *
+ * The listener is served by one multishot accept, each connection by one
+ * multishot receive into buffers provided to the kernel. The replies to all
+ * requests completed in a batch are sent at once, by a send linked to the
+ * close of the socket once the plane has hung up. A single io_uring_enter()
+ * submits the batch and waits for the next completions.
+ */
+struct UringBackend {
+    /**
+     * The io_uring instance.
+     */
+    int ring;
+
+    /**
+     * The mapped submission and completion rings.
+     */
+    void* rings;
+
+    /**
+     * The size of rings.
+     */
+    size_t ringsSize;
+
+    /**
+     * The mapped submission queue entries.
+     */
+    struct io_uring_sqe* entries;
+
+    /**
+     * The submission ring's head, advanced by the kernel.
+     */
+    unsigned* submitHead;
+
+    /**
+     * The submission ring's tail, advanced by this process.
+     */
+    unsigned* submitTail;
+
+    /**
+     * The mask turning submission ring positions into indexes.
+     */
+    unsigned submitMask;
+
+    /**
+     * The submission ring's indexes into entries.
+     */
+    unsigned* submitArray;
+
+    /**
+     * The completion ring's head, advanced by this process.
+     */
+    unsigned* completeHead;
+
+    /**
+     * The completion ring's tail, advanced by the kernel.
+     */
+    unsigned* completeTail;
+
+    /**
+     * The mask turning completion ring positions into indexes.
+     */
+    unsigned completeMask;
+
+    /**
+     * The completion ring's entries.
+     */
+    struct io_uring_cqe* completions;
+
+    /**
+     * The number of entries queued, but not submitted yet.
+     */
+    unsigned queued;
+
+    /**
+     * The ring of buffers provided for receives.
+     */
+    struct io_uring_buf* bufferRing;
+
+    /**
+     * The memory of the provided buffers.
+     */
+    char* buffers;
+
+    /**
+     * The airport served.
+     */
+    struct Airport* airport;
+
+    /**
+     * The function processing the planes' requests.
+     */
+    HostRequestHandler handler;
+
+    /**
+     * Bounds the number of connections served at once.
+     */
+    struct Admission* admission;
+
+    /**
+     * The listening socket.
+     */
+    int acceptSocket;
+
+    /**
+     * The number of open connections.
+     */
+    int connections;
+
+    /**
+     * The connections with replies to be sent or to be closed, linked by
+     * their next member.
+     */
+    struct UringConnection* dirty;
+
+    /**
+     * The open connections, linked by their nextOpen member.
+     */
+    struct UringConnection* open;
+
+    /**
+     * The time between two sweeps for idle connections, half the admission
+     * control's idleMs.
+     */
+    struct __kernel_timespec sweepInterval;
+};
+
+/**
+ * Set up an io_uring instance serving an airport's listening socket.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE if the kernel lacks io_uring
+ * or one of the features used, e.g. because it is disabled, so the caller
+ * can fall back to serving the planes by threads.
+ *
+ * @param backend The backend to be initialized.
+ *
+ * @param airport The airport served.
+ *
+ * @param handler The function processing the planes' requests.
+ *
+ * @param admission Bounds the number of connections served at once.
+ *
+ * @param acceptSocket  The airport's listening socket.
+ */
+int control_uring_open(struct UringBackend* backend, struct Airport* airport,
+        HostRequestHandler handler, struct Admission* admission,
+        int acceptSocket);
+
+/**
+ * Serve the airport's planes for the lifetime of the program.
+ *
+ * @param backend The opened backend.
+ */
+void control_uring_run(struct UringBackend* backend);
+
+/**
+ * Release the io_uring instance and its buffers.
+ *
+ * Open connections are left to the end of the program.
+ *
+ * @param backend The backend to be released.
+ */
+void control_uring_close(struct UringBackend* backend);
+
+#endif
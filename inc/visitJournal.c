@@ -0,0 +1,193 @@
+/*
+ *visitJournal.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "visitJournal.h"
+
+/**
+ * Map the whole journal file into memory.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE else.
+ *
+ * @param journal The journal, whose file is to be mapped.
+ *
+ * @param size  The file size, which is to be mapped.
+ */
+static int map_journal(struct VisitJournal* journal, size_t size) {
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            journal->fd, 0);
+
+    if (MAP_FAILED == map) {
+        return EXIT_FAILURE;
+    }
+
+    journal->header = (struct JournalHeader*)map;
+    journal->mapSize = size;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Prepare a freshly mapped journal file or verify an existing one.
+ *
+ * Returns EXIT_SUCCESS if the file holds a valid journal afterwards,
+ * EXIT_FAILURE else.
+ *
+ * @param journal The journal, whose file is to be verified.
+ *
+ * @param size  The current file size.
+ */
+static int load_journal(struct VisitJournal* journal, size_t size) {
+    if (size < sizeof(struct JournalHeader)) {
+        size = JOURNAL_INITIAL_SIZE;
+        if (0 != ftruncate(journal->fd, size)
+                || EXIT_SUCCESS != map_journal(journal, size)) {
+            return EXIT_FAILURE;
+        }
+        memcpy(journal->header->magic, JOURNAL_MAGIC, 8);
+        journal->header->version = JOURNAL_VERSION;
+        journal->header->used = 0;
+        return EXIT_SUCCESS;
+    }
+
+    if (EXIT_SUCCESS != map_journal(journal, size)) {
+        return EXIT_FAILURE;
+    }
+    if (0 != memcmp(journal->header->magic, JOURNAL_MAGIC, 8)
+            || JOURNAL_VERSION != journal->header->version
+            || size - sizeof(struct JournalHeader) < journal->header->used) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+struct VisitJournal* control_journal_open(const char* path) {
+    struct VisitJournal* journal = NULL;
+    struct stat status;
+
+    journal = (struct VisitJournal*)calloc(1, sizeof(struct VisitJournal));
+    if (!journal) {
+        return NULL;
+    }
+
+    journal->segmentPath = (char*)malloc(strlen(path)
+            + strlen(JOURNAL_SEGMENT_SUFFIX) + 1);
+    if (!journal->segmentPath) {
+        free(journal);
+        return NULL;
+    }
+    sprintf(journal->segmentPath, "%s%s", path, JOURNAL_SEGMENT_SUFFIX);
+
+    journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (0 > journal->fd || 0 != fstat(journal->fd, &status)
+            || EXIT_SUCCESS != load_journal(journal,
+                    (size_t)status.st_size)) {
+        control_journal_close(journal);
+        return NULL;
+    }
+
+    return journal;
+}
+
+void control_journal_close(struct VisitJournal* journal) {
+    if (journal->header) {
+        munmap(journal->header, journal->mapSize);
+    }
+    if (0 <= journal->fd) {
+        close(journal->fd);
+    }
+    free(journal->segmentPath);
+    free(journal);
+}
+
+int control_journal_append(struct VisitJournal* journal,
+        const char* planeId) {
+    size_t length = strlen(planeId);
+    size_t needed = 0;
+    size_t size = journal->mapSize;
+    size_t previousSize = 0;
+    struct JournalHeader* previous = journal->header;
+    char* record = NULL;
+
+    needed = sizeof(struct JournalHeader) + journal->header->used + length + 1;
+    if (needed > size) {
+        while (needed > size) {
+            size *= 2;
+        }
+        /*The old mapping stays in place, unless the grown one succeeds*/
+        if (0 != ftruncate(journal->fd, size)) {
+            return EXIT_FAILURE;
+        }
+        previousSize = journal->mapSize;
+        if (EXIT_SUCCESS != map_journal(journal, size)) {
+            return EXIT_FAILURE;
+        }
+        munmap(previous, previousSize);
+    }
+
+    /*Write the record first, so a crash never exposes a partial one*/
+    record = (char*)(journal->header + 1) + journal->header->used;
+    memcpy(record, planeId, length);
+    record[length] = '\n';
+    __atomic_store_n(&journal->header->used,
+            journal->header->used + length + 1, __ATOMIC_RELEASE);
+
+    return EXIT_SUCCESS;
+}
+
+const char* control_journal_records(struct VisitJournal* journal,
+        size_t* size) {
+    *size = (size_t)journal->header->used;
+    return (const char*)(journal->header + 1);
+}
+
+int control_journal_write_segment(struct VisitJournal* journal,
+        const char* text, size_t size) {
+    char* temporaryPath = NULL;
+    ssize_t written = 0;
+    size_t total = 0;
+    int fd = 0;
+
+    temporaryPath = (char*)malloc(strlen(journal->segmentPath) + 5);
+    if (!temporaryPath) {
+        return EXIT_FAILURE;
+    }
+    sprintf(temporaryPath, "%s.tmp", journal->segmentPath);
+
+    fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (0 > fd) {
+        free(temporaryPath);
+        return EXIT_FAILURE;
+    }
+
+    while (total < size) {
+        written = write(fd, text + total, size - total);
+        if (0 >= written) {
+            break;
+        }
+        total += (size_t)written;
+    }
+    close(fd);
+
+    if (total != size || 0 != rename(temporaryPath, journal->segmentPath)) {
+        unlink(temporaryPath);
+        free(temporaryPath);
+        return EXIT_FAILURE;
+    }
+
+    free(temporaryPath);
+    return EXIT_SUCCESS;
+}
+
+int control_journal_open_segment(struct VisitJournal* journal) {
+    return open(journal->segmentPath, O_RDONLY);
+}
@@ -0,0 +1,153 @@
+/*
+ *visitJournal.h
+ */
+
+#pragma once
+
+#ifndef VISIT_JOURNAL_H
+#define VISIT_JOURNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Identifies a file as visit journal.
+ */
+#define JOURNAL_MAGIC "VISITLOG"
+
+/**
+ * The journal's on-disk format version.
+ */
+#define JOURNAL_VERSION 1
+
+/**
+ * The initial size of a new journal file in bytes.
+ */
+#define JOURNAL_INITIAL_SIZE (64 * 1024)
+
+/**
+ * The suffix appended to the journal's path to name the sorted segment.
+ */
+#define JOURNAL_SEGMENT_SUFFIX ".sorted"
+
+/**
+ * The head of a journal file.
+ *
+ * The head is followed by the visiting plane IDs in arrival order, each
+ * terminated by LF.
+ */
+struct JournalHeader {
+    /**
+     * Always JOURNAL_MAGIC without the terminating NUL.
+     */
+    char magic[8];
+
+    /**
+     * Always JOURNAL_VERSION.
+     */
+    uint32_t version;
+
+    /**
+     * Reserved, always 0.
+     */
+    uint32_t reserved;
+
+    /**
+     * The number of bytes used by records after the head.
+     */
+    uint64_t used;
+};
+
+/**
+ * An append-only, memory-mapped file of plane visits.
+ */
+struct VisitJournal {
+    /**
+     * The journal file.
+     */
+    int fd;
+
+    /**
+     * The mapped journal file, starting with the head.
+     */
+    struct JournalHeader* header;
+
+    /**
+     * The size of the mapping, which equals the file size.
+     */
+    size_t mapSize;
+
+    /**
+     * The path of the sorted segment.
+     */
+    char* segmentPath;
+};
+
+/**
+ * Open or create the journal at the given path.
+ *
+ * Returns the opened journal, NULL if the file cannot be opened, mapped or is
+ * not a journal.
+ *
+ * @param path  The journal file's path.
+ */
+struct VisitJournal* control_journal_open(const char* path);
+
+/**
+ * Unmap and close the journal.
+ *
+ * @param journal The journal to be closed.
+ */
+void control_journal_close(struct VisitJournal* journal);
+
+/**
+ * Append a plane's visit to the journal.
+ *
+ * The file grows as needed. Returns EXIT_SUCCESS on success, EXIT_FAILURE if
+ * the file cannot be extended.
+ *
+ * @param journal The journal to be appended to.
+ *
+ * @param planeId The visiting plane's ID without trailing LF.
+ */
+int control_journal_append(struct VisitJournal* journal, const char* planeId);
+
+/**
+ * Get the first record of the journal.
+ *
+ * Returns a pointer to the records, which are terminated by LF each. They are
+ * valid until the next control_journal_append().
+ *
+ * @param journal The journal to be read.
+ *
+ * @param size  Output parameter, the number of bytes used by the records.
+ */
+const char* control_journal_records(struct VisitJournal* journal,
+        size_t* size);
+
+/**
+ * Replace the sorted segment with the given text.
+ *
+ * The segment is written to a temporary file, which is renamed afterwards, so
+ * readers having the old segment open are not disturbed. Returns EXIT_SUCCESS
+ * on success, EXIT_FAILURE else.
+ *
+ * @param journal The journal owning the segment.
+ *
+ * @param text  The sorted reply to be stored.
+ *
+ * @param size  The length of text.
+ */
+int control_journal_write_segment(struct VisitJournal* journal,
+        const char* text, size_t size);
+
+/**
+ * Open the sorted segment for reading.
+ *
+ * Returns the file descriptor of the segment, -1 on error.
+ *
+ * @param journal The journal owning the segment.
+ */
+int control_journal_open_segment(struct VisitJournal* journal);
+
+#endif
@@ -0,0 +1,791 @@
+/*
+ *visitLog.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "errorReturn.h"
+#include "protocol.h"
+#include "sharedLog.h"
+#include "visitJournal.h"
+#include "visitLog.h"
+#include "visitorSketch.h"
+
+void control_visit_log_init(struct VisitLog* visitLog, int capacity) {
+    memset(visitLog, 0, sizeof(struct VisitLog));
+    pthread_mutex_init(&visitLog->guard, NULL);
+
+    visitLog->visits = (struct VisitRecord*)malloc((size_t)capacity
+            * sizeof(struct VisitRecord));
+    visitLog->capacity = visitLog->visits ? capacity : 0;
+}
+
+/**
+ * Get the ID of the given plane.
+ *
+ * @param visitLog  The visit log owning the plane.
+ *
+ * @param entry The plane's statistics.
+ */
+static const char* plane_id(const struct VisitLog* visitLog,
+        const struct PlaneCount* entry) {
+    return visitLog->pool + entry->name;
+}
+
+const char* control_visit_log_plane(const struct VisitLog* visitLog,
+        int visit) {
+    return plane_id(visitLog, visitLog->counts
+            + visitLog->visits[visit].plane);
+}
+
+/**
+ * Hash a plane ID using FNV-1a.
+ *
+ * @param planeId The plane ID to be hashed.
+ */
+static unsigned long hash_id(const char* planeId) {
+    unsigned long hash = 2166136261UL;
+
+    while (*planeId) {
+        hash ^= (unsigned char)*planeId++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+/**
+ * Find the hash index slot of the given plane.
+ *
+ * Returns the slot holding the plane's handle + 1 or the unused slot, where
+ * it has to be inserted. The caller must hold the visit log's guard and
+ * slotCount must not be 0.
+ *
+ * @param visitLog  The visit log to be searched.
+ *
+ * @param planeId   The plane's ID.
+ */
+static uint32_t* find_slot(const struct VisitLog* visitLog,
+        const char* planeId) {
+    unsigned long mask = (unsigned long)visitLog->slotCount - 1;
+    unsigned long slot = hash_id(planeId) & mask;
+    uint32_t* entry = NULL;
+
+    while (1) {
+        entry = visitLog->slots + slot;
+        if (0 == *entry || 0 == strcmp(planeId, plane_id(visitLog,
+                visitLog->counts + *entry - 1))) {
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * Double the number of hash index slots and rehash all planes.
+ *
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_INFO if no memory is
+ * left. The caller must hold the visit log's guard.
+ *
+ * @param visitLog  The visit log, whose hash index is to be grown.
+ */
+static int grow_slots(struct VisitLog* visitLog) {
+    uint32_t* slots = NULL;
+    int slotCount = MAX(2 * visitLog->slotCount, VISIT_LOG_MIN_GROWTH);
+    int i = 0;
+
+    slots = (uint32_t*)calloc((size_t)slotCount, sizeof(uint32_t));
+    if (!slots) {
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    free(visitLog->slots);
+    visitLog->slots = slots;
+    visitLog->slotCount = slotCount;
+
+    for (i = 0; i < visitLog->countedPlanes; i++) {
+        *find_slot(visitLog, plane_id(visitLog, visitLog->counts + i))
+                = (uint32_t)i + 1;
+    }
+
+    return E_CONTROL_OK;
+}
+
+/**
+ * Add a new plane to the string pool and the plane table.
+ *
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_INFO if no memory is
+ * left. The caller must hold the visit log's guard.
+ *
+ * @param visitLog  The visit log, which shall know the plane.
+ *
+ * @param planeId   The plane's ID.
+ *
+ * @param slot  The unused hash index slot found for the plane.
+ */
+static int add_plane(struct VisitLog* visitLog, const char* planeId,
+        uint32_t* slot) {
+    struct PlaneCount* counts = NULL;
+    struct PlaneCount* entry = NULL;
+    char* pool = NULL;
+    size_t length = strlen(planeId) + 1;
+    size_t poolSize = visitLog->poolSize;
+    int capacity = 0;
+
+    if (visitLog->poolUsed + length > poolSize) {
+        poolSize = MAX(2 * poolSize, VISIT_LOG_MIN_GROWTH
+                * (size_t)CONTROL_MAX_ID_SIZE);
+        pool = (char*)realloc(visitLog->pool, poolSize);
+        if (!pool) {
+            return E_CONTROL_INVALID_INFO;
+        }
+        visitLog->pool = pool;
+        visitLog->poolSize = poolSize;
+    }
+
+    if (visitLog->countedPlanes == visitLog->countCapacity) {
+        capacity = MAX(2 * visitLog->countCapacity, VISIT_LOG_MIN_GROWTH);
+        counts = (struct PlaneCount*)realloc(visitLog->counts,
+                (size_t)capacity * sizeof(struct PlaneCount));
+        if (!counts) {
+            return E_CONTROL_INVALID_INFO;
+        }
+        visitLog->counts = counts;
+        visitLog->countCapacity = capacity;
+    }
+
+    entry = visitLog->counts + visitLog->countedPlanes;
+    entry->name = visitLog->poolUsed;
+    entry->count = 0;
+    entry->lastSeq = 0;
+    memcpy(visitLog->pool + visitLog->poolUsed, planeId, length);
+    visitLog->poolUsed += length;
+
+    visitLog->countedPlanes += 1;
+    *slot = (uint32_t)visitLog->countedPlanes;
+    return E_CONTROL_OK;
+}
+
+/**
+ * Look up the handle of the given plane, interning its ID if it is new.
+ *
+ * Returns the plane's handle, -1 if no memory is left. The caller must hold
+ * the visit log's guard.
+ *
+ * @param visitLog  The visit log to be searched.
+ *
+ * @param planeId   The plane's ID.
+ */
+static long intern_plane(struct VisitLog* visitLog, const char* planeId) {
+    uint32_t* slot = NULL;
+
+    if (4 * (visitLog->countedPlanes + 1) > 3 * visitLog->slotCount
+            && E_CONTROL_OK != grow_slots(visitLog)) {
+        return -1;
+    }
+
+    slot = find_slot(visitLog, planeId);
+    if (0 == *slot && E_CONTROL_OK != add_plane(visitLog, planeId, slot)) {
+        return -1;
+    }
+
+    return (long)*slot - 1;
+}
+
+/**
+ * Store a visit at the end of the arrival-ordered log.
+ *
+ * The plane's visit statistics and the visitor sketch are updated as well.
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_INFO if the log cannot
+ * grow. The caller must hold the visit log's guard.
+ *
+ * @param visitLog  The visit log to be appended to.
+ *
+ * @param planeId   The visiting plane's ID, shorter than CONTROL_MAX_ID_SIZE.
+ */
+static int store_visit(struct VisitLog* visitLog, const char* planeId) {
+    struct VisitRecord* visits = NULL;
+    struct VisitRecord* visit = NULL;
+    struct PlaneCount* entry = NULL;
+    long plane = 0;
+    int capacity = 0;
+
+    if (visitLog->loggedPlanes == visitLog->capacity) {
+        capacity = MAX(2 * visitLog->capacity, VISIT_LOG_MIN_GROWTH);
+        visits = (struct VisitRecord*)realloc(visitLog->visits,
+                (size_t)capacity * sizeof(struct VisitRecord));
+        if (!visits) {
+            return E_CONTROL_INVALID_INFO;
+        }
+        visitLog->visits = visits;
+        visitLog->capacity = capacity;
+    }
+
+    plane = intern_plane(visitLog, planeId);
+    if (0 > plane) {
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    visit = visitLog->visits + visitLog->loggedPlanes;
+    visitLog->loggedPlanes += 1;
+    visit->plane = (uint32_t)plane;
+    visit->seq = (uint32_t)visitLog->loggedPlanes;
+
+    entry = visitLog->counts + plane;
+    entry->count += 1;
+    entry->lastSeq = visit->seq;
+
+    if (!visitLog->sketch) {
+        visitLog->sketch = control_sketch_create();
+    }
+    if (visitLog->sketch) {
+        control_sketch_add(visitLog->sketch, planeId);
+    }
+    return E_CONTROL_OK;
+}
+
+/**
+ * Store a merged visit and persist it in the journal, if any.
+ *
+ * A journal, which cannot grow any more, is detached and closed: it would
+ * miss this visit, so it no longer replays the log. The visits are kept in
+ * memory only from then on. The caller must hold the visit log's guard.
+ *
+ * @param visitLog  The visit log to be appended to.
+ *
+ * @param planeId   The visiting plane's ID, shorter than CONTROL_MAX_ID_SIZE.
+ */
+static void merge_visit(struct VisitLog* visitLog, const char* planeId) {
+    struct VisitJournal* journal = visitLog->journal;
+
+    if (E_CONTROL_OK == store_visit(visitLog, planeId) && journal
+            && EXIT_SUCCESS != control_journal_append(journal, planeId)) {
+        __atomic_store_n(&visitLog->journal, NULL, __ATOMIC_RELEASE);
+        visitLog->segmentCurrent = 0;
+        control_journal_close(journal);
+    }
+}
+
+/**
+ * Drop the cached "log" reply, as further visits were merged.
+ *
+ * The caller must hold the visit log's guard.
+ *
+ * @param visitLog  The visit log, whose reply is out of date.
+ */
+static void invalidate_replies(struct VisitLog* visitLog) {
+    free(visitLog->sortedReply);
+    visitLog->sortedReply = NULL;
+    visitLog->sortedReplySize = 0;
+    visitLog->segmentCurrent = 0;
+}
+
+void control_visit_log_attach_journal(struct VisitLog* visitLog,
+        struct VisitJournal* journal) {
+    char planeId[CONTROL_MAX_ID_SIZE];
+    const char* records = NULL;
+    const char* end = NULL;
+    size_t size = 0;
+    size_t length = 0;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    records = control_journal_records(journal, &size);
+    while (0 < size) {
+        end = (const char*)memchr(records, '\n', size);
+        if (!end) {
+            break;
+        }
+        length = (size_t)(end - records);
+        if (length < CONTROL_MAX_ID_SIZE) {
+            memcpy(planeId, records, length);
+            planeId[length] = '\0';
+            store_visit(visitLog, planeId);
+        }
+        size -= length + 1;
+        records = end + 1;
+    }
+
+    __atomic_store_n(&visitLog->journal, journal, __ATOMIC_RELEASE);
+    invalidate_replies(visitLog);
+
+    pthread_mutex_unlock(&visitLog->guard);
+}
+
+void control_visit_log_attach_shared(struct VisitLog* visitLog,
+        struct SharedLog* shared) {
+    pthread_mutex_lock(&visitLog->guard);
+    visitLog->shared = shared;
+    pthread_mutex_unlock(&visitLog->guard);
+}
+
+void control_visit_log_destroy(struct VisitLog* visitLog) {
+    struct PlaneVisit* visit = NULL;
+
+    /*Persist what is left pending before the journal is closed*/
+    if (visitLog->journal) {
+        control_visit_log_merge(visitLog);
+    }
+    while (visitLog->pending) {
+        visit = visitLog->pending;
+        visitLog->pending = visit->next;
+        free(visit);
+    }
+
+    if (visitLog->journal) {
+        control_journal_close(visitLog->journal);
+    }
+    if (visitLog->shared) {
+        control_shared_log_close(visitLog->shared);
+    }
+
+    free(visitLog->visits);
+    free(visitLog->pool);
+    free(visitLog->counts);
+    free(visitLog->slots);
+    free(visitLog->sortedReply);
+    free(visitLog->sketch);
+    pthread_mutex_destroy(&visitLog->guard);
+}
+
+int control_visit_log_append(struct VisitLog* visitLog, const char* planeId) {
+    struct PlaneVisit* visit = NULL;
+
+    if (CONTROL_MAX_ID_SIZE <= strlen(planeId)) {
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    /*A full shared log still takes check-ins, but only into this process*/
+    if (visitLog->shared && E_CONTROL_OK
+            == control_shared_log_append(visitLog->shared, planeId)) {
+        return E_CONTROL_OK;
+    }
+
+    if (__atomic_load_n(&visitLog->journal, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&visitLog->guard);
+        control_visit_log_merge(visitLog);
+        merge_visit(visitLog, planeId);
+        invalidate_replies(visitLog);
+        pthread_mutex_unlock(&visitLog->guard);
+        return E_CONTROL_OK;
+    }
+
+    visit = (struct PlaneVisit*)malloc(sizeof(struct PlaneVisit));
+    if (!visit) {
+        return E_CONTROL_INVALID_INFO;
+    }
+    strcpy(visit->id, planeId);
+
+    visit->next = __atomic_load_n(&visitLog->pending, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&visitLog->pending, &visit->next,
+            visit, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+    if (VISIT_LOG_MERGE_BATCH <= __atomic_add_fetch(&visitLog->pendingCount,
+            1, __ATOMIC_RELAXED)
+            && 0 == pthread_mutex_trylock(&visitLog->guard)) {
+        control_visit_log_merge(visitLog);
+        pthread_mutex_unlock(&visitLog->guard);
+    }
+
+    return E_CONTROL_OK;
+}
+
+void control_visit_log_merge(struct VisitLog* visitLog) {
+    char planeId[CONTROL_MAX_ID_SIZE];
+    struct PlaneVisit* visit = NULL;
+    struct PlaneVisit* newest = NULL;
+    struct PlaneVisit* oldest = NULL;
+    int merged = 0;
+
+    newest = __atomic_exchange_n(&visitLog->pending, NULL, __ATOMIC_ACQUIRE);
+
+    /*The stack holds the newest check-in on top, so reverse it*/
+    while (newest) {
+        visit = newest;
+        newest = visit->next;
+        visit->next = oldest;
+        oldest = visit;
+    }
+
+    while (oldest) {
+        visit = oldest;
+        oldest = visit->next;
+        merge_visit(visitLog, visit->id);
+        free(visit);
+        merged += 1;
+    }
+    __atomic_sub_fetch(&visitLog->pendingCount, merged, __ATOMIC_RELAXED);
+
+    while (visitLog->shared
+            && control_shared_log_next(visitLog->shared, planeId)) {
+        merge_visit(visitLog, planeId);
+        merged = 1;
+    }
+
+    if (merged) {
+        invalidate_replies(visitLog);
+    }
+}
+
+/**
+ * A distinct plane while rendering the sorted "log" reply.
+ */
+struct SortedPlane {
+    /**
+     * The plane's ID within the string pool.
+     */
+    const char* id;
+
+    /**
+     * The number of the plane's visits.
+     */
+    unsigned long count;
+};
+
+/**
+ * Comparer function used while ordering the planes by their IDs.
+ *
+ * Returns a value lower, equal or greater than 0 if arg0's ID is lower, equal
+ * or greater than arg1's.
+ *
+ * @param arg0  The one struct SortedPlane to compare.
+ *
+ * @param arg1  The other struct SortedPlane to compare to.
+ */
+static int plane_comparator(const void* arg0, const void* arg1) {
+    return strcmp(((const struct SortedPlane*)arg0)->id,
+            ((const struct SortedPlane*)arg1)->id);
+}
+
+/**
+ * Render the sorted "log" reply into the cache.
+ *
+ * Only the distinct IDs are sorted, each is repeated by its visit count.
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_INFO if no memory is
+ * left. The caller must hold the visit log's guard.
+ *
+ * @param visitLog  The visit log to be rendered.
+ */
+static int build_sorted_reply(struct VisitLog* visitLog) {
+    struct SortedPlane* sorted = NULL;
+    char* reply = NULL;
+    size_t size = 0;
+    size_t length = 0;
+    unsigned long visit = 0;
+    int i = 0;
+
+    sorted = (struct SortedPlane*)malloc((visitLog->countedPlanes + 1)
+            * sizeof(struct SortedPlane));
+    if (!sorted) {
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    for (i = 0; i < visitLog->countedPlanes; i++) {
+        sorted[i].id = plane_id(visitLog, visitLog->counts + i);
+        sorted[i].count = visitLog->counts[i].count;
+        size += (strlen(sorted[i].id) + 1) * sorted[i].count;
+    }
+    qsort(sorted, visitLog->countedPlanes, sizeof(struct SortedPlane),
+            plane_comparator);
+
+    reply = (char*)malloc(size + 3);
+    if (!reply) {
+        free(sorted);
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    size = 0;
+    for (i = 0; i < visitLog->countedPlanes; i++) {
+        length = strlen(sorted[i].id);
+        for (visit = 0; visit < sorted[i].count; visit++) {
+            memcpy(reply + size, sorted[i].id, length);
+            reply[size + length] = '\n';
+            size += length + 1;
+        }
+    }
+    memcpy(reply + size, ".\n", 3);
+    size += 2;
+
+    free(sorted);
+
+    visitLog->sortedReply = reply;
+    visitLog->sortedReplySize = size;
+
+    if (visitLog->journal && CONTROL_SENDFILE_MIN_SIZE <= size) {
+        visitLog->segmentCurrent = (EXIT_SUCCESS
+                == control_journal_write_segment(visitLog->journal, reply,
+                        size));
+    }
+    return E_CONTROL_OK;
+}
+
+char* control_visit_log_sorted(struct VisitLog* visitLog, size_t* size) {
+    char* reply = NULL;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    control_visit_log_merge(visitLog);
+
+    if (!visitLog->sortedReply
+            && E_CONTROL_OK != build_sorted_reply(visitLog)) {
+        pthread_mutex_unlock(&visitLog->guard);
+        return NULL;
+    }
+
+    reply = (char*)malloc(visitLog->sortedReplySize + 1);
+    if (reply) {
+        memcpy(reply, visitLog->sortedReply, visitLog->sortedReplySize + 1);
+        *size = visitLog->sortedReplySize;
+    }
+
+    pthread_mutex_unlock(&visitLog->guard);
+    return reply;
+}
+
+char* control_visit_log_since(struct VisitLog* visitLog, unsigned long cursor,
+        size_t* size) {
+    char* reply = NULL;
+    const char* planeId = NULL;
+    size_t length = 0;
+    size_t used = 0;
+    int first = 0;
+    int i = 0;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    control_visit_log_merge(visitLog);
+
+    if (cursor <= (unsigned long)visitLog->loggedPlanes) {
+        first = (int)cursor;
+    }
+
+    length = (size_t)(visitLog->loggedPlanes - first) * CONTROL_MAX_ID_SIZE
+            + 32;
+    reply = (char*)malloc(length);
+    if (!reply) {
+        pthread_mutex_unlock(&visitLog->guard);
+        return NULL;
+    }
+
+    for (i = first; i < visitLog->loggedPlanes; i++) {
+        planeId = control_visit_log_plane(visitLog, i);
+        length = strlen(planeId);
+        memcpy(reply + used, planeId, length);
+        reply[used + length] = '\n';
+        used += length + 1;
+    }
+    used += sprintf(reply + used, ".%d\n", visitLog->loggedPlanes);
+    *size = used;
+
+    pthread_mutex_unlock(&visitLog->guard);
+    return reply;
+}
+
+unsigned long control_visit_log_count(struct VisitLog* visitLog,
+        const char* planeId, unsigned long* lastSeq) {
+    struct PlaneCount* entry = NULL;
+    uint32_t* slot = NULL;
+    unsigned long count = 0;
+
+    *lastSeq = 0;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    control_visit_log_merge(visitLog);
+
+    if (visitLog->slotCount) {
+        slot = find_slot(visitLog, planeId);
+        if (0 != *slot) {
+            entry = visitLog->counts + *slot - 1;
+            count = entry->count;
+            *lastSeq = entry->lastSeq;
+        }
+    }
+
+    pthread_mutex_unlock(&visitLog->guard);
+    return count;
+}
+
+/**
+ * Check if a plane's statistics rank below another's in a "top" reply.
+ *
+ * Returns 1 if entry0 has fewer visits than entry1 or the same number of
+ * visits, but a lexicographically greater ID, 0 else.
+ *
+ * @param visitLog  The visit log owning the statistics.
+ *
+ * @param entry0  The one statistics to compare.
+ *
+ * @param entry1  The other statistics to compare to.
+ */
+static int ranks_below(const struct VisitLog* visitLog,
+        const struct PlaneCount* entry0, const struct PlaneCount* entry1) {
+    if (entry0->count != entry1->count) {
+        return entry0->count < entry1->count;
+    }
+    return 0 < strcmp(plane_id(visitLog, entry0),
+            plane_id(visitLog, entry1));
+}
+
+/**
+ * Restore the heap property below the given position of a min-heap.
+ *
+ * The heap's root holds the lowest ranking statistics.
+ *
+ * @param visitLog  The visit log owning the statistics.
+ *
+ * @param heap  The heap of statistics.
+ *
+ * @param used  The number of entries in the heap.
+ *
+ * @param position  The position, whose entry may be out of place.
+ */
+static void sift_down(const struct VisitLog* visitLog,
+        const struct PlaneCount** heap, int used, int position) {
+    const struct PlaneCount* swap = NULL;
+    int child = 0;
+
+    while ((child = 2 * position + 1) < used) {
+        if (child + 1 < used
+                && ranks_below(visitLog, heap[child + 1], heap[child])) {
+            child += 1;
+        }
+        if (!ranks_below(visitLog, heap[child], heap[position])) {
+            break;
+        }
+        swap = heap[child];
+        heap[child] = heap[position];
+        heap[position] = swap;
+        position = child;
+    }
+}
+
+char* control_visit_log_top(struct VisitLog* visitLog, unsigned long top,
+        size_t* size) {
+    const struct PlaneCount** heap = NULL;
+    const struct PlaneCount* entry = NULL;
+    char* reply = NULL;
+    size_t used = 0;
+    int heapSize = 0;
+    int i = 0;
+    int j = 0;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    control_visit_log_merge(visitLog);
+
+    top = MIN(top, (unsigned long)visitLog->countedPlanes);
+    heap = (const struct PlaneCount**)malloc((top + 1)
+            * sizeof(struct PlaneCount*));
+    reply = (char*)malloc(top * (CONTROL_MAX_ID_SIZE + 24) + 3);
+    if (!heap || !reply) {
+        pthread_mutex_unlock(&visitLog->guard);
+        free(heap);
+        free(reply);
+        return NULL;
+    }
+
+    /*Keep the top ranking planes in a min-heap, O(N log k)*/
+    for (i = 0; 0 < top && i < visitLog->countedPlanes; i++) {
+        entry = visitLog->counts + i;
+        if ((unsigned long)heapSize < top) {
+            heap[heapSize] = entry;
+            heapSize += 1;
+            if ((unsigned long)heapSize == top) {
+                for (j = heapSize / 2; 0 <= j; j--) {
+                    sift_down(visitLog, heap, heapSize, j);
+                }
+            }
+        } else if (ranks_below(visitLog, heap[0], entry)) {
+            heap[0] = entry;
+            sift_down(visitLog, heap, heapSize, 0);
+        }
+    }
+
+    /*Popping the heap moves the lowest ranking planes to the end*/
+    for (i = heapSize - 1; 0 < i; i--) {
+        entry = heap[0];
+        heap[0] = heap[i];
+        heap[i] = entry;
+        sift_down(visitLog, heap, i, 0);
+    }
+
+    for (i = 0; i < heapSize; i++) {
+        used += sprintf(reply + used, "%s:%lu\n",
+                plane_id(visitLog, heap[i]), heap[i]->count);
+    }
+    memcpy(reply + used, ".\n", 3);
+    *size = used + 2;
+
+    pthread_mutex_unlock(&visitLog->guard);
+    free(heap);
+    return reply;
+}
+
+unsigned long control_visit_log_distinct(struct VisitLog* visitLog) {
+    unsigned long distinct = 0;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    control_visit_log_merge(visitLog);
+    if (visitLog->sketch) {
+        distinct = control_sketch_distinct(visitLog->sketch);
+    }
+
+    pthread_mutex_unlock(&visitLog->guard);
+    return distinct;
+}
+
+char* control_visit_log_heavy(struct VisitLog* visitLog, unsigned long top,
+        size_t* size) {
+    char* reply = NULL;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    control_visit_log_merge(visitLog);
+    reply = control_sketch_heavy(visitLog->sketch, top, size);
+
+    pthread_mutex_unlock(&visitLog->guard);
+    return reply;
+}
+
+char* control_visit_log_sketch(struct VisitLog* visitLog, size_t* size) {
+    char* reply = NULL;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    control_visit_log_merge(visitLog);
+    reply = control_sketch_encode(visitLog->sketch, size);
+
+    pthread_mutex_unlock(&visitLog->guard);
+    return reply;
+}
+
+int control_visit_log_sorted_segment(struct VisitLog* visitLog, size_t* size) {
+    int segment = -1;
+
+    pthread_mutex_lock(&visitLog->guard);
+
+    if (!visitLog->journal) {
+        pthread_mutex_unlock(&visitLog->guard);
+        return -1;
+    }
+
+    control_visit_log_merge(visitLog);
+
+    if (!visitLog->sortedReply) {
+        build_sorted_reply(visitLog);
+    }
+
+    if (visitLog->segmentCurrent) {
+        segment = control_journal_open_segment(visitLog->journal);
+        *size = visitLog->sortedReplySize;
+    }
+
+    pthread_mutex_unlock(&visitLog->guard);
+    return segment;
+}
@@ -0,0 +1,402 @@
+/*
+ *visitLog.h
+ */
+
+#pragma once
+
+#ifndef VISIT_LOG_H
+#define VISIT_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "protocol.h"
+#include "sharedLog.h"
+#include "visitJournal.h"
+#include "visitorSketch.h"
+
+/**
+ * The minimum length of a "log" reply, which is sent from the sorted segment.
+ */
+#define CONTROL_SENDFILE_MIN_SIZE (16 * 1024)
+
+/**
+ * The number of entries, by which the visit log's tables grow at least.
+ * Kept small, so hosting thousands of quiet airports stays cheap.
+ */
+#define VISIT_LOG_MIN_GROWTH 64
+
+/**
+ * The number of pending check-ins, from which on a check-in merges them into
+ * the log if nobody else holds it.
+ */
+#define VISIT_LOG_MERGE_BATCH 256
+
+/**
+ * A single check-in, which is waiting to be merged into the visit log.
+ */
+struct PlaneVisit {
+    /**
+     * The next older pending check-in.
+     */
+    struct PlaneVisit* next;
+
+    /**
+     * The visiting plane's ID without trailing LF.
+     */
+    char id[CONTROL_MAX_ID_SIZE];
+};
+
+/**
+ * A single merged visit.
+ */
+struct VisitRecord {
+    /**
+     * The handle of the visiting plane, i.e. its index in the plane table.
+     */
+    uint32_t plane;
+
+    /**
+     * The visit's sequence number, starting at 1.
+     */
+    uint32_t seq;
+};
+
+/**
+ * The interned ID and visit statistics of a single plane.
+ */
+struct PlaneCount {
+    /**
+     * The offset of the plane's ID in the string pool.
+     */
+    size_t name;
+
+    /**
+     * The number of visits.
+     */
+    unsigned long count;
+
+    /**
+     * The sequence number of the latest visit, starting at 1.
+     */
+    unsigned long lastSeq;
+};
+
+/**
+ * The log of all planes, which visited an airport.
+ *
+ * Check-ins are pushed onto a lock-free multi-producer stack, so plane threads
+ * never wait for each other. The pending check-ins are merged into the
+ * arrival-ordered log when somebody asks for its contents or once
+ * VISIT_LOG_MERGE_BATCH of them are pending, so they do not pile up without
+ * queries. If a journal is attached, check-ins are merged and persisted there
+ * right away instead, so none is lost if the control is killed.
+ *
+ * Plane IDs are interned: every distinct ID is stored once in a string pool
+ * and each visit only refers to it by a 4-byte handle. Every merged visit
+ * also updates a fixed-size sketch of the visitors.
+ *
+ * If a shared log is attached, check-ins go there instead of the pending
+ * stack and merging follows the visits of all processes sharing it.
+ */
+struct VisitLog {
+    /**
+     * The most recent pending check-in, NULL if none is pending.
+     */
+    struct PlaneVisit* pending;
+
+    /**
+     * The number of pending check-ins, updated atomically.
+     */
+    int pendingCount;
+
+    /**
+     * Mutex protecting the merged log and the cached reply.
+     */
+    pthread_mutex_t guard;
+
+    /**
+     * The merged visits in arrival order.
+     */
+    struct VisitRecord* visits;
+
+    /**
+     * The number of used entries in visits.
+     */
+    int loggedPlanes;
+
+    /**
+     * The number of allocated entries in visits, which grows on demand.
+     */
+    int capacity;
+
+    /**
+     * The NUL-terminated IDs of all distinct planes.
+     */
+    char* pool;
+
+    /**
+     * The number of used bytes in pool.
+     */
+    size_t poolUsed;
+
+    /**
+     * The number of allocated bytes in pool.
+     */
+    size_t poolSize;
+
+    /**
+     * The distinct planes, indexed by their handles.
+     */
+    struct PlaneCount* counts;
+
+    /**
+     * The number of distinct planes in counts.
+     */
+    int countedPlanes;
+
+    /**
+     * The number of allocated entries in counts.
+     */
+    int countCapacity;
+
+    /**
+     * Hash index from plane ID to handle + 1, 0 marks unused slots.
+     */
+    uint32_t* slots;
+
+    /**
+     * The number of entries in slots, always a power of 2.
+     */
+    int slotCount;
+
+    /**
+     * The cached reply to a "log" request, NULL if it is out of date.
+     */
+    char* sortedReply;
+
+    /**
+     * The length of the cached reply.
+     */
+    size_t sortedReplySize;
+
+    /**
+     * The journal persisting all visits, NULL if none is attached.
+     */
+    struct VisitJournal* journal;
+
+    /**
+     * Set if the journal's sorted segment matches the cached reply.
+     */
+    int segmentCurrent;
+
+    /**
+     * The sketch of all visitors, allocated on the first visit.
+     */
+    struct VisitorSketch* sketch;
+
+    /**
+     * The log shared with other processes, NULL if none is attached.
+     */
+    struct SharedLog* shared;
+};
+
+/**
+ * Initialize an empty visit log.
+ *
+ * @param visitLog  The visit log to be initialized.
+ *
+ * @param capacity  The number of visits, which can be logged before the log
+ *                  needs to grow.
+ */
+void control_visit_log_init(struct VisitLog* visitLog, int capacity);
+
+/**
+ * Attach a journal to the visit log.
+ *
+ * All visits recorded in the journal are loaded into the log. Afterwards
+ * every merged visit is appended to the journal. The visit log takes over
+ * the journal and closes it upon destruction.
+ *
+ * @param visitLog  The visit log, which shall persist its visits.
+ *
+ * @param journal   The opened journal.
+ */
+void control_visit_log_attach_journal(struct VisitLog* visitLog,
+        struct VisitJournal* journal);
+
+/**
+ * Attach a shared log to the visit log.
+ *
+ * Afterwards check-ins are appended to the shared log and the visit log
+ * merges the visits of all processes attached to it. The visit log takes
+ * over the shared log and closes it upon destruction.
+ *
+ * @param visitLog  The visit log, which shall share its visits.
+ *
+ * @param shared  The opened shared log.
+ */
+void control_visit_log_attach_shared(struct VisitLog* visitLog,
+        struct SharedLog* shared);
+
+/**
+ * Free all the resources held by the visit log.
+ *
+ * @param visitLog  The visit log to be destroyed.
+ */
+void control_visit_log_destroy(struct VisitLog* visitLog);
+
+/**
+ * Record a plane's visit.
+ *
+ * Without a journal the check-in does not block: it is left pending if
+ * somebody else holds the log. With a journal attached, it is merged and
+ * persisted before returning.
+ *
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_INFO if the given ID is
+ * too long or no memory is left for the pending check-in.
+ *
+ * @param visitLog  The visit log to be appended to.
+ *
+ * @param planeId   The visiting plane's ID without trailing LF.
+ */
+int control_visit_log_append(struct VisitLog* visitLog, const char* planeId);
+
+/**
+ * Move all pending check-ins into the arrival-ordered log.
+ *
+ * With a shared log attached, all visits committed there are moved.
+ *
+ * The caller must hold the visit log's guard.
+ *
+ * @param visitLog  The visit log to be merged.
+ */
+void control_visit_log_merge(struct VisitLog* visitLog);
+
+/**
+ * Get the reply to a "log" request.
+ *
+ * Returns a copy of all logged plane IDs in lexicographic order, each
+ * terminated by LF, followed by the closing ".\n". The sorted text is cached
+ * until the next check-in is merged. The caller has to free() the returned
+ * buffer. NULL is returned if no memory is left.
+ *
+ * @param visitLog  The visit log to be replied.
+ *
+ * @param size  Output parameter, the length of the returned text.
+ */
+char* control_visit_log_sorted(struct VisitLog* visitLog, size_t* size);
+
+/**
+ * Get the reply to a "log <cursor>" request.
+ *
+ * Returns a copy of the plane IDs logged after the given cursor in arrival
+ * order, each terminated by LF, followed by the closing "." and the new
+ * cursor. The cost is proportional to the number of returned visits. If the
+ * cursor is ahead of the log, e.g. because the control restarted without a
+ * journal, all visits are returned. The caller has to free() the returned
+ * buffer. NULL is returned if no memory is left.
+ *
+ * @param visitLog  The visit log to be replied.
+ *
+ * @param cursor  The number of visits the caller has already seen.
+ *
+ * @param size  Output parameter, the length of the returned text.
+ */
+char* control_visit_log_since(struct VisitLog* visitLog, unsigned long cursor,
+        size_t* size);
+
+/**
+ * Get the ID of the plane, which visited at the given position in the log.
+ *
+ * The caller must hold the visit log's guard, the returned ID is valid until
+ * it is released.
+ *
+ * @param visitLog  The visit log to be read.
+ *
+ * @param visit   The visit's index in the arrival-ordered log.
+ */
+const char* control_visit_log_plane(const struct VisitLog* visitLog,
+        int visit);
+
+/**
+ * Get the visit statistics of a plane.
+ *
+ * Returns the number of visits of the given plane, 0 if it never visited.
+ *
+ * @param visitLog  The visit log to be queried.
+ *
+ * @param planeId   The plane's ID without trailing LF.
+ *
+ * @param lastSeq   Output parameter, the sequence number of the plane's
+ *                  latest visit, 0 if it never visited.
+ */
+unsigned long control_visit_log_count(struct VisitLog* visitLog,
+        const char* planeId, unsigned long* lastSeq);
+
+/**
+ * Get the reply to a "top <N>" request.
+ *
+ * Returns a copy of the N most frequent visitors as "id:count" lines, the
+ * most frequent first and ties in lexicographic order, followed by the
+ * closing ".\n". The caller has to free() the returned buffer. NULL is
+ * returned if no memory is left.
+ *
+ * @param visitLog  The visit log to be queried.
+ *
+ * @param top   The maximum number of planes to be replied.
+ *
+ * @param size  Output parameter, the length of the returned text.
+ */
+char* control_visit_log_top(struct VisitLog* visitLog, unsigned long top,
+        size_t* size);
+
+/**
+ * Estimate the number of distinct planes, which visited.
+ *
+ * @param visitLog  The visit log to be queried.
+ */
+unsigned long control_visit_log_distinct(struct VisitLog* visitLog);
+
+/**
+ * Get the reply to a "heavy <N>" request.
+ *
+ * Like control_visit_log_top(), but the planes and their counts are estimated
+ * from the visitor sketch, so at most SKETCH_TOP planes are replied.
+ *
+ * @param visitLog  The visit log to be queried.
+ *
+ * @param top   The maximum number of planes to be replied.
+ *
+ * @param size  Output parameter, the length of the returned text.
+ */
+char* control_visit_log_heavy(struct VisitLog* visitLog, unsigned long top,
+        size_t* size);
+
+/**
+ * Get the reply to a "sketch" request.
+ *
+ * Returns the visitor sketch's text form as control_sketch_encode() does.
+ *
+ * @param visitLog  The visit log to be queried.
+ *
+ * @param size  Output parameter, the length of the returned text.
+ */
+char* control_visit_log_sketch(struct VisitLog* visitLog, size_t* size);
+
+/**
+ * Open the journal's sorted segment holding the reply to a "log" request.
+ *
+ * Returns a file descriptor reading the same text as
+ * control_visit_log_sorted() would return. -1 is returned if no journal is
+ * attached, the reply is shorter than CONTROL_SENDFILE_MIN_SIZE or the
+ * segment cannot be written. The caller has to close the descriptor.
+ *
+ * @param visitLog  The visit log to be replied.
+ *
+ * @param size  Output parameter, the length of the segment.
+ */
+int control_visit_log_sorted_segment(struct VisitLog* visitLog, size_t* size);
+
+#endif
@@ -0,0 +1,507 @@
+/*
+ *visitorSketch.c
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "errorReturn.h"
+#include "protocol.h"
+#include "visitorSketch.h"
+
+/**
+ * The hexadecimal digits used by the text form.
+ */
+static const char hexDigits[] = "0123456789abcdef";
+
+struct VisitorSketch* control_sketch_create() {
+    return (struct VisitorSketch*)calloc(1, sizeof(struct VisitorSketch));
+}
+
+/**
+ * Hash a plane ID to 64 well mixed bits.
+ *
+ * FNV-1a is followed by MurmurHash3's finalizer, as the HyperLogLog relies on
+ * the leading bits being uniformly distributed.
+ *
+ * @param planeId The plane ID to be hashed.
+ */
+static uint64_t sketch_hash(const char* planeId) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    while (*planeId) {
+        hash ^= (unsigned char)*planeId++;
+        hash *= 1099511628211ULL;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * Get a plane's counter within a count-min row.
+ *
+ * The rows' hash functions are derived from two halves of the plane's hash.
+ *
+ * @param hash  The hash of the plane's ID.
+ *
+ * @param row The count-min row.
+ */
+static int counter_index(uint64_t hash, int row) {
+    uint32_t low = (uint32_t)hash;
+    uint32_t high = (uint32_t)(hash >> 32) | 1;
+
+    return (int)((low + (uint32_t)row * high) & (SKETCH_WIDTH - 1));
+}
+
+/**
+ * Estimate the number of a plane's visits by its hash.
+ *
+ * @param sketch  The sketch to be queried.
+ *
+ * @param hash  The hash of the plane's ID.
+ */
+static uint32_t estimate_count(const struct VisitorSketch* sketch,
+        uint64_t hash) {
+    uint32_t estimate = UINT32_MAX;
+    int row = 0;
+
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        estimate = MIN(estimate,
+                sketch->counters[row][counter_index(hash, row)]);
+    }
+    return estimate;
+}
+
+/**
+ * Swap two heavy hitters.
+ *
+ * @param entry0  The one heavy hitter.
+ *
+ * @param entry1  The other heavy hitter.
+ */
+static void swap_hitters(struct HeavyHitter* entry0,
+        struct HeavyHitter* entry1) {
+    struct HeavyHitter swap;
+
+    memcpy(&swap, entry0, sizeof(struct HeavyHitter));
+    memcpy(entry0, entry1, sizeof(struct HeavyHitter));
+    memcpy(entry1, &swap, sizeof(struct HeavyHitter));
+}
+
+/**
+ * Restore the heap property of the heavy hitters above the given position.
+ *
+ * @param sketch  The sketch owning the heap.
+ *
+ * @param position  The position, whose count may have decreased.
+ */
+static void sift_hitter_up(struct VisitorSketch* sketch, int position) {
+    int parent = 0;
+
+    while (0 < position) {
+        parent = (position - 1) / 2;
+        if (sketch->top[parent].count <= sketch->top[position].count) {
+            break;
+        }
+        swap_hitters(sketch->top + parent, sketch->top + position);
+        position = parent;
+    }
+}
+
+/**
+ * Restore the heap property of the heavy hitters below the given position.
+ *
+ * @param sketch  The sketch owning the heap.
+ *
+ * @param position  The position, whose count may have increased.
+ */
+static void sift_hitter_down(struct VisitorSketch* sketch, int position) {
+    int child = 0;
+
+    while ((child = 2 * position + 1) < sketch->topSize) {
+        if (child + 1 < sketch->topSize
+                && sketch->top[child + 1].count < sketch->top[child].count) {
+            child += 1;
+        }
+        if (sketch->top[position].count <= sketch->top[child].count) {
+            break;
+        }
+        swap_hitters(sketch->top + child, sketch->top + position);
+        position = child;
+    }
+}
+
+/**
+ * Offer a plane to the heavy hitters.
+ *
+ * A tracked plane's count is updated. An untracked plane replaces the one
+ * with the fewest visits, if it has more.
+ *
+ * @param sketch  The sketch owning the heap.
+ *
+ * @param hash  The hash of the plane's ID.
+ *
+ * @param planeId The plane's ID.
+ *
+ * @param count The estimated number of the plane's visits.
+ */
+static void offer_hitter(struct VisitorSketch* sketch, uint64_t hash,
+        const char* planeId, uint32_t count) {
+    struct HeavyHitter* entry = NULL;
+    int i = 0;
+
+    for (i = 0; i < sketch->topSize; i++) {
+        entry = sketch->top + i;
+        if (entry->hash == hash && 0 == strcmp(entry->id, planeId)) {
+            entry->count = count;
+            sift_hitter_down(sketch, i);
+            return;
+        }
+    }
+
+    if (sketch->topSize < SKETCH_TOP) {
+        entry = sketch->top + sketch->topSize;
+        sketch->topSize += 1;
+    } else if (sketch->top[0].count < count) {
+        entry = sketch->top;
+    } else {
+        return;
+    }
+
+    entry->hash = hash;
+    entry->count = count;
+    strncpy(entry->id, planeId, CONTROL_MAX_ID_SIZE - 1);
+    entry->id[CONTROL_MAX_ID_SIZE - 1] = '\0';
+
+    if (entry == sketch->top) {
+        sift_hitter_down(sketch, 0);
+    } else {
+        sift_hitter_up(sketch, (int)(entry - sketch->top));
+    }
+}
+
+void control_sketch_add(struct VisitorSketch* sketch, const char* planeId) {
+    uint64_t hash = sketch_hash(planeId);
+    uint64_t rest = hash << SKETCH_PRECISION;
+    uint32_t estimate = UINT32_MAX;
+    uint32_t* counter = NULL;
+    uint8_t rank = 0;
+    int row = 0;
+
+    /*The rank is the position of the first set bit after the index bits*/
+    rank = (uint8_t)(__builtin_clzll(rest
+            | (1ULL << (SKETCH_PRECISION - 1))) + 1);
+    sketch->registers[hash >> (64 - SKETCH_PRECISION)] = MAX(rank,
+            sketch->registers[hash >> (64 - SKETCH_PRECISION)]);
+
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        counter = sketch->counters[row] + counter_index(hash, row);
+        if (UINT32_MAX != *counter) {
+            *counter += 1;
+        }
+        estimate = MIN(estimate, *counter);
+    }
+
+    offer_hitter(sketch, hash, planeId, estimate);
+}
+
+unsigned long control_sketch_distinct(const struct VisitorSketch* sketch) {
+    double registers = (double)SKETCH_REGISTERS;
+    double alpha = 0.7213 / (1.0 + 1.079 / registers);
+    double sum = 0.0;
+    double estimate = 0.0;
+    int zeros = 0;
+    int i = 0;
+
+    for (i = 0; i < SKETCH_REGISTERS; i++) {
+        sum += ldexp(1.0, -(int)sketch->registers[i]);
+        zeros += (0 == sketch->registers[i]);
+    }
+
+    estimate = alpha * registers * registers / sum;
+
+    /*Linear counting is more accurate while many registers are unused*/
+    if (estimate <= 2.5 * registers && 0 < zeros) {
+        estimate = registers * log(registers / (double)zeros);
+    }
+    return (unsigned long)(estimate + 0.5);
+}
+
+unsigned long control_sketch_count(const struct VisitorSketch* sketch,
+        const char* planeId) {
+    return estimate_count(sketch, sketch_hash(planeId));
+}
+
+void control_sketch_merge(struct VisitorSketch* sketch,
+        const struct VisitorSketch* other) {
+    struct HeavyHitter candidates[2 * SKETCH_TOP];
+    uint64_t sum = 0;
+    int count = 0;
+    int row = 0;
+    int i = 0;
+
+    for (i = 0; i < SKETCH_REGISTERS; i++) {
+        sketch->registers[i] = MAX(sketch->registers[i],
+                other->registers[i]);
+    }
+
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        for (i = 0; i < SKETCH_WIDTH; i++) {
+            sum = (uint64_t)sketch->counters[row][i]
+                    + other->counters[row][i];
+            sketch->counters[row][i] = (uint32_t)MIN(sum, UINT32_MAX);
+        }
+    }
+
+    /*Both sides' heavy hitters are candidates, ranked by the merged counts*/
+    memcpy(candidates, sketch->top,
+            (size_t)sketch->topSize * sizeof(struct HeavyHitter));
+    memcpy(candidates + sketch->topSize, other->top,
+            (size_t)other->topSize * sizeof(struct HeavyHitter));
+    count = sketch->topSize + other->topSize;
+
+    sketch->topSize = 0;
+    for (i = 0; i < count; i++) {
+        offer_hitter(sketch, candidates[i].hash, candidates[i].id,
+                estimate_count(sketch, candidates[i].hash));
+    }
+}
+
+/**
+ * Comparer function used while ordering the heavy hitters for a reply.
+ *
+ * Returns a value lower than 0 if arg0 has more visits than arg1 or the same
+ * number of visits, but a lexicographically lower ID.
+ *
+ * @param arg0  The one struct HeavyHitter to compare.
+ *
+ * @param arg1  The other struct HeavyHitter to compare to.
+ */
+static int hitter_comparator(const void* arg0, const void* arg1) {
+    const struct HeavyHitter* entry0 = (const struct HeavyHitter*)arg0;
+    const struct HeavyHitter* entry1 = (const struct HeavyHitter*)arg1;
+
+    if (entry0->count != entry1->count) {
+        return entry0->count < entry1->count ? 1 : -1;
+    }
+    return strcmp(entry0->id, entry1->id);
+}
+
+char* control_sketch_heavy(const struct VisitorSketch* sketch,
+        unsigned long top, size_t* size) {
+    struct HeavyHitter sorted[SKETCH_TOP];
+    char* reply = NULL;
+    size_t used = 0;
+    int count = sketch ? sketch->topSize : 0;
+    int i = 0;
+
+    reply = (char*)malloc(SKETCH_TOP * (CONTROL_MAX_ID_SIZE + 12) + 3);
+    if (!reply) {
+        return NULL;
+    }
+
+    if (sketch) {
+        memcpy(sorted, sketch->top,
+                (size_t)count * sizeof(struct HeavyHitter));
+        qsort(sorted, count, sizeof(struct HeavyHitter), hitter_comparator);
+    }
+
+    for (i = 0; (unsigned long)i < top && i < count; i++) {
+        used += sprintf(reply + used, "%s:%lu\n", sorted[i].id,
+                (unsigned long)sorted[i].count);
+    }
+    memcpy(reply + used, ".\n", 3);
+    *size = used + 2;
+    return reply;
+}
+
+/**
+ * Write a number as a fixed number of hexadecimal digits.
+ *
+ * Returns the position after the written digits.
+ *
+ * @param text  The position to write to.
+ *
+ * @param value The number to be written.
+ *
+ * @param digits  The number of digits.
+ */
+static char* write_hex(char* text, uint32_t value, int digits) {
+    int i = 0;
+
+    for (i = digits - 1; 0 <= i; i--) {
+        text[i] = hexDigits[value & 0xf];
+        value >>= 4;
+    }
+    return text + digits;
+}
+
+char* control_sketch_encode(const struct VisitorSketch* sketch,
+        size_t* size) {
+    struct VisitorSketch* empty = NULL;
+    char* reply = NULL;
+    char* end = NULL;
+    int row = 0;
+    int i = 0;
+
+    if (!sketch) {
+        empty = control_sketch_create();
+        if (!empty) {
+            return NULL;
+        }
+        sketch = empty;
+    }
+
+    reply = (char*)malloc(5 + 2 * SKETCH_REGISTERS
+            + SKETCH_DEPTH * (5 + 8 * SKETCH_WIDTH)
+            + SKETCH_TOP * (CONTROL_MAX_ID_SIZE + 16) + 3);
+    if (!reply) {
+        free(empty);
+        return NULL;
+    }
+
+    end = reply;
+    memcpy(end, "hll:", 4);
+    end += 4;
+    for (i = 0; i < SKETCH_REGISTERS; i++) {
+        end = write_hex(end, sketch->registers[i], 2);
+    }
+    *end++ = '\n';
+
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        memcpy(end, "cms:", 4);
+        end += 4;
+        for (i = 0; i < SKETCH_WIDTH; i++) {
+            end = write_hex(end, sketch->counters[row][i], 8);
+        }
+        *end++ = '\n';
+    }
+
+    for (i = 0; i < sketch->topSize; i++) {
+        end += sprintf(end, "top:%s:%lu\n", sketch->top[i].id,
+                (unsigned long)sketch->top[i].count);
+    }
+    memcpy(end, ".\n", 3);
+    *size = (size_t)(end - reply) + 2;
+
+    free(empty);
+    return reply;
+}
+
+/**
+ * Read a number from a fixed number of hexadecimal digits.
+ *
+ * Returns the position after the digits, NULL if one of them is invalid.
+ *
+ * @param text  The position to read from.
+ *
+ * @param digits  The number of digits.
+ *
+ * @param value Output parameter, the number read.
+ */
+static const char* read_hex(const char* text, int digits, uint32_t* value) {
+    const char* digit = NULL;
+    int i = 0;
+
+    *value = 0;
+    for (i = 0; i < digits; i++) {
+        digit = text[i] ? strchr(hexDigits, text[i]) : NULL;
+        if (!digit) {
+            return NULL;
+        }
+        *value = (*value << 4) | (uint32_t)(digit - hexDigits);
+    }
+    return text + digits;
+}
+
+/**
+ * Read a line of hexadecimal numbers following a prefix.
+ *
+ * Returns the position after the line's LF, NULL if the line is malformed.
+ *
+ * @param text  The start of the line.
+ *
+ * @param prefix  The expected prefix.
+ *
+ * @param values  Output parameter, the numbers read.
+ *
+ * @param count The number of numbers.
+ *
+ * @param digits  The number of digits per number.
+ */
+static const char* read_hex_line(const char* text, const char* prefix,
+        uint32_t* values, int count, int digits) {
+    size_t length = strlen(prefix);
+    int i = 0;
+
+    if (0 != strncmp(prefix, text, length)) {
+        return NULL;
+    }
+    text += length;
+
+    for (i = 0; text && i < count; i++) {
+        text = read_hex(text, digits, values + i);
+    }
+    return (text && '\n' == *text) ? text + 1 : NULL;
+}
+
+int control_sketch_decode(struct VisitorSketch* sketch, const char* text) {
+    uint32_t values[SKETCH_REGISTERS];
+    char planeId[CONTROL_MAX_ID_SIZE];
+    const char* end = NULL;
+    const char* separator = NULL;
+    char* countEnd = NULL;
+    unsigned long count = 0;
+    int row = 0;
+    int i = 0;
+
+    memset(sketch, 0, sizeof(struct VisitorSketch));
+
+    text = read_hex_line(text, "hll:", values, SKETCH_REGISTERS, 2);
+    if (!text) {
+        return E_CONTROL_INVALID_INFO;
+    }
+    for (i = 0; i < SKETCH_REGISTERS; i++) {
+        sketch->registers[i] = (uint8_t)MIN(values[i],
+                65 - SKETCH_PRECISION);
+    }
+
+    for (row = 0; text && row < SKETCH_DEPTH; row++) {
+        text = read_hex_line(text, "cms:", sketch->counters[row],
+                SKETCH_WIDTH, 8);
+    }
+    if (!text) {
+        return E_CONTROL_INVALID_INFO;
+    }
+
+    while (0 == strncmp("top:", text, 4)) {
+        text += 4;
+        end = strchr(text, '\n');
+        separator = end ? (const char*)memrchr(text, ':', end - text) : NULL;
+        if (!separator || CONTROL_MAX_ID_SIZE <= separator - text) {
+            return E_CONTROL_INVALID_INFO;
+        }
+        count = strtoul(separator + 1, &countEnd, 10);
+        if (countEnd != end || UINT32_MAX < count) {
+            return E_CONTROL_INVALID_INFO;
+        }
+        memcpy(planeId, text, (size_t)(separator - text));
+        planeId[separator - text] = '\0';
+        offer_hitter(sketch, sketch_hash(planeId), planeId, (uint32_t)count);
+        text = end + 1;
+    }
+
+    return (0 == strncmp(".\n", text, 2) || 0 == strcmp(".", text))
+            ? E_CONTROL_OK : E_CONTROL_INVALID_INFO;
+}
@@ -0,0 +1,183 @@
+/*
+ *visitorSketch.h
+ */
+
+#pragma once
+
+#ifndef VISITOR_SKETCH_H
+#define VISITOR_SKETCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+/**
+ * The number of index bits of the HyperLogLog, i.e. 2^12 registers with a
+ * standard error of about 1.6%.
+ */
+#define SKETCH_PRECISION 12
+
+/**
+ * The number of HyperLogLog registers.
+ */
+#define SKETCH_REGISTERS (1 << SKETCH_PRECISION)
+
+/**
+ * The number of count-min rows, each one independently hashed.
+ */
+#define SKETCH_DEPTH 4
+
+/**
+ * The number of counters per count-min row. A count is overestimated by at
+ * most e / SKETCH_WIDTH of all visits with a probability of 98%.
+ */
+#define SKETCH_WIDTH 1024
+
+/**
+ * The number of heavy hitters tracked.
+ */
+#define SKETCH_TOP 32
+
+/**
+ * A plane tracked as heavy hitter.
+ */
+struct HeavyHitter {
+    /**
+     * The hash of the plane's ID.
+     */
+    uint64_t hash;
+
+    /**
+     * The estimated number of the plane's visits.
+     */
+    uint32_t count;
+
+    /**
+     * The plane's ID without trailing LF.
+     */
+    char id[CONTROL_MAX_ID_SIZE];
+};
+
+/**
+ * Fixed-size summary of an airport's visitors.
+ *
+ * A HyperLogLog estimates the number of distinct planes and a count-min
+ * sketch the number of visits per plane. The planes with the most visits
+ * are kept in a min-heap. The memory used does not depend on the traffic and
+ * sketches of several airports can be merged. A sketch is not thread-safe.
+ */
+struct VisitorSketch {
+    /**
+     * The maximum rank seen per HyperLogLog register.
+     */
+    uint8_t registers[SKETCH_REGISTERS];
+
+    /**
+     * The count-min counters.
+     */
+    uint32_t counters[SKETCH_DEPTH][SKETCH_WIDTH];
+
+    /**
+     * The heavy hitters, the one with the fewest visits at the root.
+     */
+    struct HeavyHitter top[SKETCH_TOP];
+
+    /**
+     * The number of used entries in top.
+     */
+    int topSize;
+};
+
+/**
+ * Allocate an empty sketch.
+ *
+ * Returns the sketch, which has to be free()d, or NULL if no memory is left.
+ */
+struct VisitorSketch* control_sketch_create();
+
+/**
+ * Record a plane's visit.
+ *
+ * @param sketch  The sketch to be updated.
+ *
+ * @param planeId The visiting plane's ID, shorter than CONTROL_MAX_ID_SIZE.
+ */
+void control_sketch_add(struct VisitorSketch* sketch, const char* planeId);
+
+/**
+ * Estimate the number of distinct planes.
+ *
+ * @param sketch  The sketch to be queried.
+ */
+unsigned long control_sketch_distinct(const struct VisitorSketch* sketch);
+
+/**
+ * Estimate the number of a plane's visits.
+ *
+ * The estimate is never lower than the actual number.
+ *
+ * @param sketch  The sketch to be queried.
+ *
+ * @param planeId The plane's ID.
+ */
+unsigned long control_sketch_count(const struct VisitorSketch* sketch,
+        const char* planeId);
+
+/**
+ * Add another sketch's visits to a sketch.
+ *
+ * Afterwards the sketch summarizes the visitors of both.
+ *
+ * @param sketch  The sketch to be updated.
+ *
+ * @param other The sketch to be merged into it.
+ */
+void control_sketch_merge(struct VisitorSketch* sketch,
+        const struct VisitorSketch* other);
+
+/**
+ * Get the reply to a "heavy <N>" request.
+ *
+ * Returns a copy of at most N heavy hitters as "id:count" lines, the most
+ * frequent first and ties in lexicographic order, followed by the closing
+ * ".\n". The caller has to free() the returned buffer. NULL is returned if
+ * no memory is left.
+ *
+ * @param sketch  The sketch to be queried, NULL if no plane visited yet.
+ *
+ * @param top   The maximum number of planes to be replied.
+ *
+ * @param size  Output parameter, the length of the returned text.
+ */
+char* control_sketch_heavy(const struct VisitorSketch* sketch,
+        unsigned long top, size_t* size);
+
+/**
+ * Get the reply to a "sketch" request.
+ *
+ * Returns the sketch in its text form: a line "hll:" followed by the
+ * registers as hexadecimal bytes, SKETCH_DEPTH lines "cms:" followed by the
+ * counters as 8 hexadecimal digits each, a line "top:<id>:<count>" per heavy
+ * hitter and the closing ".\n". The caller has to free() the returned
+ * buffer. NULL is returned if no memory is left.
+ *
+ * @param sketch  The sketch to be encoded, NULL if no plane visited yet.
+ *
+ * @param size  Output parameter, the length of the returned text.
+ */
+char* control_sketch_encode(const struct VisitorSketch* sketch, size_t* size);
+
+/**
+ * Read a sketch from its text form.
+ *
+ * Returns E_CONTROL_OK on success, E_CONTROL_INVALID_INFO if the text is not
+ * a complete reply to a "sketch" request.
+ *
+ * @param sketch  Output parameter, the decoded sketch.
+ *
+ * @param text  The NUL-terminated text returned by control_sketch_encode().
+ */
+int control_sketch_decode(struct VisitorSketch* sketch, const char* text);
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ *workerPool.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "protocol.h"
+#include "workerPool.h"
+
+/**
+ * Push a socket at a deque's tail, only done by the acceptor.
+ *
+ * Returns 0 on success, -1 if the deque is full.
+ *
+ * @param deque The deque.
+ *
+ * @param socket  The socket to be pushed.
+ */
+static int deque_push(struct WorkerDeque* deque, int socket) {
+    uint64_t tail = __atomic_load_n(&deque->tail, __ATOMIC_RELAXED);
+
+    if (WORKER_POOL_DEQUE <= tail - __atomic_load_n(&deque->head,
+            __ATOMIC_SEQ_CST)) {
+        return -1;
+    }
+    __atomic_store_n(&deque->slots[tail % WORKER_POOL_DEQUE], socket,
+            __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->tail, tail + 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+/**
+ * Take the socket at a deque's head, done by its owner and by thieves.
+ *
+ * The slot is read before the head is moved past it. The acceptor only
+ * overwrites it after the head moved, so a socket read from an overwritten
+ * slot never wins the compare and swap.
+ *
+ * Returns the socket, -1 if the deque is empty.
+ *
+ * @param deque The deque.
+ */
+static int deque_take(struct WorkerDeque* deque) {
+    uint64_t head = __atomic_load_n(&deque->head, __ATOMIC_SEQ_CST);
+    int socket = -1;
+
+    while (head < __atomic_load_n(&deque->tail, __ATOMIC_SEQ_CST)) {
+        socket = __atomic_load_n(&deque->slots[head % WORKER_POOL_DEQUE],
+                __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&deque->head, &head, head + 1, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            return socket;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Take a socket for a worker, from its own deque first, else stolen from the
+ * other workers' ones in turn.
+ *
+ * Returns the socket, -1 if all deques are empty.
+ *
+ * @param pool  The pool.
+ *
+ * @param own The worker's position in the pool.
+ */
+static int take_socket(struct WorkerPool* pool, int own) {
+    int size = __atomic_load_n(&pool->size, __ATOMIC_RELAXED);
+    int socket = -1;
+    int i = 0;
+
+    for (i = 0; i < size && 0 > socket; i++) {
+        socket = deque_take(&pool->deques[(own + i) % size]);
+    }
+    return socket;
+}
+
+/**
+ * Let a sleeping worker look for sockets again.
+ *
+ * @param deque The worker's deque.
+ */
+static void wake_worker(struct WorkerDeque* deque) {
+    pthread_mutex_lock(&deque->guard);
+    deque->woken = 1;
+    pthread_cond_signal(&deque->wakeup);
+    pthread_mutex_unlock(&deque->guard);
+}
+
+/**
+ * Sleep until a worker is woken.
+ *
+ * @param deque The worker's deque.
+ */
+static void wait_until_woken(struct WorkerDeque* deque) {
+    pthread_mutex_lock(&deque->guard);
+    while (!deque->woken) {
+        pthread_cond_wait(&deque->wakeup, &deque->guard);
+    }
+    deque->woken = 0;
+    pthread_mutex_unlock(&deque->guard);
+}
+
+/**
+ * Claim a sleeping worker for a socket.
+ *
+ * Returns the worker's position, -1 if no worker sleeps.
+ *
+ * @param pool  The pool.
+ *
+ * @param first The position looked at first.
+ */
+static int claim_sleeper(struct WorkerPool* pool, int first) {
+    int size = __atomic_load_n(&pool->size, __ATOMIC_SEQ_CST);
+    struct WorkerDeque* deque = NULL;
+    int i = 0;
+
+    for (i = 0; i < size; i++) {
+        deque = &pool->deques[(first + i) % size];
+        if (__atomic_load_n(&deque->sleeping, __ATOMIC_SEQ_CST)
+                && __atomic_exchange_n(&deque->sleeping, 0,
+                __ATOMIC_SEQ_CST)) {
+            return (int)(deque - pool->deques);
+        }
+    }
+    return -1;
+}
+
+static void* run_worker(void* parameter);
+
+/**
+ * Start one more worker, unless the pool is stopping.
+ *
+ * Nothing is pushed to a worker's deque before its thread is created.
+ *
+ * Returns the new worker's position, -1 if the pool is at its capacity or
+ * no thread can be created.
+ *
+ * @param pool  The pool.
+ */
+static int add_worker(struct WorkerPool* pool) {
+    int size = 0;
+
+    pthread_mutex_lock(&pool->growth);
+    size = pool->size;
+    if (size >= pool->capacity || __atomic_load_n(&pool->stopping,
+            __ATOMIC_SEQ_CST) || 0 != pthread_create(
+            &pool->deques[size].thread, NULL, run_worker,
+            &pool->deques[size])) {
+        size = -1;
+    } else {
+        __atomic_store_n(&pool->size, size + 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&pool->growth);
+    return size;
+}
+
+/**
+ * Take a socket for a worker, sleeping while there is none.
+ *
+ * The worker is marked sleeping before it looks a last time, so a socket
+ * pushed meanwhile is either seen by it or the acceptor sees it sleeping and
+ * wakes it. If the acceptor claimed the worker after it found a socket in
+ * that last look, the wake is passed on to another sleeper or a worker
+ * started for it, which steals the socket pushed for this worker.
+ *
+ * Returns the socket, -1 if the pool stops and no socket is left.
+ *
+ * @param pool  The pool.
+ *
+ * @param own The worker's position in the pool.
+ */
+static int wait_for_socket(struct WorkerPool* pool, int own) {
+    struct WorkerDeque* deque = &pool->deques[own];
+    int socket = take_socket(pool, own);
+    int sleeper = -1;
+
+    while (0 > socket) {
+        __atomic_store_n(&deque->sleeping, 1, __ATOMIC_SEQ_CST);
+        socket = take_socket(pool, own);
+        if (0 <= socket) {
+            if (!__atomic_exchange_n(&deque->sleeping, 0, __ATOMIC_SEQ_CST)) {
+                /*The wake follows the push, so the socket is queued now*/
+                wait_until_woken(deque);
+                sleeper = claim_sleeper(pool, own + 1);
+                if (0 <= sleeper) {
+                    wake_worker(&pool->deques[sleeper]);
+                } else {
+                    add_worker(pool);
+                }
+            }
+            break;
+        }
+        if (__atomic_load_n(&pool->stopping, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+        wait_until_woken(deque);
+        __atomic_store_n(&deque->sleeping, 0, __ATOMIC_SEQ_CST);
+        socket = take_socket(pool, own);
+    }
+    return socket;
+}
+
+/**
+ * A worker's starting point.
+ *
+ * @param parameter The worker's deque.
+ */
+static void* run_worker(void* parameter) {
+    struct WorkerDeque* deque = (struct WorkerDeque*)parameter;
+    struct WorkerPool* pool = deque->pool;
+    int own = (int)(deque - pool->deques);
+    int socket = wait_for_socket(pool, own);
+
+    while (0 <= socket) {
+        pool->task(pool->context, socket);
+        socket = wait_for_socket(pool, own);
+    }
+    return NULL;
+}
+
+
+int worker_pool_start(struct WorkerPool* pool, int size, WorkerTask task,
+        void* context) {
+    int i = 0;
+
+    memset(pool, 0, sizeof(struct WorkerPool));
+    size = MIN(MAX(1, size), WORKER_POOL_MAX);
+    pool->deques = (struct WorkerDeque*)calloc(size,
+            sizeof(struct WorkerDeque));
+    if (!pool->deques) {
+        return EXIT_FAILURE;
+    }
+    pool->task = task;
+    pool->context = context;
+    pool->capacity = size;
+    pthread_mutex_init(&pool->growth, NULL);
+
+    for (i = 0; i < size; i++) {
+        pool->deques[i].pool = pool;
+        pthread_mutex_init(&pool->deques[i].guard, NULL);
+        pthread_cond_init(&pool->deques[i].wakeup, NULL);
+    }
+    for (i = 0; i < MIN(size, WORKER_POOL_INITIAL); i++) {
+        if (0 > add_worker(pool)) {
+            break;
+        }
+    }
+    if (0 == pool->size) {
+        pthread_mutex_destroy(&pool->growth);
+        free(pool->deques);
+        pool->deques = NULL;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int worker_pool_submit(struct WorkerPool* pool, int socket) {
+    int sleeper = claim_sleeper(pool, pool->next);
+    int started = 0 > sleeper ? add_worker(pool) : -1;
+    int target = 0 <= sleeper ? sleeper : 0 <= started ? started : pool->next;
+    int size = __atomic_load_n(&pool->size, __ATOMIC_SEQ_CST);
+    int i = 0;
+
+    for (i = 0; i < size; i++) {
+        if (0 == deque_push(&pool->deques[target], socket)) {
+            break;
+        }
+        target = (target + 1) % size;
+    }
+    pool->next = (target + 1) % size;
+
+    /*A worker, which fell asleep meanwhile, steals the queued socket. This
+      may be the one just started, which looked at its deque before the push*/
+    if (0 > sleeper) {
+        sleeper = claim_sleeper(pool, pool->next);
+    }
+    if (0 <= sleeper) {
+        wake_worker(&pool->deques[sleeper]);
+    }
+    return i < size ? 0 : -1;
+}
+
+void worker_pool_stop(struct WorkerPool* pool) {
+    int i = 0;
+
+    /*No worker is started once the lock is passed*/
+    __atomic_store_n(&pool->stopping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&pool->growth);
+    pthread_mutex_unlock(&pool->growth);
+    for (i = 0; i < pool->size; i++) {
+        wake_worker(&pool->deques[i]);
+    }
+
+    for (i = 0; i < pool->size; i++) {
+        pthread_join(pool->deques[i].thread, NULL);
+    }
+    for (i = 0; i < pool->capacity; i++) {
+        pthread_cond_destroy(&pool->deques[i].wakeup);
+        pthread_mutex_destroy(&pool->deques[i].guard);
+    }
+    pthread_mutex_destroy(&pool->growth);
+    free(pool->deques);
+    pool->deques = NULL;
+    pool->size = 0;
+    pool->capacity = 0;
+}
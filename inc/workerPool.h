@@ -0,0 +1,192 @@
+/*
+ *workerPool.h
+ */
+
+#pragma once
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * The number of sockets each worker's deque holds, a power of two.
+ */
+#define WORKER_POOL_DEQUE 256
+
+/**
+ * The maximum number of workers of a pool.
+ */
+#define WORKER_POOL_MAX 4096
+
+/**
+ * The number of workers started with a pool, more are started on demand.
+ */
+#define WORKER_POOL_INITIAL 4
+
+/**
+ * Callback serving an accepted connection on a worker.
+ *
+ * @param context The context given to worker_pool_start().
+ *
+ * @param socket  The connection to be served and closed.
+ */
+typedef void (*WorkerTask)(void* context, int socket);
+
+struct WorkerPool;
+
+/**
+ * A worker's deque of accepted sockets.
+ *
+ * Only the acceptor pushes at the tail, the owning worker and idle workers
+ * stealing from it take from the head by compare and swap, so the handoff
+ * needs no lock. The counters only grow; a slot is reused once the head has
+ * passed it.
+ */
+struct WorkerDeque {
+    /**
+     * The position the next socket is pushed to, written by the acceptor.
+     */
+    uint64_t tail;
+
+    /**
+     * Keeps the head off the tail's cache line.
+     */
+    char padding[56];
+
+    /**
+     * The position of the next socket to be taken.
+     */
+    uint64_t head;
+
+    /**
+     * The sockets, a ring buffer of WORKER_POOL_DEQUE entries.
+     */
+    int slots[WORKER_POOL_DEQUE];
+
+    /**
+     * The pool the deque belongs to.
+     */
+    struct WorkerPool* pool;
+
+    /**
+     * Set while the owning worker waits for a socket. The acceptor clears it
+     * when it claims the worker for a socket.
+     */
+    int sleeping;
+
+    /**
+     * Set when the owning worker has to look for sockets again.
+     */
+    int woken;
+
+    /**
+     * Mutex protecting woken.
+     */
+    pthread_mutex_t guard;
+
+    /**
+     * Signaled when woken is set.
+     */
+    pthread_cond_t wakeup;
+
+    /**
+     * The owning worker's thread.
+     */
+    pthread_t thread;
+};
+
+/**
+ * Threads started on demand, which serve the connections a server accepts.
+ *
+ * The acceptor hands each admitted socket to a sleeping worker's deque and
+ * wakes just that worker. If all workers are busy, one more is started up to
+ * the pool's capacity; beyond, the sockets are queued in their deques in
+ * turn. A worker serves its own deque first and steals from the others', so
+ * sockets queued behind a long connection are taken over by the first worker
+ * done. Workers are kept until the pool stops.
+ */
+struct WorkerPool {
+    /**
+     * One deque per worker.
+     */
+    struct WorkerDeque* deques;
+
+    /**
+     * The number of workers started.
+     */
+    int size;
+
+    /**
+     * The maximum number of workers, which deques are allocated for.
+     */
+    int capacity;
+
+    /**
+     * The deque the acceptor looks at first, only used by the acceptor.
+     */
+    int next;
+
+    /**
+     * Set once the workers have to exit.
+     */
+    int stopping;
+
+    /**
+     * Mutex serializing the start of workers.
+     */
+    pthread_mutex_t growth;
+
+    /**
+     * Serves the sockets.
+     */
+    WorkerTask task;
+
+    /**
+     * The context handed to task.
+     */
+    void* context;
+};
+
+/**
+ * Start the first workers of a pool.
+ *
+ * Returns EXIT_SUCCESS if at least one worker runs, EXIT_FAILURE else. If
+ * fewer threads can be created, the pool runs with those.
+ *
+ * @param pool  The pool to be started.
+ *
+ * @param size  The maximum number of workers, clamped to
+ *              1..WORKER_POOL_MAX. At most WORKER_POOL_INITIAL are started
+ *              right away.
+ *
+ * @param task  Serves the sockets handed over.
+ *
+ * @param context The context handed to task.
+ */
+int worker_pool_start(struct WorkerPool* pool, int size, WorkerTask task,
+        void* context);
+
+/**
+ * Hand an accepted socket over to the workers.
+ *
+ * Must only be called by a single acceptor thread. Returns 0 on success, -1
+ * if all deques are full and the caller has to reject the socket.
+ *
+ * @param pool  The running pool.
+ *
+ * @param socket  The socket to be served.
+ */
+int worker_pool_submit(struct WorkerPool* pool, int socket);
+
+/**
+ * Stop the workers once all sockets handed over are served and release the
+ * pool's memory.
+ *
+ * @param pool  The running pool.
+ */
+void worker_pool_stop(struct WorkerPool* pool);
+
+#endif
@@ -4,20 +4,30 @@
 #include <ctype.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/sendfile.h>
 #include <pthread.h>
-
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+
+#include "../inc/admission.h"
+#include "../inc/airportHost.h"
+#include "../inc/checkinDatagram.h"
+#include "../inc/controlStats.h"
 #include "../inc/errorReturn.h"
 #include "../inc/protocol.h"
+#include "../inc/registration.h"
+#include "../inc/sharedLog.h"
+#include "../inc/uringBackend.h"
+#include "../inc/visitJournal.h"
+#include "../inc/visitLog.h"
+#include "../inc/workerPool.h"
 
 /**
- * The airport ID.
- */
-char* id = NULL;
-
-/**
- * The airport info text.
+ * The airport named on the command line.
  */
-char* info = NULL;
+struct Airport primaryAirport;
 
 /**
  * The port used to connect to the mapper.
@@ -30,29 +40,34 @@ int mapperPort = 0;
 int keepListening = 1;
 
 /**
- * I/O stream to the connected plane.
+ * The recent throughput and latency of all airports served by the process.
  */
-FILE* streamToPlane;
+struct ControlStats stats;
 
 /**
- * The number of used entries in the planes log.
+ * Bounds the planes served at once by the command line's airport.
  */
-int loggedPlanes = 0;
+struct Admission admission;
 
 /**
- * The buffer holding all the logged planes.
+ * Serves further airports from a file, if CONTROL_AIRPORTS_ENV is given.
  */
-char** planesLog = NULL;
+struct AirportHost host;
 
 /**
- * Mutex protecting the read/write operations on the global state.
+ * Keeps the airports registered with the mapper.
  */
-static pthread_mutex_t planesLogGuard = PTHREAD_MUTEX_INITIALIZER;
+struct Registration registration;
 
 /**
- * Mutex protecting the client socket variable set upon accept.
+ * Serves the command line's airport, if CONTROL_IO_ENV selects io_uring.
  */
-static pthread_mutex_t clientSocketGuard = PTHREAD_MUTEX_INITIALIZER;
+struct UringBackend uring;
+
+/**
+ * The threads serving the admitted planes.
+ */
+struct WorkerPool workers;
 
 /**
  * Validate the command line arguments.
@@ -104,141 +119,692 @@ int check_args(int argc, char* argv[]) {
  *
  * @param fileToPlaneNo The socket, which sould be used for client
  *                      communication.
+ *
+ * @param streamToPlane Output parameter, which is set to the file stream on
+ *                      success.
  */
-int open_stream(int fileToPlaneNo) {
-    int success = open_socket_stream(fileToPlaneNo, &streamToPlane);
+int open_stream(int fileToPlaneNo, FILE** streamToPlane) {
+    int success = open_socket_stream(fileToPlaneNo, streamToPlane);
     return (EXIT_SUCCESS == success) ? E_CONTROL_OK :
             E_CONTROL_FAILED_TO_CONNECT;
 }
 
 /**
- * Receive the visiting plane's ID.
+ * Send the journal's sorted segment to the caller.
+ *
+ * The segment is copied by the kernel, it never passes through user space.
+ *
+ * Returns the number of bytes sent.
+ *
+ * @param streamToPlane The file stream, which shall be used to send the log
+ *                      to the caller.
+ *
+ * @param segment The opened sorted segment.
+ *
+ * @param size  The length of the segment.
+ */
+size_t send_segment(FILE* streamToPlane, int segment, size_t size) {
+    off_t offset = 0;
+    ssize_t sent = 0;
+
+    fflush(streamToPlane);
+
+    while ((size_t)offset < size) {
+        sent = sendfile(fileno(streamToPlane), segment, &offset,
+                size - (size_t)offset);
+        if (0 >= sent) {
+            break;
+        }
+    }
+
+    return (size_t)offset;
+}
+
+/**
+ * Send a reply text to the caller and free it.
+ *
+ * Returns the number of bytes sent, 0 if reply is NULL.
+ *
+ * @param streamToPlane The file stream, which shall be used to send the reply
+ *                      to the caller.
+ *
+ * @param reply The reply text, which may be NULL.
+ *
+ * @param size  The length of the reply text.
+ */
+size_t send_reply(FILE* streamToPlane, char* reply, size_t size) {
+    if (!reply) {
+        return 0;
+    }
+
+    size = fwrite(reply, 1, size, streamToPlane);
+    free(reply);
+    return size;
+}
+
+/**
+ * Reply all logged planes in lexicographic order.
+ *
+ * Large replies are served from the journal's sorted segment if a journal is
+ * used and the caller is connected to a socket. Returns the number of bytes
+ * sent.
+ *
+ * @param airport The airport, whose log is requested.
+ *
+ * @param streamToPlane The file stream, which shall be used to send the log
+ *                      to the caller.
+ */
+size_t reply_log(struct Airport* airport, FILE* streamToPlane) {
+    char* reply = NULL;
+    size_t replySize = 0;
+    int segment = -1;
+
+    if (0 <= fileno(streamToPlane)) {
+        segment = control_visit_log_sorted_segment(&airport->visitLog,
+                &replySize);
+    }
+    if (0 <= segment) {
+        replySize = send_segment(streamToPlane, segment, replySize);
+        close(segment);
+        return replySize;
+    }
+
+    reply = control_visit_log_sorted(&airport->visitLog, &replySize);
+    return send_reply(streamToPlane, reply, replySize);
+}
+
+/**
+ * Reply the given plane's number of visits and its latest visit.
+ *
+ * Returns the number of bytes sent.
+ *
+ * @param airport The airport, whose log is searched.
+ *
+ * @param streamToPlane The file stream, which shall be used to send the reply
+ *                      to the caller.
+ *
+ * @param planeId The plane, which is to be looked up.
+ */
+size_t reply_count(struct Airport* airport, FILE* streamToPlane,
+        const char* planeId) {
+    unsigned long lastSeq = 0;
+    unsigned long count = control_visit_log_count(&airport->visitLog, planeId,
+            &lastSeq);
+    int sent = fprintf(streamToPlane, "%lu:%lu\n", count, lastSeq);
+
+    return (size_t)MAX(0, sent);
+}
+
+/**
+ * Check if the given line is a request with a numeric argument.
+ *
+ * Returns 1 if the line consists of the given command, a blank and a
+ * non-negative number, 0 else.
+ *
+ * @param line  The received line without trailing LF.
+ *
+ * @param command The request's name including the trailing blank.
+ *
+ * @param argument  Output parameter, which is set to the given number.
+ */
+int is_numeric_request(const char* line, const char* command,
+        unsigned long* argument) {
+    size_t length = strlen(command);
+    char* end = NULL;
+
+    if (0 != strncmp(command, line, length) || !isdigit(line[length])) {
+        return 0;
+    }
+
+    *argument = strtoul(line + length, &end, 10);
+    return '\0' == *end;
+}
+
+/**
+ * Process a single request of a connected client.
+ *
+ * A plane's ID is logged and replied the airport's info text. Alternatively a
+ * request "log" can be handled. In this case all log entries are replied to
+ * the caller. A request "log <cursor>" replies only the entries logged after
+ * the cursor in arrival order, followed by the new cursor. "count <id>"
+ * replies the plane's number of visits and the sequence number of its latest
+ * visit, "top <N>" replies the N most frequent visitors and "stats" replies
+ * the recent throughput and latency. "distinct", "heavy <N>" and "sketch"
+ * reply estimates from the visitor sketch.
+ *
+ * Returns the number of bytes sent.
+ *
+ * @param airport The airport, which the client is connected to.
+ *
+ * @param request The received line without trailing LF.
+ *
+ * @param streamToPlane The file stream, which shall be used to send the reply
+ *                      to the caller.
+ *
+ * @param kind  Output parameter, set to STATS_CHECK_INS or STATS_QUERIES.
+ */
+size_t process_request(struct Airport* airport, const char* request,
+        FILE* streamToPlane, enum StatsCounter* kind) {
+    unsigned long argument = 0;
+    char* reply = NULL;
+    size_t replySize = 0;
+    int sent = 0;
+
+    *kind = STATS_QUERIES;
+
+    if (0 == strcmp("log", request)) {
+        return reply_log(airport, streamToPlane);
+    } else if (is_numeric_request(request, "log ", &argument)) {
+        reply = control_visit_log_since(&airport->visitLog, argument,
+                &replySize);
+    } else if (0 == strncmp("count ", request, 6)) {
+        return reply_count(airport, streamToPlane, request + 6);
+    } else if (is_numeric_request(request, "top ", &argument)) {
+        reply = control_visit_log_top(&airport->visitLog, argument,
+                &replySize);
+    } else if (0 == strcmp("stats", request)) {
+        reply = control_stats_reply(airport->stats, &replySize);
+    } else if (0 == strcmp("distinct", request)) {
+        sent = fprintf(streamToPlane, "%lu\n",
+                control_visit_log_distinct(&airport->visitLog));
+        return (size_t)MAX(0, sent);
+    } else if (is_numeric_request(request, "heavy ", &argument)) {
+        reply = control_visit_log_heavy(&airport->visitLog, argument,
+                &replySize);
+    } else if (0 == strcmp("sketch", request)) {
+        reply = control_visit_log_sketch(&airport->visitLog, &replySize);
+    } else {
+        *kind = STATS_CHECK_INS;
+        control_visit_log_append(&airport->visitLog, request);
+        sent = fprintf(streamToPlane, "%s\n", airport->info);
+        return (size_t)MAX(0, sent);
+    }
+
+    return send_reply(streamToPlane, reply, replySize);
+}
+
+/**
+ * Check if a request is served in the bulk lane.
  *
- * Receive incoming client transmissions in order to log visiting airplanes.
- * Alternatively a request "log" can be handled. In this case all log entries
- * are replied to the caller.
+ * Returns 1 for "log", "log <cursor>", "top <N>" and "sketch", whose replies
+ * grow with the visit log, 0 else.
+ *
+ * @param request The received line without trailing LF.
+ */
+int is_bulk_request(const char* request) {
+    return 0 == strcmp("log", request) || 0 == strncmp("log ", request, 4)
+            || 0 == strncmp("top ", request, 4)
+            || 0 == strcmp("sketch", request);
+}
+
+/**
+ * Receive the visiting planes' IDs.
+ *
+ * Serve all requests a client sends over this connection until it is closed,
+ * so gateways can pipeline many check-ins. The replies are sent in request
+ * order. They are flushed once no further complete request is buffered. The
+ * socket is closed before returning.
  *
  * @param fileToPlaneNo The socket, which sould be used for client
  *                      communication.
  */
 void log_plane(int fileToPlaneNo) {
+    char buffer[CONTROL_MAX_ID_SIZE];
+    FILE* streamToPlane = NULL;
+    struct LineReader reader;
+    struct timespec start;
+    enum StatsCounter kind = STATS_QUERIES;
+    size_t bytes = 0;
+    int length = 0;
+
+    if (E_CONTROL_OK != open_stream(fileToPlaneNo, &streamToPlane)) {
+        control_stats_add(&stats, STATS_ERRORS, 1);
+        control_close_conn(fileToPlaneNo);
+        return;
+    }
+    init_line_reader(&reader, fileToPlaneNo);
+
+    while (0 <= (length = read_line(&reader, buffer, sizeof(buffer)))) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        kind = STATS_QUERIES;
+
+        if (is_bulk_request(buffer) && !admission_begin_bulk(&admission)) {
+            control_stats_add(&stats, STATS_ERRORS, 1);
+            bytes = fwrite(SERVER_BUSY_REPLY, 1, strlen(SERVER_BUSY_REPLY),
+                    streamToPlane);
+        } else if (is_bulk_request(buffer)) {
+            bytes = process_request(&primaryAirport, buffer, streamToPlane,
+                    &kind);
+            admission_end_bulk(&admission);
+        } else {
+            bytes = process_request(&primaryAirport, buffer, streamToPlane,
+                    &kind);
+        }
+
+        if (!has_buffered_line(&reader) && 0 != fflush(streamToPlane)) {
+            control_stats_add(&stats, STATS_ERRORS, 1);
+            break;
+        }
+
+        control_stats_request(&stats, kind, (uint64_t)(length + 1 + bytes),
+                control_stats_micros_since(&start));
+    }
+
+    fclose(streamToPlane);
+}
+
+/**
+ * Serve an admitted plane on a worker.
+ *
+ * @param context Unused.
+ *
+ * @param planeSocket The plane's connection.
+ */
+void serve_planes(void* context, int planeSocket) {
+    /*Serve the waiting planes, before giving the slot back*/
+    while (0 <= planeSocket) {
+        log_plane(planeSocket);
+        planeSocket = admission_next(&admission);
+    }
+}
+
+/**
+ * Register the airports with the mapper in the background.
+ *
+ * All airports are registered in batches over one mapper connection. The
+ * program exits and returns E_CONTROL_FAILED_TO_CONNECT if the registration
+ * thread cannot be started.
+ *
+ * @param airports  The listening airports.
+ *
+ * @param count The number of airports.
+ */
+void register_airports(const struct Airport* airports, int count) {
+    const char** registeredIds = NULL;
+    int* registeredPorts = NULL;
+    int success = E_CONTROL_OK;
     int i = 0;
 
-    if (E_CONTROL_OK != open_stream(fileToPlaneNo)) {
-        return;
+    registeredIds = (const char**)malloc(count * sizeof(const char*));
+    registeredPorts = (int*)malloc(count * sizeof(int));
+    if (!registeredIds || !registeredPorts) {
+        error_return_control(E_CONTROL_FAILED_TO_CONNECT);
+    }
+
+    for (i = 0; i < count; i++) {
+        registeredIds[i] = airports[i].id;
+        registeredPorts[i] = airports[i].port;
     }
 
-    pthread_mutex_lock(&planesLogGuard);
+    registration.mapperPort = mapperPort;
+    registration.count = count;
+    registration.ids = registeredIds;
+    registration.ports = registeredPorts;
 
-    if (!fgets(planesLog[loggedPlanes], CONTROL_MAX_ID_SIZE, streamToPlane)) {
-        return;
+    success = control_start_registration(&registration);
+    if (E_CONTROL_OK != success) {
+        error_return_control(success);
     }
-    if (0 == strncmp("log", planesLog[loggedPlanes], 3)) {
-        control_sort_plane_log(planesLog, loggedPlanes);
+}
+
+/**
+ * Check if the given option is enabled in the environment.
+ *
+ * Returns 1 if the variable is set to a value other than "" or "0", 0 else.
+ *
+ * @param name  The environment variable's name.
+ */
+int is_enabled(const char* name) {
+    const char* value = getenv(name);
+
+    return value && '\0' != value[0] && 0 != strcmp("0", value);
+}
 
-        for (i = 0; i < loggedPlanes; i++) {
-            fprintf(streamToPlane, "%s", planesLog[i]);
+/**
+ * The UDP check-in thread's starting point.
+ *
+ * Serves the airport's check-in datagrams for the lifetime of the program.
+ */
+void* datagram_main(void* parameter) {
+    struct AirportDatagrams* datagrams = (struct AirportDatagrams*)parameter;
+    struct pollfd waiting;
+
+    waiting.fd = datagrams->socket;
+    waiting.events = POLLIN;
+
+    while (1) {
+        if (0 == control_serve_datagrams(datagrams)) {
+            poll(&waiting, 1, -1);
         }
-        fputs(".\n", streamToPlane);
-    } else {
-        loggedPlanes += 1;
-        fprintf(streamToPlane, "%s\n", info);
     }
 
-    pthread_mutex_unlock(&planesLogGuard);
-    fclose(streamToPlane);
+    return NULL;
 }
 
 /**
- * The new launched thread's starting point.
+ * Accept check-ins over UDP on the given port number, if enabled.
  *
- * This is the thread function, which runs individual client connections.
+ * The airport stays reachable over TCP only if the port number is taken or
+ * no thread can be started.
+ *
+ * @param port  The port number, which this control is listening on.
  */
-void* thread_main(void* parameter) {
-    int planeSocket = *(int*)parameter;
-    pthread_mutex_unlock(&clientSocketGuard);
+void open_datagrams(int port) {
+    pthread_t datagramThread;
+    pthread_attr_t datagramThreadOptions;
+    struct AirportDatagrams* datagrams = &primaryAirport.datagrams;
 
-    log_plane(planeSocket);
+    if (!is_enabled(CONTROL_UDP_ENV)) {
+        return;
+    }
 
-    control_close_conn(planeSocket);
+    datagrams->airport = &primaryAirport;
+    datagrams->socket = control_open_datagram_conn(port);
+    if (0 > datagrams->socket) {
+        return;
+    }
 
-    return NULL;
+    pthread_attr_init(&datagramThreadOptions);
+    pthread_attr_setdetachstate(&datagramThreadOptions,
+            PTHREAD_CREATE_DETACHED);
+
+    if (0 != pthread_create(&datagramThread, &datagramThreadOptions,
+            datagram_main, datagrams)) {
+        control_close_conn(datagrams->socket);
+        datagrams->socket = -1;
+    }
+
+    pthread_attr_destroy(&datagramThreadOptions);
+}
+
+/**
+ * Open the listening socket shared by all controls of the airport.
+ *
+ * The port published in the shared log is joined. If there is none or it
+ * cannot be bound, e.g. because all its controls are gone, an ephemeral port
+ * is bound and published instead. In case of error, this function does not
+ * return. Instead the program exits and a specific error code is issued.
+ *
+ * @param port  Output parameter, which holds the port number the new socket is
+ *              bound to.
+ */
+int open_shared_listener(int* port) {
+    struct SharedLog* shared = primaryAirport.visitLog.shared;
+    int published = control_shared_log_port(shared);
+    int acceptSocket = -1;
+
+    while (1) {
+        *port = published;
+        if (published && 0 <= (acceptSocket
+                = control_open_shared_conn(port))) {
+            return acceptSocket;
+        }
+
+        *port = 0;
+        acceptSocket = control_open_shared_conn(port);
+        if (0 > acceptSocket) {
+            error_return_control(E_CONTROL_FAILED_TO_CONNECT);
+        }
+
+        /*Another control may have published its port meanwhile*/
+        published = control_shared_log_publish_port(shared, published,
+                *port);
+        if (published == *port) {
+            return acceptSocket;
+        }
+        control_close_conn(acceptSocket);
+    }
+}
+
+/**
+ * Check if the environment selects the io_uring backend.
+ *
+ * Returns 1 if CONTROL_IO_ENV is CONTROL_IO_URING, 0 else.
+ */
+int is_uring_selected() {
+    const char* backend = getenv(CONTROL_IO_ENV);
+
+    return backend && 0 == strcmp(CONTROL_IO_URING, backend);
 }
 
 /**
  * Listen on an ephemeral port for planes.
  *
- * The program exits and returns a specific error code if no new thread could
- * be created for an incoming client connection, the incoming connection cannot
- * be accepted or this airport fails to register with the mapper.
+ * Planes are accepted right away, the registration with the mapper happens in
+ * the background. They are served by the io_uring backend if it is selected
+ * and the kernel supports it, by the pool of workers else. Planes beyond the
+ * admission limits are turned away as busy.
  *
  * @param port  Output parameter, the ephemeral port, which this control is
  *              listening on.
  */
 void listen_for_planes(int* port) {
-    int success = E_CONTROL_OK;
     int acceptSocket = 0;
     int planeSocket = 0;
-    pthread_t planeThread;
-    pthread_attr_t planeThreadOptions;
 
     *port = 0;
 
-    acceptSocket = control_open_incoming_conn(port);
+    if (primaryAirport.visitLog.shared) {
+        acceptSocket = open_shared_listener(port);
+    } else {
+        acceptSocket = control_open_incoming_conn(port);
+    }
+
+    listen(acceptSocket, CONTROL_MAX_CONNECTIONS);
+
+    primaryAirport.port = *port;
+    open_datagrams(*port);
 
     if (mapperPort) {
-        success = control_register_id(mapperPort, *port, id);
-        if (E_CONTROL_OK != success) {
-            error_return_control(success);
-        }
+        register_airports(&primaryAirport, 1);
     }
 
     fprintf(stdout, "%d\n", *port);
     fflush(stdout);
 
-    listen(acceptSocket, CONTROL_MAX_CONNECTIONS);
+    /*Without io_uring support, the planes are served by threads*/
+    if (is_uring_selected() && EXIT_SUCCESS == control_uring_open(&uring,
+            &primaryAirport, process_request, &admission, acceptSocket)) {
+        control_uring_run(&uring);
+    }
 
-    pthread_attr_init(&planeThreadOptions);
-    pthread_attr_setdetachstate(&planeThreadOptions,
-            PTHREAD_CREATE_DETACHED);
+    /*A worker per admitted plane, so none waits for another to finish*/
+    if (EXIT_SUCCESS != worker_pool_start(&workers,
+            admission_env_limit(CONTROL_POOL_ENV, admission.limit),
+            serve_planes, NULL)) {
+        error_return_control(E_CONTROL_FAILED_TO_CONNECT);
+    }
 
     while (keepListening) {
-        pthread_mutex_lock(&clientSocketGuard);
         planeSocket = accept(acceptSocket, NULL, NULL);
         if (0 > planeSocket) {
-            pthread_mutex_unlock(&clientSocketGuard);
-            error_return_control(E_CONTROL_FAILED_TO_CONNECT);
+            control_stats_add(&stats, STATS_ERRORS, 1);
+            continue;
         }
 
-        if (0 != pthread_create(&planeThread, &planeThreadOptions, thread_main,
-                &planeSocket)) {
-            pthread_mutex_unlock(&clientSocketGuard);
-            error_return_control(E_CONTROL_FAILED_TO_CONNECT);
+        admission_limit_idle(&admission, planeSocket);
+        switch (admission_offer(&admission, planeSocket)) {
+            case ADMISSION_SERVE:
+                break;
+            case ADMISSION_QUEUED:
+                continue;
+            default:
+                control_stats_add(&stats, STATS_ERRORS, 1);
+                admission_reject(&admission, planeSocket);
+                continue;
+        }
+
+        /*Without a worker, the planes are turned away instead of exiting*/
+        while (0 <= planeSocket
+                && 0 != worker_pool_submit(&workers, planeSocket)) {
+            control_stats_add(&stats, STATS_ERRORS, 1);
+            admission_reject(&admission, planeSocket);
+            planeSocket = admission_next(&admission);
         }
     }
 
     control_close_conn(acceptSocket);
-    pthread_attr_destroy(&planeThreadOptions);
+    worker_pool_stop(&workers);
+}
+
+/**
+ * Attach the visit journal named in the environment, if any.
+ *
+ * The program exits and returns E_CONTROL_INVALID_JOURNAL if the journal
+ * cannot be opened.
+ *
+ * @param journaled The airport, whose visits are journaled.
+ */
+void open_journal(struct Airport* journaled) {
+    struct VisitJournal* journal = NULL;
+    const char* path = getenv(CONTROL_JOURNAL_ENV);
+
+    if (!path || '\0' == path[0]) {
+        return;
+    }
+
+    journal = control_journal_open(path);
+    if (!journal) {
+        error_return_control(E_CONTROL_INVALID_JOURNAL);
+    }
+
+    control_visit_log_attach_journal(&journaled->visitLog, journal);
+}
+
+/**
+ * Attach the airport's shared log, if the environment asks for it.
+ *
+ * The program exits and returns E_CONTROL_INVALID_SHARED_LOG if the shared
+ * log cannot be opened.
+ *
+ * @param shared  The airport, whose visits are shared.
+ */
+void open_shared_log(struct Airport* shared) {
+    struct SharedLog* log = NULL;
+
+    if (!is_enabled(CONTROL_SHARED_ENV)) {
+        return;
+    }
+
+    log = control_shared_log_open(shared->id);
+    if (!log) {
+        error_return_control(E_CONTROL_INVALID_SHARED_LOG);
+    }
+
+    control_visit_log_attach_shared(&shared->visitLog, log);
+}
+
+/**
+ * Get the number of workers serving hosted airports from the environment.
+ *
+ * Returns HOST_DEFAULT_WORKERS if the environment does not give a positive
+ * number.
+ */
+int get_worker_count() {
+    const char* workers = getenv(CONTROL_WORKERS_ENV);
+    long count = workers ? strtol(workers, NULL, 10) : 0;
+
+    return (0 < count && count <= 1024) ? (int)count : HOST_DEFAULT_WORKERS;
+}
+
+/**
+ * Serve the command line's airport and the ones listed in a file.
+ *
+ * All airports share one event loop served by a pool of workers and are
+ * registered with the mapper in batches. The command line's airport's port
+ * is printed first as usual, followed by a "<id>:<port>" line for every
+ * airport from the file. The journal, if any, keeps the command line's
+ * airport's visits. The program exits and returns a specific error code if
+ * the airports cannot be loaded or opened.
+ *
+ * @param path  The path of the airports file.
+ */
+void host_airports(const char* path) {
+    int success = E_CONTROL_OK;
+    int i = 0;
+
+    control_host_init(&host, &stats, process_request);
+    host.useDatagrams = is_enabled(CONTROL_UDP_ENV);
+
+    success = control_host_add(&host, primaryAirport.id,
+            primaryAirport.info);
+    if (E_CONTROL_OK != success) {
+        error_return_control(success);
+    }
+    success = control_host_load(&host, path);
+    if (E_CONTROL_OK != success) {
+        error_return_control(success);
+    }
+    success = control_host_open(&host);
+    if (E_CONTROL_OK != success) {
+        error_return_control(success);
+    }
+
+    open_journal(host.airports);
+
+    if (mapperPort) {
+        register_airports(host.airports, host.count);
+    }
+
+    fprintf(stdout, "%d\n", host.airports[0].port);
+    for (i = 1; i < host.count; i++) {
+        fprintf(stdout, "%s:%d\n", host.airports[i].id,
+                host.airports[i].port);
+    }
+    fflush(stdout);
+
+    control_host_run(&host, get_worker_count());
 }
 
 int main(int argc, char* argv[]) {
+    const char* airports = NULL;
     int port = 0;
 
     check_args(argc, argv);
 
-    id = argv[1];
-    info = argv[2];
+    /*Peers hanging up must not kill the airport*/
+    signal(SIGPIPE, SIG_IGN);
+
+    primaryAirport.endpoint = HOST_LISTENER;
+    primaryAirport.id = argv[1];
+    primaryAirport.info = argv[2];
+    primaryAirport.stats = &stats;
+    primaryAirport.acceptSocket = -1;
+    primaryAirport.datagrams.endpoint = HOST_DATAGRAM;
+    primaryAirport.datagrams.socket = -1;
 
     if (4 == argc) {
         mapperPort = (int)strtol(argv[3], NULL, 10);
     }
+    set_client_fast_open(is_enabled(CONTROL_FASTOPEN_ENV));
+
+    if (EXIT_SUCCESS != admission_init(&admission,
+            admission_env_limit(CONTROL_MAX_CLIENTS_ENV,
+                    ADMISSION_DEFAULT_CLIENTS),
+            admission_env_limit(CONTROL_QUEUE_ENV,
+                    ADMISSION_DEFAULT_QUEUE))) {
+        error_return_control(E_CONTROL_FAILED_TO_CONNECT);
+    }
+    admission.idleMs = admission_env_limit(CONTROL_IDLE_ENV,
+            ADMISSION_DEFAULT_IDLE_MS);
 
-    planesLog = control_alloc_log(CONTROL_MAX_PLANE_COUNT, CONTROL_MAX_ID_SIZE);
-    loggedPlanes = 0;
+    airports = getenv(CONTROL_AIRPORTS_ENV);
+    if (airports && '\0' != airports[0]) {
+        host_airports(airports);
+    }
+
+    control_visit_log_init(&primaryAirport.visitLog,
+            CONTROL_MAX_PLANE_COUNT);
+
+    /*The shared log already holds the visits of all controls*/
+    open_shared_log(&primaryAirport);
+    if (!primaryAirport.visitLog.shared) {
+        open_journal(&primaryAirport);
+    }
 
     listen_for_planes(&port);
 
-    free(planesLog);
+    control_visit_log_destroy(&primaryAirport.visitLog);
     return EXIT_SUCCESS;
 }
 
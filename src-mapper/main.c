@@ -6,28 +6,50 @@
 #include <sys/types.h>
 #include <pthread.h>
 
+#include "../inc/admission.h"
 #include "../inc/errorReturn.h"
 #include "../inc/protocol.h"
+#include "../inc/workerPool.h"
 
 /**
  * The number of used entries in the airport map.
  */
 int mappedControls = 0;
 
+/**
+ * The number of allocated entries in the airport map.
+ */
+int mapCapacity = 0;
+
 /**
  * The buffer holding all the mapped airports.
  */
 char** controlMap = NULL;
 
+/**
+ * Hash index from airport ID to map entry, NULL marks unused slots.
+ */
+char** mapIndex = NULL;
+
+/**
+ * The number of slots in mapIndex, always a power of 2.
+ */
+int indexSlots = 0;
+
 /**
  * Mutex protecting the read/write operations on the global state.
  */
 static pthread_mutex_t controlMapGuard = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * Mutex protecting the client socket variable set upon accept.
+ * Bounds the clients served at once.
  */
-static pthread_mutex_t clientSocketGuard = PTHREAD_MUTEX_INITIALIZER;
+static struct Admission admission;
+
+/**
+ * The threads serving the admitted clients.
+ */
+static struct WorkerPool workers;
 
 /**
  * Open a stream representing bidirectional communication to a client.
@@ -50,15 +72,86 @@ int open_stream(int fileToClientNo, FILE** streamToClient) {
     return EXIT_SUCCESS;
 }
 
+/**
+ * Hash the first bytes of an airport ID using FNV-1a.
+ *
+ * @param id  The airport ID.
+ *
+ * @param length  The number of bytes to be hashed.
+ */
+unsigned long hash_id(const char* id, size_t length) {
+    unsigned long hash = 2166136261UL;
+    size_t i = 0;
+
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)id[i];
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+/**
+ * Find the hash index slot of the given airport ID.
+ *
+ * Returns the slot holding the ID's map entry or the unused slot, where it
+ * has to be inserted.
+ *
+ * @param id  The airport ID, which need not be terminated.
+ *
+ * @param length  The length of the airport ID.
+ */
+char** find_slot(const char* id, size_t length) {
+    unsigned long mask = (unsigned long)indexSlots - 1;
+    unsigned long slot = hash_id(id, length) & mask;
+
+    while (mapIndex[slot] && (strlen(mapIndex[slot]) != length
+            || 0 != strncmp(id, mapIndex[slot], length))) {
+        slot = (slot + 1) & mask;
+    }
+
+    return mapIndex + slot;
+}
+
+/**
+ * Rebuild the hash index of all map entries.
+ *
+ * Returns EXIT_SUCCESS on success, EXIT_FAILURE if no memory is left for a
+ * different number of slots. Keeping the number of slots always succeeds.
+ *
+ * @param slots The number of slots, a power of 2.
+ */
+int build_index(int slots) {
+    char** grownIndex = NULL;
+    int i = 0;
+
+    if (slots != indexSlots) {
+        grownIndex = (char**)calloc((size_t)slots, sizeof(char*));
+        if (!grownIndex) {
+            return EXIT_FAILURE;
+        }
+        free(mapIndex);
+        mapIndex = grownIndex;
+        indexSlots = slots;
+    } else {
+        memset(mapIndex, 0, (size_t)slots * sizeof(char*));
+    }
+
+    for (i = 0; i < mappedControls; i++) {
+        *find_slot(controlMap[i], strlen(controlMap[i])) = controlMap[i];
+    }
+
+    return EXIT_SUCCESS;
+}
+
 /**
  * Search for the given airport ID in the control map.
  *
- * Returns the index of the map entry if found, -1 else.
+ * Returns the map entry if found, NULL else.
  *
  * @param id  The airport ID, which is to be looke up.
  */
-int find_entry(const char* id) {
-    int i = 0;
+char* find_entry(const char* id) {
     size_t distance = 0;
 
     distance = strrchr(id, ':') - id;
@@ -71,15 +164,33 @@ int find_entry(const char* id) {
         distance = strlen(id);
     }
 
+    return *find_slot(id, distance);
+}
+
+/**
+ * Double the capacity of the control map.
+ *
+ * The entries are copied in their current order and indexed again. Returns
+ * EXIT_SUCCESS on success, EXIT_FAILURE if no memory is left.
+ */
+int grow_map() {
+    char** grownMap = NULL;
+    int i = 0;
+
+    grownMap = mapper_alloc_map(2 * mapCapacity, MAPPER_MAX_ID_SIZE
+            + sizeof(int));
+    if (!grownMap) {
+        return EXIT_FAILURE;
+    }
+
     for (i = 0; i < mappedControls; i++) {
-        if (0 == strncmp(id, controlMap[i], distance)) {
-            if (strlen(controlMap[i]) == distance) {
-                return i;
-            }
-        }
+        memcpy(grownMap[i], controlMap[i], MAPPER_MAX_ID_SIZE + sizeof(int));
     }
 
-    return -1;
+    free(controlMap);
+    controlMap = grownMap;
+    mapCapacity *= 2;
+    return build_index(indexSlots);
 }
 
 /**
@@ -95,16 +206,26 @@ void add_entry(char* id) {
     int port = 0;
     const char* seperator = strrchr(id, ':');
     size_t distance = seperator - id;
-    char* currentEntry = controlMap[mappedControls];
-    int* currentEntryValue = (int*)(currentEntry + MAPPER_MAX_ID_SIZE);
+    char* currentEntry = NULL;
+    int* currentEntryValue = NULL;
 
     if (!seperator) {
         return;
     }
 
-    if (0 <= find_entry(id)) {
+    if (find_entry(id)) {
+        return;
+    }
+
+    if (mappedControls == mapCapacity && EXIT_SUCCESS != grow_map()) {
+        return;
+    }
+    if (4 * (mappedControls + 1) > 3 * indexSlots
+            && EXIT_SUCCESS != build_index(2 * indexSlots)) {
         return;
     }
+    currentEntry = controlMap[mappedControls];
+    currentEntryValue = (int*)(currentEntry + MAPPER_MAX_ID_SIZE);
 
     mapper_trim_string_end(id);
 
@@ -125,9 +246,8 @@ void add_entry(char* id) {
     currentEntry[MAPPER_MAX_ID_SIZE - 1] = '\0';
     *currentEntryValue = port;
 
-    if (mappedControls < MAPPER_MAX_CONTROL_COUNT) {
-        mappedControls += 1;
-    }
+    *find_slot(currentEntry, strlen(currentEntry)) = currentEntry;
+    mappedControls += 1;
 }
 
 /**
@@ -142,12 +262,12 @@ void add_entry(char* id) {
  *                        number to the caller.
  */
 void reply_entry(const char* id, FILE* streamToClient) {
-    int found = -1;
+    char* found = NULL;
     int* currentEntryValue = NULL;
 
     found = find_entry(id);
-    if (0 <= found) {
-        currentEntryValue = (int*)(controlMap[found] + MAPPER_MAX_ID_SIZE);
+    if (found) {
+        currentEntryValue = (int*)(found + MAPPER_MAX_ID_SIZE);
     }
 
     if (currentEntryValue) {
@@ -179,11 +299,40 @@ void reply_all(FILE* streamToClient) {
     }
 }
 
+/**
+ * Send all the map entries to a client.
+ *
+ * The entries are rendered while the map is locked, but sent after it is
+ * released, so a slow client does not hold up the others.
+ *
+ * @param streamToClient  The file stream, which shall be used to send the map
+ *                        entries to the caller.
+ */
+void reply_snapshot(FILE* streamToClient) {
+    char* snapshot = NULL;
+    size_t size = 0;
+    FILE* rendered = open_memstream(&snapshot, &size);
+
+    if (!rendered) {
+        return;
+    }
+
+    pthread_mutex_lock(&controlMapGuard);
+    reply_all(rendered);
+    pthread_mutex_unlock(&controlMapGuard);
+
+    fclose(rendered);
+    fwrite(snapshot, 1, size, streamToClient);
+    free(snapshot);
+}
+
 /**
  * Process the client's request.
  *
  * Receive the clients' (airplanes and airports) requests to enter and query
- * map entries.
+ * map entries. Requests may be pipelined, the replies are flushed once no
+ * further complete request is buffered. The socket is closed before
+ * returning.
  *
  * @param fileToClientNo  The socket, which shall be used to exchange data with
  *                        the client.
@@ -191,33 +340,45 @@ void reply_all(FILE* streamToClient) {
 void process_requests(int fileToClientNo) {
     char buffer[128];
     FILE* streamToClient = NULL;
+    struct LineReader reader;
 
     if (EXIT_SUCCESS != open_stream(fileToClientNo, &streamToClient)) {
+        mapper_close_conn(fileToClientNo);
         return;
     }
+    init_line_reader(&reader, fileToClientNo);
 
     while (1) {
-        if (!fgets(buffer, sizeof(buffer), streamToClient)) {
+        if (0 > read_line(&reader, buffer, sizeof(buffer))) {
             break;
         }
 
-        pthread_mutex_lock(&controlMapGuard);
+        /*Snapshots take the bulk lane, so lookups are not held up*/
+        if ('@' == buffer[0] && !admission_begin_bulk(&admission)) {
+            fprintf(streamToClient, "%s", SERVER_BUSY_REPLY);
+        } else if ('@' == buffer[0]) {
+            reply_snapshot(streamToClient);
+            admission_end_bulk(&admission);
+        } else {
+            pthread_mutex_lock(&controlMapGuard);
+
+            switch (buffer[0]) {
+                case '!':
+                    add_entry(buffer + 1);
+                    break;
+                case '?':
+                    reply_entry(buffer + 1, streamToClient);
+                    break;
+                default:
+                    break;
+            }
 
-        switch (buffer[0]) {
-            case '!':
-                add_entry(buffer + 1);
-                break;
-            case '?':
-                reply_entry(buffer + 1, streamToClient);
-                break;
-            case '@':
-                reply_all(streamToClient);
-                break;
-            default:
-                break;
+            pthread_mutex_unlock(&controlMapGuard);
         }
 
-        pthread_mutex_unlock(&controlMapGuard);
+        if (!has_buffered_line(&reader) && 0 != fflush(streamToClient)) {
+            break;
+        }
     }
 
     /*printf("Close stream\n");*/
@@ -225,35 +386,32 @@ void process_requests(int fileToClientNo) {
 }
 
 /**
- * The new launched thread's starting point.
+ * Serve an admitted client on a worker.
+ *
+ * @param context Unused.
  *
- * This is the thread function, which runs individual client connections.
+ * @param clientSocket  The client's connection.
  */
-void* thread_main(void* parameter) {
-    int clientSocket = *(int*)parameter;
-    pthread_mutex_unlock(&clientSocketGuard);
-
-    process_requests(clientSocket);
-
-    /*printf("Close connection\n");*/
-    mapper_close_conn(clientSocket);
-
-    return NULL;
+void serve_clients(void* context, int clientSocket) {
+    /*Serve the waiting clients, before giving the slot back*/
+    while (0 <= clientSocket) {
+        process_requests(clientSocket);
+        clientSocket = admission_next(&admission);
+    }
 }
 
 /**
  * Listen on an ephemeral port for clients.
  *
- * Returns EXIT_FAILURE if no new thread could be created for an incoming
- * client connection, EXIT_SUCCESS on success.
+ * Admitted clients are handed over to the workers. Clients beyond the
+ * admission control's limits, or which no worker can take, are rejected with
+ * a busy reply. This function does not return.
  */
 int listen_for_clients() {
     int success = EXIT_SUCCESS;
     int port = 0;
     int acceptSocket = 0;
     int clientSocket = 0;
-    pthread_t clientThread;
-    pthread_attr_t clientThreadOptions;
 
     acceptSocket = mapper_open_incoming_conn(&port);
     fprintf(stdout, "%d\n", port);
@@ -261,28 +419,33 @@ int listen_for_clients() {
 
     listen(acceptSocket, CONTROL_MAX_CONNECTIONS);
 
-    pthread_attr_init(&clientThreadOptions);
-    pthread_attr_setdetachstate(&clientThreadOptions,
-            PTHREAD_CREATE_DETACHED);
-
     while (1) {
-        pthread_mutex_lock(&clientSocketGuard);
         clientSocket = accept(acceptSocket, NULL, NULL);
         if (0 > clientSocket) {
-            pthread_mutex_unlock(&clientSocketGuard);
             continue;
         }
 
-        if (0 != pthread_create(&clientThread, &clientThreadOptions,
-                thread_main, &clientSocket)) {
-            pthread_mutex_unlock(&clientSocketGuard);
-            success = EXIT_FAILURE;
-            break;
+        admission_limit_idle(&admission, clientSocket);
+        switch (admission_offer(&admission, clientSocket)) {
+            case ADMISSION_SERVE:
+                break;
+            case ADMISSION_QUEUED:
+                continue;
+            default:
+                admission_reject(&admission, clientSocket);
+                continue;
+        }
+
+        /*Without a worker, the clients are turned away instead of exiting*/
+        while (0 <= clientSocket
+                && 0 != worker_pool_submit(&workers, clientSocket)) {
+            admission_reject(&admission, clientSocket);
+            clientSocket = admission_next(&admission);
         }
     }
 
     mapper_close_conn(acceptSocket);
-    pthread_attr_destroy(&clientThreadOptions);
+    worker_pool_stop(&workers);
     return success;
 }
 
@@ -291,11 +454,33 @@ int main(int argc, char* argv[]) {
 
     controlMap = mapper_alloc_map(MAPPER_MAX_CONTROL_COUNT, MAPPER_MAX_ID_SIZE
             + sizeof(int));
+    mapCapacity = MAPPER_MAX_CONTROL_COUNT;
     mappedControls = 0;
+    if (!controlMap || EXIT_SUCCESS != build_index(2 * mapCapacity)) {
+        return EXIT_FAILURE;
+    }
+
+    if (EXIT_SUCCESS != admission_init(&admission,
+            admission_env_limit(MAPPER_MAX_CLIENTS_ENV,
+                    ADMISSION_DEFAULT_CLIENTS),
+            admission_env_limit(MAPPER_QUEUE_ENV,
+                    ADMISSION_DEFAULT_QUEUE))) {
+        return EXIT_FAILURE;
+    }
+    admission.idleMs = admission_env_limit(MAPPER_IDLE_ENV,
+            ADMISSION_DEFAULT_IDLE_MS);
+
+    /*A worker per admitted client, so none waits for another to finish*/
+    if (EXIT_SUCCESS != worker_pool_start(&workers,
+            admission_env_limit(MAPPER_POOL_ENV, admission.limit),
+            serve_clients, NULL)) {
+        return EXIT_FAILURE;
+    }
 
     success = listen_for_clients();
 
     free(controlMap);
+    free(mapIndex);
     return success;
 }
 
@@ -7,11 +7,11 @@
 
 #include "../inc/errorReturn.h"
 #include "../inc/protocol.h"
-
-/**
- * The airplane ID.
- */
-char* id = NULL;
+#include "../inc/rocAgent.h"
+#include "../inc/routeCache.h"
+#include "../inc/routeFleet.h"
+#include "../inc/routeFlight.h"
+#include "../inc/routeVisit.h"
 
 /**
  * The port used to connect to the mapper.
@@ -19,34 +19,14 @@ char* id = NULL;
 int mapperPort = 0;
 
 /**
- * Keep the connection open for planes.
- */
-int keepListening = 1;
-
-/**
- * I/O stream to the currently connected airport.
- */
-FILE* streamToControl;
-
-/**
- * The number of airports to visit.
+ * The resolution cache shared with other rocs, NULL if there is none.
  */
-int destinationCount = 0;
+struct RouteCache* cache = NULL;
 
 /**
- * The flight route.
+ * The stream the timing report is written to, NULL if there is none.
  */
-int* destinationControls = NULL;
-
-/**
- * The number of used entries in the destinations-log.
- */
-int loggedDestinations = 0;
-
-/**
- * The buffer holding all the logged destination infos.
- */
-char** destinationInfoLogs = NULL;
+FILE* timings = NULL;
 
 /**
  * Validate the command line arguments.
@@ -100,134 +80,176 @@ void check_args(int argc, char* argv[]) {
 }
 
 /**
- * Open a set of streams representing bidirectional communication to a client.
+ * Print a line of the flight's output right away.
+ *
+ * @param context Unused.
  *
- * Returns E_ROC_OK if the file stream could be opend,
- * E_ROC_FAILED_TO_CONNECT_CONTROL else.
+ * @param stream  FLIGHT_INFO for stdout, FLIGHT_ERROR for stderr and
+ *                FLIGHT_TIMING for the timing report.
  *
- * @param fileToControlNo The socket, which should be used for client
- *                        communication.
+ * @param text  The line without trailing LF.
  */
-int open_stream(int fileToControlNo) {
-    int success = open_socket_stream(fileToControlNo, &streamToControl);
-    return (EXIT_SUCCESS == success) ? E_ROC_OK :
-            E_ROC_FAILED_TO_CONNECT_CONTROL;
+void print_output(void* context, enum FlightStream stream,
+        const char* text) {
+    FILE* output = FLIGHT_INFO == stream ? stdout
+            : FLIGHT_TIMING == stream ? timings : stderr;
+
+    fprintf(output, "%s\n", text);
+    fflush(output);
 }
 
 /**
- * Print the collected airport infos to stdout.
+ * Open the timing report's stream named by ROC_TIMINGS_ENV, if set.
  *
- * Dump all log entries of visited airports to stdout.
+ * "-" names stderr, anything else a file, which the report is appended to.
+ * Returns the stream, NULL if there is no report.
  */
-void print_info_logs() {
-    int i = 0;
+FILE* open_timings() {
+    const char* path = getenv(ROC_TIMINGS_ENV);
 
-    for (i = 0; i < loggedDestinations; i++) {
-        fprintf(stdout, "%s\n", destinationInfoLogs[i]);
+    if (!path || '\0' == path[0]) {
+        return NULL;
     }
-    fflush(stdout);
+    if (0 == strcmp("-", path)) {
+        return stderr;
+    }
+    return fopen(path, "a");
 }
 
 /**
- * Send my airplane's id and get the airport's info back.
+ * Hand the route to the agent at ROC_AGENT_ENV, if set.
+ *
+ * Does not return if the agent flew the route. Else an agent is started for
+ * the next rocs, while this one flies the route itself.
  *
- * Exchange data with the visited airport via the socket connection.
+ * @param flight  The flight, whose settings and output are used.
  *
- * @param currentInfo The next free log entry.
+ * @param argc  The number of command line arguments.
+ *
+ * @param argv  The command line arguments.
  */
-int get_airport_info(char* currentInfo) {
-    fprintf(streamToControl, "%s\n", id);
-    fflush(streamToControl);
+void fly_with_agent(struct RouteFlight* flight, int argc, char* argv[]) {
+    const char* path = getenv(ROC_AGENT_ENV);
+    int success = 0;
 
-    if (!fgets(currentInfo, ROC_MAX_INFO_SIZE, streamToControl)) {
-        return E_ROC_FAILED_TO_CONNECT_CONTROL;
+    if (!path || '\0' == path[0]) {
+        return;
     }
-    roc_trim_string_end(currentInfo);
 
-    return E_ROC_OK;
+    success = roc_agent_fly(path, flight, argv + 3, argc - 3);
+    if (E_ROC_OK == success) {
+        exit(EXIT_SUCCESS);
+    }
+    if (0 < success) {
+        error_return_roc((enum RocErrorCodes)success);
+    }
+    roc_agent_spawn(path);
 }
 
 /**
- * Get the airport info from all the destinations.
+ * Fly the command line's plane along with all planes of a fleet file.
+ *
+ * The command line's plane's infos are printed as usual, followed by the
+ * fleet's report and, if ROC_VISITORS_ENV is set, the combined visitors of
+ * its controls. Up to ROC_PARALLEL_ENV planes fly at once,
+ * ROUTE_MAX_PARALLEL if it is not set. Does not return, the program exits
+ * with E_ROC_FAILED_TO_CONNECT_CONTROL if any visit failed.
+ *
+ * @param argc  The number of command line arguments.
+ *
+ * @param argv  The command line arguments.
  *
- * Visit all the destinations and exchange data with the respective controls
- * via socket connections. In case one of the destinations cannot be contacted,
- * continue with the next one. In this case E_ROC_FAILED_TO_CONNECT_CONTROL is
- * returned upon exiting the program.
+ * @param path  The path of the fleet file.
  */
-void visit_all_targets() {
-    int i = 0;
-    int destinationSocket = 0;
-    int success = 1;
-    char* currentInfo = NULL;
-
-    for (i = 0; i < destinationCount; i++) {
-        destinationSocket = roc_open_destination_conn(destinationControls[i]);
-        if (0 > destinationSocket) {
-            success = 0;
-            continue;
-        }
+void fly_fleet(int argc, char* argv[], const char* path) {
+    struct MapperList mappers;
+    struct VisitDeadlines deadlines;
+    struct Fleet fleet;
+    const char* visitors = getenv(ROC_VISITORS_ENV);
+    int parallel = getenv(ROC_PARALLEL_ENV) ? roc_parallel_limit()
+            : ROUTE_MAX_PARALLEL;
+    int success = E_ROC_OK;
+    int failed = 0;
+
+    roc_fleet_init(&fleet);
+    success = roc_fleet_add(&fleet, argv[1], argv + 3, argc - 3);
+    if (E_ROC_OK == success) {
+        success = roc_fleet_load(&fleet, path);
+    }
+    if (E_ROC_OK != success) {
+        error_return_roc((enum RocErrorCodes)success);
+    }
+    if (fleet.needsMapper && 0 == mapperPort) {
+        error_return_roc(E_ROC_MAPPER_REQUIRED);
+    }
 
-        if (E_ROC_OK != open_stream(destinationSocket)) {
-            success = 0;
-            roc_close_conn(destinationSocket);
-            continue;
-        }
+    /*All planes share one resolution of their airport IDs*/
+    cache = roc_cache_open_env();
+    roc_mappers_init(&mappers, mapperPort);
+    success = roc_fleet_resolve(&fleet, &mappers, cache);
+    if (E_ROC_OK != success) {
+        error_return_roc((enum RocErrorCodes)success);
+    }
 
-        currentInfo = destinationInfoLogs[loggedDestinations];
-        if (E_ROC_OK != get_airport_info(currentInfo)) {
-            success = 0;
-            fclose(streamToControl);
-            roc_close_conn(destinationSocket);
-            continue;
-        }
+    /*The command line's plane's infos are printed as they arrive*/
+    fleet.output = print_output;
+    roc_visit_deadlines(&deadlines);
+    failed = roc_fleet_fly(&fleet, parallel, &deadlines);
 
-        if (E_ROC_OK != roc_check_chars(currentInfo)) {
-            success = 0;
-            fclose(streamToControl);
-            roc_close_conn(destinationSocket);
-            continue;
-        }
-
-        loggedDestinations += 1;
-        fclose(streamToControl);
-        roc_close_conn(destinationSocket);
+    roc_fleet_report(&fleet, stdout);
+    if (visitors && '\0' != visitors[0] && 0 != strcmp("0", visitors)) {
+        roc_fleet_visitors(&fleet, stdout);
     }
 
-    print_info_logs();
-
-    if (!success) {
+    roc_fleet_free(&fleet);
+    if (cache) {
+        roc_cache_close(cache);
+    }
+    if (0 < failed) {
         error_return_roc(E_ROC_FAILED_TO_CONNECT_CONTROL);
     }
+    exit(EXIT_SUCCESS);
 }
 
 int main(int argc, char* argv[]) {
-    int i = 0;
+    struct RouteFlight flight;
+    const char* fleetPath = NULL;
+    const char* fastOpen = NULL;
+    int success = E_ROC_OK;
 
     check_args(argc, argv);
 
-    id = argv[1];
-
     if ('-' != argv[2][0]) {
         mapperPort = (int)strtol(argv[2], NULL, 10);
     }
 
-    destinationControls = (int*)malloc((argc - 3) * sizeof(int));
-    for (i = 3; i < argc; i++) {
-        destinationControls[destinationCount] = roc_resolve_control(mapperPort,
-                argv[i]);
-        if (destinationControls[destinationCount]) {
-            destinationCount += 1;
-        }
+    fastOpen = getenv(ROC_FASTOPEN_ENV);
+    set_client_fast_open(fastOpen && '\0' != fastOpen[0]
+            && 0 != strcmp("0", fastOpen));
+
+    fleetPath = getenv(ROC_FLEET_ENV);
+    if (fleetPath && '\0' != fleetPath[0]) {
+        fly_fleet(argc, argv, fleetPath);
     }
 
-    destinationInfoLogs = roc_alloc_log(ROC_MAX_DESTINATION_COUNT,
-            ROC_MAX_INFO_SIZE);
-    loggedDestinations = 0;
+    roc_flight_init(&flight, argv[1], mapperPort, print_output, NULL);
+    timings = open_timings();
+    flight.timed = NULL != timings;
+    fly_with_agent(&flight, argc, argv);
 
-    visit_all_targets();
+    cache = roc_cache_open_env();
+    flight.cache = cache;
+    success = roc_flight_resolve(&flight, argv + 3, argc - 3);
+    if (E_ROC_OK == success) {
+        success = roc_flight_visit(&flight);
+    }
 
-    free(destinationInfoLogs);
+    roc_flight_free(&flight);
+    if (cache) {
+        roc_cache_close(cache);
+    }
+    if (E_ROC_OK != success) {
+        error_return_roc((enum RocErrorCodes)success);
+    }
     return EXIT_SUCCESS;
 }
-
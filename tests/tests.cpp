@@ -3,9 +3,27 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
 //#include "errorReturn.c"
 #include "protocol.c"
+#include "connPool.c"
+#include "rocAgent.c"
+#include "routeCache.c"
+#include "routeFleet.c"
+#include "routeFlight.c"
+#include "routeResolve.c"
+#include "routeVisit.c"
+#include "admission.c"
+#include "airportHost.c"
+#include "checkinDatagram.c"
+#include "controlStats.c"
+#include "sharedLog.c"
+#include "uringBackend.c"
+#include "visitJournal.c"
+#include "visitLog.c"
+#include "visitorSketch.c"
+#include "workerPool.c"
 
 // Fake implementations
 void error_return_control(enum ControlErrorCodes code) {
@@ -154,3 +172,1373 @@ TEST_F(A4Suite, test_roc_resolve_control) {
     EXPECT_EQ(65535, roc_resolve_control(0, "65535"));
     EXPECT_EQ(0, roc_resolve_control(0, "SJO"));
 }
+
+TEST_F(A4Suite, test_visit_log_sorted) {
+    struct VisitLog visits;
+    size_t size = 0;
+    char* reply = NULL;
+    control_visit_log_init(&visits, 5);
+    EXPECT_EQ(E_CONTROL_OK, control_visit_log_append(&visits, "AF999"));
+    EXPECT_EQ(E_CONTROL_OK, control_visit_log_append(&visits, "AF000"));
+    reply = control_visit_log_sorted(&visits, &size);
+    EXPECT_STREQ("AF000\nAF999\n.\n", reply);
+    EXPECT_EQ(strlen(reply), size);
+    free(reply);
+    EXPECT_STREQ("AF999", control_visit_log_plane(&visits, 0));
+    EXPECT_EQ(E_CONTROL_OK, control_visit_log_append(&visits, "AF111"));
+    EXPECT_EQ(E_CONTROL_OK, control_visit_log_append(&visits, "AF999"));
+    reply = control_visit_log_sorted(&visits, &size);
+    EXPECT_STREQ("AF000\nAF111\nAF999\nAF999\n.\n", reply);
+    free(reply);
+    EXPECT_EQ(3, visits.countedPlanes);
+    EXPECT_GT(16U, sizeof(struct VisitRecord));
+    control_visit_log_destroy(&visits);
+}
+
+TEST_F(A4Suite, test_visit_journal_replay) {
+    struct VisitLog visits;
+    char path[] = "/tmp/visitJournalXXXXXX";
+    int fd = mkstemp(path);
+    size_t size = 0;
+    char* reply = NULL;
+    EXPECT_LE(0, fd);
+    close(fd);
+
+    control_visit_log_init(&visits, 1);
+    control_visit_log_attach_journal(&visits, control_journal_open(path));
+    EXPECT_EQ(E_CONTROL_OK, control_visit_log_append(&visits, "QF2"));
+    EXPECT_EQ(E_CONTROL_OK, control_visit_log_append(&visits, "QF1"));
+    EXPECT_EQ(E_CONTROL_OK, control_visit_log_append(&visits, "QF3"));
+    EXPECT_EQ(12U, visits.journal->header->used);
+    control_visit_log_destroy(&visits);
+
+    control_visit_log_init(&visits, 1);
+    control_visit_log_attach_journal(&visits, control_journal_open(path));
+    EXPECT_EQ(3, visits.loggedPlanes);
+    reply = control_visit_log_sorted(&visits, &size);
+    EXPECT_STREQ("QF1\nQF2\nQF3\n.\n", reply);
+    free(reply);
+    control_visit_log_destroy(&visits);
+    unlink(path);
+}
+
+TEST_F(A4Suite, test_visit_journal_full) {
+    struct VisitLog visits;
+    struct rlimit limit;
+    struct rlimit previous;
+    unsigned long lastSeq = 0;
+    char path[] = "/tmp/visitJournalXXXXXX";
+    char planeId[16];
+    int fd = mkstemp(path);
+    int i = 0;
+    EXPECT_LE(0, fd);
+    close(fd);
+
+    /*The journal cannot grow beyond its initial size*/
+    getrlimit(RLIMIT_FSIZE, &previous);
+    limit = previous;
+    limit.rlim_cur = JOURNAL_INITIAL_SIZE;
+    signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+
+    control_visit_log_init(&visits, 1);
+    control_visit_log_attach_journal(&visits, control_journal_open(path));
+    ASSERT_TRUE(NULL != visits.journal);
+    for (i = 0; i < 10000; i++) {
+        sprintf(planeId, "QF%05d", i);
+        EXPECT_EQ(E_CONTROL_OK, control_visit_log_append(&visits, planeId));
+    }
+    setrlimit(RLIMIT_FSIZE, &previous);
+    signal(SIGXFSZ, SIG_DFL);
+
+    /*The visits are kept in memory, once the journal is detached*/
+    EXPECT_TRUE(NULL == visits.journal);
+    EXPECT_EQ(1UL, control_visit_log_count(&visits, "QF09999", &lastSeq));
+    EXPECT_EQ(10000, visits.loggedPlanes);
+    control_visit_log_destroy(&visits);
+    unlink(path);
+}
+
+TEST_F(A4Suite, test_visit_log_since) {
+    struct VisitLog visits;
+    size_t size = 0;
+    char* reply = NULL;
+    control_visit_log_init(&visits, 2);
+    control_visit_log_append(&visits, "VH2");
+    control_visit_log_append(&visits, "VH1");
+    reply = control_visit_log_since(&visits, 0, &size);
+    EXPECT_STREQ("VH2\nVH1\n.2\n", reply);
+    free(reply);
+    control_visit_log_append(&visits, "VH0");
+    reply = control_visit_log_since(&visits, 2, &size);
+    EXPECT_STREQ("VH0\n.3\n", reply);
+    EXPECT_EQ(strlen(reply), size);
+    free(reply);
+    reply = control_visit_log_since(&visits, 3, &size);
+    EXPECT_STREQ(".3\n", reply);
+    free(reply);
+    control_visit_log_destroy(&visits);
+}
+
+TEST_F(A4Suite, test_read_line) {
+    int sockets[2];
+    char line[8];
+    struct LineReader reader;
+    const char text[] = "AF1\nAF2\nVERYLONGID\nAF3";
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+    EXPECT_EQ((ssize_t)strlen(text), write(sockets[1], text, strlen(text)));
+    close(sockets[1]);
+
+    init_line_reader(&reader, sockets[0]);
+    EXPECT_EQ(0, has_buffered_line(&reader));
+    EXPECT_EQ(3, read_line(&reader, line, sizeof(line)));
+    EXPECT_STREQ("AF1", line);
+    EXPECT_EQ(1, has_buffered_line(&reader));
+    EXPECT_EQ(3, read_line(&reader, line, sizeof(line)));
+    EXPECT_STREQ("AF2", line);
+    EXPECT_EQ(7, read_line(&reader, line, sizeof(line)));
+    EXPECT_STREQ("VERYLON", line);
+    EXPECT_EQ(3, read_line(&reader, line, sizeof(line)));
+    EXPECT_STREQ("AF3", line);
+    EXPECT_EQ(-1, read_line(&reader, line, sizeof(line)));
+    close(sockets[0]);
+}
+
+TEST_F(A4Suite, test_read_line_timeout) {
+    int sockets[2];
+    char line[16];
+    struct LineReader reader;
+    struct timeval timeout;
+    const char text[] = "!AF1:1\n!SLOW:12";
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 50000;
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+    ASSERT_EQ(0, setsockopt(sockets[0], SOL_SOCKET, SO_RCVTIMEO, &timeout,
+            sizeof(timeout)));
+    EXPECT_EQ((ssize_t)strlen(text), write(sockets[1], text, strlen(text)));
+
+    /*The line cut off by the timeout is not handed out*/
+    init_line_reader(&reader, sockets[0]);
+    EXPECT_EQ(6, read_line(&reader, line, sizeof(line)));
+    EXPECT_STREQ("!AF1:1", line);
+    EXPECT_EQ(-1, read_line(&reader, line, sizeof(line)));
+    EXPECT_EQ(0, has_buffered_line(&reader));
+    EXPECT_EQ(4, write(sockets[1], "345\n", 4));
+    EXPECT_EQ(3, read_line(&reader, line, sizeof(line)));
+    EXPECT_STREQ("345", line);
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+TEST_F(A4Suite, test_visit_log_counts) {
+    struct VisitLog visits;
+    unsigned long lastSeq = 0;
+    size_t size = 0;
+    char* reply = NULL;
+    char planeId[16];
+    int i = 0;
+    control_visit_log_init(&visits, 4);
+    for (i = 0; i < 2000; i++) {
+        sprintf(planeId, "QF%d", i % 500);
+        control_visit_log_append(&visits, planeId);
+    }
+    EXPECT_GT(VISIT_LOG_MERGE_BATCH, visits.pendingCount);
+    control_visit_log_append(&visits, "QF7");
+    control_visit_log_append(&visits, "QF3");
+    control_visit_log_append(&visits, "QF7");
+    EXPECT_EQ(6UL, control_visit_log_count(&visits, "QF7", &lastSeq));
+    EXPECT_EQ(2003UL, lastSeq);
+    EXPECT_EQ(4UL, control_visit_log_count(&visits, "QF499", &lastSeq));
+    EXPECT_EQ(2000UL, lastSeq);
+    EXPECT_EQ(0UL, control_visit_log_count(&visits, "QF500", &lastSeq));
+    EXPECT_EQ(0UL, lastSeq);
+    EXPECT_EQ(500, visits.countedPlanes);
+    reply = control_visit_log_top(&visits, 3, &size);
+    EXPECT_STREQ("QF7:6\nQF3:5\nQF0:4\n.\n", reply);
+    EXPECT_EQ(strlen(reply), size);
+    free(reply);
+    reply = control_visit_log_top(&visits, 0, &size);
+    EXPECT_STREQ(".\n", reply);
+    free(reply);
+    control_visit_log_destroy(&visits);
+}
+
+TEST_F(A4Suite, test_visitor_sketch) {
+    struct VisitLog visits;
+    struct VisitorSketch* merged = control_sketch_create();
+    struct VisitorSketch* decoded = control_sketch_create();
+    unsigned long distinct = 0;
+    size_t size = 0;
+    char* reply = NULL;
+    char planeId[16];
+    int i = 0;
+    control_visit_log_init(&visits, 4);
+    EXPECT_EQ(0UL, control_visit_log_distinct(&visits));
+    for (i = 0; i < 20000; i++) {
+        sprintf(planeId, "QF%d", i % 10000);
+        control_visit_log_append(&visits, planeId);
+        control_sketch_add(merged, i % 100 ? "VA1" : "JQ1");
+    }
+    distinct = control_visit_log_distinct(&visits);
+    EXPECT_LT(9700UL, distinct);
+    EXPECT_GT(10300UL, distinct);
+    for (i = 0; i < 50; i++) {
+        control_visit_log_append(&visits, "QF7");
+    }
+    reply = control_visit_log_heavy(&visits, 1, &size);
+    EXPECT_EQ(0, strncmp("QF7:", reply, 4));
+    EXPECT_EQ(strlen(reply), size);
+    free(reply);
+    reply = control_visit_log_sketch(&visits, &size);
+    EXPECT_EQ(strlen(reply), size);
+    EXPECT_EQ(E_CONTROL_OK, control_sketch_decode(decoded, reply));
+    EXPECT_EQ(0, memcmp(decoded->registers, visits.sketch->registers,
+            SKETCH_REGISTERS));
+    EXPECT_EQ(E_CONTROL_INVALID_INFO, control_sketch_decode(decoded,
+            reply + 1));
+    free(reply);
+    EXPECT_EQ(E_CONTROL_INVALID_INFO, control_sketch_decode(decoded, ""));
+    control_sketch_merge(merged, visits.sketch);
+    EXPECT_LE(19800UL, control_sketch_count(merged, "VA1"));
+    EXPECT_LE(52UL, control_sketch_count(merged, "QF7"));
+    reply = control_sketch_heavy(merged, 3, &size);
+    EXPECT_EQ(0, strncmp("VA1:", reply, 4));
+    EXPECT_NE(nullptr, strstr(reply, "\nJQ1:"));
+    EXPECT_NE(nullptr, strstr(reply, "\nQF7:"));
+    free(reply);
+    distinct = control_sketch_distinct(merged);
+    EXPECT_LT(9700UL, distinct);
+    EXPECT_GT(10300UL, distinct);
+    control_visit_log_destroy(&visits);
+    free(merged);
+    free(decoded);
+}
+
+TEST_F(A4Suite, test_shared_log) {
+    struct VisitLog visits[2];
+    struct SharedVisit* stalled = NULL;
+    struct stat status;
+    char airportId[32];
+    char name[64];
+    unsigned long lastSeq = 0;
+    size_t size = 0;
+    char* reply = NULL;
+    int fd = 0;
+    int i = 0;
+    sprintf(airportId, "test/%d", (int)getpid());
+    sprintf(name, "/control2310-test_%d", (int)getpid());
+    fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    EXPECT_EQ(4, write(fd, "junk", 4));
+    close(fd);
+    for (i = 0; i < 2; i++) {
+        control_visit_log_init(visits + i, 4);
+        control_visit_log_attach_shared(visits + i,
+                control_shared_log_open(airportId));
+        ASSERT_NE(nullptr, visits[i].shared);
+    }
+    EXPECT_EQ(0, control_shared_log_port(visits[0].shared));
+    EXPECT_EQ(4000, control_shared_log_publish_port(visits[0].shared, 0,
+            4000));
+    EXPECT_EQ(4000, control_shared_log_publish_port(visits[1].shared, 0,
+            4001));
+    EXPECT_EQ(4001, control_shared_log_publish_port(visits[1].shared, 4000,
+            4001));
+    control_visit_log_append(visits, "QF2");
+    control_visit_log_append(visits + 1, "QF1");
+    control_visit_log_append(visits, "QF2");
+    for (i = 0; i < 2; i++) {
+        reply = control_visit_log_sorted(visits + i, &size);
+        EXPECT_STREQ("QF1\nQF2\nQF2\n.\n", reply);
+        free(reply);
+    }
+    control_visit_log_append(visits + 1, "QF1");
+    EXPECT_EQ(2UL, control_visit_log_count(visits, "QF1", &lastSeq));
+    EXPECT_EQ(4UL, lastSeq);
+    reply = control_visit_log_since(visits + 1, 2, &size);
+    EXPECT_STREQ("QF2\nQF1\n.4\n", reply);
+    free(reply);
+    stalled = visits[0].shared->visits + __atomic_fetch_add(
+            &visits[0].shared->header->reserved, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < 5000; i++) {
+        control_visit_log_append(visits + 1, "QF9");
+    }
+    EXPECT_EQ(0UL, control_visit_log_count(visits, "QF9", &lastSeq));
+    visits[0].shared->stalledSince.tv_sec -= 2;
+    EXPECT_EQ(5000UL, control_visit_log_count(visits, "QF9", &lastSeq));
+    memcpy(stalled->id, "QF8", 4);
+    __atomic_store_n(&stalled->length, 4, __ATOMIC_RELEASE);
+    EXPECT_EQ(1UL, control_visit_log_count(visits, "QF8", &lastSeq));
+    EXPECT_EQ(0, visits[0].shared->skippedCount);
+    for (i = 0; i <= SHARED_LOG_SKIPPED_MAX; i++) {
+        __atomic_fetch_add(&visits[0].shared->header->reserved, 1,
+                __ATOMIC_RELAXED);
+        control_visit_log_append(visits + 1, "QF7");
+        control_visit_log_count(visits, "QF7", &lastSeq);
+        visits[0].shared->stalledSince.tv_sec -= 2;
+    }
+    EXPECT_EQ((unsigned long)SHARED_LOG_SKIPPED_MAX + 1,
+            control_visit_log_count(visits, "QF7", &lastSeq));
+    EXPECT_EQ(SHARED_LOG_SKIPPED_MAX, visits[0].shared->skippedCount);
+    EXPECT_EQ(visits[0].shared->readCursor - 2 * SHARED_LOG_SKIPPED_MAX,
+            visits[0].shared->skipped[0].slot);
+    visits[0].shared->skipped[0].since.tv_sec -= SHARED_LOG_ABANDON_MS / 1000;
+    control_visit_log_count(visits, "QF7", &lastSeq);
+    EXPECT_EQ(SHARED_LOG_SKIPPED_MAX - 1, visits[0].shared->skippedCount);
+    EXPECT_EQ(0, fstat(visits[0].shared->fd, &status));
+    EXPECT_GT(1 << 20, status.st_size);
+    control_visit_log_destroy(visits);
+    control_visit_log_destroy(visits + 1);
+    EXPECT_GT(0, shm_open(name, O_RDWR, 0600));
+}
+
+TEST_F(A4Suite, test_admission) {
+    struct Admission admission;
+    int sockets[2];
+    char reply[16];
+    EXPECT_EQ(EXIT_SUCCESS, admission_init(&admission, 2, 2));
+    EXPECT_EQ(1, admission.bulkLimit);
+    EXPECT_EQ(ADMISSION_SERVE, admission_offer(&admission, 10));
+    EXPECT_EQ(ADMISSION_SERVE, admission_offer(&admission, 11));
+    EXPECT_EQ(ADMISSION_QUEUED, admission_offer(&admission, 12));
+    EXPECT_EQ(ADMISSION_QUEUED, admission_offer(&admission, 13));
+    EXPECT_EQ(ADMISSION_REJECTED, admission_offer(&admission, 14));
+    EXPECT_EQ(12, admission_next(&admission));
+    EXPECT_EQ(ADMISSION_QUEUED, admission_offer(&admission, 15));
+    EXPECT_EQ(13, admission_next(&admission));
+    EXPECT_EQ(15, admission_next(&admission));
+    EXPECT_EQ(-1, admission_next(&admission));
+    EXPECT_EQ(1, admission.active);
+    EXPECT_EQ(ADMISSION_SERVE, admission_offer(&admission, 16));
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+    admission_reject(&admission, sockets[0]);
+    EXPECT_EQ(5, read(sockets[1], reply, sizeof(reply)));
+    EXPECT_EQ(0, strncmp(SERVER_BUSY_REPLY, reply, 5));
+    EXPECT_EQ(1UL, (unsigned long)admission.rejected);
+    close(sockets[1]);
+    EXPECT_EQ(ADMISSION_DEFAULT_IDLE_MS, admission.idleMs);
+    admission.idleMs = 50;
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+    EXPECT_EQ(EXIT_SUCCESS, admission_limit_idle(&admission, sockets[0]));
+    EXPECT_EQ(-1, read(sockets[0], reply, sizeof(reply)));
+    EXPECT_TRUE(EAGAIN == errno || EWOULDBLOCK == errno);
+    close(sockets[0]);
+    close(sockets[1]);
+    EXPECT_EQ(1, admission_begin_bulk(&admission));
+    EXPECT_EQ(0, admission_begin_bulk(&admission));
+    admission_end_bulk(&admission);
+    EXPECT_EQ(1, admission_begin_bulk(&admission));
+    admission_end_bulk(&admission);
+    EXPECT_EQ(0, admission.bulkActive);
+    EXPECT_EQ(1000, admission_env_limit("TEST2310_UNSET", 1000));
+    free(admission.queue);
+}
+
+TEST_F(A4Suite, test_control_stats) {
+    static struct ControlStats stats;
+    char expected[64];
+    size_t size = 0;
+    char* reply = NULL;
+    int i = 0;
+    for (i = 0; i < 98; i++) {
+        control_stats_request(&stats, STATS_CHECK_INS, 10, 3);
+    }
+    control_stats_request(&stats, STATS_QUERIES, 100, 1000);
+    control_stats_request(&stats, STATS_QUERIES, 100, 100000);
+    control_stats_add(&stats, STATS_ERRORS, 2);
+    reply = control_stats_reply(&stats, &size);
+    sprintf(expected, "%llu:98:2:1180:2\n",
+            (unsigned long long)stats.seconds[time(NULL) % STATS_SECONDS]
+            .second);
+    EXPECT_EQ(0, strncmp(expected, reply, strlen(expected)));
+    EXPECT_STREQ("p50:4\np90:4\np99:1024\np999:131072\n.\n",
+            reply + strlen(expected));
+    EXPECT_EQ(strlen(reply), size);
+    free(reply);
+}
+
+TEST_F(A4Suite, test_host_load) {
+    static struct ControlStats stats;
+    struct AirportHost host;
+    char path[] = "/tmp/airportsXXXXXX";
+    int fd = mkstemp(path);
+    FILE* airports = fdopen(fd, "w");
+    fputs("SYD:Sydney\n\nMEL:Melbourne\n", airports);
+    fclose(airports);
+
+    control_host_init(&host, &stats, NULL);
+    EXPECT_EQ(E_CONTROL_OK, control_host_add(&host, "BNE", "Brisbane"));
+    EXPECT_EQ(E_CONTROL_INVALID_INFO, control_host_add(&host, "A:B", "x"));
+    EXPECT_EQ(E_CONTROL_OK, control_host_load(&host, path));
+    EXPECT_EQ(3, host.count);
+    EXPECT_STREQ("SYD", host.airports[1].id);
+    EXPECT_STREQ("Melbourne", host.airports[2].info);
+    EXPECT_EQ(&stats, host.airports[2].stats);
+
+    airports = fopen(path, "w");
+    fputs("PER\n", airports);
+    fclose(airports);
+    EXPECT_EQ(E_CONTROL_INVALID_AIRPORTS, control_host_load(&host, path));
+    EXPECT_EQ(E_CONTROL_INVALID_AIRPORTS, control_host_load(&host,
+            "/nonexistent/airports"));
+    unlink(path);
+}
+
+static size_t reply_bulky(struct Airport* airport, const char* request,
+        FILE* streamToPlane, enum StatsCounter* kind) {
+    static char bulk[HOST_OUTPUT_HIGH_WATER];
+
+    *kind = STATS_QUERIES;
+    if (0 == strcmp("log", request)) {
+        memset(bulk, 'x', sizeof(bulk) - 1);
+        bulk[sizeof(bulk) - 1] = '\n';
+        return fwrite(bulk, 1, sizeof(bulk), streamToPlane);
+    }
+    return (size_t)fprintf(streamToPlane, "%s\n", airport->info);
+}
+
+TEST_F(A4Suite, test_host_high_water) {
+    static struct ControlStats stats;
+    struct AirportHost host;
+    struct Airport airport;
+    struct HostConnection* connection = NULL;
+    struct epoll_event event;
+    static char reply[2 * HOST_OUTPUT_HIGH_WATER];
+    ssize_t received = 0;
+    size_t total = 0;
+    int sockets[2];
+
+    control_host_init(&host, &stats, reply_bulky);
+    host.eventLoop = epoll_create1(EPOLL_CLOEXEC);
+    memset(&airport, 0, sizeof(airport));
+    airport.info = (char*)"Sydney";
+    airport.stats = &stats;
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0,
+            sockets));
+    connection = (struct HostConnection*)calloc(1,
+            sizeof(struct HostConnection));
+    connection->endpoint = HOST_CONNECTION;
+    connection->airport = &airport;
+    init_line_reader(&connection->reader, sockets[0]);
+    ASSERT_EQ(0, arm_endpoint(&host, sockets[0], connection, EPOLLIN,
+            EPOLL_CTL_ADD));
+
+    /*The request behind the bulky reply is served without further input*/
+    ASSERT_EQ(13, write(sockets[1], "log\ncount P1\n", 13));
+    while (total < HOST_OUTPUT_HIGH_WATER + 7UL && 1 == epoll_wait(
+            host.eventLoop, &event, 1, 1000)) {
+        serve_connection(&host, (struct HostConnection*)event.data.ptr);
+        while (0 < (received = read(sockets[1], reply + total,
+                sizeof(reply) - total))) {
+            total += (size_t)received;
+        }
+    }
+    ASSERT_EQ(HOST_OUTPUT_HIGH_WATER + 7UL, total);
+    EXPECT_EQ(0, strncmp("Sydney\n", reply + HOST_OUTPUT_HIGH_WATER, 7));
+
+    close(sockets[1]);
+    ASSERT_EQ(1, epoll_wait(host.eventLoop, &event, 1, 1000));
+    serve_connection(&host, (struct HostConnection*)event.data.ptr);
+    close(host.eventLoop);
+}
+
+TEST_F(A4Suite, test_checkin_datagrams) {
+    static struct ControlStats stats;
+    struct Airport airport;
+    struct sockaddr_in address;
+    socklen_t addressSize = sizeof(address);
+    unsigned long lastSeq = 0;
+    char reply[64];
+    int planeSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    const char* checkIns[] = {"2a:QF1", "2a:QF1", "2b:QF1", "QF2", "2c:"};
+    int i = 0;
+
+    memset(&airport, 0, sizeof(airport));
+    airport.info = (char*)"Sydney";
+    airport.stats = &stats;
+    control_visit_log_init(&airport.visitLog, 4);
+    airport.datagrams.airport = &airport;
+    airport.datagrams.socket = control_open_datagram_conn(0);
+    ASSERT_LE(0, airport.datagrams.socket);
+    getsockname(airport.datagrams.socket, (struct sockaddr*)&address,
+            &addressSize);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (i = 0; i < 5; i++) {
+        sendto(planeSocket, checkIns[i], strlen(checkIns[i]), 0,
+                (struct sockaddr*)&address, addressSize);
+    }
+    EXPECT_EQ(3, control_serve_datagrams(&airport.datagrams));
+    EXPECT_EQ(2UL, control_visit_log_count(&airport.visitLog, "QF1",
+            &lastSeq));
+
+    memset(reply, 0, sizeof(reply));
+    recv(planeSocket, reply, sizeof(reply) - 1, 0);
+    EXPECT_STREQ("2a:Sydney", reply);
+
+    close(planeSocket);
+    close(airport.datagrams.socket);
+    free(airport.datagrams.keys);
+    control_visit_log_destroy(&airport.visitLog);
+}
+
+static size_t echo_request(struct Airport* airport, const char* request,
+        FILE* streamToPlane, enum StatsCounter* kind) {
+    *kind = STATS_CHECK_INS;
+    return (size_t)fprintf(streamToPlane, "%s:%s\n", airport->info, request);
+}
+
+static void* run_uring(void* parameter) {
+    control_uring_run((struct UringBackend*)parameter);
+    return NULL;
+}
+
+TEST_F(A4Suite, test_uring_backend) {
+    static struct ControlStats stats;
+    static struct Admission admission;
+    static struct Airport airport;
+    static struct UringBackend backend;
+    struct sockaddr_in address;
+    pthread_t loop;
+    char reply[64];
+    int port = 0;
+    int acceptSocket = control_open_incoming_conn(&port);
+    int planeSocket = socket(AF_INET, SOCK_STREAM, 0);
+    size_t received = 0;
+    ssize_t length = 0;
+
+    listen(acceptSocket, CONTROL_MAX_CONNECTIONS);
+    airport.info = (char*)"Sydney";
+    airport.stats = &stats;
+    admission_init(&admission, 4, 0);
+    if (EXIT_SUCCESS != control_uring_open(&backend, &airport, echo_request,
+            &admission, acceptSocket)) {
+        /*The kernel lacks io_uring, control falls back to threads*/
+        close(acceptSocket);
+        close(planeSocket);
+        return;
+    }
+    pthread_create(&loop, NULL, run_uring, &backend);
+    pthread_detach(loop);
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(planeSocket, (struct sockaddr*)&address,
+            sizeof(address)));
+
+    /*Pipelined requests, the last one lacking its LF*/
+    send(planeSocket, "QF1\nQF2\nQF3", 11, 0);
+    shutdown(planeSocket, SHUT_WR);
+
+    memset(reply, 0, sizeof(reply));
+    while (0 < (length = recv(planeSocket, reply + received,
+            sizeof(reply) - 1 - received, 0))) {
+        received += (size_t)length;
+    }
+    EXPECT_STREQ("Sydney:QF1\nSydney:QF2\nSydney:QF3\n", reply);
+    EXPECT_EQ(0, length);
+
+    close(planeSocket);
+}
+
+TEST_F(A4Suite, test_uring_idle) {
+    static struct ControlStats stats;
+    static struct Admission admission;
+    static struct Airport airport;
+    static struct UringBackend backend;
+    struct sockaddr_in address;
+    struct timeval timeout = {2, 0};
+    pthread_t loop;
+    char reply[64];
+    int port = 0;
+    int acceptSocket = control_open_incoming_conn(&port);
+    int planeSocket = socket(AF_INET, SOCK_STREAM, 0);
+    size_t received = 0;
+    ssize_t length = 0;
+
+    listen(acceptSocket, CONTROL_MAX_CONNECTIONS);
+    airport.info = (char*)"Sydney";
+    airport.stats = &stats;
+    admission_init(&admission, 1, 0);
+    admission.idleMs = 100;
+    if (EXIT_SUCCESS != control_uring_open(&backend, &airport, echo_request,
+            &admission, acceptSocket)) {
+        close(acceptSocket);
+        close(planeSocket);
+        return;
+    }
+    pthread_create(&loop, NULL, run_uring, &backend);
+    pthread_detach(loop);
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(planeSocket, (struct sockaddr*)&address,
+            sizeof(address)));
+    setsockopt(planeSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+            sizeof(timeout));
+
+    /*The idle plane is hung up on, its request cut off is dropped*/
+    send(planeSocket, "QF1\nQF2", 7, 0);
+    memset(reply, 0, sizeof(reply));
+    while (0 < (length = recv(planeSocket, reply + received,
+            sizeof(reply) - 1 - received, 0))) {
+        received += (size_t)length;
+    }
+    EXPECT_STREQ("Sydney:QF1\n", reply);
+    EXPECT_EQ(0, length);
+
+    close(planeSocket);
+}
+
+static void* answer_in_reverse(void* parameter) {
+    int* listeners = (int*)parameter;
+    char request[64];
+    char reply[64];
+    int planeSocket = 0;
+    int i = 0;
+
+    /*The last destination replies first*/
+    for (i = 2; 0 <= i; i--) {
+        planeSocket = accept(listeners[i], NULL, NULL);
+        recv(planeSocket, request, sizeof(request), 0);
+        snprintf(reply, sizeof(reply), 0 == i ? "busy\n" : "Airport%d\n", i);
+        send(planeSocket, reply, strlen(reply), 0);
+        close(planeSocket);
+    }
+    return NULL;
+}
+
+struct CollectedVisits {
+    int order[5];
+    int visited[5];
+    struct VisitTimings timings[5];
+    char** infos;
+    int count;
+};
+
+static void collect_visit(void* context, int destination, const char* info,
+        int visited, const struct VisitTimings* timings) {
+    struct CollectedVisits* collected = (struct CollectedVisits*)context;
+
+    collected->order[collected->count++] = destination;
+    collected->visited[destination] = visited;
+    if (info) {
+        strcpy(collected->infos[destination], info);
+    }
+    if (timings) {
+        collected->timings[destination] = *timings;
+    }
+}
+
+TEST_F(A4Suite, test_route_visit) {
+    int listeners[3];
+    int ports[5];
+    int skip[5] = {0, 0, 0, 0, 1};
+    struct CollectedVisits collected;
+    pthread_t responder;
+    int i = 0;
+
+    memset(&collected, 0, sizeof(collected));
+    collected.infos = roc_alloc_log(5, ROC_MAX_INFO_SIZE);
+    for (i = 0; i < 3; i++) {
+        ports[i] = 0;
+        listeners[i] = control_open_incoming_conn(&ports[i]);
+        listen(listeners[i], CONTROL_MAX_CONNECTIONS);
+    }
+    /*A closed port refuses the connection*/
+    ports[3] = 0;
+    close(control_open_incoming_conn(&ports[3]));
+    ports[4] = ports[1];
+
+    pthread_create(&responder, NULL, answer_in_reverse, listeners);
+    EXPECT_EQ(2, roc_visit_destinations("QF1", ports, 5, 4, skip, NULL,
+            NULL, collect_visit, &collected));
+    pthread_join(responder, NULL);
+
+    /*Handed over in route order, though the last one replied first*/
+    ASSERT_EQ(5, collected.count);
+    for (i = 0; i < 5; i++) {
+        EXPECT_EQ(i, collected.order[i]);
+    }
+    EXPECT_EQ(0, collected.visited[0]);
+    EXPECT_EQ(1, collected.visited[1]);
+    EXPECT_EQ(1, collected.visited[2]);
+    EXPECT_EQ(-1, collected.visited[3]);
+    EXPECT_EQ(0, collected.visited[4]);
+    EXPECT_STREQ("Airport1", collected.infos[1]);
+    EXPECT_STREQ("Airport2", collected.infos[2]);
+
+    /*Each step of a reply is timed after the previous one*/
+    EXPECT_LT(0, collected.timings[2].started);
+    EXPECT_LE(collected.timings[2].started, collected.timings[2].connected);
+    EXPECT_LE(collected.timings[2].connected, collected.timings[2].sent);
+    EXPECT_LE(collected.timings[2].sent, collected.timings[2].firstByte);
+    EXPECT_LE(collected.timings[2].firstByte, collected.timings[2].closed);
+    EXPECT_EQ(0, collected.timings[3].firstByte);
+    EXPECT_EQ(0, collected.timings[4].started);
+
+    for (i = 0; i < 3; i++) {
+        close(listeners[i]);
+    }
+    free(collected.infos);
+}
+
+TEST_F(A4Suite, test_visit_deadlines) {
+    char info[ROC_MAX_INFO_SIZE];
+    struct VisitDeadlines deadlines;
+    struct timespec start;
+    int hung = 0;
+    int port = 0;
+
+    /*The connection is accepted by the kernel, but never replied*/
+    hung = control_open_incoming_conn(&port);
+    listen(hung, CONTROL_MAX_CONNECTIONS);
+
+    deadlines.hopMillis = 100;
+    deadlines.routeEnd = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    EXPECT_EQ(VISIT_TIMED_OUT, roc_visit_destination("QF1", port, &deadlines,
+            NULL, NULL, info));
+    /*Deadlines are kept in whole milliseconds*/
+    EXPECT_LE(99000u, control_stats_micros_since(&start));
+    EXPECT_GT(2000000u, control_stats_micros_since(&start));
+
+    /*Past the route's deadline, nothing is visited anymore*/
+    setenv(ROC_HOP_TIMEOUT_ENV, "0", 1);
+    setenv(ROC_ROUTE_TIMEOUT_ENV, "1", 1);
+    roc_visit_deadlines(&deadlines);
+    unsetenv(ROC_HOP_TIMEOUT_ENV);
+    unsetenv(ROC_ROUTE_TIMEOUT_ENV);
+    EXPECT_EQ(0, deadlines.hopMillis);
+    usleep(2000);
+    EXPECT_EQ(VISIT_TIMED_OUT, roc_visit_destination("QF1", port, &deadlines,
+            NULL, NULL, info));
+
+    close(hung);
+}
+
+static void* answer_lookups(void* parameter) {
+    int* mapper = (int*)parameter;
+    struct LineReader reader;
+    char request[64];
+    int clientSocket = accept(mapper[0], NULL, NULL);
+
+    /*Count the lookups of a single connection*/
+    init_line_reader(&reader, clientSocket);
+    while (0 <= read_line(&reader, request, sizeof(request))) {
+        mapper[1] += 1;
+        if (0 == strcmp("?SYD", request)) {
+            send(clientSocket, "2000\n", 5, 0);
+        } else {
+            send(clientSocket, ";\n", 2, 0);
+        }
+    }
+    close(clientSocket);
+    return NULL;
+}
+
+TEST_F(A4Suite, test_route_resolve) {
+    char syd[] = "SYD";
+    char mel[] = "MEL";
+    char port[] = "3000";
+    char invalid[] = "70000";
+    char* route[] = {syd, port, syd, invalid};
+    char* unknown[] = {port, mel, syd};
+    int ports[4];
+    int mapper[2] = {0, 0};
+    int mapperPort = 0;
+    pthread_t responder;
+
+    /*Numeric destinations need no mapper*/
+    EXPECT_EQ(E_ROC_OK, roc_resolve_route(0, route + 1, 1, ports, NULL,
+            NULL, NULL));
+    EXPECT_EQ(3000, ports[0]);
+
+    mapper[0] = control_open_incoming_conn(&mapperPort);
+    listen(mapper[0], CONTROL_MAX_CONNECTIONS);
+    pthread_create(&responder, NULL, answer_lookups, mapper);
+    EXPECT_EQ(E_ROC_OK, roc_resolve_route(mapperPort, route, 4, ports,
+            NULL, NULL, NULL));
+    pthread_join(responder, NULL);
+    EXPECT_EQ(1, mapper[1]);
+    EXPECT_EQ(2000, ports[0]);
+    EXPECT_EQ(3000, ports[1]);
+    EXPECT_EQ(2000, ports[2]);
+    EXPECT_EQ(0, ports[3]);
+
+    mapper[1] = 0;
+    pthread_create(&responder, NULL, answer_lookups, mapper);
+    EXPECT_EQ(E_ROC_FAILED_TO_FIND_ENTRY, roc_resolve_route(mapperPort,
+            unknown, 3, ports, NULL, NULL, NULL));
+    pthread_join(responder, NULL);
+    EXPECT_EQ(2, mapper[1]);
+    close(mapper[0]);
+
+    EXPECT_EQ(E_ROC_FAILED_TO_CONNECT_MAPPER, roc_resolve_route(mapperPort,
+            unknown, 3, ports, NULL, NULL, NULL));
+}
+
+static void* ignore_lookups(void* parameter) {
+    int* mapper = (int*)parameter;
+    char request[64];
+    int clientSocket = accept(mapper[0], NULL, NULL);
+
+    /*Never reply, until the roc gives up on the connection*/
+    while (0 < recv(clientSocket, request, sizeof(request), 0)) {
+        mapper[1] += 1;
+    }
+    close(clientSocket);
+    return NULL;
+}
+
+TEST_F(A4Suite, test_hedged_lookups) {
+    char syd[] = "SYD";
+    char* route[] = {syd};
+    char backups[16];
+    struct MapperList mappers;
+    struct timespec start;
+    int slow[2] = {0, 0};
+    int fast[2] = {0, 0};
+    int slowPort = 0;
+    int fastPort = 0;
+    int ports[1];
+    pthread_t ignorer;
+    pthread_t responder;
+
+    slow[0] = control_open_incoming_conn(&slowPort);
+    listen(slow[0], CONTROL_MAX_CONNECTIONS);
+    fast[0] = control_open_incoming_conn(&fastPort);
+    listen(fast[0], CONTROL_MAX_CONNECTIONS);
+
+    snprintf(backups, sizeof(backups), "%d,x", fastPort);
+    setenv(ROC_MAPPERS_ENV, backups, 1);
+    setenv(ROC_HEDGE_ENV, "20", 1);
+    roc_mappers_init(&mappers, slowPort);
+    unsetenv(ROC_MAPPERS_ENV);
+    unsetenv(ROC_HEDGE_ENV);
+    ASSERT_EQ(2, mappers.count);
+    EXPECT_EQ(fastPort, mappers.ports[1]);
+    EXPECT_EQ(20, mappers.hedgeMillis);
+
+    /*The second mapper is asked once the first took too long*/
+    pthread_create(&ignorer, NULL, ignore_lookups, slow);
+    pthread_create(&responder, NULL, answer_lookups, fast);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    EXPECT_EQ(E_ROC_OK, roc_resolve_hedged(&mappers, route, 1, ports, NULL,
+            NULL, NULL));
+    EXPECT_LE(20000u, control_stats_micros_since(&start));
+    EXPECT_GT(2000000u, control_stats_micros_since(&start));
+    EXPECT_EQ(2000, ports[0]);
+
+    /*The first mapper's connection is shut down once the second replied*/
+    pthread_join(ignorer, NULL);
+    pthread_join(responder, NULL);
+    EXPECT_EQ(1, slow[1]);
+    EXPECT_EQ(1, fast[1]);
+
+    /*A failing mapper is not waited for*/
+    close(slow[0]);
+    mappers.hedgeMillis = 10000;
+    pthread_create(&responder, NULL, answer_lookups, fast);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    EXPECT_EQ(E_ROC_OK, roc_resolve_hedged(&mappers, route, 1, ports, NULL,
+            NULL, NULL));
+    EXPECT_GT(2000000u, control_stats_micros_since(&start));
+    pthread_join(responder, NULL);
+    EXPECT_EQ(2000, ports[0]);
+
+    close(fast[0]);
+}
+
+TEST_F(A4Suite, test_route_cache) {
+    char path[] = "/tmp/roc2310-cache-XXXXXX";
+    char syd[] = "SYD";
+    char mel[] = "MEL";
+    char* route[] = {syd, mel, syd};
+    int ports[3];
+    int cached[3];
+    int mapper[2] = {0, 0};
+    int mapperPort = 0;
+    struct RouteCache* cache = NULL;
+    pthread_t responder;
+
+    close(mkstemp(path));
+    cache = roc_cache_open(path, 60);
+    ASSERT_TRUE(NULL != cache);
+    roc_cache_store(cache, 1, "MEL", 4000);
+    roc_cache_store(cache, 1, "BNE", 5000);
+    EXPECT_EQ(4000, roc_cache_lookup(cache, 1, "MEL"));
+    EXPECT_EQ(0, roc_cache_lookup(cache, 2, "MEL"));
+    roc_cache_invalidate(cache, 1, "BNE");
+    EXPECT_EQ(0, roc_cache_lookup(cache, 1, "BNE"));
+    roc_cache_close(cache);
+
+    /*Entries outlive the process, which stored them*/
+    cache = roc_cache_open(path, 0);
+    ASSERT_TRUE(NULL != cache);
+    EXPECT_EQ(4000, roc_cache_lookup(cache, 1, "MEL"));
+    roc_cache_store(cache, 1, "PER", 6000);
+    EXPECT_EQ(0, roc_cache_lookup(cache, 1, "PER"));
+
+    /*Only the miss is sent to the mapper, and cached afterwards*/
+    mapper[0] = control_open_incoming_conn(&mapperPort);
+    listen(mapper[0], CONTROL_MAX_CONNECTIONS);
+    cache->ttl = 60;
+    roc_cache_store(cache, mapperPort, "MEL", 4000);
+    pthread_create(&responder, NULL, answer_lookups, mapper);
+    EXPECT_EQ(E_ROC_OK, roc_resolve_route(mapperPort, route, 3, ports,
+            cache, NULL, cached));
+    pthread_join(responder, NULL);
+    close(mapper[0]);
+    EXPECT_EQ(1, mapper[1]);
+    EXPECT_EQ(2000, ports[0]);
+    EXPECT_EQ(4000, ports[1]);
+    EXPECT_EQ(0, cached[0]);
+    EXPECT_EQ(1, cached[1]);
+
+    /*Without a mapper, the cached route still resolves*/
+    EXPECT_EQ(E_ROC_OK, roc_resolve_route(mapperPort, route, 3, ports,
+            cache, NULL, cached));
+    EXPECT_EQ(2000, ports[2]);
+    EXPECT_EQ(1, cached[2]);
+
+    roc_cache_close(cache);
+    unlink(path);
+}
+
+static void* answer_planes(void* parameter) {
+    int* listeners = (int*)parameter;
+    struct pollfd waiting[2];
+    char request[64];
+    char reply[64];
+    int planeSocket = 0;
+    int answered = 0;
+    int i = 0;
+
+    for (i = 0; i < 2; i++) {
+        waiting[i].fd = listeners[i];
+        waiting[i].events = POLLIN;
+    }
+
+    /*Every visit of the fleet is answered with its airport's info*/
+    while (answered < listeners[2] && 0 < poll(waiting, 2, -1)) {
+        for (i = 0; i < 2; i++) {
+            if (!waiting[i].revents) {
+                continue;
+            }
+            planeSocket = accept(listeners[i], NULL, NULL);
+            recv(planeSocket, request, sizeof(request), 0);
+            snprintf(reply, sizeof(reply), "Airport%d\n", i);
+            send(planeSocket, reply, strlen(reply), 0);
+            close(planeSocket);
+            answered += 1;
+        }
+    }
+    return NULL;
+}
+
+struct CollectedOutput {
+    char lines[4][64];
+    int count;
+};
+
+static void collect_output(void* context, enum FlightStream stream,
+        const char* text) {
+    struct CollectedOutput* collected = (struct CollectedOutput*)context;
+
+    snprintf(collected->lines[collected->count++ % 4], 64, "%c%s",
+            AGENT_PREFIXES[stream], text);
+}
+
+TEST_F(A4Suite, test_route_fleet) {
+    char path[] = "/tmp/roc2310-fleet-XXXXXX";
+    char first[8];
+    char closed[8];
+    char* route[] = {first, closed};
+    char* report = NULL;
+    size_t reportSize = 0;
+    int listeners[3];
+    int ports[3] = {0, 0, 0};
+    struct MapperList mappers;
+    struct CollectedOutput collected;
+    struct Fleet fleet;
+    FILE* output = NULL;
+    pthread_t responder;
+    int i = 0;
+
+    for (i = 0; i < 2; i++) {
+        listeners[i] = control_open_incoming_conn(&ports[i]);
+        listen(listeners[i], CONTROL_MAX_CONNECTIONS);
+    }
+    close(control_open_incoming_conn(&ports[2]));
+    listeners[2] = 4;
+    snprintf(first, sizeof(first), "%d", ports[0]);
+    snprintf(closed, sizeof(closed), "%d", ports[2]);
+
+    output = fdopen(mkstemp(path), "w");
+    fprintf(output, "QF2 %d\t%d\n\nQF3 %d 0\n", ports[0], ports[1],
+            ports[1]);
+    fclose(output);
+
+    roc_fleet_init(&fleet);
+    EXPECT_EQ(E_ROC_OK, roc_fleet_add(&fleet, "QF1", route, 2));
+    EXPECT_EQ(E_ROC_INVALID_FLEET, roc_fleet_add(&fleet, "Q:F", route, 2));
+    EXPECT_EQ(E_ROC_OK, roc_fleet_load(&fleet, path));
+    unlink(path);
+    ASSERT_EQ(3, fleet.count);
+    /*Like on the command line, an invalid port number needs a mapper*/
+    EXPECT_EQ(1, fleet.needsMapper);
+
+    /*The invalid port number is dropped from QF3's route*/
+    roc_mappers_init(&mappers, 0);
+    EXPECT_EQ(E_ROC_OK, roc_fleet_resolve(&fleet, &mappers, NULL));
+    EXPECT_EQ(1, fleet.planes[2].hops);
+
+    memset(&collected, 0, sizeof(collected));
+    fleet.output = collect_output;
+    fleet.outputContext = &collected;
+    pthread_create(&responder, NULL, answer_planes, listeners);
+    EXPECT_EQ(1, roc_fleet_fly(&fleet, 2, NULL));
+    pthread_join(responder, NULL);
+
+    EXPECT_EQ(1, fleet.planes[0].replied);
+    EXPECT_EQ(2, fleet.planes[1].replied);
+    EXPECT_EQ(1, fleet.planes[2].replied);
+    /*Only the first plane's infos are printed*/
+    EXPECT_EQ(1, collected.count);
+    EXPECT_STREQ("iAirport0", collected.lines[0]);
+    EXPECT_EQ(4, fleet.latencyCount);
+
+    output = open_memstream(&report, &reportSize);
+    roc_fleet_report(&fleet, output);
+    fclose(output);
+    EXPECT_TRUE(NULL != strstr(report, "plane:QF2:2/2:"));
+    EXPECT_TRUE(NULL != strstr(report,
+            "\nplanes:3\nhops:4/5\ntimeouts:0\n"));
+    free(report);
+
+    roc_fleet_free(&fleet);
+    for (i = 0; i < 2; i++) {
+        close(listeners[i]);
+    }
+}
+
+TEST_F(A4Suite, test_fleet_timeout) {
+    char silent[8];
+    char* route[] = {silent, silent, silent};
+    struct VisitDeadlines deadlines;
+    struct Fleet fleet;
+    struct MapperList mappers;
+    int port = 0;
+    int listener = control_open_incoming_conn(&port);
+    int64_t start = 0;
+
+    /*The listener accepts connections, but never replies*/
+    listen(listener, CONTROL_MAX_CONNECTIONS);
+    snprintf(silent, sizeof(silent), "%d", port);
+    roc_fleet_init(&fleet);
+    ASSERT_EQ(E_ROC_OK, roc_fleet_add(&fleet, "QF1", route, 3));
+    ASSERT_EQ(E_ROC_OK, roc_fleet_add(&fleet, "QF2", route, 1));
+    roc_mappers_init(&mappers, 0);
+    ASSERT_EQ(E_ROC_OK, roc_fleet_resolve(&fleet, &mappers, NULL));
+
+    /*QF1's third visit is not started by its route deadline*/
+    memset(&deadlines, 0, sizeof(deadlines));
+    deadlines.hopMillis = 100;
+    deadlines.routeMillis = 150;
+    start = roc_now_millis();
+    EXPECT_EQ(4, roc_fleet_fly(&fleet, 2, &deadlines));
+    EXPECT_GT(1000, roc_now_millis() - start);
+    EXPECT_EQ(4, fleet.timedOut);
+    EXPECT_EQ(0, fleet.planes[0].replied);
+
+    roc_fleet_free(&fleet);
+    close(listener);
+}
+
+static void* answer_sketches(void* parameter) {
+    int* listeners = (int*)parameter;
+    struct VisitorSketch* sketch = control_sketch_create();
+    struct pollfd waiting[2];
+    char request[16];
+    char planeId[16];
+    char* reply = NULL;
+    size_t size = 0;
+    int planeSocket = 0;
+    int answered = 0;
+    int i = 0;
+    int j = 0;
+
+    for (i = 0; i < 2; i++) {
+        waiting[i].fd = listeners[i];
+        waiting[i].events = POLLIN;
+    }
+
+    /*Each control saw 600 planes, 200 of them also visited the other one*/
+    while (answered < 2 && 0 < poll(waiting, 2, -1)) {
+        i = waiting[0].revents ? 0 : 1;
+        waiting[i].fd = -1;
+        answered += 1;
+        memset(sketch, 0, sizeof(struct VisitorSketch));
+        for (j = 0; j < 600; j++) {
+            sprintf(planeId, "QF%d", 400 * i + j);
+            control_sketch_add(sketch, planeId);
+        }
+        for (j = 0; j < 40; j++) {
+            control_sketch_add(sketch, "VA1");
+        }
+        reply = control_sketch_encode(sketch, &size);
+        planeSocket = accept(listeners[i], NULL, NULL);
+        recv(planeSocket, request, sizeof(request), 0);
+        send(planeSocket, reply, size, 0);
+        close(planeSocket);
+        free(reply);
+    }
+    free(sketch);
+    return NULL;
+}
+
+TEST_F(A4Suite, test_fleet_visitors) {
+    char ports[3][8];
+    char* route[] = {ports[0], ports[1], ports[0], ports[2]};
+    char* report = NULL;
+    size_t reportSize = 0;
+    int listeners[2];
+    int port = 0;
+    struct MapperList mappers;
+    struct Fleet fleet;
+    FILE* output = NULL;
+    pthread_t responder;
+    unsigned long visitors = 0;
+    int i = 0;
+
+    for (i = 0; i < 2; i++) {
+        listeners[i] = control_open_incoming_conn(&port);
+        listen(listeners[i], CONTROL_MAX_CONNECTIONS);
+        snprintf(ports[i], sizeof(ports[i]), "%d", port);
+    }
+    close(control_open_incoming_conn(&port));
+    snprintf(ports[2], sizeof(ports[2]), "%d", port);
+
+    roc_fleet_init(&fleet);
+    EXPECT_EQ(E_ROC_OK, roc_fleet_add(&fleet, "QF1", route, 4));
+    roc_mappers_init(&mappers, 0);
+    EXPECT_EQ(E_ROC_OK, roc_fleet_resolve(&fleet, &mappers, NULL));
+
+    pthread_create(&responder, NULL, answer_sketches, listeners);
+    output = open_memstream(&report, &reportSize);
+    roc_fleet_visitors(&fleet, output);
+    fclose(output);
+    pthread_join(responder, NULL);
+
+    EXPECT_EQ(0, strncmp("controls:2/3\nvisitors:", report, 22));
+    visitors = strtoul(report + 22, NULL, 10);
+    EXPECT_LT(950UL, visitors);
+    EXPECT_GT(1050UL, visitors);
+    EXPECT_TRUE(NULL != strstr(report, "\nheavy:VA1:80\n"));
+    free(report);
+
+    roc_fleet_free(&fleet);
+    for (i = 0; i < 2; i++) {
+        close(listeners[i]);
+    }
+}
+
+static void* answer_on_one_conn(void* parameter) {
+    int* listener = (int*)parameter;
+    struct LineReader reader;
+    char request[64];
+    int planeSocket = accept(*listener, NULL, NULL);
+
+    /*Later visits only succeed, if they reuse the first connection*/
+    init_line_reader(&reader, planeSocket);
+    while (0 <= read_line(&reader, request, sizeof(request))) {
+        send(planeSocket, "Sydney\n", 7, 0);
+    }
+    close(planeSocket);
+    return NULL;
+}
+
+static void* serve_agent(void* parameter) {
+    static int success = 0;
+
+    success = roc_agent_serve((const char*)parameter, 1);
+    return &success;
+}
+
+TEST_F(A4Suite, test_roc_agent) {
+    char path[] = "/tmp/roc2310-agent-XXXXXX";
+    char control[8];
+    char syd[] = "SYD";
+    char* route[] = {control, control};
+    char* unknown[] = {syd};
+    struct CollectedOutput collected;
+    struct RouteFlight flight;
+    pthread_t responder;
+    pthread_t agent;
+    void* served = NULL;
+    int listener = 0;
+    int port = 0;
+    int result = -1;
+    int i = 0;
+
+    close(mkstemp(path));
+    unlink(path);
+    listener = control_open_incoming_conn(&port);
+    listen(listener, CONTROL_MAX_CONNECTIONS);
+    snprintf(control, sizeof(control), "%d", port);
+
+    memset(&collected, 0, sizeof(collected));
+    roc_flight_init(&flight, "QF1", 0, collect_output, &collected);
+    flight.deadlines.hopMillis = 1000;
+
+    /*Without an agent, the roc has to fly itself*/
+    EXPECT_EQ(-1, roc_agent_fly(path, &flight, route, 2));
+
+    pthread_create(&responder, NULL, answer_on_one_conn, &listener);
+    pthread_create(&agent, NULL, serve_agent, path);
+    for (i = 0; i < 1000 && -1 == result; i++) {
+        result = roc_agent_fly(path, &flight, route, 2);
+        usleep(-1 == result ? 1000 : 0);
+    }
+    EXPECT_EQ(E_ROC_OK, result);
+    EXPECT_EQ(E_ROC_OK, roc_agent_fly(path, &flight, route, 1));
+    ASSERT_EQ(3, collected.count);
+    for (i = 0; i < 3; i++) {
+        EXPECT_STREQ("iSydney", collected.lines[i]);
+    }
+
+    /*The agent's errors are the roc's*/
+    EXPECT_EQ(E_ROC_FAILED_TO_CONNECT_MAPPER, roc_agent_fly(path, &flight,
+            unknown, 1));
+
+    /*Once idle, the agent closes its connections and goes away*/
+    pthread_join(agent, &served);
+    pthread_join(responder, NULL);
+    EXPECT_EQ(EXIT_SUCCESS, *(int*)served);
+    EXPECT_NE(0, access(path, F_OK));
+
+    close(listener);
+    strcat(path, ".lock");
+    unlink(path);
+    strcpy(strrchr(path, '.'), ".cache");
+    unlink(path);
+}
+
+TEST_F(A4Suite, test_fast_open) {
+    char info[ROC_MAX_INFO_SIZE];
+    struct VisitDeadlines deadlines;
+    int ports[1] = {0};
+    int listener = control_open_incoming_conn(&ports[0]);
+    int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+    socklen_t size = sizeof(int);
+    int value = 0;
+    pthread_t responder;
+
+    listen(listener, CONTROL_MAX_CONNECTIONS);
+    EXPECT_EQ(0, getsockopt(listener, IPPROTO_TCP, TCP_FASTOPEN, &value,
+            &size));
+    EXPECT_EQ(TCP_FASTOPEN_QUEUE, value);
+
+    tune_client_conn(clientSocket);
+    EXPECT_EQ(0, getsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &value,
+            &size));
+    EXPECT_EQ(1, value);
+    close(clientSocket);
+
+    /*Visits work alike, whether the kernel lets the SYN carry the ID or not*/
+    set_client_fast_open(1);
+    deadlines.hopMillis = 1000;
+    deadlines.routeEnd = 0;
+    pthread_create(&responder, NULL, answer_on_one_conn, &listener);
+    EXPECT_EQ(VISIT_REPLIED, roc_visit_destination("QF1", ports[0],
+            &deadlines, NULL, NULL, info));
+    EXPECT_STREQ("Sydney", info);
+    set_client_fast_open(0);
+    shutdown(listener, SHUT_RDWR);
+    pthread_join(responder, NULL);
+
+    close(listener);
+}
+
+struct ServedSockets {
+    int blocked;
+    int busy;
+    int served;
+    int sum;
+};
+
+static void serve_socket(void* context, int socket) {
+    struct ServedSockets* served = (struct ServedSockets*)context;
+
+    /*Socket 0 keeps its worker busy, until it is released*/
+    if (0 == socket) {
+        __atomic_add_fetch(&served->busy, 1, __ATOMIC_SEQ_CST);
+    }
+    while (0 == socket && __atomic_load_n(&served->blocked,
+            __ATOMIC_SEQ_CST)) {
+        usleep(1000);
+    }
+    __atomic_add_fetch(&served->sum, socket, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&served->served, 1, __ATOMIC_SEQ_CST);
+}
+
+TEST_F(A4Suite, test_worker_pool) {
+    struct ServedSockets served;
+    struct WorkerPool pool;
+    int i = 0;
+
+    memset(&served, 0, sizeof(served));
+    served.blocked = 1;
+    ASSERT_EQ(EXIT_SUCCESS, worker_pool_start(&pool, 2, serve_socket,
+            &served));
+    EXPECT_EQ(2, pool.size);
+
+    /*Half of the sockets queue behind the busy worker and are stolen*/
+    for (i = 0; i <= 1000; i++) {
+        while (0 != worker_pool_submit(&pool, i)) {
+            usleep(100);
+        }
+    }
+    for (i = 0; i < 5000 && 1000 > __atomic_load_n(&served.served,
+            __ATOMIC_SEQ_CST); i++) {
+        usleep(1000);
+    }
+    EXPECT_EQ(1000, served.served);
+
+    /*Stopping waits for the sockets handed over*/
+    __atomic_store_n(&served.blocked, 0, __ATOMIC_SEQ_CST);
+    worker_pool_stop(&pool);
+    EXPECT_EQ(1001, served.served);
+    EXPECT_EQ(500500, served.sum);
+}
+
+TEST_F(A4Suite, test_worker_pool_grows) {
+    struct ServedSockets served;
+    struct WorkerPool pool;
+    int i = 0;
+
+    memset(&served, 0, sizeof(served));
+    served.blocked = 1;
+    ASSERT_EQ(EXIT_SUCCESS, worker_pool_start(&pool, WORKER_POOL_INITIAL + 4,
+            serve_socket, &served));
+    EXPECT_EQ(WORKER_POOL_INITIAL, pool.size);
+
+    /*Each busy worker gets another one started, up to the capacity*/
+    for (i = 0; i < WORKER_POOL_INITIAL + 4; i++) {
+        ASSERT_EQ(0, worker_pool_submit(&pool, 0));
+    }
+    for (i = 0; i < 5000 && WORKER_POOL_INITIAL + 4 > __atomic_load_n(
+            &served.busy, __ATOMIC_SEQ_CST); i++) {
+        usleep(1000);
+    }
+    EXPECT_EQ(WORKER_POOL_INITIAL + 4, served.busy);
+    EXPECT_EQ(WORKER_POOL_INITIAL + 4, pool.size);
+
+    __atomic_store_n(&served.blocked, 0, __ATOMIC_SEQ_CST);
+    worker_pool_stop(&pool);
+    EXPECT_EQ(WORKER_POOL_INITIAL + 4, served.served);
+}